@@ -0,0 +1,398 @@
+#include "hal.h"
+#include <avr/interrupt.h>
+#include <stddef.h>
+#include <string.h>
+#include <util/atomic.h>
+
+/* The registers which are plain variables. */
+volatile uint8_t SREG;
+volatile uint16_t SP = RAMEND;
+volatile uint8_t PRR, MCUSR;
+volatile uint8_t PINB, DDRB, PORTB;
+volatile uint8_t PINC, DDRC, PORTC;
+volatile uint8_t PIND, DDRD, PORTD;
+volatile uint8_t EICRA, EIMSK;
+volatile uint8_t TCCR0A, TCCR0B, TCNT0, OCR0A, OCR0B, TIMSK0;
+volatile uint8_t TCCR1A, TCCR1B, TCCR1C, TIMSK1;
+volatile uint16_t TCNT1, OCR1A, OCR1B, ICR1;
+volatile uint8_t TCCR2A, TCCR2B, OCR2A, OCR2B, TIMSK2, ASSR;
+volatile uint8_t GTCCR;
+volatile uint8_t SPCR;
+volatile uint8_t UCSR0A, UCSR0B, UCSR0C, UBRR0H, UBRR0L, UDR0;
+volatile uint8_t EECR, EEDR;
+volatile uint16_t EEAR;
+volatile uint8_t ACSR, ADCSRB, ADMUX, DIDR1;
+
+/* The registers which are accessed through functions. */
+static volatile uint8_t hal_tcnt2_value, hal_spdr_value, hal_spsr_value;
+static volatile uint8_t hal_eifr_flags, hal_tifr0_flags, hal_tifr1_flags, hal_tifr2_flags;
+
+/* The copy of a flag register handed out to the firmware, see <avr/io.h>. */
+static volatile uint8_t hal_flags_copy;
+
+/* The levels of the analog-only inputs ADC6 and ADC7, in bits 6 and 7. */
+static uint8_t hal_adc_levels;
+
+/* The number of cycles per Timer2 tick for each clock select value. */
+static const unsigned int hal_timer2_prescalers[8] = {
+  0, 1, 8, 32, 64, 128, 256, 1024
+};
+
+/* The contents of the EEPROM, see <avr/eeprom.h>. */
+uint8_t hal_eeprom[E2END + 1];
+
+unsigned int hal_timer2_autotick;
+uint8_t (*hal_spi_slave)(uint8_t value);
+void (*hal_uart_tx)(uint8_t value);
+
+/*
+ * Default (empty) handlers for every vector, which are overridden by the
+ * ISR() definitions of the modules linked into the host program.
+ */
+#define HAL_WEAK_VECTOR(vector) __attribute__((weak)) void vector(void) { }
+
+HAL_WEAK_VECTOR(INT0_vect)
+HAL_WEAK_VECTOR(INT1_vect)
+HAL_WEAK_VECTOR(TIMER2_COMPA_vect)
+HAL_WEAK_VECTOR(TIMER2_COMPB_vect)
+HAL_WEAK_VECTOR(TIMER2_OVF_vect)
+HAL_WEAK_VECTOR(TIMER1_CAPT_vect)
+HAL_WEAK_VECTOR(TIMER1_COMPA_vect)
+HAL_WEAK_VECTOR(TIMER1_COMPB_vect)
+HAL_WEAK_VECTOR(TIMER1_OVF_vect)
+HAL_WEAK_VECTOR(TIMER0_COMPA_vect)
+HAL_WEAK_VECTOR(TIMER0_COMPB_vect)
+HAL_WEAK_VECTOR(TIMER0_OVF_vect)
+HAL_WEAK_VECTOR(USART_RX_vect)
+HAL_WEAK_VECTOR(USART_UDRE_vect)
+HAL_WEAK_VECTOR(EE_READY_vect)
+
+/*
+ * The interrupt sources in priority order (the order of the vector table).
+ * An interrupt is pending when its flag bit is set, and enabled when its mask
+ * bit is set. If clear is true, the hardware clears the flag when the vector
+ * is executed.
+ */
+typedef struct
+{
+  volatile uint8_t *flag_reg;
+  uint8_t flag;
+  volatile uint8_t *mask_reg;
+  uint8_t mask;
+  bool clear;
+  void (*vector)(void);
+} hal_source_t;
+
+static const hal_source_t hal_sources[] = {
+  { &hal_eifr_flags,   INTF0, &EIMSK,  INT0,   true,  INT0_vect },
+  { &hal_eifr_flags,   INTF1, &EIMSK,  INT1,   true,  INT1_vect },
+  { &hal_tifr2_flags,  OCF2A, &TIMSK2, OCIE2A, true,  TIMER2_COMPA_vect },
+  { &hal_tifr2_flags,  OCF2B, &TIMSK2, OCIE2B, true,  TIMER2_COMPB_vect },
+  { &hal_tifr2_flags,  TOV2,  &TIMSK2, TOIE2,  true,  TIMER2_OVF_vect },
+  { &hal_tifr1_flags,  ICF1,  &TIMSK1, ICIE1,  true,  TIMER1_CAPT_vect },
+  { &hal_tifr1_flags,  OCF1A, &TIMSK1, OCIE1A, true,  TIMER1_COMPA_vect },
+  { &hal_tifr1_flags,  OCF1B, &TIMSK1, OCIE1B, true,  TIMER1_COMPB_vect },
+  { &hal_tifr1_flags,  TOV1,  &TIMSK1, TOIE1,  true,  TIMER1_OVF_vect },
+  { &hal_tifr0_flags,  OCF0A, &TIMSK0, OCIE0A, true,  TIMER0_COMPA_vect },
+  { &hal_tifr0_flags,  OCF0B, &TIMSK0, OCIE0B, true,  TIMER0_COMPB_vect },
+  { &hal_tifr0_flags,  TOV0,  &TIMSK0, TOIE0,  true,  TIMER0_OVF_vect },
+  { &UCSR0A,          RXC0,  &UCSR0B, RXCIE0, true,  USART_RX_vect },
+  { &UCSR0A,          UDRE0, &UCSR0B, UDRIE0, false, USART_UDRE_vect },
+  { &EECR,            EEPE,  &EECR,   EERIE,  false, EE_READY_vect }
+};
+
+#define HAL_SOURCES (sizeof(hal_sources) / sizeof(hal_sources[0]))
+
+static bool hal_pending(const hal_source_t *source)
+{
+  if (!(*source->mask_reg & (1 << source->mask)))
+    return false;
+
+  /*
+   * Bytes written to UDR0 are sent instantly, so the data register is always
+   * empty. The EEPROM ready interrupt fires while no write is in progress.
+   */
+  if (source->vector == USART_UDRE_vect)
+    return true;
+  else if (source->vector == EE_READY_vect)
+    return !(EECR & (1 << EEPE));
+
+  return *source->flag_reg & (1 << source->flag);
+}
+
+static void hal_call(const hal_source_t *source)
+{
+  if (source->clear)
+    *source->flag_reg &= ~(1 << source->flag);
+
+  /* The I flag is cleared on entry to an ISR and set again by RETI. */
+  SREG &= ~(1 << SREG_I);
+  source->vector();
+  SREG |= (1 << SREG_I);
+
+  /*
+   * The UDRE ISR either writes the next byte to UDR0 or masks the interrupt,
+   * so if it's still enabled a byte has been transmitted.
+   */
+  if (source->vector == USART_UDRE_vect && (UCSR0B & (1 << UDRIE0)) && hal_uart_tx)
+    hal_uart_tx(UDR0);
+}
+
+static volatile uint8_t *hal_flags(volatile uint8_t *flags)
+{
+  hal_flags_copy = *flags;
+  return &hal_flags_copy;
+}
+
+void hal_reset(void)
+{
+  volatile uint8_t *regs8[] = {
+    &SREG, &PRR, &MCUSR, &PINB, &DDRB, &PORTB, &PINC, &DDRC, &PORTC, &PIND,
+    &DDRD, &PORTD, &EICRA, &EIMSK, &TCCR0A, &TCCR0B, &TCNT0, &OCR0A,
+    &OCR0B, &TIMSK0, &TCCR1A, &TCCR1B, &TCCR1C, &TIMSK1, &TCCR2A, &TCCR2B,
+    &OCR2A, &OCR2B, &TIMSK2, &ASSR, &GTCCR, &SPCR,
+    &UCSR0A, &UCSR0B, &UCSR0C, &UBRR0H, &UBRR0L, &UDR0, &EECR, &EEDR, &ACSR, &ADCSRB,
+    &ADMUX, &DIDR1, &hal_tcnt2_value, &hal_spdr_value, &hal_spsr_value,
+    &hal_eifr_flags, &hal_tifr0_flags, &hal_tifr1_flags, &hal_tifr2_flags,
+    &hal_adc_levels
+  };
+  for (size_t i = 0; i < sizeof(regs8) / sizeof(regs8[0]); i++)
+    *regs8[i] = 0;
+
+  TCNT1 = OCR1A = OCR1B = ICR1 = EEAR = 0;
+  SP = RAMEND;
+
+  /* An erased EEPROM reads as all ones. */
+  memset(hal_eeprom, 0xFF, sizeof(hal_eeprom));
+}
+
+void hal_dispatch(void)
+{
+  while (SREG & (1 << SREG_I))
+  {
+    const hal_source_t *source = NULL;
+    for (size_t i = 0; i < HAL_SOURCES && !source; i++)
+    {
+      if (hal_pending(&hal_sources[i]))
+        source = &hal_sources[i];
+    }
+
+    if (!source)
+      break;
+
+    hal_call(source);
+  }
+}
+
+void hal_raise(void (*vector)(void))
+{
+  for (size_t i = 0; i < HAL_SOURCES; i++)
+  {
+    const hal_source_t *source = &hal_sources[i];
+    if (source->vector == vector && (*source->mask_reg & (1 << source->mask)))
+      *source->flag_reg |= (1 << source->flag);
+  }
+
+  hal_dispatch();
+}
+
+void hal_sei(void)
+{
+  SREG |= (1 << SREG_I);
+  hal_dispatch();
+}
+
+void hal_cli(void)
+{
+  SREG &= ~(1 << SREG_I);
+}
+
+uint8_t hal_atomic_enter(void)
+{
+  uint8_t sreg = SREG;
+  SREG &= ~(1 << SREG_I);
+  return sreg;
+}
+
+void hal_atomic_restore(const uint8_t *sreg)
+{
+  SREG = *sreg;
+  hal_dispatch();
+}
+
+void hal_atomic_force_on(const uint8_t *sreg)
+{
+  (void) sreg;
+  hal_sei();
+}
+
+/* Returns Timer1's TOP value, and whether it is ICR1, in its current mode. */
+static uint16_t hal_timer1_top(bool *icr)
+{
+  uint8_t wgm = (TCCR1A & 0x3) | (((TCCR1B >> WGM12) & 0x3) << 2);
+
+  *icr = wgm == 8 || wgm == 10 || wgm == 12 || wgm == 14;
+  if (*icr)
+    return ICR1;
+
+  switch (wgm)
+  {
+    case 4: case 9: case 11: case 15: return OCR1A;
+    case 5:  return 0xFF;
+    case 6:  return 0x1FF;
+    case 7:  return 0x3FF;
+    default: return 0xFFFF;
+  }
+}
+
+/*
+ * Advances Timer1 by the given number of cycles, if it is clocked without a
+ * prescaler. None of its flags are raised.
+ */
+static void hal_timer1_step(unsigned int cycles)
+{
+  if ((TCCR1B & 0x7) != (1 << CS10))
+    return;
+
+  bool icr;
+  uint32_t top = hal_timer1_top(&icr);
+  TCNT1 = (TCNT1 + cycles) % (top + 1);
+}
+
+void hal_timer2_step(unsigned int ticks)
+{
+  while (ticks--)
+  {
+    hal_timer1_step(hal_timer2_prescalers[TCCR2B & 0x7]);
+
+    uint8_t value = ++hal_tcnt2_value;
+    if (value == 0)
+      hal_raise(TIMER2_OVF_vect);
+    if (value == OCR2A)
+      hal_raise(TIMER2_COMPA_vect);
+    if (value == OCR2B)
+      hal_raise(TIMER2_COMPB_vect);
+  }
+}
+
+void hal_timer2_set(uint8_t value)
+{
+  hal_tcnt2_value = value;
+}
+
+volatile uint8_t *hal_tcnt2(void)
+{
+  hal_timer2_step(hal_timer2_autotick);
+  return &hal_tcnt2_value;
+}
+
+volatile uint8_t *hal_eifr(void)
+{
+  return hal_flags(&hal_eifr_flags);
+}
+
+volatile uint8_t *hal_tifr0(void)
+{
+  return hal_flags(&hal_tifr0_flags);
+}
+
+volatile uint8_t *hal_tifr1(void)
+{
+  return hal_flags(&hal_tifr1_flags);
+}
+
+volatile uint8_t *hal_tifr2(void)
+{
+  return hal_flags(&hal_tifr2_flags);
+}
+
+volatile uint8_t *hal_spdr(void)
+{
+  /* Accessing SPDR after a transfer has completed clears SPIF. */
+  hal_spsr_value &= ~(1 << SPIF);
+  return &hal_spdr_value;
+}
+
+volatile uint8_t *hal_spsr(void)
+{
+  /* Complete the transfer started by the last write to SPDR. */
+  if (!(hal_spsr_value & (1 << SPIF)))
+  {
+    uint8_t value = hal_spdr_value;
+    hal_spdr_value = hal_spi_slave ? hal_spi_slave(value) : value;
+    hal_spsr_value |= (1 << SPIF);
+  }
+  return &hal_spsr_value;
+}
+
+void hal_pin_write(volatile uint8_t *pin, uint8_t bit, bool level)
+{
+  bool prev = *pin & (1 << bit);
+  if (level)
+    *pin |= (1 << bit);
+  else
+    *pin &= ~(1 << bit);
+
+  /* Check if the change triggers INT0 (PD2) or INT1 (PD3). */
+  if (pin != &PIND || (bit != PD2 && bit != PD3))
+    return;
+
+  uint8_t irq = bit == PD2 ? INT0 : INT1;
+  uint8_t sense = (EICRA >> (irq * 2)) & 0x3;
+
+  bool trigger;
+  switch (sense)
+  {
+    case 0:  trigger = !level; break;
+    case 1:  trigger = prev != level; break;
+    case 2:  trigger = prev && !level; break;
+    default: trigger = !prev && level; break;
+  }
+
+  if (trigger)
+    hal_raise(irq == INT0 ? INT0_vect : INT1_vect);
+}
+
+void hal_adc_write(uint8_t channel, bool level)
+{
+  if (level)
+    hal_adc_levels |= (1 << channel);
+  else
+    hal_adc_levels &= ~(1 << channel);
+
+  /*
+   * Only the configuration the firmware uses is modelled: the bandgap
+   * reference on the comparator's positive input, and the ADC multiplexer on
+   * its negative input. The output is high when the input is below the
+   * reference.
+   */
+  uint8_t mux = ADMUX & 0x7;
+  if ((ACSR & (1 << ACD)) || !(ACSR & (1 << ACBG)) || (PRR & (1 << PRADC)) ||
+      !(ADCSRB & (1 << ACME)) || mux != channel)
+    return;
+
+  bool output = !level;
+  if (output == !!(ACSR & (1 << ACO)))
+    return;
+
+  if (output)
+    ACSR |= (1 << ACO);
+  else
+    ACSR &= ~(1 << ACO);
+
+  /* Latch TCNT1 if the edge triggers the input capture unit. */
+  bool icr, rising = TCCR1B & (1 << ICES1);
+  hal_timer1_top(&icr);
+  if (!(ACSR & (1 << ACIC)) || icr || rising != output)
+    return;
+
+  ICR1 = TCNT1;
+  hal_raise(TIMER1_CAPT_vect);
+}
+
+void hal_uart_rx(uint8_t value)
+{
+  UDR0 = value;
+  UCSR0A |= (1 << RXC0);
+  hal_dispatch();
+}
@@ -0,0 +1,95 @@
+/*
+ * The mock hardware abstraction layer used by the host build.
+ *
+ * The firmware modules are compiled unchanged against the headers in
+ * host/include, which turn the I/O registers into variables. This header
+ * exposes the hooks a host program uses to drive those registers as the
+ * hardware would: advancing Timer2, changing input pins, exchanging SPI bytes,
+ * receiving UART bytes and servicing the interrupts these raise.
+ */
+#ifndef HOST_HAL_H
+#define HOST_HAL_H
+
+#include <avr/io.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* The interrupt vectors, which are defined by ISR() in the firmware. */
+void INT0_vect(void);
+void INT1_vect(void);
+void TIMER2_COMPA_vect(void);
+void TIMER2_COMPB_vect(void);
+void TIMER2_OVF_vect(void);
+void TIMER1_CAPT_vect(void);
+void TIMER1_COMPA_vect(void);
+void TIMER1_COMPB_vect(void);
+void TIMER1_OVF_vect(void);
+void TIMER0_COMPA_vect(void);
+void TIMER0_COMPB_vect(void);
+void TIMER0_OVF_vect(void);
+void USART_RX_vect(void);
+void USART_UDRE_vect(void);
+void EE_READY_vect(void);
+
+/*
+ * The number of ticks Timer2 advances by each time TCNT2 is read. This is
+ * zero by default, so time only passes when hal_timer2_step() is called, but
+ * it must be non-zero for code which busy-waits on the clock to terminate.
+ */
+extern unsigned int hal_timer2_autotick;
+
+/*
+ * Called with each byte written to SPDR, returning the byte the SPI slave
+ * shifts back. If NULL, the written byte is echoed back.
+ */
+extern uint8_t (*hal_spi_slave)(uint8_t value);
+
+/* Called with each byte the UART transmits. If NULL, the byte is discarded. */
+extern void (*hal_uart_tx)(uint8_t value);
+
+/*
+ * Resets every register to zero, which enables no interrupts, and erases the
+ * EEPROM.
+ */
+void hal_reset(void);
+
+/* Services any pending interrupts, if interrupts are enabled. */
+void hal_dispatch(void);
+
+/*
+ * Raises the flag of the given interrupt vector, if the interrupt is enabled,
+ * and services it. This is used to simulate peripherals the HAL doesn't model.
+ */
+void hal_raise(void (*vector)(void));
+
+/*
+ * Advances Timer2 by the given number of ticks, raising the overflow and
+ * compare match flags as it goes and servicing the interrupts after each tick.
+ * Timer1 is advanced in step if it counts every cycle, as the IR carrier does.
+ */
+void hal_timer2_step(unsigned int ticks);
+
+/* Sets TCNT2 without raising any flags. */
+void hal_timer2_set(uint8_t value);
+
+/*
+ * Drives an input pin high or low. If the pin is INT0 (PD2) or INT1 (PD3) and
+ * the change matches the sense control bits in EICRA, the interrupt flag is
+ * raised and serviced.
+ */
+void hal_pin_write(volatile uint8_t *pin, uint8_t bit, bool level);
+
+/*
+ * Drives ADC6 or ADC7, which are analog-only inputs, to ground (false) or VCC.
+ * If the pin is the analog comparator's input (which needs the ADC to be
+ * powered up, for its multiplexer), the comparator's output ACO is updated, and
+ * if it is routed to Timer1's input capture unit and the change matches the
+ * edge selected by ICES1, TCNT1 is latched in ICR1 and the capture interrupt
+ * flag is raised and serviced.
+ */
+void hal_adc_write(uint8_t channel, bool level);
+
+/* Receives a byte on the UART, raising and servicing the RX interrupt. */
+void hal_uart_rx(uint8_t value);
+
+#endif
@@ -0,0 +1,73 @@
+/*
+ * A mock of <avr/eeprom.h> for the host build. The EEPROM is an array in
+ * host/hal.c, and writes complete instantly.
+ */
+#ifndef HOST_AVR_EEPROM_H
+#define HOST_AVR_EEPROM_H
+
+#include <avr/io.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define EEMEM
+
+extern uint8_t hal_eeprom[E2END + 1];
+
+static inline bool eeprom_is_ready(void)
+{
+  return true;
+}
+
+#define eeprom_busy_wait() do { } while (0)
+
+static inline uint8_t eeprom_read_byte(const uint8_t *addr)
+{
+  return hal_eeprom[(uintptr_t) addr];
+}
+
+static inline uint16_t eeprom_read_word(const uint16_t *addr)
+{
+  uintptr_t a = (uintptr_t) addr;
+  return hal_eeprom[a] | (hal_eeprom[a + 1] << 8);
+}
+
+static inline void eeprom_read_block(void *dst, const void *src, size_t n)
+{
+  memcpy(dst, &hal_eeprom[(uintptr_t) src], n);
+}
+
+static inline void eeprom_write_byte(uint8_t *addr, uint8_t value)
+{
+  hal_eeprom[(uintptr_t) addr] = value;
+}
+
+static inline void eeprom_update_byte(uint8_t *addr, uint8_t value)
+{
+  hal_eeprom[(uintptr_t) addr] = value;
+}
+
+static inline void eeprom_write_word(uint16_t *addr, uint16_t value)
+{
+  uintptr_t a = (uintptr_t) addr;
+  hal_eeprom[a] = value & 0xFF;
+  hal_eeprom[a + 1] = value >> 8;
+}
+
+static inline void eeprom_update_word(uint16_t *addr, uint16_t value)
+{
+  eeprom_write_word(addr, value);
+}
+
+static inline void eeprom_write_block(const void *src, void *dst, size_t n)
+{
+  memcpy(&hal_eeprom[(uintptr_t) dst], src, n);
+}
+
+static inline void eeprom_update_block(const void *src, void *dst, size_t n)
+{
+  eeprom_write_block(src, dst, n);
+}
+
+#endif
@@ -0,0 +1,19 @@
+/*
+ * A mock of <avr/interrupt.h> for the host build. ISRs become ordinary
+ * functions named after their vectors, which the HAL calls when the
+ * corresponding interrupt is raised and enabled.
+ */
+#ifndef HOST_AVR_INTERRUPT_H
+#define HOST_AVR_INTERRUPT_H
+
+#include <avr/io.h>
+
+#define ISR(vector) void vector(void); void vector(void)
+
+void hal_sei(void);
+void hal_cli(void);
+
+#define sei() hal_sei()
+#define cli() hal_cli()
+
+#endif
@@ -0,0 +1,272 @@
+/*
+ * A mock of <avr/io.h> for the host build. The ATmega328P's I/O registers are
+ * replaced with ordinary variables, defined in host/hal.c, which the code
+ * under test reads and writes as usual. The few registers whose accesses have
+ * side effects on real hardware are routed through functions in the HAL.
+ *
+ * Only the registers and bits used by the firmware are declared.
+ */
+#ifndef HOST_AVR_IO_H
+#define HOST_AVR_IO_H
+
+#include <stdint.h>
+
+#define _BV(bit) (1 << (bit))
+
+/* Memory sizes. */
+#define RAMSTART 0x100
+#define RAMEND   0x8FF
+#define E2END    0x3FF
+#define FLASHEND 0x7FFF
+
+/* Status register and stack pointer. */
+extern volatile uint8_t SREG;
+extern volatile uint16_t SP;
+
+#define SREG_I 7
+
+/* Power reduction and reset status. */
+extern volatile uint8_t PRR;
+extern volatile uint8_t MCUSR;
+
+#define PRADC    0
+#define PRUSART0 1
+#define PRSPI    2
+#define PRTIM1   3
+#define PRTIM0   5
+#define PRTIM2   6
+#define PRTWI    7
+
+#define PORF  0
+#define EXTRF 1
+#define BORF  2
+#define WDRF  3
+
+/* I/O ports. */
+extern volatile uint8_t PINB, DDRB, PORTB;
+extern volatile uint8_t PINC, DDRC, PORTC;
+extern volatile uint8_t PIND, DDRD, PORTD;
+
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+#define PB6 6
+#define PB7 7
+
+#define PC0 0
+#define PC1 1
+#define PC2 2
+#define PC3 3
+#define PC4 4
+#define PC5 5
+#define PC6 6
+
+#define PD0 0
+#define PD1 1
+#define PD2 2
+#define PD3 3
+#define PD4 4
+#define PD5 5
+#define PD6 6
+#define PD7 7
+
+/*
+ * Interrupt flag registers. A one is written to a flag to clear it, which a
+ * plain variable can't model, so these are read through the HAL and writes to
+ * them are discarded. The HAL only raises a flag while its interrupt is
+ * enabled, so there is never a stale flag for the firmware to clear.
+ */
+volatile uint8_t *hal_eifr(void);
+volatile uint8_t *hal_tifr0(void);
+volatile uint8_t *hal_tifr1(void);
+volatile uint8_t *hal_tifr2(void);
+#define EIFR  (*hal_eifr())
+#define TIFR0 (*hal_tifr0())
+#define TIFR1 (*hal_tifr1())
+#define TIFR2 (*hal_tifr2())
+
+/* External interrupts. */
+extern volatile uint8_t EICRA, EIMSK;
+
+#define ISC00 0
+#define ISC01 1
+#define ISC10 2
+#define ISC11 3
+
+#define INT0 0
+#define INT1 1
+
+#define INTF0 0
+#define INTF1 1
+
+/* Timer0. */
+extern volatile uint8_t TCCR0A, TCCR0B, TCNT0, OCR0A, OCR0B, TIMSK0;
+
+#define WGM00  0
+#define WGM01  1
+#define COM0B0 4
+#define COM0B1 5
+#define COM0A0 6
+#define COM0A1 7
+
+#define CS00  0
+#define CS01  1
+#define CS02  2
+#define WGM02 3
+
+#define TOIE0  0
+#define OCIE0A 1
+#define OCIE0B 2
+
+#define TOV0  0
+#define OCF0A 1
+#define OCF0B 2
+
+/* Timer1. */
+extern volatile uint8_t TCCR1A, TCCR1B, TCCR1C, TIMSK1;
+extern volatile uint16_t TCNT1, OCR1A, OCR1B, ICR1;
+
+#define WGM10  0
+#define WGM11  1
+#define COM1B0 4
+#define COM1B1 5
+#define COM1A0 6
+#define COM1A1 7
+
+#define CS10  0
+#define CS11  1
+#define CS12  2
+#define WGM12 3
+#define WGM13 4
+#define ICES1 6
+#define ICNC1 7
+
+#define TOIE1  0
+#define OCIE1A 1
+#define OCIE1B 2
+#define ICIE1  5
+
+#define TOV1  0
+#define OCF1A 1
+#define OCF1B 2
+#define ICF1  5
+
+/*
+ * Timer2. Reads of TCNT2 go through the HAL, which can advance the timer on
+ * each read so that busy-waits terminate.
+ */
+extern volatile uint8_t TCCR2A, TCCR2B, OCR2A, OCR2B, TIMSK2, ASSR;
+volatile uint8_t *hal_tcnt2(void);
+#define TCNT2 (*hal_tcnt2())
+
+#define WGM20  0
+#define WGM21  1
+#define COM2B0 4
+#define COM2B1 5
+#define COM2A0 6
+#define COM2A1 7
+
+#define CS20  0
+#define CS21  1
+#define CS22  2
+#define WGM22 3
+
+#define TOIE2  0
+#define OCIE2A 1
+#define OCIE2B 2
+
+#define TOV2  0
+#define OCF2A 1
+#define OCF2B 2
+
+/* General timer/counter control. */
+extern volatile uint8_t GTCCR;
+
+#define PSRSYNC 0
+#define PSRASY  1
+#define TSM     7
+
+/*
+ * SPI. Polling SPSR completes the transfer started by writing SPDR, passing
+ * the byte to the HAL's SPI slave hook and replacing SPDR with its reply.
+ * Accessing SPDR afterwards clears SPIF, as on the real hardware.
+ */
+extern volatile uint8_t SPCR;
+volatile uint8_t *hal_spdr(void);
+volatile uint8_t *hal_spsr(void);
+#define SPDR (*hal_spdr())
+#define SPSR (*hal_spsr())
+
+#define SPR0 0
+#define SPR1 1
+#define CPHA 2
+#define CPOL 3
+#define MSTR 4
+#define DORD 5
+#define SPE  6
+#define SPIE 7
+
+#define SPI2X 0
+#define WCOL  6
+#define SPIF  7
+
+/* USART0. */
+extern volatile uint8_t UCSR0A, UCSR0B, UCSR0C, UBRR0H, UBRR0L, UDR0;
+
+#define MPCM0 0
+#define U2X0  1
+#define UPE0  2
+#define DOR0  3
+#define FE0   4
+#define UDRE0 5
+#define TXC0  6
+#define RXC0  7
+
+#define TXB80  0
+#define RXB80  1
+#define UCSZ02 2
+#define TXEN0  3
+#define RXEN0  4
+#define UDRIE0 5
+#define TXCIE0 6
+#define RXCIE0 7
+
+#define UCPOL0 0
+#define UCSZ00 1
+#define UCSZ01 2
+
+/* EEPROM. */
+extern volatile uint8_t EECR, EEDR;
+extern volatile uint16_t EEAR;
+
+#define EERE  0
+#define EEPE  1
+#define EEMPE 2
+#define EERIE 3
+
+/* Analog comparator and ADC multiplexer. */
+extern volatile uint8_t ACSR, ADCSRB, ADMUX, DIDR1;
+
+#define ACIS0 0
+#define ACIS1 1
+#define ACIC  2
+#define ACIE  3
+#define ACI   4
+#define ACO   5
+#define ACBG  6
+#define ACD   7
+
+#define ACME 6
+
+#define MUX0 0
+#define MUX1 1
+#define MUX2 2
+#define MUX3 3
+
+#define AIN0D 0
+#define AIN1D 1
+
+#endif
@@ -0,0 +1,22 @@
+/*
+ * A mock of <avr/pgmspace.h> for the host build. There is only one address
+ * space on the host, so data "in flash" is simply const data.
+ */
+#ifndef HOST_AVR_PGMSPACE_H
+#define HOST_AVR_PGMSPACE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+
+#define pgm_read_byte(addr)  (*(const uint8_t *) (addr))
+#define pgm_read_word(addr)  (*(const uint16_t *) (addr))
+#define pgm_read_dword(addr) (*(const uint32_t *) (addr))
+#define pgm_read_ptr(addr)   (*(void * const *) (addr))
+
+#define memcpy_P memcpy
+#define strlen_P strlen
+
+#endif
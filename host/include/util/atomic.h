@@ -0,0 +1,25 @@
+/*
+ * A mock of <util/atomic.h> for the host build. As with avr-libc, the block
+ * saves SREG, disables interrupts and restores SREG when the block is left,
+ * including by a return or break. Restoring SREG services any interrupts
+ * which were raised while they were disabled.
+ */
+#ifndef HOST_UTIL_ATOMIC_H
+#define HOST_UTIL_ATOMIC_H
+
+#include <avr/io.h>
+#include <stdint.h>
+
+uint8_t hal_atomic_enter(void);
+void hal_atomic_restore(const uint8_t *sreg);
+void hal_atomic_force_on(const uint8_t *sreg);
+
+#define ATOMIC_BLOCK(type) for (type, hal_atomic_todo = 1; hal_atomic_todo; hal_atomic_todo = 0)
+
+#define ATOMIC_RESTORESTATE \
+  uint8_t hal_atomic_sreg __attribute__((__cleanup__(hal_atomic_restore))) = hal_atomic_enter()
+
+#define ATOMIC_FORCEON \
+  uint8_t hal_atomic_sreg __attribute__((__cleanup__(hal_atomic_force_on))) = hal_atomic_enter()
+
+#endif
@@ -0,0 +1,46 @@
+/*
+ * A mock of <util/crc16.h> for the host build, with C versions of the
+ * avr-libc CRC routines used by the firmware.
+ */
+#ifndef HOST_UTIL_CRC16_H
+#define HOST_UTIL_CRC16_H
+
+#include <stdint.h>
+
+/* CRC-16 (polynomial 0xA001, reflected). */
+static inline uint16_t _crc16_update(uint16_t crc, uint8_t a)
+{
+  crc ^= a;
+  for (int i = 0; i < 8; i++)
+  {
+    if (crc & 1)
+      crc = (crc >> 1) ^ 0xA001;
+    else
+      crc = (crc >> 1);
+  }
+  return crc;
+}
+
+/* CRC-CCITT (polynomial 0x8408, reflected). */
+static inline uint16_t _crc_ccitt_update(uint16_t crc, uint8_t data)
+{
+  data ^= crc & 0xFF;
+  data ^= data << 4;
+  return ((((uint16_t) data << 8) | ((crc >> 8) & 0xFF)) ^ (uint8_t) (data >> 4) ^ ((uint16_t) data << 3));
+}
+
+/* CRC-8 (polynomial 0x07). */
+static inline uint8_t _crc8_ccitt_update(uint8_t crc, uint8_t data)
+{
+  crc ^= data;
+  for (int i = 0; i < 8; i++)
+  {
+    if (crc & 0x80)
+      crc = (crc << 1) ^ 0x07;
+    else
+      crc <<= 1;
+  }
+  return crc;
+}
+
+#endif
@@ -0,0 +1,121 @@
+/*
+ * Writes a capture of packets sent with the default timings, in the format
+ * written by ir_capture_cycle() (see ir.h), for test_irreplay.sh to replay
+ * through tools/irreplay.
+ *
+ * Each mark and space is lengthened or shortened by up to CAPTURE_JITTER
+ * clock ticks, as the TSOP's output would be. The packets and the jitter come
+ * from a fixed seed, so the capture is the same each time.
+ */
+#include <lasertag/clock.h>
+#include <lasertag/config.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <util/crc16.h>
+
+#define CAPTURE_JITTER 2
+
+/* The silence before each packet, in clock ticks. */
+#define CAPTURE_GAP (10000 / CLOCK_USECS_PER_TICK)
+
+/* The longest chunk, as in ir.c. */
+#define CAPTURE_CHUNK 48
+
+static uint8_t capture_chunk[CAPTURE_CHUNK];
+static uint8_t capture_len;
+static uint32_t capture_seed = 1;
+
+static void capture_put(uint8_t value, uint16_t *crc)
+{
+  putchar(value);
+  *crc = _crc16_update(*crc, value);
+}
+
+static void capture_flush(void)
+{
+  uint16_t crc = 0xFFFF;
+  putchar('L');
+  putchar('I');
+  capture_put(CLOCK_USECS_PER_TICK, &crc);
+  capture_put(0, &crc);
+  capture_put(capture_len, &crc);
+  for (uint8_t i = 0; i < capture_len; i++)
+    capture_put(capture_chunk[i], &crc);
+  putchar(crc & 0xFF);
+  putchar(crc >> 8);
+
+  capture_len = 0;
+}
+
+/* Appends an edge, the given number of ticks after the previous one. */
+static void capture_edge(bool mark, uint16_t ticks)
+{
+  uint8_t value = (mark ? 0x80 : 0) | (ticks & 0x3F);
+  ticks >>= 6;
+  if (ticks)
+    value |= 0x40;
+  capture_chunk[capture_len++] = value;
+
+  while (ticks)
+  {
+    value = ticks & 0x7F;
+    ticks >>= 7;
+    if (ticks)
+      value |= 0x80;
+    capture_chunk[capture_len++] = value;
+  }
+
+  /* Leave room for the longest encoding of an edge. */
+  if (capture_len > CAPTURE_CHUNK - 3)
+    capture_flush();
+}
+
+static uint16_t capture_random(void)
+{
+  capture_seed = capture_seed * 1103515245 + 12345;
+  return capture_seed >> 16;
+}
+
+/* Returns the given length in clock ticks, with some jitter. */
+static uint16_t capture_ticks(uint16_t usecs)
+{
+  return usecs / CLOCK_USECS_PER_TICK - CAPTURE_JITTER +
+    capture_random() % (2 * CAPTURE_JITTER + 1);
+}
+
+int main(int argc, char **argv)
+{
+  if (argc != 2)
+  {
+    fprintf(stderr, "Usage: %s packets\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  config_init();
+
+  for (int n = atoi(argv[1]); n > 0; n--)
+  {
+    uint16_t packet = capture_random();
+
+    /*
+     * Each edge holds the time since the previous one, so the length of a mark
+     * or space goes with the edge which ends it.
+     */
+    capture_edge(true, CAPTURE_GAP);
+    uint16_t len = capture_ticks(config.ir_header);
+    for (int8_t bit = 15; bit >= 0; bit--)
+    {
+      capture_edge(false, len);
+      capture_edge(true, capture_ticks(config.ir_space));
+      len = capture_ticks(packet & (1 << bit) ? config.ir_mark_one :
+        config.ir_mark_zero);
+    }
+    capture_edge(false, len);
+  }
+
+  if (capture_len)
+    capture_flush();
+
+  return EXIT_SUCCESS;
+}
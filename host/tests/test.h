@@ -0,0 +1,92 @@
+/*
+ * The checks shared by the host tests, which drive the firmware modules from
+ * the host build through the mock HAL.
+ *
+ * Each test program runs its cases in turn, reporting each failed check, and
+ * exits with a non-zero status if any failed. The mock HAL runs interrupts
+ * synchronously, so a bug which stops the firmware from making progress shows
+ * up as a hang rather than a failed check, and so each program is killed if it
+ * runs for longer than TEST_TIMEOUT seconds.
+ */
+#ifndef HOST_TESTS_TEST_H
+#define HOST_TESTS_TEST_H
+
+#include <hal.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define TEST_TIMEOUT 10
+
+/* The name of the case being run, and the number of checks which failed. */
+static const char *test_case;
+static unsigned int test_failures;
+
+#define TEST_CHECK(cond) test_check((cond), #cond, __FILE__, __LINE__)
+
+#define TEST_EQUAL(actual, expected) \
+  test_equal((long) (actual), (long) (expected), #actual, __FILE__, __LINE__)
+
+static void test_check(bool ok, const char *cond, const char *file, int line)
+{
+  if (ok)
+    return;
+
+  fprintf(stderr, "%s:%d: %s: check failed: %s\n", file, line, test_case, cond);
+  test_failures++;
+}
+
+static void test_equal(long actual, long expected, const char *expr,
+  const char *file, int line)
+{
+  if (actual == expected)
+    return;
+
+  fprintf(stderr, "%s:%d: %s: %s is %ld, expected %ld\n", file, line,
+    test_case, expr, actual, expected);
+  test_failures++;
+}
+
+static void test_timeout(int sig)
+{
+  (void) sig;
+  static const char msg[] = "test timed out\n";
+  write(STDERR_FILENO, msg, sizeof(msg) - 1);
+  _exit(EXIT_FAILURE);
+}
+
+/*
+ * Runs a case with freshly reset registers. The modules' own state isn't
+ * reset, so each case must initialize the modules it uses.
+ */
+static void test_run(const char *name, void (*run)(void))
+{
+  if (!test_case)
+  {
+    signal(SIGALRM, test_timeout);
+    alarm(TEST_TIMEOUT);
+  }
+
+  test_case = name;
+  hal_reset();
+  hal_timer2_autotick = 0;
+  hal_spi_slave = NULL;
+  hal_uart_tx = NULL;
+  run();
+}
+
+/* Reports the results, returning the program's exit status. */
+static int test_report(const char *program)
+{
+  if (test_failures)
+  {
+    fprintf(stderr, "%s: %u checks failed\n", program, test_failures);
+    return EXIT_FAILURE;
+  }
+
+  printf("%s: passed\n", program);
+  return EXIT_SUCCESS;
+}
+
+#endif
@@ -0,0 +1,107 @@
+/*
+ * Tests that the clock reads consistently while Timer2 overflows, both when
+ * the overflow ISR runs in the middle of a read and when it is held off with
+ * interrupts disabled.
+ */
+#include "test.h"
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <lasertag/clock.h>
+
+/* The number of reads made by each case. */
+#define TEST_READS 100000
+
+static void test_clock_init(void)
+{
+  clock_init();
+  sei();
+}
+
+/*
+ * Reads the clock repeatedly, checking that it never goes backwards and never
+ * moves by more than the given number of ticks between reads.
+ */
+static void test_monotonic(unsigned int reads, uint32_t max_step)
+{
+  uint32_t prev = clock_ticks();
+  for (unsigned int i = 0; i < reads; i++)
+  {
+    uint32_t now = clock_ticks();
+    uint32_t step = now - prev;
+    if (step > max_step)
+    {
+      TEST_CHECK(step <= max_step);
+      return;
+    }
+    prev = now;
+  }
+}
+
+static void test_clock_overflow(void)
+{
+  test_clock_init();
+
+  /*
+   * The timer advances each time it is read, so a read which takes TCNT2 past
+   * 255 runs the overflow ISR between reading the overflow count and reading
+   * the flag. The steps are varied so that the overflow lands on each read of
+   * TCNT2, including the ones made by a retry.
+   */
+  for (unsigned int autotick = 1; autotick <= 7; autotick++)
+  {
+    hal_timer2_autotick = autotick;
+    test_monotonic(TEST_READS / 7, 2 * autotick);
+  }
+
+  /* The two functions read the same clock. */
+  hal_timer2_autotick = 0;
+  TEST_EQUAL(clock_micros(), clock_ticks() * CLOCK_USECS_PER_TICK);
+}
+
+static void test_clock_pending(void)
+{
+  test_clock_init();
+
+  /*
+   * With interrupts disabled, an overflow is left pending, but is still
+   * counted by a read made after it.
+   */
+  hal_timer2_set(UINT8_MAX - 1);
+  uint32_t before = clock_ticks();
+  cli();
+  hal_timer2_step(3);
+  TEST_CHECK(TIFR2 & (1 << TOV2));
+  TEST_EQUAL(clock_ticks() - before, 3);
+
+  /*
+   * The reads carry on counting up until the ISR runs, as long as the timer
+   * doesn't overflow again.
+   */
+  hal_timer2_autotick = 1;
+  test_monotonic(UINT8_MAX - 3, 1);
+  hal_timer2_autotick = 0;
+
+  /* Then the ISR counts the overflow itself, and the clock doesn't move. */
+  uint32_t pending = clock_ticks();
+  sei();
+  TEST_CHECK(!(TIFR2 & (1 << TOV2)));
+  TEST_EQUAL(clock_ticks(), pending);
+
+  /*
+   * A read of 255 with the flag set was taken just before the timer overflowed,
+   * so the overflow isn't counted.
+   */
+  before = clock_ticks();
+  cli();
+  hal_timer2_step(UINT8_MAX - (before & UINT8_MAX) + 1);
+  hal_timer2_set(UINT8_MAX);
+  TEST_EQUAL(clock_ticks() - before, UINT8_MAX - (before & UINT8_MAX));
+  sei();
+}
+
+int main(void)
+{
+  test_run("overflow", test_clock_overflow);
+  test_run("pending", test_clock_pending);
+  return test_report("test_clock");
+}
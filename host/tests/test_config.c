@@ -0,0 +1,117 @@
+/*
+ * Tests the checks made on a configuration block before it is staged, writing
+ * the defaults with one value changed at a time.
+ */
+#include "test.h"
+#include <lasertag/config.h>
+#include <lasertag/ir.h>
+#include <lasertag/uart.h>
+#include <stddef.h>
+#include <util/crc16.h>
+
+/* Stages the block with a fresh CRC, returning true if it was accepted. */
+static bool test_stage(config_t block)
+{
+  const uint8_t *bytes = (const uint8_t *) &block;
+  block.crc = ~0;
+  for (size_t i = 0; i < offsetof(config_t, crc); i++)
+    block.crc = _crc16_update(block.crc, bytes[i]);
+
+  TEST_CHECK(config_stage(0, bytes, sizeof(block)));
+  return config_pending();
+}
+
+#define TEST_ACCEPTED(field, value) \
+  do { config_t block = config; block.field = (value); TEST_CHECK(test_stage(block)); } while (0)
+
+#define TEST_REJECTED(field, value) \
+  do { config_t block = config; block.field = (value); TEST_CHECK(!test_stage(block)); } while (0)
+
+static void test_config_defaults(void)
+{
+  /* The EEPROM is blank, so the defaults are loaded, and are valid. */
+  config_init();
+  TEST_EQUAL(config.version, CONFIG_VERSION);
+  TEST_EQUAL(config.uart_baud, 9600);
+  TEST_CHECK(test_stage(config));
+
+  /* A block whose CRC doesn't match is rejected. */
+  config_t block = config;
+  block.crc ^= 1;
+  TEST_CHECK(config_stage(0, (const uint8_t *) &block, sizeof(block)));
+  TEST_CHECK(!config_pending());
+
+  TEST_REJECTED(version, CONFIG_VERSION + 1);
+}
+
+static void test_config_game(void)
+{
+  config_init();
+
+  TEST_ACCEPTED(node, 0xFE);
+  TEST_REJECTED(node, 0x00);
+  TEST_REJECTED(node, 0xFF);
+
+  /* The team and player must fit in a shot's packet. */
+  TEST_ACCEPTED(team, 3);
+  TEST_REJECTED(team, 4);
+  TEST_ACCEPTED(player, 63);
+  TEST_REJECTED(player, 64);
+
+  TEST_ACCEPTED(team_color, 0x0F);
+  TEST_REJECTED(team_color, 0);
+  TEST_REJECTED(team_color, 0x10);
+  TEST_REJECTED(alt_color, 0);
+  TEST_REJECTED(alt_color, 0x80);
+  TEST_ACCEPTED(flags, CONFIG_FRIENDLY_FIRE);
+  TEST_REJECTED(flags, 0x02);
+
+  TEST_REJECTED(health, 0);
+  TEST_ACCEPTED(damage, 15);
+  TEST_REJECTED(damage, 0);
+  TEST_REJECTED(damage, 16);
+  TEST_REJECTED(magazine, 0);
+  TEST_ACCEPTED(ammo_low, config.magazine);
+  TEST_REJECTED(ammo_low, config.magazine + 1);
+}
+
+static void test_config_ir(void)
+{
+  config_init();
+
+  /* Each timing and the error must fit within the class table. */
+  TEST_ACCEPTED(ir_header, IR_MAX_USECS - config.ir_error);
+  TEST_REJECTED(ir_header, IR_MAX_USECS - config.ir_error + 1);
+  TEST_REJECTED(ir_header, 60000);
+  TEST_REJECTED(ir_space, IR_MAX_USECS - config.ir_error + 1);
+  TEST_REJECTED(ir_space, config.ir_error);
+  TEST_REJECTED(ir_mark_zero, config.ir_error);
+  TEST_REJECTED(ir_error, 0);
+  TEST_REJECTED(ir_error, 65535);
+
+  /* The windows of the marks may touch, but not overlap. */
+  TEST_ACCEPTED(ir_error, 100);
+  TEST_REJECTED(ir_error, 204);
+  TEST_REJECTED(ir_mark_one, config.ir_mark_zero);
+  TEST_REJECTED(ir_mark_one, config.ir_header - 2 * config.ir_error + 4);
+}
+
+static void test_config_uart(void)
+{
+  config_init();
+
+  TEST_ACCEPTED(uart_baud, UART_MIN_BAUD);
+  TEST_ACCEPTED(uart_baud, UART_MAX_BAUD);
+  TEST_REJECTED(uart_baud, 0);
+  TEST_REJECTED(uart_baud, UART_MIN_BAUD - 1);
+  TEST_REJECTED(uart_baud, UART_MAX_BAUD + 1);
+}
+
+int main(void)
+{
+  test_run("defaults", test_config_defaults);
+  test_run("game", test_config_game);
+  test_run("ir", test_config_ir);
+  test_run("uart", test_config_uart);
+  return test_report("test_config");
+}
@@ -0,0 +1,348 @@
+/*
+ * Tests the IR decoder by driving the receiver's pin (PD2) with the mock HAL
+ * and advancing Timer2 between the edges, and the transmitter by looping the
+ * carrier back to the receiver.
+ */
+#include "test.h"
+#include <avr/interrupt.h>
+#include <lasertag/clock.h>
+#include <lasertag/config.h>
+#include <lasertag/ir.h>
+
+/* The silence after each packet, which is longer than the RX timeout. */
+#define TEST_GAP 2000
+
+/* The silence the transmitter leaves after each packet, as in ir.c. */
+#define TEST_TX_GAP 2000
+
+/* The number of packets the RX buffer holds, one less than its size. */
+#define TEST_BUF_PACKETS 3
+
+static void test_ir_init(void)
+{
+  config_init();
+
+  /* The TSOP's output is active low, so the pin idles high. */
+  hal_pin_write(&PIND, PD2, true);
+
+  clock_init();
+  ir_init();
+  ir_reset();
+  sei();
+}
+
+/* Drives the receiver's output for the given number of microseconds. */
+static void test_level(bool mark, uint16_t usecs)
+{
+  hal_pin_write(&PIND, PD2, !mark);
+  hal_timer2_step(usecs / CLOCK_USECS_PER_TICK);
+}
+
+/* Sends a packet with the configured timings, but the given header mark. */
+static void test_packet_header(uint16_t packet, uint16_t header)
+{
+  test_level(true, header);
+  for (int8_t bit = 15; bit >= 0; bit--)
+  {
+    test_level(false, config.ir_space);
+    test_level(true, packet & (1 << bit) ? config.ir_mark_one :
+      config.ir_mark_zero);
+  }
+  test_level(false, TEST_GAP);
+}
+
+static void test_packet(uint16_t packet)
+{
+  test_packet_header(packet, config.ir_header);
+}
+
+static uint16_t test_dropped(trace_ir_drop_t reason)
+{
+  ir_stats_t stats;
+  ir_stats(&stats);
+  return stats.dropped[reason - 1];
+}
+
+static uint16_t test_received(void)
+{
+  ir_stats_t stats;
+  ir_stats(&stats);
+  return stats.received;
+}
+
+/* Checks that the RX buffer holds exactly the given packet. */
+static void test_expect(uint16_t expected)
+{
+  uint16_t packet = 0;
+  TEST_CHECK(ir_rx(&packet));
+  TEST_EQUAL(packet, expected);
+  TEST_CHECK(!ir_rx(&packet));
+}
+
+static void test_ir_decode(void)
+{
+  test_ir_init();
+
+  const uint16_t packets[] = { 0xA5C3, 0x0000, 0xFFFF, 0x8001, 0x1234 };
+  for (uint8_t i = 0; i < sizeof(packets) / sizeof(packets[0]); i++)
+  {
+    test_packet(packets[i]);
+    test_expect(packets[i]);
+  }
+
+  TEST_EQUAL(test_received(), 5);
+  for (trace_ir_drop_t reason = 1; reason <= TRACE_IR_FULL; reason++)
+    TEST_EQUAL(test_dropped(reason), 0);
+}
+
+static void test_ir_timed(void)
+{
+  test_ir_init();
+
+  /* The packet is received at the falling edge which ends its last mark. */
+  test_level(true, config.ir_header);
+  for (int8_t bit = 15; bit >= 0; bit--)
+  {
+    test_level(false, config.ir_space);
+    test_level(true, config.ir_mark_zero);
+  }
+  hal_pin_write(&PIND, PD2, true);
+  uint16_t received = clock_ticks();
+  hal_timer2_step(100);
+
+  uint16_t packet, ticks;
+  TEST_CHECK(ir_rx_timed(&packet, &ticks));
+  TEST_EQUAL(packet, 0x0000);
+  TEST_EQUAL(ticks, received);
+
+  test_level(false, TEST_GAP);
+}
+
+static void test_ir_error(void)
+{
+  test_ir_init();
+
+  /* Timings within the configured error on either side are accepted. */
+  test_packet_header(0x5A5A, config.ir_header - config.ir_error * 3 / 4);
+  test_expect(0x5A5A);
+  test_packet_header(0x5A5A, config.ir_header + config.ir_error * 3 / 4);
+  test_expect(0x5A5A);
+
+  /* Those outside it aren't. */
+  uint16_t packet;
+  test_level(true, config.ir_header - config.ir_error * 3 / 2);
+  test_level(false, TEST_GAP);
+  TEST_CHECK(!ir_rx(&packet));
+  test_level(true, config.ir_header + config.ir_error * 3 / 2);
+  test_level(false, TEST_GAP);
+  TEST_CHECK(!ir_rx(&packet));
+  TEST_EQUAL(test_received(), 2);
+  TEST_EQUAL(test_dropped(TRACE_IR_BAD_HEADER), 2);
+}
+
+static void test_ir_bad_space(void)
+{
+  test_ir_init();
+
+  test_level(true, config.ir_header);
+  test_level(false, config.ir_space * 3);
+  test_level(true, config.ir_mark_one);
+  test_level(false, TEST_GAP);
+
+  /* The rest of a dropped packet isn't counted again. */
+  uint16_t packet;
+  TEST_CHECK(!ir_rx(&packet));
+  TEST_EQUAL(test_dropped(TRACE_IR_BAD_SPACE), 1);
+  TEST_EQUAL(test_dropped(TRACE_IR_BAD_EDGE), 0);
+
+  /* The decoder recovers in time for the next packet. */
+  test_packet(0x0F0F);
+  test_expect(0x0F0F);
+}
+
+static void test_ir_timeout(void)
+{
+  test_ir_init();
+
+  test_level(true, config.ir_header);
+  for (uint8_t bit = 0; bit < 5; bit++)
+  {
+    test_level(false, config.ir_space);
+    test_level(true, config.ir_mark_one);
+  }
+  test_level(false, TEST_GAP);
+
+  uint16_t packet;
+  TEST_CHECK(!ir_rx(&packet));
+  TEST_EQUAL(test_dropped(TRACE_IR_TIMEOUT), 1);
+
+  test_packet(0xF00F);
+  test_expect(0xF00F);
+}
+
+static void test_ir_full(void)
+{
+  test_ir_init();
+
+  /* Packets which arrive while the buffer is full are dropped. */
+  for (uint16_t i = 0; i < TEST_BUF_PACKETS + 2; i++)
+    test_packet(0x1000 + i);
+
+  uint16_t packet;
+  for (uint16_t i = 0; i < TEST_BUF_PACKETS; i++)
+  {
+    TEST_CHECK(ir_rx(&packet));
+    TEST_EQUAL(packet, 0x1000 + i);
+  }
+  TEST_CHECK(!ir_rx(&packet));
+  TEST_EQUAL(test_received(), TEST_BUF_PACKETS);
+  TEST_EQUAL(test_dropped(TRACE_IR_FULL), 2);
+
+  /* Wrap around the buffer several times, filling it each time. */
+  for (uint16_t round = 0; round < 8; round++)
+  {
+    for (uint16_t i = 0; i < TEST_BUF_PACKETS; i++)
+      test_packet(round << 8 | i);
+
+    for (uint16_t i = 0; i < TEST_BUF_PACKETS; i++)
+    {
+      TEST_CHECK(ir_rx(&packet));
+      TEST_EQUAL(packet, round << 8 | i);
+    }
+    TEST_CHECK(!ir_rx(&packet));
+  }
+  TEST_EQUAL(test_dropped(TRACE_IR_FULL), 2);
+}
+
+/*
+ * Feeds the carrier back to the receiver for the given number of ticks, and
+ * collects up to max of the packets received, returning how many there were.
+ * The number of times the carrier was off for longer than a space, and the
+ * shortest of those times in ticks, are written to gaps and gap_min.
+ */
+static size_t test_loopback(uint16_t *packets, size_t max, uint32_t ticks,
+  uint8_t *gaps, uint32_t *gap_min)
+{
+  size_t received = 0;
+  uint32_t off_since = 0;
+  *gaps = 0;
+  *gap_min = UINT32_MAX;
+
+  for (uint32_t tick = 0; tick < ticks; tick++)
+  {
+    bool carrier = TCCR1A & (1 << COM1A1);
+    bool was_carrier = !(PIND & (1 << PD2));
+    if (carrier && !was_carrier && tick > 0)
+    {
+      uint32_t off = tick - off_since;
+      if (off > (config.ir_space + config.ir_error) / CLOCK_USECS_PER_TICK)
+      {
+        (*gaps)++;
+        if (off < *gap_min)
+          *gap_min = off;
+      }
+    }
+    else if (!carrier && was_carrier)
+    {
+      off_since = tick;
+    }
+
+    if (carrier != was_carrier)
+      hal_pin_write(&PIND, PD2, !carrier);
+    hal_timer2_step(1);
+
+    uint16_t packet;
+    while (ir_rx(&packet))
+    {
+      if (received < max)
+        packets[received] = packet;
+      received++;
+    }
+  }
+
+  return received;
+}
+
+static void test_ir_loopback(void)
+{
+  test_ir_init();
+
+  /* One packet is sent straight away, and the others wait in the buffer. */
+  const uint16_t packets[] = { 0xA5C3, 0xFFFF, 0x0000, 0x8001 };
+  const size_t count = sizeof(packets) / sizeof(packets[0]);
+  for (uint8_t i = 0; i < count; i++)
+    TEST_EQUAL(ir_tx(packets[i], IR_PRIORITY_SHOT), IR_TX_QUEUED);
+
+  uint16_t received[count];
+  uint8_t gaps;
+  uint32_t gap_min;
+  TEST_EQUAL(test_loopback(received, count, 20000, &gaps, &gap_min), count);
+  for (uint8_t i = 0; i < count; i++)
+    TEST_EQUAL(received[i], packets[i]);
+
+  ir_stats_t stats;
+  ir_stats(&stats);
+  TEST_EQUAL(stats.received, count);
+  TEST_EQUAL(stats.sent[IR_PRIORITY_SHOT], count);
+}
+
+static void test_ir_priority(void)
+{
+  test_ir_init();
+
+  /* The first beacon is sent straight away. */
+  TEST_EQUAL(ir_tx(0x0B01, IR_PRIORITY_CONTROL), IR_TX_QUEUED);
+
+  /*
+   * While it is being sent, a beacon identical to one already waiting is
+   * coalesced with it, and one which doesn't fit is dropped.
+   */
+  TEST_EQUAL(ir_tx(0x0B02, IR_PRIORITY_CONTROL), IR_TX_QUEUED);
+  TEST_EQUAL(ir_tx(0x0B02, IR_PRIORITY_CONTROL), IR_TX_COALESCED);
+  TEST_EQUAL(ir_tx(0x0B03, IR_PRIORITY_CONTROL), IR_TX_QUEUED);
+  TEST_EQUAL(ir_tx(0x0B04, IR_PRIORITY_CONTROL), IR_TX_QUEUED);
+  TEST_EQUAL(ir_tx(0x0B05, IR_PRIORITY_CONTROL), IR_TX_FULL);
+
+  /* The shots' queue is separate, and also coalesces identical packets. */
+  TEST_EQUAL(ir_tx(0x5101, IR_PRIORITY_SHOT), IR_TX_QUEUED);
+  TEST_EQUAL(ir_tx(0x5101, IR_PRIORITY_SHOT), IR_TX_COALESCED);
+
+  /*
+   * The shot isn't sent until the beacon being sent has finished, but then
+   * goes ahead of the beacons which were queued before it. Each packet
+   * follows the previous one after a gap of at least IR_TX_GAP.
+   */
+  const uint16_t expected[] = { 0x0B01, 0x5101, 0x0B02, 0x0B03, 0x0B04 };
+  const size_t count = sizeof(expected) / sizeof(expected[0]);
+  uint16_t received[count];
+  uint8_t gaps;
+  uint32_t gap_min;
+  TEST_EQUAL(test_loopback(received, count, 30000, &gaps, &gap_min), count);
+  for (uint8_t i = 0; i < count; i++)
+    TEST_EQUAL(received[i], expected[i]);
+  TEST_EQUAL(gaps, count - 1);
+  TEST_CHECK(gap_min >= TEST_TX_GAP / CLOCK_USECS_PER_TICK);
+
+  ir_stats_t stats;
+  ir_stats(&stats);
+  TEST_EQUAL(stats.sent[IR_PRIORITY_SHOT], 1);
+  TEST_EQUAL(stats.sent[IR_PRIORITY_CONTROL], 4);
+  TEST_EQUAL(stats.coalesced[IR_PRIORITY_SHOT], 1);
+  TEST_EQUAL(stats.coalesced[IR_PRIORITY_CONTROL], 1);
+  TEST_EQUAL(stats.full[IR_PRIORITY_SHOT], 0);
+  TEST_EQUAL(stats.full[IR_PRIORITY_CONTROL], 1);
+  TEST_CHECK(stats.wait_max[IR_PRIORITY_SHOT] > 0);
+}
+
+int main(void)
+{
+  test_run("decode", test_ir_decode);
+  test_run("timed", test_ir_timed);
+  test_run("error", test_ir_error);
+  test_run("bad space", test_ir_bad_space);
+  test_run("timeout", test_ir_timeout);
+  test_run("full", test_ir_full);
+  test_run("loopback", test_ir_loopback);
+  test_run("priority", test_ir_priority);
+  return test_report("test_ir");
+}
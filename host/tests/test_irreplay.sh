@@ -0,0 +1,62 @@
+#!/bin/sh
+#
+# Compares the accuracy of the INT0 receiver and the input capture receiver
+# (IR_RX_CAPTURE) by replaying the same capture through irreplay and
+# irreplay-capture, with the receiver's interrupt held off after each edge as
+# it would be by another ISR.
+#
+# Usage: test_irreplay.sh mkcapture irreplay irreplay-capture
+
+PACKETS=200
+
+mkcapture=$1
+irreplay=$2
+irreplay_capture=$3
+
+capture=$(mktemp) || exit 1
+trap 'rm -f "$capture"' EXIT
+"$mkcapture" $PACKETS > "$capture" || exit 1
+
+failures=0
+
+fail()
+{
+  echo "test_irreplay: $*" >&2
+  failures=$((failures + 1))
+}
+
+# Prints the number of packets decoded by the given replay command.
+decoded()
+{
+  "$@" "$capture" | awk '$1 == "decoded" { print $2 }'
+}
+
+# Replays the capture through both receivers with the given options, and
+# checks the number of packets each decodes.
+compare()
+{
+  int0=$(decoded "$irreplay" "$@")
+  icp=$(decoded "$irreplay_capture" "$@")
+  echo "test_irreplay: $*: INT0 decoded $int0, input capture $icp of $PACKETS"
+
+  [ "$icp" = "$PACKETS" ] || fail "$*: input capture decoded $icp, expected $PACKETS"
+}
+
+# Both receivers decode every packet if they run on time, and if they are held
+# off for as long as the speaker's ADPCM ISR runs (~12.5 us).
+compare -l 0
+[ "$int0" = "$PACKETS" ] || fail "INT0 decoded $int0, expected $PACKETS"
+compare -l 12
+[ "$int0" = "$PACKETS" ] || fail "INT0 decoded $int0, expected $PACKETS"
+
+# With a tighter error than the time it is held off, the INT0 receiver drops
+# packets, but Timer1 still latches every edge on time.
+compare -l 48 -E 40
+[ "$int0" -lt "$icp" ] || fail "INT0 decoded $int0, expected fewer than $icp"
+
+if [ $failures -ne 0 ]; then
+  echo "test_irreplay: $failures checks failed" >&2
+  exit 1
+fi
+
+echo "test_irreplay: passed"
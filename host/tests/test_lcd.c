@@ -0,0 +1,336 @@
+/*
+ * Tests the LCD's write queue, decoding the writes sent to the controller from
+ * the outputs of its shift register.
+ *
+ * The shift register driver is replaced by the shift_init() and shift_out()
+ * below, so shift.o isn't linked from the host build.
+ */
+#include "test.h"
+#include <avr/interrupt.h>
+#include <lasertag/clock.h>
+#include <lasertag/lcd.h>
+#include <lasertag/shift.h>
+#include <string.h>
+
+/* The shift register outputs connected to the controller, as in lcd.c. */
+#define TEST_RS 0
+#define TEST_EN 1
+#define TEST_D4 2
+
+/* The number of nibbles sent to initialize the controller in 4-bit mode. */
+#define TEST_INIT_NIBBLES 4
+
+/* The number of writes the queue holds, as in lcd.c. */
+#define TEST_QUEUE_SIZE 32
+
+typedef struct
+{
+  bool rs;
+  uint8_t value;
+  uint32_t usecs;
+} test_write_t;
+
+/* The nibbles latched by the controller since test_reset_writes(). */
+static test_write_t test_nibbles[1024];
+static size_t test_nibble_count;
+
+/* The outputs of the shift register. */
+static uint8_t test_outputs;
+
+void shift_init(shift_t *shift)
+{
+  (void) shift;
+}
+
+void shift_out(shift_t *shift, uint8_t data)
+{
+  (void) shift;
+
+  /* The controller latches D4-D7 and RS on the falling edge of EN. */
+  if ((test_outputs & (1 << TEST_EN)) && !(data & (1 << TEST_EN)) &&
+      test_nibble_count < sizeof(test_nibbles) / sizeof(test_nibbles[0]))
+  {
+    test_nibbles[test_nibble_count++] = (test_write_t) {
+      .rs = data & (1 << TEST_RS),
+      .value = (data >> TEST_D4) & 0xF,
+      .usecs = clock_micros()
+    };
+  }
+
+  test_outputs = data;
+}
+
+static void test_reset_writes(void)
+{
+  test_nibble_count = 0;
+}
+
+/* Returns the nth 8-bit write, which is sent as two nibbles. */
+static test_write_t test_write(size_t n)
+{
+  test_write_t high = test_nibbles[n * 2], low = test_nibbles[n * 2 + 1];
+  TEST_EQUAL(high.rs, low.rs);
+  return (test_write_t) {
+    .rs = high.rs,
+    .value = (high.value << 4) | low.value,
+    .usecs = high.usecs
+  };
+}
+
+static void test_expect_write(size_t n, bool rs, uint8_t value)
+{
+  TEST_CHECK(n * 2 + 1 < test_nibble_count);
+  if (n * 2 + 1 >= test_nibble_count)
+    return;
+
+  test_write_t write = test_write(n);
+  TEST_EQUAL(write.rs, rs);
+  TEST_EQUAL(write.value, value);
+}
+
+/* Runs the LCD task until every queued write has been sent. */
+static void test_drain(void)
+{
+  for (unsigned int i = 0; i < 100000 && !lcd_idle(); i++)
+    lcd_cycle();
+
+  TEST_CHECK(lcd_idle());
+}
+
+/*
+ * Starts the clock, which advances each time it is read so that the driver's
+ * delays finish. The controller is only initialized once, by the first case,
+ * and the others carry on using it.
+ */
+static void test_lcd_init(void)
+{
+  hal_timer2_autotick = 1;
+  clock_init();
+  sei();
+  test_reset_writes();
+}
+
+static void test_lcd_startup(void)
+{
+  test_lcd_init();
+
+  /* Nothing is sent until the task runs. */
+  lcd_init();
+  TEST_EQUAL(test_nibble_count, 0);
+  TEST_CHECK(!lcd_idle());
+
+  /*
+   * The task sends the first nibble, then yields rather than spinning for the
+   * 4.1 ms the controller needs before the next one.
+   */
+  lcd_cycle();
+  TEST_EQUAL(test_nibble_count, 1);
+  lcd_cycle();
+  TEST_EQUAL(test_nibble_count, 1);
+
+  /*
+   * The LCD isn't idle until the writes queued by lcd_init() have been sent,
+   * the last of which is a clear.
+   */
+  for (unsigned int i = 0; i < 100000 &&
+       test_nibble_count < TEST_INIT_NIBBLES + 4 * 2; i++)
+  {
+    TEST_CHECK(!lcd_idle());
+    lcd_cycle();
+  }
+  TEST_CHECK(!lcd_idle());
+  uint32_t cleared = clock_micros();
+  test_drain();
+  TEST_CHECK(clock_micros() - cleared >= 4000);
+
+  /* The controller is switched to 4-bit mode with single nibbles. */
+  const uint8_t init[TEST_INIT_NIBBLES] = { 0x3, 0x3, 0x3, 0x2 };
+  TEST_CHECK(test_nibble_count >= TEST_INIT_NIBBLES);
+  for (size_t i = 0; i < TEST_INIT_NIBBLES && i < test_nibble_count; i++)
+  {
+    TEST_EQUAL(test_nibbles[i].rs, false);
+    TEST_EQUAL(test_nibbles[i].value, init[i]);
+  }
+  TEST_CHECK(test_nibbles[1].usecs - test_nibbles[0].usecs >= 4100);
+
+  /* Then the writes queued by lcd_init() follow, in order. */
+  TEST_EQUAL(test_nibble_count, TEST_INIT_NIBBLES + 4 * 2);
+  test_nibble_count -= TEST_INIT_NIBBLES;
+  memmove(test_nibbles, &test_nibbles[TEST_INIT_NIBBLES],
+    test_nibble_count * sizeof(test_nibbles[0]));
+
+  test_expect_write(0, false, 0x28); /* function set, 2 lines */
+  test_expect_write(1, false, 0x08); /* display control, display off */
+  test_expect_write(2, false, 0x06); /* entry mode, left to right */
+  test_expect_write(3, false, 0x01); /* clear */
+}
+
+static void test_lcd_order(void)
+{
+  test_lcd_init();
+
+  lcd_move_cursor(0, 0);
+  lcd_puts("ABCDEFGHIJ");
+  TEST_CHECK(!lcd_idle());
+  TEST_EQUAL(test_nibble_count, 0);
+  test_drain();
+
+  /* The cursor moves to the next row after the 8th column. */
+  TEST_EQUAL(test_nibble_count, 12 * 2);
+  test_expect_write(0, false, 0x80);
+  for (size_t i = 0; i < 8; i++)
+    test_expect_write(1 + i, true, 'A' + i);
+  test_expect_write(9, false, 0xC0);
+  test_expect_write(10, true, 'I');
+  test_expect_write(11, true, 'J');
+
+  /* And back to the first row after the second. */
+  test_reset_writes();
+  lcd_puts("KLMNOP");
+  test_drain();
+  TEST_EQUAL(test_nibble_count, 7 * 2);
+  test_expect_write(5, true, 'P');
+  test_expect_write(6, false, 0x80);
+}
+
+static void test_lcd_make_char(void)
+{
+  test_lcd_init();
+
+  /*
+   * The CGRAM address is set once and moves to the next row after each write,
+   * then the cursor is restored.
+   */
+  static const uint8_t bitmap[8] = { 0x00, 0x0A, 0x1F, 0x1F, 0x0E, 0x04 };
+  lcd_move_cursor(3, 1);
+  test_drain();
+  test_reset_writes();
+  lcd_make_char(2, bitmap);
+  test_drain();
+
+  TEST_EQUAL(test_nibble_count, (1 + 8 + 1) * 2);
+  test_expect_write(0, false, 0x40 | (2 * 8));
+  for (size_t i = 0; i < 8; i++)
+    test_expect_write(1 + i, true, bitmap[i]);
+  test_expect_write(9, false, 0x80 | 0x43);
+
+  /* A range of rows starts at the first of them. */
+  test_reset_writes();
+  lcd_make_char_rows(5, 3, 2, &bitmap[3]);
+  test_drain();
+
+  TEST_EQUAL(test_nibble_count, (1 + 2 + 1) * 2);
+  test_expect_write(0, false, 0x40 | (5 * 8 + 3));
+  test_expect_write(1, true, bitmap[3]);
+  test_expect_write(2, true, bitmap[4]);
+  test_expect_write(3, false, 0x80 | 0x43);
+}
+
+static void test_lcd_full(void)
+{
+  test_lcd_init();
+
+  /*
+   * Queue far more writes than the queue holds without running the task, so
+   * lcd_write() has to send them itself to make room, and the queue's indices
+   * wrap around.
+   */
+  lcd_move_cursor(0, 0);
+  char text[TEST_QUEUE_SIZE * 10 + 1];
+  for (size_t i = 0; i < sizeof(text) - 1; i++)
+    text[i] = 'a' + i % 26;
+  text[sizeof(text) - 1] = '\0';
+  lcd_puts(text);
+  test_drain();
+
+  size_t n = 0;
+  test_expect_write(n++, false, 0x80);
+  for (size_t i = 0; i < sizeof(text) - 1; i++)
+  {
+    test_expect_write(n++, true, text[i]);
+    if (i % 8 == 7)
+      test_expect_write(n++, false, (i / 8) % 2 ? 0x80 : 0xC0);
+  }
+  TEST_EQUAL(test_nibble_count, n * 2);
+}
+
+static void test_lcd_back_pressure(void)
+{
+  test_lcd_init();
+
+  /* Filling the queue doesn't send anything. */
+  for (uint8_t i = 0; i < TEST_QUEUE_SIZE; i++)
+    lcd_move_cursor(i % 8, i / 8 % 2);
+  TEST_EQUAL(test_nibble_count, 0);
+
+  /*
+   * The next write waits for room by running the task itself, which sends
+   * every queued write as none of them are slow, and then queues the write.
+   */
+  lcd_move_cursor(5, 1);
+  TEST_EQUAL(test_nibble_count, TEST_QUEUE_SIZE * 2);
+  TEST_CHECK(!lcd_idle());
+  test_drain();
+
+  TEST_EQUAL(test_nibble_count, (TEST_QUEUE_SIZE + 1) * 2);
+  for (uint8_t i = 0; i < TEST_QUEUE_SIZE; i++)
+    test_expect_write(i, false, 0x80 | (i / 8 % 2 ? 0x40 : 0) | i % 8);
+  test_expect_write(TEST_QUEUE_SIZE, false, 0xC5);
+
+  /*
+   * If the oldest write is slow, the task yields once it has been sent, which
+   * makes room, so the next write doesn't wait for the slow one to finish.
+   */
+  test_reset_writes();
+  lcd_clear();
+  for (uint8_t i = 1; i < TEST_QUEUE_SIZE; i++)
+    lcd_move_cursor(i % 8, 0);
+  uint32_t start = clock_micros();
+  lcd_move_cursor(0, 1);
+  TEST_EQUAL(test_nibble_count, 2);
+  test_expect_write(0, false, 0x01);
+  TEST_CHECK(clock_micros() - start < 4000);
+
+  test_drain();
+  TEST_EQUAL(test_nibble_count, (TEST_QUEUE_SIZE + 1) * 2);
+  TEST_CHECK(test_write(1).usecs - test_write(0).usecs >= 4000);
+  test_expect_write(TEST_QUEUE_SIZE, false, 0xC0);
+}
+
+static void test_lcd_slow(void)
+{
+  test_lcd_init();
+
+  /*
+   * A clear takes a few milliseconds, which the task waits for by yielding.
+   * The LCD is idle as soon as the clear has been sent, but a write queued
+   * after it is only sent by a later run.
+   */
+  lcd_clear();
+  TEST_CHECK(!lcd_idle());
+  lcd_cycle();
+  TEST_EQUAL(test_nibble_count, 2);
+  TEST_CHECK(lcd_idle());
+
+  lcd_putc('X');
+  TEST_CHECK(!lcd_idle());
+  lcd_cycle();
+  TEST_EQUAL(test_nibble_count, 2);
+
+  test_drain();
+  TEST_EQUAL(test_nibble_count, 4);
+  test_expect_write(0, false, 0x01);
+  test_expect_write(1, true, 'X');
+  TEST_CHECK(test_write(1).usecs - test_write(0).usecs >= 4000);
+}
+
+int main(void)
+{
+  test_run("startup", test_lcd_startup);
+  test_run("order", test_lcd_order);
+  test_run("make char", test_lcd_make_char);
+  test_run("full", test_lcd_full);
+  test_run("back pressure", test_lcd_back_pressure);
+  test_run("slow", test_lcd_slow);
+  return test_report("test_lcd");
+}
@@ -0,0 +1,158 @@
+/*
+ * Tests the UART's RX and TX ring buffers, receiving bytes through the mock
+ * HAL and collecting the bytes it transmits.
+ */
+#include "test.h"
+#include <avr/interrupt.h>
+#include <lasertag/config.h>
+#include <lasertag/uart.h>
+#include <string.h>
+
+/* The number of bytes each ring buffer holds, one less than its size. */
+#define TEST_BUF_BYTES 15
+
+/* The bytes transmitted since test_uart_init(). */
+static uint8_t test_tx[256];
+static size_t test_tx_len;
+
+static void test_uart_sent(uint8_t value)
+{
+  if (test_tx_len < sizeof(test_tx))
+    test_tx[test_tx_len] = value;
+  test_tx_len++;
+}
+
+static void test_uart_init(void)
+{
+  config_init();
+  uart_init();
+  sei();
+
+  /* Empty the RX buffer of anything left by the previous case. */
+  while (uart_getc() >= 0)
+    ;
+
+  hal_uart_tx = test_uart_sent;
+  test_tx_len = 0;
+}
+
+/* Checks that the bytes transmitted so far are exactly the given string. */
+static void test_expect_tx(const char *expected)
+{
+  TEST_EQUAL(test_tx_len, strlen(expected));
+  TEST_CHECK(test_tx_len <= sizeof(test_tx) &&
+    memcmp(test_tx, expected, test_tx_len) == 0);
+  test_tx_len = 0;
+}
+
+static void test_uart_rx(void)
+{
+  test_uart_init();
+
+  TEST_EQUAL(uart_getc(), -1);
+  for (const char *c = "hello"; *c; c++)
+  {
+    hal_uart_rx(*c);
+    TEST_EQUAL(uart_getc(), *c);
+    TEST_EQUAL(uart_getc(), -1);
+  }
+}
+
+static void test_uart_rx_full(void)
+{
+  test_uart_init();
+
+  /* Bytes which arrive while the buffer is full are dropped. */
+  for (int i = 0; i < TEST_BUF_BYTES + 5; i++)
+    hal_uart_rx('a' + i);
+
+  for (int i = 0; i < TEST_BUF_BYTES; i++)
+    TEST_EQUAL(uart_getc(), 'a' + i);
+  TEST_EQUAL(uart_getc(), -1);
+
+  /* Wrap around the buffer several times, filling it each time. */
+  for (int round = 0; round < 8; round++)
+  {
+    for (int i = 0; i < TEST_BUF_BYTES; i++)
+      hal_uart_rx(round * 16 + i);
+
+    for (int i = 0; i < TEST_BUF_BYTES; i++)
+      TEST_EQUAL(uart_getc(), round * 16 + i);
+    TEST_EQUAL(uart_getc(), -1);
+  }
+}
+
+static void test_uart_rx_wrap(void)
+{
+  test_uart_init();
+
+  /* Reads which fall behind the writes, without ever filling the buffer. */
+  int next_rx = 0, next_tx = 0;
+  for (int round = 0; round < 10; round++)
+  {
+    for (int i = 0; i < 5; i++)
+      hal_uart_rx(next_rx++);
+    for (int i = 0; i < 4; i++)
+      TEST_EQUAL(uart_getc(), next_tx++ & 0xFF);
+  }
+
+  while (next_tx < next_rx)
+    TEST_EQUAL(uart_getc(), next_tx++ & 0xFF);
+  TEST_EQUAL(uart_getc(), -1);
+}
+
+static void test_uart_tx(void)
+{
+  test_uart_init();
+
+  /* The mock HAL sends each byte as soon as the UDRE interrupt allows. */
+  uart_puts("hello");
+  test_expect_tx("hello");
+
+  /* The UDRE interrupt is masked once the buffer has been emptied. */
+  TEST_CHECK(!(UCSR0B & (1 << UDRIE0)));
+
+  uart_putu(0);
+  uart_putc(' ');
+  uart_putu(4294967295UL);
+  test_expect_tx("0 4294967295");
+}
+
+static void test_uart_tx_full(void)
+{
+  test_uart_init();
+
+  /*
+   * With interrupts disabled, nothing is sent, so the buffer fills up. If it
+   * reported full too soon, uart_putc() would spin forever.
+   */
+  char expected[TEST_BUF_BYTES + 1];
+  for (int round = 0; round < 8; round++)
+  {
+    int len = round % 2 ? TEST_BUF_BYTES : 7;
+
+    cli();
+    for (int i = 0; i < len; i++)
+    {
+      expected[i] = 'A' + (round + i) % 26;
+      uart_putc(expected[i]);
+    }
+    expected[len] = '\0';
+
+    TEST_EQUAL(test_tx_len, 0);
+    TEST_CHECK(UCSR0B & (1 << UDRIE0));
+
+    sei();
+    test_expect_tx(expected);
+  }
+}
+
+int main(void)
+{
+  test_run("rx", test_uart_rx);
+  test_run("rx full", test_uart_rx_full);
+  test_run("rx wrap", test_uart_rx_wrap);
+  test_run("tx", test_uart_tx);
+  test_run("tx full", test_uart_tx_full);
+  return test_report("test_uart");
+}
@@ -0,0 +1,46 @@
+#ifndef LASERTAG_ADPCM_H
+#define LASERTAG_ADPCM_H
+
+/*
+ * The tables of the IMA ADPCM codec, shared by the speaker's decoder and the
+ * tools/pcmenc encoder.
+ *
+ * Each 4-bit code holds a sign (bit 3) and a magnitude (bits 0-2). The
+ * magnitude scales the current step size to give the difference from the
+ * previous sample, and then moves the step index up or down the step table.
+ * Both the predicted sample and the step index start from zero at the
+ * beginning of a sample.
+ */
+
+/* The number of entries in the step table. */
+#define ADPCM_STEPS 89
+
+/* Expands X(step) for each step size, in order. */
+#define ADPCM_STEP_TABLE(X) \
+  X(7)     X(8)     X(9)     X(10)    X(11)    X(12)    X(13)    X(14) \
+  X(16)    X(17)    X(19)    X(21)    X(23)    X(25)    X(28)    X(31) \
+  X(34)    X(37)    X(41)    X(45)    X(50)    X(55)    X(60)    X(66) \
+  X(73)    X(80)    X(88)    X(97)    X(107)   X(118)   X(130)   X(143) \
+  X(157)   X(173)   X(190)   X(209)   X(230)   X(253)   X(279)   X(307) \
+  X(337)   X(371)   X(408)   X(449)   X(494)   X(544)   X(598)   X(658) \
+  X(724)   X(796)   X(876)   X(963)   X(1060)  X(1166)  X(1282)  X(1411) \
+  X(1552)  X(1707)  X(1878)  X(2066)  X(2272)  X(2499)  X(2749)  X(3024) \
+  X(3327)  X(3660)  X(4026)  X(4428)  X(4871)  X(5358)  X(5894)  X(6484) \
+  X(7132)  X(7845)  X(8630)  X(9493)  X(10442) X(11487) X(12635) X(13899) \
+  X(15289) X(16818) X(18500) X(20350) X(22385) X(24623) X(27086) X(29794) \
+  X(32767)
+
+/* The difference encoded by a magnitude at the given step size. */
+#define ADPCM_DIFF(step, magnitude) \
+  (((step) >> 3) + \
+   (((magnitude) & 4) ? (step) : 0) + \
+   (((magnitude) & 2) ? (step) >> 1 : 0) + \
+   (((magnitude) & 1) ? (step) >> 2 : 0))
+
+/* The adjustment made to the step index by each magnitude. */
+#define ADPCM_INDEX_TABLE { -1, -1, -1, -1, 2, 4, 6, 8 }
+
+/* The sign bit of a code. */
+#define ADPCM_SIGN 0x8
+
+#endif
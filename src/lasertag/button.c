@@ -1,5 +1,6 @@
 #include <lasertag/button.h>
 #include <lasertag/clock.h>
+#include <lasertag/trace.h>
 
 /* The number of microseconds between samples. */
 #define BUTTON_SAMPLE_DELAY 10000
@@ -25,10 +26,17 @@ void button_cycle(button_t *button)
       button->samples |= 0x1;
 
     /* Update the 'pressed' variable if the samples match the pattern. */
+    bool pressed = button->pressed;
     if ((button->samples & BUTTON_SAMPLE_MASK) == BUTTON_SAMPLE_MASK)
-      button->pressed = true;
+      pressed = true;
     else if (((~button->samples) & BUTTON_SAMPLE_MASK) == BUTTON_SAMPLE_MASK)
-      button->pressed = false;
+      pressed = false;
+
+    if (pressed != button->pressed)
+    {
+      button->pressed = pressed;
+      trace(TRACE_BUTTON, (button->button << 8) | pressed);
+    }
   }
 }
 
@@ -1,56 +1,82 @@
 #include <lasertag/clock.h>
 #include <avr/interrupt.h>
 #include <avr/io.h>
-#include <util/atomic.h>
-
-/* The number of microseconds between overflow interrupts. */
-#define CLOCK_USECS_PER_OVERFLOW (256 * CLOCK_USECS_PER_TICK)
+#include <lasertag/profile.h>
+#include <lasertag/timer.h>
+#include <stdbool.h>
 
 static volatile uint32_t clock_overflows = 0;
 
 ISR(TIMER2_OVF_vect)
 {
+  /* The profiler's timebase must be updated before it is used. */
+  PROFILE_OVERFLOW();
+  PROFILE_SCOPE_EVENT(PROFILE_TIMER2_OVF, profile_tick_time(0));
+
   clock_overflows++;
+
+  /* Set the compare unit if a timer deadline is now within range. */
+  timer_overflow();
 }
 
 void clock_init(void)
 {
   /*
-   * Set up Timer2 with a prescaler of 256. The waveform generator is set to
+   * Set up Timer2 with a prescaler of 64. The waveform generator is set to
    * mode 0 - normal operation.
    *
-   * As F_CPU is 16 MHz, the timer runs at 62.5 kHz - each tick lasts 16
-   * microseconds. The timer overflows after 4.096 milliseconds.
+   * As F_CPU is 16 MHz, the timer runs at 250 kHz - each tick lasts 4
+   * microseconds. The timer overflows after 1.024 milliseconds.
    */
   TCCR2A = 0;
-  TCCR2B = (1 << CS22) | (1 << CS21);
+  TCCR2B = (1 << CS22);
 
   /* Enable the overflow interrupt. */
   TIMSK2 = (1 << TOIE2);
 }
 
 uint32_t clock_micros(void)
+{
+  /* As there are 256 ticks per overflow, this wraps around with the ticks. */
+  return clock_ticks() * CLOCK_USECS_PER_TICK;
+}
+
+uint32_t clock_ticks(void)
 {
   uint8_t ticks;
   uint32_t overflows;
+  bool pending;
 
-  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  /*
+   * Read the overflow count and the timer without disabling interrupts, so
+   * that the clock can be read as often as needed without delaying the ISRs.
+   * If the overflow ISR runs during the read, the count (which takes several
+   * instructions to load) will have changed by the time it is read again, so
+   * the read is retried.
+   */
+  do
   {
     overflows = clock_overflows;
     ticks = TCNT2;
-    if ((TIFR2 & (1 << TOV2)) && ticks != UINT8_MAX)
-      overflows++;
+    pending = TIFR2 & (1 << TOV2);
   }
+  while (overflows != clock_overflows);
+
+  /*
+   * The timer may have overflowed without the ISR having run yet, e.g. if
+   * interrupts are disabled. Unless the timer was read before it overflowed,
+   * the overflow is counted here instead.
+   */
+  if (pending && ticks != UINT8_MAX)
+    overflows++;
 
-  return (uint32_t) ticks * CLOCK_USECS_PER_TICK + overflows * CLOCK_USECS_PER_OVERFLOW;
+  return (overflows << 8) | ticks;
 }
 
 uint32_t clock_delta(uint32_t now, uint32_t prev)
 {
-  if (now >= prev)
-    return now - prev;
-  else
-    return UINT32_MAX - prev + now;
+  /* Unsigned subtraction wraps around, so this is correct across overflow. */
+  return now - prev;
 }
 
 void clock_usdelay(unsigned int micros)
@@ -4,7 +4,7 @@
 #include <stdint.h>
 
 /* The prescaler used by the timer. */
-#define CLOCK_PRESCALER 256
+#define CLOCK_PRESCALER 64
 
 /* The number of microseconds per tick. */
 #define CLOCK_USECS_PER_TICK ((CLOCK_PRESCALER * 1000000) / F_CPU)
@@ -15,6 +15,14 @@ void clock_init(void);
 /* Returns the number of microseconds since the clock started. */
 uint32_t clock_micros(void);
 
+/*
+ * Returns the number of ticks since the clock started. This is cheaper than
+ * clock_micros(), as no multiplication is needed, and wraps around after ~4.8
+ * hours. Neither function disables interrupts, so they may be called as often
+ * as needed without delaying the ISRs.
+ */
+uint32_t clock_ticks(void);
+
 /*
  * Returns the number of microseconds between two times, taking overflow into
  * account.
@@ -0,0 +1,215 @@
+#include <lasertag/config.h>
+#include <avr/pgmspace.h>
+#include <lasertag/clock.h>
+#include <lasertag/ir.h>
+#include <lasertag/led.h>
+#include <lasertag/mesh.h>
+#include <lasertag/nvm.h>
+#include <lasertag/uart.h>
+#include <lasertag/uplink.h>
+#include <stddef.h>
+#include <string.h>
+#include <util/crc16.h>
+
+/* The location of the configuration in the EEPROM. */
+#define CONFIG_EEPROM_START 0
+
+/* The states of the staging area. */
+typedef enum
+{
+  /* Being written by config_stage(). */
+  CONFIG_STAGING,
+
+  /* Holds a valid block which is waiting for config_apply(). */
+  CONFIG_PENDING,
+
+  /* Holds the applied block, which is waiting to be saved or being saved. */
+  CONFIG_SAVING
+} config_state_t;
+
+static const config_t config_defaults PROGMEM = {
+  .version = CONFIG_VERSION,
+  .node = 1,
+  .team = 0,
+  .player = 1,
+  .team_color = LED_RED,
+  .alt_color = LED_RED,
+  .flags = 0,
+  .health = 100,
+  .damage = 4,
+  .magazine = 10,
+  .magazines = 5,
+  .ammo_low = 3,
+  .fire_ms = 250,
+  .reload_ms = 2000,
+  .respawn_ms = 10000,
+  .ir_header = 1200,
+  .ir_mark_one = 800,
+  .ir_mark_zero = 400,
+  .ir_space = 400,
+  .ir_error = 200,
+  .uart_baud = 9600
+};
+
+config_t config;
+
+static config_t config_staged;
+static config_state_t config_state;
+static uint8_t config_staged_len;
+static bool config_saved;
+
+static uint16_t config_crc(const config_t *block)
+{
+  const uint8_t *bytes = (const uint8_t *) block;
+  uint16_t crc = ~0;
+  for (uint8_t i = 0; i < offsetof(config_t, crc); i++)
+    crc = _crc16_update(crc, bytes[i]);
+  return crc;
+}
+
+/*
+ * Returns true if a mark of the given length is within the receiver's range,
+ * and its window doesn't include lengths too short to be a mark.
+ */
+static bool config_ir_timing_valid(uint16_t usecs, uint16_t error)
+{
+  return usecs > error && (uint32_t) usecs + error <= IR_MAX_USECS;
+}
+
+/*
+ * Returns true if the windows around two mark lengths overlap by no more than
+ * their edges, so that a mark could only be one of them.
+ */
+static bool config_ir_timings_apart(uint16_t a, uint16_t b, uint16_t error)
+{
+  return (uint32_t) a + 2 * error <= b || (uint32_t) b + 2 * error <= a;
+}
+
+/*
+ * Returns true if the block is intact and each of its values is one which the
+ * modules can use: the team and player fit in a shot's packet, the IR timings
+ * are within the receiver's range and can be told apart, and the UART can be
+ * set to the baud rate.
+ */
+static bool config_valid(const config_t *block)
+{
+  if (block->version != CONFIG_VERSION || config_crc(block) != block->crc)
+    return false;
+
+  if (block->node == MESH_BASE || block->node == MESH_BROADCAST)
+    return false;
+
+  const uint8_t colors = LED_RED | LED_GREEN | LED_YELLOW | LED_BLUE;
+  if (block->team > 3 || block->player > 63 ||
+      !block->team_color || (block->team_color & ~colors) ||
+      !block->alt_color || (block->alt_color & ~colors) ||
+      (block->flags & ~CONFIG_FRIENDLY_FIRE))
+    return false;
+
+  if (!block->health || !block->damage || block->damage > 15 ||
+      !block->magazine || block->ammo_low > block->magazine)
+    return false;
+
+  uint16_t error = block->ir_error;
+  if (error < CLOCK_USECS_PER_TICK ||
+      !config_ir_timing_valid(block->ir_header, error) ||
+      !config_ir_timing_valid(block->ir_mark_one, error) ||
+      !config_ir_timing_valid(block->ir_mark_zero, error) ||
+      !config_ir_timing_valid(block->ir_space, error) ||
+      !config_ir_timings_apart(block->ir_header, block->ir_mark_one, error) ||
+      !config_ir_timings_apart(block->ir_header, block->ir_mark_zero, error) ||
+      !config_ir_timings_apart(block->ir_mark_one, block->ir_mark_zero, error))
+    return false;
+
+  return block->uart_baud >= UART_MIN_BAUD && block->uart_baud <= UART_MAX_BAUD;
+}
+
+void config_init(void)
+{
+  nvm_read(CONFIG_EEPROM_START, &config, sizeof(config));
+  if (!config_valid(&config))
+  {
+    memcpy_P(&config, &config_defaults, sizeof(config));
+    config.crc = config_crc(&config);
+  }
+
+  config_state = CONFIG_STAGING;
+  config_staged_len = 0;
+}
+
+void config_cycle(void)
+{
+  if (config_state != CONFIG_SAVING || nvm_busy())
+    return;
+
+  /*
+   * The EE_READY ISR reads the staging area as it goes, so it is left alone
+   * until the block has been written.
+   */
+  if (!config_saved)
+  {
+    nvm_write(CONFIG_EEPROM_START, &config_staged, sizeof(config_staged));
+    config_saved = true;
+  }
+  else
+  {
+    config_state = CONFIG_STAGING;
+  }
+}
+
+bool config_stage(uint8_t offset, const uint8_t *data, uint8_t len)
+{
+  if (config_state == CONFIG_SAVING)
+    return false;
+
+  if (offset > config_staged_len || len > sizeof(config_staged) - offset)
+    return false;
+
+  /* A block which is written again replaces the pending one. */
+  config_state = CONFIG_STAGING;
+  memcpy((uint8_t *) &config_staged + offset, data, len);
+  if (offset + len > config_staged_len)
+    config_staged_len = offset + len;
+
+  if (config_staged_len == sizeof(config_staged))
+  {
+    config_staged_len = 0;
+    if (config_valid(&config_staged))
+      config_state = CONFIG_PENDING;
+  }
+
+  return true;
+}
+
+bool config_pending(void)
+{
+  return config_state == CONFIG_PENDING;
+}
+
+bool config_apply(void)
+{
+  if (config_state != CONFIG_PENDING)
+    return false;
+
+  config = config_staged;
+  config_state = CONFIG_SAVING;
+  config_saved = false;
+
+  ir_configure();
+  uart_configure();
+  uplink_configure();
+  return true;
+}
+
+void config_dump(void)
+{
+  static const char hex[] PROGMEM = "0123456789abcdef";
+
+  const uint8_t *bytes = (const uint8_t *) &config;
+  for (uint8_t i = 0; i < sizeof(config); i++)
+  {
+    uart_putc(pgm_read_byte(&hex[bytes[i] >> 4]));
+    uart_putc(pgm_read_byte(&hex[bytes[i] & 0xF]));
+  }
+  uart_puts_p(PSTR("\r\n"));
+}
@@ -0,0 +1,102 @@
+#ifndef LASERTAG_CONFIG_H
+#define LASERTAG_CONFIG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * The version of the layout of config_t, which must be incremented whenever
+ * it changes. A block with a different version is ignored.
+ */
+#define CONFIG_VERSION 1
+
+/* The bits of config_t's flags. */
+#define CONFIG_FRIENDLY_FIRE 0x01
+
+/*
+ * The configuration, which is stored at the start of the EEPROM (see nvm.h).
+ * Multi-byte values are little-endian, and times are in milliseconds unless
+ * otherwise stated.
+ */
+typedef struct
+{
+  uint8_t version;
+
+  /*
+   * The node ID which identifies this gun to the base station, other than
+   * MESH_BASE or MESH_BROADCAST.
+   */
+  uint8_t node;
+
+  /*
+   * This player's team (0-3), number within the game (0-63) and colours,
+   * each of which is one or more of the LED colours (see led.h).
+   */
+  uint8_t team, player;
+  uint8_t team_color, alt_color;
+  uint8_t flags;
+
+  /*
+   * The rules of the game. Damage is in units of GAME_DAMAGE_UNIT (1-15), and
+   * the health, damage and magazine can't be zero.
+   */
+  uint8_t health, damage, magazine, magazines, ammo_low;
+  uint16_t fire_ms, reload_ms, respawn_ms;
+
+  /*
+   * The length of the IR header, one/zero marks and spaces, and the
+   * acceptable error on either side, in microseconds. Each timing plus the
+   * error must be within IR_MAX_USECS (~2 ms), and the header, one and zero
+   * windows mustn't overlap.
+   */
+  uint16_t ir_header, ir_mark_one, ir_mark_zero, ir_space, ir_error;
+
+  /* Between UART_MIN_BAUD and UART_MAX_BAUD. */
+  uint32_t uart_baud;
+
+  /* The CRC of the rest of the block, calculated with _crc16_update(). */
+  uint16_t crc;
+} __attribute__((packed)) config_t;
+
+/*
+ * The configuration in use. This is only changed by config_apply(), so it may
+ * be read directly.
+ */
+extern config_t config;
+
+/*
+ * Loads the configuration from the EEPROM, or the defaults if the EEPROM
+ * doesn't hold a valid block. This must be called before the other modules
+ * are initialized.
+ */
+void config_init(void);
+
+/* Called regularly to save an applied configuration to the EEPROM. */
+void config_cycle(void);
+
+/*
+ * Writes part of a new configuration block into the staging area. The block
+ * must be written in order, although parts may be written again (e.g. if a
+ * frame is retransmitted). Once the whole block has been written, its CRC and
+ * values are checked and, if valid, it waits for config_apply(). Returns false
+ * if the part was out of order, or the previous block is still being saved.
+ */
+bool config_stage(uint8_t offset, const uint8_t *data, uint8_t len);
+
+/* Returns true if a valid block is waiting to be applied. */
+bool config_pending(void);
+
+/*
+ * Applies the staged block, if there is one, reconfiguring the drivers and
+ * saving it to the EEPROM in the background. This should be called between
+ * games, and returns true if the configuration changed.
+ */
+bool config_apply(void);
+
+/*
+ * Writes the configuration block to the UART in hex, in the form accepted by
+ * the console's 'C' command.
+ */
+void config_dump(void);
+
+#endif
@@ -0,0 +1,185 @@
+#include <lasertag/console.h>
+#include <avr/pgmspace.h>
+#include <lasertag/config.h>
+#include <lasertag/dedup.h>
+#include <lasertag/game.h>
+#include <lasertag/ir.h>
+#include <lasertag/profile.h>
+#include <lasertag/sched.h>
+#include <lasertag/speaker.h>
+#include <lasertag/stack.h>
+#include <lasertag/stats.h>
+#include <lasertag/trace.h>
+#include <lasertag/uart.h>
+
+/* The sound effect played by the next 'e' command. */
+static speaker_effect_t console_effect;
+
+/*
+ * The state of a 'C' command, which is followed by a configuration block in
+ * hex: whether one is being read, the offset of the next byte, and the high
+ * nibble of the byte being read or -1.
+ */
+static bool console_loading;
+static uint8_t console_offset;
+static int8_t console_nibble = -1;
+
+static int8_t console_hex(int c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  else if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  else if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  else
+    return -1;
+}
+
+/* Reads the next character of a configuration block. */
+static void console_load(int c)
+{
+  int8_t nibble = console_hex(c);
+  if (nibble < 0)
+  {
+    console_loading = false;
+    uart_puts_p(PSTR("config aborted\r\n"));
+    return;
+  }
+
+  if (console_nibble < 0)
+  {
+    console_nibble = nibble;
+    return;
+  }
+
+  uint8_t value = (console_nibble << 4) | nibble;
+  console_nibble = -1;
+
+  if (!config_stage(console_offset++, &value, 1))
+  {
+    console_loading = false;
+    uart_puts_p(PSTR("config busy\r\n"));
+  }
+  else if (console_offset == sizeof(config_t))
+  {
+    console_loading = false;
+    if (config_pending())
+      uart_puts_p(PSTR("config staged\r\n"));
+    else
+      uart_puts_p(PSTR("config invalid\r\n"));
+  }
+}
+
+/* Whether the IR receiver's edges are being captured. */
+static bool console_capturing;
+
+void console_cycle(void)
+{
+  ir_capture_cycle();
+
+  int c = uart_getc();
+  if (c < 0)
+    return;
+
+  /*
+   * A block arrives faster than the console is run, so all of the characters
+   * which have been received are read at once.
+   */
+  if (console_loading)
+  {
+    do
+      console_load(c);
+    while (console_loading && (c = uart_getc()) >= 0);
+    return;
+  }
+
+  switch (c)
+  {
+    case 'p':
+      if (PROFILE)
+        profile_dump();
+      break;
+
+    case 'P':
+      if (PROFILE)
+        profile_reset();
+      break;
+
+    case 'g':
+      game_dump();
+      dedup_dump();
+      break;
+
+    case 'G':
+      game_reset();
+      dedup_reset();
+      break;
+
+    case 'i':
+      ir_dump();
+      break;
+
+    case 'I':
+      ir_reset();
+      break;
+
+    case 'x':
+      if (IR_CAPTURE)
+      {
+        console_capturing = !console_capturing;
+        ir_capture(console_capturing);
+      }
+      break;
+
+    case 'k':
+      sched_dump();
+      break;
+
+    case 'K':
+      sched_reset();
+      break;
+
+    case 't':
+      trace_dump(false);
+      break;
+
+    case 'T':
+      if (TRACE_EEPROM)
+        trace_dump(true);
+      break;
+
+    case 'e':
+      /* Play each sound effect in turn. */
+      speaker_play(console_effect);
+      if (++console_effect == SPEAKER_EFFECTS)
+        console_effect = 0;
+      break;
+
+    case 'm':
+      stats_dump();
+      break;
+
+    case 'M':
+      game_restart();
+      break;
+
+    case 'c':
+      config_dump();
+      break;
+
+    case 'C':
+      console_loading = true;
+      console_offset = 0;
+      console_nibble = -1;
+      break;
+
+    case 's':
+      uart_puts_p(PSTR("stack used "));
+      uart_putu(stack_high_water());
+      uart_puts_p(PSTR(" free "));
+      uart_putu(stack_free());
+      uart_puts_p(PSTR("\r\n"));
+      break;
+  }
+}
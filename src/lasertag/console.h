@@ -0,0 +1,35 @@
+#ifndef LASERTAG_CONSOLE_H
+#define LASERTAG_CONSOLE_H
+
+/*
+ * Called regularly to write any captured IR edges to the UART, and to handle
+ * commands received over the UART. Each command is a single character:
+ *
+ *   p: dump the profiler results
+ *   P: clear the profiler results
+ *   g: dump the game's hit feedback latencies and the shot deduplication
+ *      counters
+ *   G: clear the game's hit feedback latencies and the shot deduplication
+ *      counters
+ *   k: dump the scheduler's task statistics
+ *   K: clear the scheduler's task statistics
+ *   i: dump the IR receiver's counters
+ *   I: clear the IR receiver's counters
+ *   x: start or stop capturing the IR receiver's edges (see ir_capture())
+ *   t: dump the trace buffer in SRAM
+ *   T: dump the trace buffer in EEPROM
+ *   e: play the next sound effect (each is played in turn)
+ *   m: dump the game statistics (see stats_dump())
+ *   M: start a new game, which clears the game statistics and applies any
+ *      staged configuration block
+ *   c: dump the configuration block in hex
+ *   C: stage a configuration block, given in hex straight after the command
+ *      (as written by 'c'), to be applied by the next 'M' - any character
+ *      which isn't a hex digit aborts it
+ *   s: report the stack high-water mark and the RAM which has never been used
+ *
+ * Commands for features which aren't enabled in the build are ignored.
+ */
+void console_cycle(void);
+
+#endif
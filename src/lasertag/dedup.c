@@ -0,0 +1,128 @@
+#include <lasertag/dedup.h>
+#include <avr/pgmspace.h>
+#include <lasertag/clock.h>
+#include <lasertag/uart.h>
+
+/*
+ * The number of sets and shots per set in the table. The number of sets must
+ * be a power of two, and the LRU bits only allow for two shots per set.
+ */
+#define DEDUP_SETS 4
+#define DEDUP_WAYS 2
+
+/*
+ * The window after the first copy of a shot in which the others are dropped,
+ * in clock ticks. This must be shorter than the time taken to fire enough
+ * shots for the sequence number to wrap around.
+ */
+#define DEDUP_WINDOW ((uint16_t) (100000UL / CLOCK_USECS_PER_TICK))
+
+/* Marks a slot in the table which holds a shot. */
+#define DEDUP_VALID 0x80
+
+typedef struct
+{
+  uint8_t shooter;
+
+  /* The sequence number, or'd with DEDUP_VALID if the slot is in use. */
+  uint8_t seq;
+  uint16_t time;
+} dedup_entry_t;
+
+static dedup_entry_t dedup_table[DEDUP_SETS][DEDUP_WAYS];
+
+/* A bit for each set, which is the way that was least recently seen. */
+static uint8_t dedup_lru;
+
+static uint16_t dedup_passed, dedup_suppressed, dedup_evicted;
+
+/*
+ * The shooter's player number is in the low bits and its team in the top two,
+ * so both are folded into the set index.
+ */
+static uint8_t dedup_hash(uint8_t shooter)
+{
+  return (shooter ^ (shooter >> 6)) & (DEDUP_SETS - 1);
+}
+
+void dedup_init(void)
+{
+  for (uint8_t set = 0; set < DEDUP_SETS; set++)
+  {
+    for (uint8_t way = 0; way < DEDUP_WAYS; way++)
+      dedup_table[set][way].seq = 0;
+  }
+  dedup_lru = 0;
+
+  dedup_reset();
+}
+
+bool dedup_seen(uint8_t shooter, uint8_t seq, uint16_t time)
+{
+  uint8_t set = dedup_hash(shooter);
+  dedup_entry_t *ways = dedup_table[set];
+  uint8_t key = seq | DEDUP_VALID;
+
+  for (uint8_t way = 0; way < DEDUP_WAYS; way++)
+  {
+    dedup_entry_t *entry = &ways[way];
+    if (entry->shooter == shooter && entry->seq == key &&
+        (uint16_t) (time - entry->time) < DEDUP_WINDOW)
+    {
+      /* The other way is now the least recently seen. */
+      if (way)
+        dedup_lru &= ~(1 << set);
+      else
+        dedup_lru |= 1 << set;
+
+      dedup_suppressed++;
+      return true;
+    }
+  }
+
+  /* Replace the least recently seen shot with this one. */
+  uint8_t way = (dedup_lru >> set) & 1;
+  dedup_entry_t *entry = &ways[way];
+  if ((entry->seq & DEDUP_VALID) && (uint16_t) (time - entry->time) < DEDUP_WINDOW)
+    dedup_evicted++;
+
+  entry->shooter = shooter;
+  entry->seq = key;
+  entry->time = time;
+  dedup_lru ^= 1 << set;
+
+  dedup_passed++;
+  return false;
+}
+
+void dedup_cycle(void)
+{
+  uint16_t now = clock_ticks();
+  for (uint8_t set = 0; set < DEDUP_SETS; set++)
+  {
+    for (uint8_t way = 0; way < DEDUP_WAYS; way++)
+    {
+      dedup_entry_t *entry = &dedup_table[set][way];
+      if ((uint16_t) (now - entry->time) >= DEDUP_WINDOW)
+        entry->seq &= ~DEDUP_VALID;
+    }
+  }
+}
+
+void dedup_dump(void)
+{
+  uart_puts_p(PSTR("dedup passed "));
+  uart_putu(dedup_passed);
+  uart_puts_p(PSTR(" suppressed "));
+  uart_putu(dedup_suppressed);
+  uart_puts_p(PSTR(" evicted "));
+  uart_putu(dedup_evicted);
+  uart_puts_p(PSTR("\r\n"));
+}
+
+void dedup_reset(void)
+{
+  dedup_passed = 0;
+  dedup_suppressed = 0;
+  dedup_evicted = 0;
+}
@@ -0,0 +1,44 @@
+#ifndef LASERTAG_DEDUP_H
+#define LASERTAG_DEDUP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Filters out repeated copies of the same shot, which arrive when it is
+ * reflected or seen by more than one sensor. A shot is identified by its
+ * shooter and sequence number, and any copies received within a short window
+ * of the first are duplicates.
+ *
+ * The shots are kept in a small set-associative table, indexed by a hash of
+ * the shooter, with the least recently seen shot in each set replaced when a
+ * new one arrives.
+ */
+
+/* Clears the table and the statistics. */
+void dedup_init(void);
+
+/*
+ * Returns true if the shot is a copy of one received within the window,
+ * otherwise records it and returns false. The time is the low 16 bits of the
+ * clock_ticks() at which it was received.
+ */
+bool dedup_seen(uint8_t shooter, uint8_t seq, uint16_t time);
+
+/*
+ * Called regularly (at least every ~150 ms, before the 16-bit times wrap
+ * around) to forget the shots whose window has passed.
+ */
+void dedup_cycle(void);
+
+/*
+ * Writes the number of shots passed and suppressed, and the number of shots
+ * replaced within their window (i.e. whose copies might not be suppressed as
+ * the table was too small) to the UART.
+ */
+void dedup_dump(void);
+
+/* Clears the statistics. */
+void dedup_reset(void);
+
+#endif
@@ -1,6 +1,82 @@
 #include <lasertag/game.h>
 #include <avr/io.h>
+#include <avr/pgmspace.h>
 #include <lasertag/button.h>
+#include <lasertag/clock.h>
+#include <lasertag/config.h>
+#include <lasertag/dedup.h>
+#include <lasertag/glyph.h>
+#include <lasertag/hud.h>
+#include <lasertag/ir.h>
+#include <lasertag/lcd.h>
+#include <lasertag/led.h>
+#include <lasertag/speaker.h>
+#include <lasertag/stats.h>
+#include <lasertag/uart.h>
+#include <lasertag/uplink.h>
+#include <stddef.h>
+
+/* Converts a time in milliseconds to clock ticks. */
+#define GAME_TICKS(ms) ((uint32_t) (ms) * 1000 / CLOCK_USECS_PER_TICK)
+
+/*
+ * The number of events in the queue. This must be a power of two, and is
+ * enough for every source to produce an event in the same cycle.
+ */
+#define GAME_QUEUE_SIZE 8
+
+/*
+ * The events handled by the state machine. The timer events are last, in the
+ * same order as the timers.
+ */
+typedef enum
+{
+  GAME_EVENT_TRIGGER,
+  GAME_EVENT_RELOAD,
+  GAME_EVENT_MODE,
+  GAME_EVENT_HIT,
+  GAME_EVENT_RELOADED,
+  GAME_EVENT_RESPAWN,
+  GAME_EVENTS
+} game_event_type_t;
+
+typedef enum
+{
+  GAME_TIMER_RELOAD,
+  GAME_TIMER_RESPAWN,
+  GAME_TIMERS
+} game_timer_t;
+
+#define GAME_EVENT_TIMER GAME_EVENT_RELOADED
+
+typedef enum
+{
+  GAME_STATE_ALIVE,
+  GAME_STATE_RELOADING,
+  GAME_STATE_DEAD,
+  GAME_STATES
+} game_state_t;
+
+typedef struct
+{
+  uint8_t type;
+
+  /* The packet and the tick at which it was received, for hit events. */
+  uint16_t packet;
+  uint16_t time;
+} game_event_t;
+
+/*
+ * Handles an event and returns the next state. Events without a handler in
+ * the current state are ignored.
+ */
+typedef game_state_t (*game_handler_t)(const game_event_t *event);
+
+/* The minimum and maximum latency of the hit feedback, in clock ticks. */
+typedef struct
+{
+  uint16_t min, max;
+} game_latency_t;
 
 static button_t button_trigger = {
   .ddr = &DDRD,
@@ -20,17 +96,419 @@ static button_t button_mode = {
   .button = PD7
 };
 
+static game_event_t game_queue[GAME_QUEUE_SIZE];
+static uint8_t game_queue_head, game_queue_tail;
+
+/* The time at which each timer expires, and a bitmask of the armed timers. */
+static uint32_t game_timer_due[GAME_TIMERS];
+static uint8_t game_timers_armed;
+
+static game_state_t game_state;
+static uint8_t game_health, game_ammo, game_magazines;
+static uint8_t game_seq;
+static uint32_t game_shot_at;
+
+/* The times from the configuration, converted to clock ticks. */
+static uint32_t game_fire_ticks, game_reload_ticks, game_respawn_ticks;
+
+/*
+ * The HUD: a health bar and number on the first row, and either the ammo or
+ * the time since the game started (toggled by the mode button) on the second.
+ */
+static hud_widget_t game_hud_health_bar = HUD_WIDGET(0, 0, 5);
+static hud_widget_t game_hud_health = HUD_WIDGET(5, 0, 3);
+static hud_widget_t game_hud_status = HUD_WIDGET(0, 1, 8);
+static bool game_show_clock;
+
+/* The seconds since the game started, and the tick at which the last began. */
+static uint16_t game_seconds;
+static uint32_t game_second_at;
+
+/* The previous state of each button, to find the edges. */
+static bool game_trigger_pressed, game_reload_pressed, game_mode_pressed;
+
+/*
+ * The latency statistics. The LCD's latency is measured when the game task
+ * next finds its queue empty, so it may be up to one period of the task late.
+ */
+static uint16_t game_hits;
+static game_latency_t game_feedback_latency, game_lcd_latency;
+static bool game_lcd_pending;
+static uint16_t game_lcd_hit_time;
+
+static void game_push(uint8_t type, uint16_t packet, uint16_t time)
+{
+  /* If the queue is full, the event is dropped. */
+  if ((uint8_t) (game_queue_tail - game_queue_head) == GAME_QUEUE_SIZE)
+    return;
+
+  game_event_t *event = &game_queue[game_queue_tail++ % GAME_QUEUE_SIZE];
+  event->type = type;
+  event->packet = packet;
+  event->time = time;
+}
+
+static void game_timer_start(game_timer_t timer, uint32_t ticks)
+{
+  game_timer_due[timer] = clock_ticks() + ticks;
+  game_timers_armed |= 1 << timer;
+}
+
+static void game_timer_stop(game_timer_t timer)
+{
+  game_timers_armed &= ~(1 << timer);
+}
+
+static void game_latency_record(game_latency_t *latency, uint16_t hit_time)
+{
+  uint16_t ticks = (uint16_t) clock_ticks() - hit_time;
+  if (ticks < latency->min)
+    latency->min = ticks;
+  if (ticks > latency->max)
+    latency->max = ticks;
+}
+
+static void game_latency_dump(const char *name, const game_latency_t *latency)
+{
+  uart_puts_p(name);
+  uart_putc(' ');
+  uart_putu(game_hits ? (uint32_t) latency->min * CLOCK_USECS_PER_TICK : 0);
+  uart_putc(' ');
+  uart_putu((uint32_t) latency->max * CLOCK_USECS_PER_TICK);
+}
+
+/* Shows the player's health on the first row of the LCD. */
+static void game_draw_health(void)
+{
+  hud_bar(&game_hud_health_bar, game_health, config.health);
+  hud_number(&game_hud_health, game_health);
+}
+
+/*
+ * Shows the ammo, or what the player is waiting for, or the clock on the
+ * second row.
+ */
+static void game_draw_status(game_state_t state)
+{
+  if (game_show_clock)
+  {
+    char buf[HUD_MAX_WIDTH] = "   ";
+    hud_format_timer(&buf[3], game_seconds);
+    hud_draw(&game_hud_status, buf);
+  }
+  else if (state == GAME_STATE_DEAD)
+  {
+    char buf[HUD_MAX_WIDTH] = " DEAD   ";
+    buf[0] = glyph_get(GLYPH_SKULL);
+    hud_draw(&game_hud_status, buf);
+  }
+  else if (state == GAME_STATE_RELOADING)
+  {
+    hud_draw_p(&game_hud_status, PSTR("RELOAD"));
+  }
+  else
+  {
+    char buf[HUD_MAX_WIDTH] = "  /     ";
+    hud_format_number(&buf[0], game_ammo, 2);
+    hud_format_number(&buf[3], game_magazines, 2);
+    hud_draw(&game_hud_status, buf);
+  }
+}
+
+/* Plays the background pattern which warns if the magazine is nearly empty. */
+static void game_show_ammo(void)
+{
+  led_pattern(game_ammo <= config.ammo_low ? LED_AMMO_LOW : LED_ALTERNATE);
+}
+
+static game_state_t game_reload(const game_event_t *event)
+{
+  (void) event;
+
+  if (game_magazines == 0 || game_ammo == config.magazine)
+    return game_state;
+
+  speaker_play(SPEAKER_RELOAD);
+  stats_reload();
+  uplink_event(UPLINK_EVENT_RELOAD, game_magazines);
+  game_timer_start(GAME_TIMER_RELOAD, game_reload_ticks);
+  game_draw_status(GAME_STATE_RELOADING);
+  return GAME_STATE_RELOADING;
+}
+
+static game_state_t game_fire(const game_event_t *event)
+{
+  uint32_t now = clock_ticks();
+  if (now - game_shot_at < game_fire_ticks)
+    return game_state;
+
+  /* Pulling the trigger with an empty magazine reloads. */
+  if (game_ammo == 0)
+    return game_reload(event);
+
+  /*
+   * If the transmitter is still busy with earlier shots, the trigger pull is
+   * ignored as though the gun wasn't ready to fire yet.
+   */
+  uint16_t packet = GAME_PACKET(config.team, config.player, config.damage, game_seq);
+  if (ir_tx(packet, IR_PRIORITY_SHOT) == IR_TX_FULL)
+    return game_state;
+
+  game_shot_at = now;
+  game_ammo--;
+  game_seq = (game_seq + 1) & 0xF;
+
+  speaker_play(SPEAKER_SHOT);
+  led_muz_flash();
+  stats_shot();
+  uplink_event(UPLINK_EVENT_SHOT, packet);
+
+  if (game_ammo == config.ammo_low)
+    game_show_ammo();
+  game_draw_status(GAME_STATE_ALIVE);
+  return GAME_STATE_ALIVE;
+}
+
+static game_state_t game_reloaded(const game_event_t *event)
+{
+  (void) event;
+
+  game_magazines--;
+  game_ammo = config.magazine;
+  game_show_ammo();
+  game_draw_status(GAME_STATE_ALIVE);
+  return GAME_STATE_ALIVE;
+}
+
+static game_state_t game_hit(const game_event_t *event)
+{
+  uint16_t packet = event->packet;
+
+  /* Ignore reflections of our own shots, and our team's unless allowed. */
+  if (GAME_PACKET_PLAYER(packet) == config.player && GAME_PACKET_TEAM(packet) == config.team)
+    return game_state;
+
+  if (!(config.flags & CONFIG_FRIENDLY_FIRE) && GAME_PACKET_TEAM(packet) == config.team)
+    return game_state;
+
+  uint8_t damage = GAME_PACKET_DAMAGE(packet) * GAME_DAMAGE_UNIT;
+  if (damage == 0)
+    return game_state;
+
+  game_state_t state = game_state;
+  game_health = damage < game_health ? game_health - damage : 0;
+
+  if (game_health == 0)
+  {
+    /* The reload is abandoned, and the LEDs fade out until the respawn. */
+    game_timer_stop(GAME_TIMER_RELOAD);
+    game_timer_start(GAME_TIMER_RESPAWN, game_respawn_ticks);
+    speaker_play(SPEAKER_HIT);
+    led_pattern(LED_FADE);
+    state = GAME_STATE_DEAD;
+  }
+  else
+  {
+    speaker_play(SPEAKER_HIT);
+    led_pattern(LED_STROBE);
+  }
+
+  game_draw_health();
+  if (state == GAME_STATE_DEAD)
+    game_draw_status(state);
+
+  game_hits++;
+  game_latency_record(&game_feedback_latency, event->time);
+  game_lcd_pending = true;
+  game_lcd_hit_time = event->time;
+
+  stats_hit(GAME_PACKET_SHOOTER(packet));
+  uplink_event(UPLINK_EVENT_HIT, GAME_PACKET_SHOOTER(packet));
+  if (state == GAME_STATE_DEAD)
+  {
+    stats_death();
+    uplink_event(UPLINK_EVENT_DEATH, GAME_PACKET_SHOOTER(packet));
+  }
+
+  return state;
+}
+
+static game_state_t game_mode(const game_event_t *event)
+{
+  (void) event;
+
+  game_show_clock = !game_show_clock;
+  game_draw_status(game_state);
+  return game_state;
+}
+
+static game_state_t game_respawn(const game_event_t *event)
+{
+  (void) event;
+
+  game_health = config.health;
+  game_ammo = config.magazine;
+  game_magazines = config.magazines;
+
+  speaker_play(SPEAKER_RESPAWN);
+  game_show_ammo();
+  uplink_event(UPLINK_EVENT_RESPAWN, 0);
+
+  game_draw_health();
+  game_draw_status(GAME_STATE_ALIVE);
+  return GAME_STATE_ALIVE;
+}
+
+/*
+ * The handler for each event in each state. A dead player ignores everything
+ * but the respawn timer and the mode button.
+ */
+static const game_handler_t game_handlers[GAME_STATES][GAME_EVENTS] PROGMEM = {
+  [GAME_STATE_ALIVE] = {
+    [GAME_EVENT_TRIGGER]  = game_fire,
+    [GAME_EVENT_RELOAD]   = game_reload,
+    [GAME_EVENT_MODE]     = game_mode,
+    [GAME_EVENT_HIT]      = game_hit
+  },
+  [GAME_STATE_RELOADING] = {
+    [GAME_EVENT_MODE]     = game_mode,
+    [GAME_EVENT_HIT]      = game_hit,
+    [GAME_EVENT_RELOADED] = game_reloaded
+  },
+  [GAME_STATE_DEAD] = {
+    [GAME_EVENT_MODE]     = game_mode,
+    [GAME_EVENT_RESPAWN]  = game_respawn
+  }
+};
+
+/* Queues an event for each button which has just been pressed. */
+static void game_poll_button(button_t *button, bool *pressed, uint8_t type)
+{
+  button_cycle(button);
+
+  if (button->pressed && !*pressed)
+    game_push(type, 0, 0);
+  *pressed = button->pressed;
+}
+
+/* Updates the rules and the team colours from the configuration. */
+static void game_configure(void)
+{
+  game_fire_ticks = GAME_TICKS(config.fire_ms);
+  game_reload_ticks = GAME_TICKS(config.reload_ms);
+  game_respawn_ticks = GAME_TICKS(config.respawn_ms);
+
+  led_team_on(config.team_color, config.alt_color);
+}
+
 void game_init(void)
 {
   button_init(&button_trigger);
   button_init(&button_reload);
   button_init(&button_mode);
+
+  dedup_init();
+  stats_init();
+  game_reset();
+  game_configure();
+  game_second_at = clock_ticks();
+
+  /* Start the game as though the player has just respawned. */
+  game_state = game_respawn(NULL);
+}
+
+void game_restart(void)
+{
+  if (config_apply())
+  {
+    game_configure();
+    uplink_event(UPLINK_EVENT_CONFIG, config.version);
+  }
+
+  stats_clear();
+
+  /* Forget everything which happened in the last game. */
+  game_timers_armed = 0;
+  game_queue_head = game_queue_tail;
+  game_shot_at = clock_ticks() - game_fire_ticks;
+  game_seconds = 0;
+  game_second_at = clock_ticks();
+  game_state = game_respawn(NULL);
 }
 
 void game_cycle(void)
 {
-  button_cycle(&button_trigger);
-  button_cycle(&button_reload);
-  button_cycle(&button_mode);
+  game_poll_button(&button_trigger, &game_trigger_pressed, GAME_EVENT_TRIGGER);
+  game_poll_button(&button_reload, &game_reload_pressed, GAME_EVENT_RELOAD);
+  game_poll_button(&button_mode, &game_mode_pressed, GAME_EVENT_MODE);
+
+  /* Copies of a shot which has already been seen are dropped here. */
+  dedup_cycle();
+
+  uint16_t packet, time;
+  while (ir_rx_timed(&packet, &time))
+  {
+    if (!dedup_seen(GAME_PACKET_SHOOTER(packet), GAME_PACKET_SEQ(packet), time))
+      game_push(GAME_EVENT_HIT, packet, time);
+  }
+
+  uint32_t now = clock_ticks();
+  for (uint8_t timer = 0; timer < GAME_TIMERS; timer++)
+  {
+    uint8_t mask = 1 << timer;
+    if ((game_timers_armed & mask) && (int32_t) (now - game_timer_due[timer]) >= 0)
+    {
+      game_timers_armed &= ~mask;
+      game_push(GAME_EVENT_TIMER + timer, 0, 0);
+    }
+  }
+
+  while (game_queue_head != game_queue_tail)
+  {
+    const game_event_t *event = &game_queue[game_queue_head++ % GAME_QUEUE_SIZE];
+
+    game_handler_t handler;
+    memcpy_P(&handler, &game_handlers[game_state][event->type], sizeof(handler));
+    if (handler)
+      game_state = handler(event);
+  }
+
+  /* Count the seconds for the clock, which is redrawn only if it's shown. */
+  if (clock_ticks() - game_second_at >= GAME_TICKS(1000))
+  {
+    game_second_at += GAME_TICKS(1000);
+    if (game_seconds != UINT16_MAX)
+      game_seconds++;
+    if (game_show_clock)
+      game_draw_status(game_state);
+  }
+
+  /* The statistics are written once the events have stopped for a while. */
+  stats_cycle();
+  config_cycle();
+
+  if (game_lcd_pending && lcd_idle())
+  {
+    game_latency_record(&game_lcd_latency, game_lcd_hit_time);
+    game_lcd_pending = false;
+  }
+}
+
+void game_dump(void)
+{
+  uart_puts_p(PSTR("hits "));
+  uart_putu(game_hits);
+  uart_putc(' ');
+  game_latency_dump(PSTR("feedback"), &game_feedback_latency);
+  uart_putc(' ');
+  game_latency_dump(PSTR("lcd"), &game_lcd_latency);
+  uart_puts_p(PSTR("\r\n"));
 }
 
+void game_reset(void)
+{
+  game_hits = 0;
+  game_feedback_latency.min = UINT16_MAX;
+  game_feedback_latency.max = 0;
+  game_lcd_latency = game_feedback_latency;
+}
@@ -1,8 +1,48 @@
 #ifndef LASERTAG_GAME_H
 #define LASERTAG_GAME_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * A shot is sent as a 16-bit IR packet, laid out as follows (most significant
+ * bit first):
+ *
+ *   2-bit team, 6-bit player, 4-bit damage, 4-bit sequence number
+ *
+ * The damage is in units of GAME_DAMAGE_UNIT health points, and the sequence
+ * number is incremented with each shot.
+ */
+#define GAME_PACKET(team, player, damage, seq) \
+  (((uint16_t) (team) << 14) | ((uint16_t) (player) << 8) | \
+   ((damage) << 4) | (seq))
+
+#define GAME_PACKET_TEAM(packet)    ((packet) >> 14)
+#define GAME_PACKET_PLAYER(packet)  (((packet) >> 8) & 0x3F)
+#define GAME_PACKET_SHOOTER(packet) ((packet) >> 8)
+#define GAME_PACKET_DAMAGE(packet)  (((packet) >> 4) & 0xF)
+#define GAME_PACKET_SEQ(packet)     ((packet) & 0xF)
+
+#define GAME_DAMAGE_UNIT 5
+
 void game_init(void);
 void game_cycle(void);
 
-#endif
+/*
+ * Starts a new game: applies any new configuration, clears the statistics and
+ * respawns the player.
+ */
+void game_restart(void);
+
+/*
+ * Writes the number of hits which caused damage, and the minimum and maximum
+ * time from each being received to the speaker and LEDs starting to play their
+ * feedback, and to the LCD showing the new health, to the UART. Times are in
+ * microseconds.
+ */
+void game_dump(void);
 
+/* Clears the statistics. */
+void game_reset(void);
+
+#endif
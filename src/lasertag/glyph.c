@@ -0,0 +1,95 @@
+#include <lasertag/glyph.h>
+#include <avr/pgmspace.h>
+#include <lasertag/lcd.h>
+
+/* Marks a slot whose contents are unknown, as at power on. */
+#define GLYPH_EMPTY 0xFF
+
+static const uint8_t glyph_bitmaps[GLYPHS][8] PROGMEM = {
+  [GLYPH_BAR_1] = { 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10 },
+  [GLYPH_BAR_2] = { 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18 },
+  [GLYPH_BAR_3] = { 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C },
+  [GLYPH_BAR_4] = { 0x1E, 0x1E, 0x1E, 0x1E, 0x1E, 0x1E, 0x1E, 0x1E },
+  [GLYPH_SKULL] = { 0x0E, 0x1F, 0x15, 0x1F, 0x1B, 0x0E, 0x0A, 0x00 }
+};
+
+/* The glyph in each slot, and the number of times it is on the screen. */
+static uint8_t glyph_slots[GLYPH_SLOTS] = {
+  GLYPH_EMPTY, GLYPH_EMPTY, GLYPH_EMPTY, GLYPH_EMPTY,
+  GLYPH_EMPTY, GLYPH_EMPTY, GLYPH_EMPTY, GLYPH_EMPTY
+};
+static uint8_t glyph_refs[GLYPH_SLOTS];
+
+/* The slots, from the most to the least recently used. */
+static uint8_t glyph_lru[GLYPH_SLOTS] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+
+/* Moves a slot to the front of the LRU list. */
+static void glyph_touch(uint8_t slot)
+{
+  uint8_t i = 0;
+  while (glyph_lru[i] != slot)
+    i++;
+
+  for (; i > 0; i--)
+    glyph_lru[i] = glyph_lru[i - 1];
+  glyph_lru[0] = slot;
+}
+
+/* Loads a glyph into a slot, only rewriting the rows which change. */
+static void glyph_load(uint8_t slot, glyph_t glyph)
+{
+  uint8_t rows[8];
+  memcpy_P(rows, glyph_bitmaps[glyph], sizeof(rows));
+
+  uint8_t first = 0, last = 7;
+  uint8_t old = glyph_slots[slot];
+  if (old != GLYPH_EMPTY)
+  {
+    while (first < 8 && rows[first] == pgm_read_byte(&glyph_bitmaps[old][first]))
+      first++;
+    while (last > first && rows[last] == pgm_read_byte(&glyph_bitmaps[old][last]))
+      last--;
+  }
+
+  if (first < 8)
+    lcd_make_char_rows(slot, first, last - first + 1, &rows[first]);
+  glyph_slots[slot] = glyph;
+}
+
+uint8_t glyph_get(glyph_t glyph)
+{
+  for (uint8_t slot = 0; slot < GLYPH_SLOTS; slot++)
+  {
+    if (glyph_slots[slot] == glyph)
+    {
+      glyph_touch(slot);
+      return slot;
+    }
+  }
+
+  /* Evict the least recently used glyph which isn't on the screen. */
+  for (uint8_t i = GLYPH_SLOTS; i > 0; i--)
+  {
+    uint8_t slot = glyph_lru[i - 1];
+    if (glyph_refs[slot] == 0)
+    {
+      glyph_load(slot, glyph);
+      glyph_touch(slot);
+      return slot;
+    }
+  }
+
+  return GLYPH_NONE;
+}
+
+void glyph_retain(uint8_t c)
+{
+  if (c < GLYPH_SLOTS)
+    glyph_refs[c]++;
+}
+
+void glyph_release(uint8_t c)
+{
+  if (c < GLYPH_SLOTS && glyph_refs[c])
+    glyph_refs[c]--;
+}
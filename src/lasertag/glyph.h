@@ -0,0 +1,46 @@
+#ifndef LASERTAG_GLYPH_H
+#define LASERTAG_GLYPH_H
+
+#include <stdint.h>
+
+/*
+ * The LCD has room for GLYPH_SLOTS custom characters, which are shown by
+ * writing character codes 0 to GLYPH_SLOTS - 1. The glyph cache loads the
+ * glyphs below into the slots as they are needed, evicting the least recently
+ * used glyph which isn't on the screen when they are all full.
+ *
+ * A glyph which is already loaded isn't uploaded again, and loading a glyph
+ * over another only rewrites the rows in which they differ.
+ */
+#define GLYPH_SLOTS 8
+
+/* Returned by glyph_get() if every slot holds a glyph which is on screen. */
+#define GLYPH_NONE '?'
+
+typedef enum
+{
+  /* Bar graph characters with 1 to 4 columns filled from the left. */
+  GLYPH_BAR_1,
+  GLYPH_BAR_2,
+  GLYPH_BAR_3,
+  GLYPH_BAR_4,
+
+  GLYPH_SKULL,
+  GLYPHS
+} glyph_t;
+
+/*
+ * Returns the character code which shows the glyph, loading it into a slot if
+ * it isn't already.
+ */
+uint8_t glyph_get(glyph_t glyph);
+
+/*
+ * Count the number of times each slot's character code is on the screen, so
+ * that glyphs which are being shown aren't evicted. Other character codes are
+ * ignored.
+ */
+void glyph_retain(uint8_t c);
+void glyph_release(uint8_t c);
+
+#endif
@@ -0,0 +1,215 @@
+#include <lasertag/hud.h>
+#include <avr/pgmspace.h>
+#include <lasertag/glyph.h>
+#include <lasertag/lcd.h>
+
+/* The number of decimal digits in a 16-bit number. */
+#define HUD_DIGITS 5
+
+/* The LCD's built-in full block character. */
+#define HUD_FULL_BLOCK '\xFF'
+
+/*
+ * Converts a number to HUD_DIGITS decimal digits, most significant first, with
+ * the double dabble algorithm: the number is shifted into a packed BCD value
+ * one bit at a time, and before each shift 3 is added to each digit which is 5
+ * or more, so that doubling it carries into the next digit.
+ */
+static void hud_bcd(uint16_t value, uint8_t digits[HUD_DIGITS])
+{
+  uint8_t high = 0, mid = 0, low = 0;
+
+  for (uint8_t bit = 0; bit < 16; bit++)
+  {
+    if ((low & 0x0F) >= 0x05)
+      low += 0x03;
+    if ((low & 0xF0) >= 0x50)
+      low += 0x30;
+    if ((mid & 0x0F) >= 0x05)
+      mid += 0x03;
+    if ((mid & 0xF0) >= 0x50)
+      mid += 0x30;
+    if (high >= 0x05)
+      high += 0x03;
+
+    high = (high << 1) | (mid >> 7);
+    mid = (mid << 1) | (low >> 7);
+    low = (low << 1) | (value >> 15);
+    value <<= 1;
+  }
+
+  digits[0] = high;
+  digits[1] = mid >> 4;
+  digits[2] = mid & 0x0F;
+  digits[3] = low >> 4;
+  digits[4] = low & 0x0F;
+}
+
+/* Formats a number below 100 as two digits. */
+static void hud_format_two_digits(char *buf, uint8_t value)
+{
+  /* This is exactly value / 10 for values below 100. */
+  uint8_t tens = ((uint16_t) value * 103) >> 10;
+  buf[0] = '0' + tens;
+  buf[1] = '0' + value - tens * 10;
+}
+
+void hud_format_number(char *buf, uint16_t value, uint8_t width)
+{
+  uint8_t digits[HUD_DIGITS];
+  hud_bcd(value, digits);
+
+  /* Find the first significant digit, keeping at least one for zero. */
+  uint8_t first = 0;
+  while (first < HUD_DIGITS - 1 && digits[first] == 0)
+    first++;
+
+  uint8_t len = HUD_DIGITS - first;
+  if (len > width)
+  {
+    for (uint8_t i = 0; i < width; i++)
+      buf[i] = '9';
+    return;
+  }
+
+  uint8_t pad = width - len;
+  for (uint8_t i = 0; i < pad; i++)
+    buf[i] = ' ';
+  for (uint8_t i = 0; i < len; i++)
+    buf[pad + i] = '0' + digits[first + i];
+}
+
+void hud_format_bar(char *buf, uint16_t value, uint16_t max, uint8_t width)
+{
+  if (value > max)
+    value = max;
+
+  /*
+   * Count the steps which are full, value * steps / max, by adding max until
+   * it passes value * steps. The bar is at most 40 steps long, so this is
+   * quicker than dividing.
+   */
+  uint8_t steps = width * HUD_BAR_STEPS;
+  uint32_t target = (uint32_t) value * steps;
+  uint32_t sum = max;
+  uint8_t filled = 0;
+  while (filled < steps && sum <= target)
+  {
+    filled++;
+    sum += max;
+  }
+
+  for (uint8_t i = 0; i < width; i++)
+  {
+    if (filled >= HUD_BAR_STEPS)
+    {
+      buf[i] = HUD_FULL_BLOCK;
+      filled -= HUD_BAR_STEPS;
+    }
+    else if (filled)
+    {
+      buf[i] = glyph_get(GLYPH_BAR_1 + filled - 1);
+      filled = 0;
+    }
+    else
+    {
+      buf[i] = ' ';
+    }
+  }
+}
+
+void hud_format_timer(char *buf, uint16_t secs)
+{
+  /* This is exactly secs / 60 for every 16-bit value. */
+  uint16_t mins = ((uint32_t) secs * 34953) >> 21;
+  secs -= mins * 60;
+
+  if (mins > 99)
+  {
+    mins = 99;
+    secs = 59;
+  }
+
+  hud_format_two_digits(buf, mins);
+  buf[2] = ':';
+  hud_format_two_digits(buf + 3, secs);
+}
+
+void hud_draw(hud_widget_t *widget, const char *text)
+{
+  /*
+   * The LCD moves its cursor along after each character, so it only needs to
+   * be moved when some unchanged characters are skipped.
+   */
+  bool placed = false;
+  for (uint8_t i = 0; i < widget->width; i++)
+  {
+    if (widget->drawn && widget->shown[i] == text[i])
+    {
+      placed = false;
+      continue;
+    }
+
+    if (!placed)
+    {
+      lcd_move_cursor(widget->col + i, widget->row);
+      placed = true;
+    }
+
+    lcd_putc((uint8_t) text[i]);
+
+    /* Keep the glyph cache from evicting the custom characters shown. */
+    if (widget->drawn)
+      glyph_release(widget->shown[i]);
+    glyph_retain(text[i]);
+    widget->shown[i] = text[i];
+  }
+
+  widget->drawn = true;
+}
+
+void hud_draw_p(hud_widget_t *widget, const char *text)
+{
+  char buf[HUD_MAX_WIDTH];
+  char c;
+  uint8_t i = 0;
+
+  while (i < widget->width && (c = pgm_read_byte(text++)))
+    buf[i++] = c;
+  while (i < widget->width)
+    buf[i++] = ' ';
+
+  hud_draw(widget, buf);
+}
+
+void hud_number(hud_widget_t *widget, uint16_t value)
+{
+  char buf[HUD_MAX_WIDTH];
+  hud_format_number(buf, value, widget->width);
+  hud_draw(widget, buf);
+}
+
+void hud_bar(hud_widget_t *widget, uint16_t value, uint16_t max)
+{
+  char buf[HUD_MAX_WIDTH];
+  hud_format_bar(buf, value, max, widget->width);
+  hud_draw(widget, buf);
+}
+
+void hud_timer(hud_widget_t *widget, uint16_t secs)
+{
+  char buf[HUD_TIMER_WIDTH];
+  hud_format_timer(buf, secs);
+  hud_draw(widget, buf);
+}
+
+void hud_invalidate(hud_widget_t *widget)
+{
+  if (widget->drawn)
+  {
+    for (uint8_t i = 0; i < widget->width; i++)
+      glyph_release(widget->shown[i]);
+  }
+
+  widget->drawn = false;
+}
@@ -0,0 +1,76 @@
+#ifndef LASERTAG_HUD_H
+#define LASERTAG_HUD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Widgets which draw numbers, bar graphs and timers on the LCD. Each widget
+ * remembers what it last showed, and only moves the cursor to and rewrites the
+ * characters which have changed since, so updating a number every frame costs
+ * one or two writes rather than a whole row.
+ *
+ * The text of a widget is built with the hud_format_*() functions, which don't
+ * divide (the AVR has no divide instruction, so each division is a call to a
+ * loop of a few hundred cycles), and drawn with hud_draw().
+ */
+
+/* The widest a widget may be, which is the width of the LCD. */
+#define HUD_MAX_WIDTH 8
+
+/* The number of steps in each character of a bar graph. */
+#define HUD_BAR_STEPS 5
+
+/* The width of a timer, formatted as mm:ss. */
+#define HUD_TIMER_WIDTH 5
+
+typedef struct
+{
+  uint8_t col, row, width;
+
+  /* The characters on the LCD, which are only known once drawn is true. */
+  bool drawn;
+  char shown[HUD_MAX_WIDTH];
+} hud_widget_t;
+
+#define HUD_WIDGET(col, row, width) { (col), (row), (width), false, { 0 } }
+
+/*
+ * Formats a number right-aligned in the given width, padded with spaces. A
+ * number which doesn't fit is shown as all 9s.
+ */
+void hud_format_number(char *buf, uint16_t value, uint8_t width);
+
+/*
+ * Formats a bar graph which is value / max full, in steps of 1 /
+ * (width * HUD_BAR_STEPS) rounded down. The partly full characters come from
+ * the glyph cache, so they are only loaded when they are needed (and not at
+ * startup, when the LCD's queue is too short to hold them and can't be emptied
+ * until interrupts are enabled).
+ */
+void hud_format_bar(char *buf, uint16_t value, uint16_t max, uint8_t width);
+
+/*
+ * Formats a number of seconds as mm:ss, up to 99:59. A timer widget must be
+ * HUD_TIMER_WIDTH wide.
+ */
+void hud_format_timer(char *buf, uint16_t secs);
+
+/*
+ * Draws the width characters of text which differ from those shown. The custom
+ * characters shown by widgets are never evicted from the glyph cache.
+ */
+void hud_draw(hud_widget_t *widget, const char *text);
+
+/* Draws the text in program memory, padded with spaces to the width. */
+void hud_draw_p(hud_widget_t *widget, const char *text);
+
+/* Shortcuts which format and draw a whole widget. */
+void hud_number(hud_widget_t *widget, uint16_t value);
+void hud_bar(hud_widget_t *widget, uint16_t value, uint16_t max);
+void hud_timer(hud_widget_t *widget, uint16_t secs);
+
+/* Forgets what the widget shows, so that the next draw rewrites all of it. */
+void hud_invalidate(hud_widget_t *widget);
+
+#endif
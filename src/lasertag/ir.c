@@ -1,12 +1,18 @@
 #include <lasertag/ir.h>
 #include <avr/interrupt.h>
 #include <avr/io.h>
+#include <avr/pgmspace.h>
 #include <lasertag/clock.h>
+#include <lasertag/config.h>
+#include <lasertag/profile.h>
+#include <lasertag/sched.h>
+#include <lasertag/timer.h>
+#include <lasertag/trace.h>
+#include <lasertag/uart.h>
 #include <stddef.h>
+#include <string.h>
 #include <util/atomic.h>
-
-/* The frequency of the infrared carrier. */
-#define IR_FREQ 38000
+#include <util/crc16.h>
 
 /*
  * The reciprocal of the duty cycle of the carrier, i.e. a value of 4 sets the
@@ -15,26 +21,27 @@
 #define IR_DUTY_RECIPROCAL 4
 
 /*
- * The length of header, one/zero marks and spaces in clock ticks. The last
- * value is the acceptable error on either side of the ideal value.
+ * The number of packets in the RX buffer and each priority's TX buffer. As the
+ * IR receiver can only manage around 800 bursts per second, the buffers can be
+ * kept small.
  */
-#define IR_HEADER    (1200 / CLOCK_USECS_PER_TICK)
-#define IR_MARK_ONE  (800  / CLOCK_USECS_PER_TICK)
-#define IR_MARK_ZERO (400  / CLOCK_USECS_PER_TICK)
-#define IR_SPACE     (400  / CLOCK_USECS_PER_TICK)
-#define IR_ERROR     (200  / CLOCK_USECS_PER_TICK)
+#define IR_BUF_SIZE 4
 
 /*
- * The RX timeout in clock ticks, this is slightly longer than the maximum
- * number of ticks that the carrier is expected to be turned on for.
+ * The minimum time between the end of a packet's last mark and the start of
+ * the next packet's header, in microseconds, which lets the receiver's AGC
+ * recover.
  */
-#define IR_TIMEOUT (IR_HEADER + IR_ERROR * 2)
+#define IR_TX_GAP 2000
 
 /*
- * The number of packets in the RX and TX buffers. As the IR receiver can only
- * manage around 800 bursts per second, the buffers can be kept small.
+ * The number of edges in the capture buffer, which must hold the edges of a
+ * few packets as the buffer is only emptied every 20ms by the console task.
  */
-#define IR_BUF_SIZE 4
+#define IR_CAPTURE_SIZE 64
+
+/* The maximum length of the edges in a capture chunk. */
+#define IR_CAPTURE_CHUNK 48
 
 /*
  * The possible states for the RX and TX state machines.
@@ -42,12 +49,14 @@
  *  IDLE: doing nothing
  *  MARK: transmitting or receiving a mark
  * SPACE: transmitting or receiving a space
+ *   GAP: waiting for IR_TX_GAP after transmitting a packet
  */
 typedef enum
 {
   IR_STATE_IDLE,
   IR_STATE_MARK,
-  IR_STATE_SPACE
+  IR_STATE_SPACE,
+  IR_STATE_GAP
 } ir_state_t;
 
 typedef struct
@@ -56,6 +65,56 @@ typedef struct
   volatile size_t head, tail;
 } ir_ringbuf_t;
 
+/*
+ * The length of a header, one/zero mark or space in clock ticks, and the
+ * range of lengths which the receiver accepts.
+ */
+typedef struct
+{
+  uint16_t len, min, max;
+} ir_timing_t;
+
+/* The timings, calculated from the configuration by ir_configure(). */
+static ir_timing_t ir_header, ir_mark_one, ir_mark_zero, ir_space;
+
+/*
+ * The symbols which a mark or space of a given length could be, as a bitmask.
+ * Where the zero and one windows overlap, the mark is taken to be a zero.
+ */
+#define IR_CLASS_HEADER 0x01
+#define IR_CLASS_ZERO   0x02
+#define IR_CLASS_ONE    0x04
+#define IR_CLASS_SPACE  0x08
+
+/*
+ * The classifier looks the length of a mark or space up in a table, so that
+ * the receiver takes the same time whatever the length, rather than comparing
+ * it against each window in turn. The table is indexed by the length in units
+ * of 2^IR_CLASS_SHIFT ticks (8 microseconds), and the last entry, which longer
+ * lengths are clamped to, is always empty. This limits the timings to ~2 ms.
+ *
+ * The edges of each window are moved to the 8 us steps, so a window may take
+ * lengths up to one tick (4 us) longer than its maximum, and its minimum may
+ * rise by up to a tick. The classes fit in a nibble, so two entries are packed
+ * into each byte, the even one in the low nibble, and the table takes 128
+ * bytes of SRAM rather than 256.
+ */
+#define IR_CLASS_SHIFT 1
+#define IR_CLASSES     256
+
+#if (((IR_CLASSES - 1) << IR_CLASS_SHIFT) - 1) * CLOCK_USECS_PER_TICK != IR_MAX_USECS
+#error "IR_MAX_USECS must be the end of the last non-empty class"
+#endif
+
+/* The classes of each length, built from the timings by ir_configure(). */
+static uint8_t ir_classes[IR_CLASSES / 2];
+
+/*
+ * The RX timeout in clock ticks, this is slightly longer than the maximum
+ * number of ticks that the carrier is expected to be turned on for.
+ */
+static uint16_t ir_timeout;
+
 /* The TX state. */
 static volatile ir_state_t ir_tx_state;
 static volatile uint16_t ir_tx_packet;
@@ -64,10 +123,54 @@ static uint8_t ir_tx_bit;
 /* The RX state. */
 static volatile ir_state_t ir_rx_state;
 static volatile uint16_t ir_rx_packet;
-static uint8_t ir_rx_bit, ir_rx_clock;
+static uint8_t ir_rx_bit;
+static uint32_t ir_rx_clock;
+
+/* The RX buffer, and the TX buffer for each priority. */
+static ir_ringbuf_t ir_rx_buf, ir_tx_bufs[IR_PRIORITIES];
+
+/* The clock tick at which each pending packet was queued. */
+static volatile uint32_t ir_tx_times[IR_PRIORITIES][IR_BUF_SIZE];
+
+/* The low 16 bits of the clock tick at which each received packet ended. */
+static volatile uint16_t ir_rx_times[IR_BUF_SIZE];
+
+/* The number of packets received, and dropped for each reason. */
+static uint16_t ir_received;
+static uint16_t ir_dropped[TRACE_IR_FULL];
+
+/* The TX counters for each priority, see ir_stats_t. */
+static uint16_t ir_sent[IR_PRIORITIES], ir_coalesced[IR_PRIORITIES];
+static uint16_t ir_full[IR_PRIORITIES], ir_wait_max[IR_PRIORITIES];
+
+static const char ir_name_header[] PROGMEM = " header ";
+static const char ir_name_space[] PROGMEM = " space ";
+static const char ir_name_mark[] PROGMEM = " mark ";
+static const char ir_name_edge[] PROGMEM = " edge ";
+static const char ir_name_timeout[] PROGMEM = " timeout ";
+static const char ir_name_full[] PROGMEM = " full ";
+
+static const char * const ir_drop_names[TRACE_IR_FULL] PROGMEM = {
+  ir_name_header,
+  ir_name_space,
+  ir_name_mark,
+  ir_name_edge,
+  ir_name_timeout,
+  ir_name_full
+};
 
-/* The TX and RX buffers. */
-static ir_ringbuf_t ir_rx_buf, ir_tx_buf;
+/*
+ * The capture state: whether edges are being captured, the clock tick of the
+ * previous edge, and the number of edges dropped since the last chunk.
+ *
+ * Each edge in the buffer is the time since the previous edge, with the level
+ * in the top bit.
+ */
+static volatile bool ir_capturing;
+static uint32_t ir_capture_at;
+static volatile uint8_t ir_capture_dropped;
+static volatile uint16_t ir_capture_buf[IR_CAPTURE_SIZE];
+static volatile uint8_t ir_capture_head, ir_capture_tail;
 
 static bool ir_ringbuf_empty(ir_ringbuf_t *ring)
 {
@@ -76,7 +179,7 @@ static bool ir_ringbuf_empty(ir_ringbuf_t *ring)
 
 static bool ir_ringbuf_full(ir_ringbuf_t *ring)
 {
-  return ((ring->head + 1) % IR_BUF_SIZE) == ring->tail;
+  return ((ring->tail + 1) % IR_BUF_SIZE) == ring->head;
 }
 
 static uint16_t ir_ringbuf_pop(ir_ringbuf_t *ring)
@@ -92,167 +195,124 @@ static void ir_ringbuf_push(ir_ringbuf_t *ring, uint16_t packet)
   ring->tail = (ring->tail + 1) % IR_BUF_SIZE;
 }
 
+static bool ir_ringbuf_contains(ir_ringbuf_t *ring, uint16_t packet)
+{
+  for (size_t i = ring->head; i != ring->tail; i = (i + 1) % IR_BUF_SIZE)
+  {
+    if (ring->buf[i] == packet)
+      return true;
+  }
+  return false;
+}
+
+/*
+ * The Timer1 channel A output compare mode bit which connects the carrier to
+ * PB1: mode 2 (non-inverting PWM), or mode 1 (toggle) if IR_RX_CAPTURE is set.
+ */
+#define IR_CARRIER_COM (IR_RX_CAPTURE ? COM1A0 : COM1A1)
+
 /*
  * The following functions turn the infrared carrier on and off by setting the
- * Timer1 channel A output compare mode to 2 and 0 respectively.
+ * Timer1 channel A output compare mode to the mode above and 0 respectively.
  */
 static void ir_carrier_on(void)
 {
-  TCCR1A |= (1 << COM1A1);
+  TCCR1A |= (1 << IR_CARRIER_COM);
 }
 
 static void ir_carrier_off(void)
 {
-  TCCR1A &= ~(1 << COM1A1);
+  TCCR1A &= ~(1 << IR_CARRIER_COM);
 }
 
-/*
- * Schedules an RX timeout interrupt.
- *
- * NB: interrupts must be disabled by the caller.
- */
-static void ir_schedule_timeout_intr(void)
+/* Converts a time from the configuration to clock ticks. */
+static uint16_t ir_ticks(uint16_t usecs)
 {
-  /* Disable the output compare interrupt. */
-  TIMSK2 &= ~(1 << OCIE2B);
-
-  /* Reset the output compare flag to mask an immediate interrupt. */
-  TIFR2 |= (1 << OCF2B);
-
-  /* Set how many clock ticks in the future the interrupt should be fired. */
-  OCR2B = TCNT2 + IR_TIMEOUT;
-
-  /* Enable the output compare interrupt. */
-  TIMSK2 |= (1 << OCIE2B);
+  return usecs / CLOCK_USECS_PER_TICK;
 }
 
-/*
- * Mask any further RX timeout interrupts.
- *
- * NB: interrupts must be disabled by the caller.
- */
-static void ir_mask_timeout_intr(void)
+static void ir_timing_init(ir_timing_t *timing, uint16_t usecs, uint16_t error,
+  uint8_t class)
 {
-  TIMSK2 &= ~(1 << OCIE2B);
-}
+  uint16_t len = ir_ticks(usecs);
+  timing->len = len;
+  timing->min = len > error ? len - error : 0;
+  timing->max = UINT16_MAX - len > error ? len + error : UINT16_MAX;
 
-/*
- * Schedules a transmit interrupt, which is used to change the state of the
- * carrier at the end of a mark or space, or to end the transmission.
- *
- * NB: interrupts must be disabled by the caller.
- */
-static void ir_schedule_tx_intr(uint8_t clock_ticks)
-{
-  /* Disable the output compare interrupt. */
-  TIMSK2 &= ~(1 << OCIE2A);
+  /*
+   * Mark the entries whose lengths (rounded down to the start of the entry)
+   * are within the window.
+   */
+  uint16_t first = (timing->min + (1 << IR_CLASS_SHIFT) - 1) >> IR_CLASS_SHIFT;
+  uint16_t last = timing->max >> IR_CLASS_SHIFT;
+  if (last > IR_CLASSES - 2)
+    last = IR_CLASSES - 2;
 
-  /* Reset the output compare flag to mask an immediate interrupt. */
-  TIFR2 |= (1 << OCF2A);
+  for (uint16_t i = first; i <= last; i++)
+    ir_classes[i >> 1] |= (i & 1) ? class << 4 : class;
+}
 
-  /* Set how many clcok ticks in the future the interrupt should be fired. */
-  OCR2A = TCNT2 + clock_ticks;
+/* Returns the classes of a mark or space of the given length in clock ticks. */
+static uint8_t ir_classify(uint16_t ticks)
+{
+  uint16_t i = ticks >> IR_CLASS_SHIFT;
+  if (i >= IR_CLASSES)
+    i = IR_CLASSES - 1;
 
-  /* Enable the output compare interrupt. */
-  TIMSK2 |= (1 << OCIE2A);
+  uint8_t classes = ir_classes[i >> 1];
+  return (i & 1) ? classes >> 4 : classes & 0xF;
 }
 
 /*
- * Mask any further transmit interrupts.
+ * Records that the packet being received was dropped, and resets the RX
+ * state.
  *
  * NB: interrupts must be disabled by the caller.
  */
-static void ir_mask_tx_intr(void)
-{
-  TIMSK2 &= ~(1 << OCIE2A);
-}
-
-/* Calculate the delta between clock ticks taking rollover into account. */
-static uint8_t ir_delta(uint8_t now, uint8_t prev)
+static void ir_rx_drop(trace_ir_drop_t reason)
 {
-  if (now >= prev)
-    return now - prev;
-  else
-    return UINT8_MAX - prev + now;
+  trace(TRACE_IR_DROP, (reason << 8) | ir_rx_bit);
+  ir_dropped[reason - 1]++;
+  ir_rx_state = IR_STATE_IDLE;
+  timer_cancel(TIMER_IR_RX);
 }
 
 /*
- * Start the transmission of a new packet - this is used in both ir_tx() and
- * the Timer2 ISR.
+ * Adds an edge to the capture buffer.
  *
  * NB: interrupts must be disabled by the caller.
  */
-static void ir_start_tx(uint16_t packet)
-{
-  ir_tx_state = IR_STATE_MARK;
-  ir_tx_packet = packet;
-  ir_tx_bit = 16;
-
-  ir_carrier_on();
-  ir_schedule_tx_intr(IR_HEADER);
-}
-
-ISR(TIMER2_COMPB_vect)
+static void ir_capture_edge(uint32_t now, bool rising)
 {
-  /* The receive operation has timed out, reset the RX state. */
-  ir_rx_state = IR_STATE_IDLE;
-  ir_mask_timeout_intr();
-}
-
-ISR(TIMER2_COMPA_vect)
-{
-  if (ir_tx_state == IR_STATE_MARK)
+  uint8_t next = (ir_capture_tail + 1) % IR_CAPTURE_SIZE;
+  if (next == ir_capture_head)
   {
-    /*
-     * This is the end of a mark period. Switch the carrier off and schedule
-     * the next interrupt to be triggered at the end of the space period.
-     */
-    ir_tx_state = IR_STATE_SPACE;
-    ir_carrier_off();
-    ir_schedule_tx_intr(IR_SPACE);
+    if (ir_capture_dropped != UINT8_MAX)
+      ir_capture_dropped++;
+    return;
   }
-  else
-  {
-    /* Check if the packet has been completely transmitted. */
-    if (ir_tx_bit-- == 0)
-    {
-      if (ir_ringbuf_empty(&ir_tx_buf))
-      {
-        /*
-         * The transmit buffer is empty, mask any further transmit interrupts
-         * and switch back to the idle state.
-         */
-        ir_tx_state = IR_STATE_IDLE;
-        ir_mask_tx_intr();
-      }
-      else
-      {
-        /* Start transmission of the next packet in the transmit buffer. */
-        ir_start_tx(ir_ringbuf_pop(&ir_tx_buf));
-      }
-      return;
-    }
 
-    /* Read the bit being transmitted. */
-    bool bit = (ir_tx_packet & (1 << ir_tx_bit));
+  uint32_t delta = now - ir_capture_at;
+  ir_capture_at = now;
 
-    /*
-     * Switch back to the mark state, varying the length of the mark depending
-     * on what the bit was, and re-enable the carrier.
-     */
-    ir_tx_state = IR_STATE_MARK;
-    ir_carrier_on();
-    ir_schedule_tx_intr(bit ? IR_MARK_ONE : IR_MARK_ZERO);
-  }
+  uint16_t edge = delta > IR_CAPTURE_MAX_DELTA ? IR_CAPTURE_MAX_DELTA : delta;
+  if (rising)
+    edge |= 0x8000;
+
+  ir_capture_buf[ir_capture_tail] = edge;
+  ir_capture_tail = next;
 }
 
-ISR(INT0_vect)
+/*
+ * Decodes an edge seen by the receiver at the given clock tick, where rising
+ * is true for the start of a mark.
+ *
+ * NB: interrupts must be disabled by the caller.
+ */
+static void ir_rx_edge(uint32_t now, bool rising)
 {
-  /* Record the current time. */
-  uint8_t now = TCNT2;
-
-  /* Read the PD2 pin, note that the TSOP is active low. */
-  bool rising = !(PIND & (1 << PD2));
+  if (IR_CAPTURE && ir_capturing)
+    ir_capture_edge(now, rising);
 
   if (ir_rx_state == IR_STATE_IDLE && rising)
   {
@@ -271,9 +331,9 @@ ISR(INT0_vect)
      * This means the rising edge of an existing packet was detected - i.e. the
      * end of a space/start of the a mark.
      */
-    uint8_t delta = ir_delta(now, ir_rx_clock);
+    uint8_t class = ir_classify(now - ir_rx_clock);
 
-    if (delta >= (IR_SPACE - IR_ERROR) && delta <= (IR_SPACE + IR_ERROR))
+    if (class & IR_CLASS_SPACE)
     {
       /* Time the next mark. */
       ir_rx_clock = now;
@@ -282,8 +342,7 @@ ISR(INT0_vect)
     else
     {
       /* Corrupted packet - drop it. */
-      ir_rx_state = IR_STATE_IDLE;
-      ir_mask_timeout_intr();
+      ir_rx_drop(TRACE_IR_BAD_SPACE);
       return;
     }
   }
@@ -292,12 +351,12 @@ ISR(INT0_vect)
     /*
      * This means a falling edge was detected - i.e. this is the end of a mark.
      */
-    uint8_t delta = ir_delta(now, ir_rx_clock);
+    uint8_t class = ir_classify(now - ir_rx_clock);
 
     if (ir_rx_bit == 16)
     {
       /* This means we are looking for the header mark. */
-      if (delta >= (IR_HEADER - IR_ERROR) && delta <= (IR_HEADER + IR_ERROR))
+      if (class & IR_CLASS_HEADER)
       {
         /* Time the next space. */
         ir_rx_clock = now;
@@ -307,34 +366,27 @@ ISR(INT0_vect)
       else
       {
         /* Corrupted packet - drop it. */
-        ir_rx_state = IR_STATE_IDLE;
-        ir_mask_timeout_intr();
+        ir_rx_drop(TRACE_IR_BAD_HEADER);
         return;
       }
     }
     else
     {
       /* This means we are looking for a zero or one mark. */
-      if (delta >= (IR_MARK_ZERO - IR_ERROR) && delta <= (IR_MARK_ZERO + IR_ERROR))
-      {
-        /*
-         * As the packet buffer is initialized to zero we don't need to set a
-         * bit here.
-         */
-      }
-      else if (delta >= (IR_MARK_ONE - IR_ERROR) && delta <= (IR_MARK_ONE + IR_ERROR))
-      {
-        /* Set the bit in the RX packet buffer. */
-        ir_rx_packet |= (1 << ir_rx_bit);
-      }
-      else
+      if (!(class & (IR_CLASS_ZERO | IR_CLASS_ONE)))
       {
         /* Corrupted packet - drop it. */
-        ir_rx_state = IR_STATE_IDLE;
-        ir_mask_timeout_intr();
+        ir_rx_drop(TRACE_IR_BAD_MARK);
         return;
       }
 
+      /*
+       * As the packet buffer is initialized to zero, only a one needs to set
+       * a bit.
+       */
+      if (class & IR_CLASS_ONE)
+        ir_rx_packet |= (1 << ir_rx_bit);
+
       /* Check if a whole packet has now been received. */
       if (ir_rx_bit == 0)
       {
@@ -345,10 +397,23 @@ ISR(INT0_vect)
          * If the RX buffer is full, all we can do is drop the packet.
          */
         if (!ir_ringbuf_full(&ir_rx_buf))
+        {
+          trace(TRACE_IR_RX, ir_rx_packet);
+          ir_rx_times[ir_rx_buf.tail] = now;
           ir_ringbuf_push(&ir_rx_buf, ir_rx_packet);
+          ir_received++;
+
+          /* Let the game handle the packet straight away. */
+          sched_wake(SCHED_GAME);
+        }
+        else
+        {
+          ir_rx_drop(TRACE_IR_FULL);
+          return;
+        }
 
         ir_rx_state = IR_STATE_IDLE;
-        ir_mask_timeout_intr();
+        timer_cancel(TIMER_IR_RX);
         return;
       }
       else
@@ -367,14 +432,188 @@ ISR(INT0_vect)
      * interrupt was missed or we're processing things too slowly to keep up.)
      *
      * There isn't much that can be done aside from dropping the current
-     * packet.
+     * packet. The stray edges of a packet which has already been dropped
+     * aren't worth recording.
      */
-    ir_rx_state = IR_STATE_IDLE;
-    ir_mask_timeout_intr();
+    if (ir_rx_state != IR_STATE_IDLE)
+      ir_rx_drop(TRACE_IR_BAD_EDGE);
     return;
   }
 
-  ir_schedule_timeout_intr();
+  timer_at(TIMER_IR_RX, now + ir_timeout);
+}
+
+/*
+ * Decodes the edge latched by Timer1's input capture unit.
+ *
+ * NB: interrupts must be disabled by the caller.
+ */
+static void ir_rx_capture(void)
+{
+  uint16_t capture = ICR1;
+  uint32_t now = clock_ticks();
+  uint16_t count = TCNT1;
+
+  /*
+   * Between packets, Timer1 counts every cycle up to 65535, so how long ago
+   * the edge was latched is known exactly unless it was over 4 ms ago. While a
+   * packet is being transmitted, Timer1 wraps around with the carrier, so
+   * the edge is timed by when this runs instead, as by INT0.
+   */
+  if (!(TCCR1B & (1 << WGM13)))
+    now -= (uint16_t) (count - capture) / CLOCK_PRESCALER;
+
+  /*
+   * The comparator's output is high while the TSOP's output is below the
+   * reference, i.e. during a mark, so a rising edge is the start of one.
+   */
+  bool rising = TCCR1B & (1 << ICES1);
+
+  /*
+   * Wait for the opposite edge to the comparator's current output, so that if
+   * an edge was missed the decoder sees two edges in the same direction. The
+   * input capture flag must be cleared after changing the edge.
+   */
+  if (ACSR & (1 << ACO))
+    TCCR1B &= ~(1 << ICES1);
+  else
+    TCCR1B |= (1 << ICES1);
+  TIFR1 = (1 << ICF1);
+
+  ir_rx_edge(now, rising);
+}
+
+/*
+ * If IR_RX_CAPTURE is set, switches Timer1 to generating the carrier (mode
+ * 15 - fast PWM with the TOP value stored in the OCR1A register) while a
+ * packet is being transmitted, or back to counting freely (mode 0 - normal
+ * operation) afterwards. An edge which has already been latched is decoded
+ * first, as its time can only be worked out in the mode it was latched in.
+ *
+ * NB: interrupts must be disabled by the caller.
+ */
+static void ir_timer1_carrier(bool carrier)
+{
+  if (!IR_RX_CAPTURE)
+    return;
+
+  if (TIFR1 & (1 << ICF1))
+    ir_rx_capture();
+
+  if (carrier)
+  {
+    /* Start counting from zero, so TCNT1 is below TOP when mode 15 starts. */
+    TCNT1 = 0;
+    TCCR1A |= (1 << WGM11) | (1 << WGM10);
+    TCCR1B |= (1 << WGM12) | (1 << WGM13);
+  }
+  else
+  {
+    TCCR1A &= ~((1 << WGM11) | (1 << WGM10));
+    TCCR1B &= ~((1 << WGM12) | (1 << WGM13));
+  }
+}
+
+/*
+ * Start the transmission of a new packet of the given priority, which has
+ * waited for the given number of clock ticks - this is used in both ir_tx()
+ * and the timer handler.
+ *
+ * NB: interrupts must be disabled by the caller.
+ */
+static void ir_start_tx(uint16_t packet, ir_priority_t priority, uint32_t wait)
+{
+  trace(TRACE_IR_TX, packet);
+  ir_sent[priority]++;
+  if (wait > ir_wait_max[priority])
+    ir_wait_max[priority] = wait > UINT16_MAX ? UINT16_MAX : wait;
+
+  ir_tx_state = IR_STATE_MARK;
+  ir_tx_packet = packet;
+  ir_tx_bit = 16;
+
+  ir_timer1_carrier(true);
+  ir_carrier_on();
+  timer_after(TIMER_IR_TX, ir_header.len);
+}
+
+void ir_rx_timeout(void)
+{
+  /* The receive operation has timed out, reset the RX state. */
+  ir_rx_drop(TRACE_IR_TIMEOUT);
+}
+
+void ir_tx_timer(void)
+{
+  if (ir_tx_state == IR_STATE_MARK)
+  {
+    /*
+     * This is the end of a mark period. Switch the carrier off and schedule
+     * the next interrupt to be triggered at the end of the space period, or
+     * the gap if the packet has been completely transmitted.
+     */
+    ir_carrier_off();
+    if (ir_tx_bit == 0)
+    {
+      ir_timer1_carrier(false);
+      ir_tx_state = IR_STATE_GAP;
+      timer_again(TIMER_IR_TX, ir_ticks(IR_TX_GAP));
+    }
+    else
+    {
+      ir_tx_state = IR_STATE_SPACE;
+      timer_again(TIMER_IR_TX, ir_space.len);
+    }
+  }
+  else if (ir_tx_state == IR_STATE_GAP)
+  {
+    /* Start transmission of the next packet of the highest priority. */
+    for (uint8_t priority = 0; priority < IR_PRIORITIES; priority++)
+    {
+      ir_ringbuf_t *ring = &ir_tx_bufs[priority];
+      if (!ir_ringbuf_empty(ring))
+      {
+        uint32_t wait = clock_ticks() - ir_tx_times[priority][ring->head];
+        ir_start_tx(ir_ringbuf_pop(ring), priority, wait);
+        return;
+      }
+    }
+
+    /* The transmit buffers are empty, switch back to the idle state. */
+    ir_tx_state = IR_STATE_IDLE;
+  }
+  else
+  {
+    ir_tx_bit--;
+
+    /* Read the bit being transmitted. */
+    bool bit = (ir_tx_packet & (1 << ir_tx_bit));
+
+    /*
+     * Switch back to the mark state, varying the length of the mark depending
+     * on what the bit was, and re-enable the carrier.
+     */
+    ir_tx_state = IR_STATE_MARK;
+    ir_carrier_on();
+    timer_again(TIMER_IR_TX, bit ? ir_mark_one.len : ir_mark_zero.len);
+  }
+}
+
+ISR(INT0_vect)
+{
+  PROFILE_SCOPE(PROFILE_INT0);
+
+  /* Record the current time. */
+  uint32_t now = clock_ticks();
+
+  /* Read the PD2 pin, note that the TSOP is active low. */
+  ir_rx_edge(now, !(PIND & (1 << PD2)));
+}
+
+ISR(TIMER1_CAPT_vect)
+{
+  PROFILE_SCOPE(PROFILE_TIMER1_CAPT);
+  ir_rx_capture();
 }
 
 void ir_init(void)
@@ -382,6 +621,42 @@ void ir_init(void)
   /* Set PB1 (IR LED) to be an output. */
   DDRB |= (1 << PB1);
 
+  if (IR_RX_CAPTURE)
+  {
+    /*
+     * Compare ADC6 (IR receiver) against the bandgap reference, and route the
+     * output of the comparator to Timer1's input capture unit. The ADC itself
+     * is never enabled, but the comparator can only use its multiplexer while
+     * it is powered up, and main() powers it down.
+     */
+    PRR &= ~(1 << PRADC);
+    ADCSRB |= (1 << ACME);
+    ADMUX = IR_RX_ADC;
+    ACSR = (1 << ACBG) | (1 << ACIC);
+
+    /*
+     * Configure Timer1 to count every cycle, latching the count in ICR1 at
+     * each edge. While a packet is being transmitted, ir_timer1_carrier()
+     * makes it toggle PB1 each time TCNT1 reaches OCR1A, at which point it is
+     * reset back to zero (channel A compare output mode 1). This generates
+     * the carrier at IR_FREQ with a 50% duty cycle.
+     *
+     * The noise canceler is enabled, and the first edge captured is the start
+     * of a mark (a rising edge of the comparator's output).
+     */
+    TCCR1A = 0;
+    TCCR1B = (1 << ICNC1) | (1 << ICES1) | (1 << CS10);
+    TCCR1C = 0;
+
+    OCR1A = IR_TIMER1_PERIOD - 1;
+
+    TIFR1 = (1 << ICF1);
+    TIMSK1 |= (1 << ICIE1);
+
+    ir_configure();
+    return;
+  }
+
   /* Set PD2 (IR receiver) to be an input. */
   DDRD &= ~(1 << PD2);
 
@@ -416,43 +691,92 @@ void ir_init(void)
   TCCR1B = (1 << WGM12) | (1 << WGM13) | (1 << CS10);
   TCCR1C = 0;
 
-  uint16_t ticks = F_CPU / IR_FREQ - 1;
+  uint16_t ticks = IR_TIMER1_PERIOD - 1;
   ICR1 = ticks;
   OCR1A = ticks / IR_DUTY_RECIPROCAL;
+
+  ir_configure();
+}
+
+void ir_configure(void)
+{
+  uint16_t error = ir_ticks(config.ir_error);
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    memset(ir_classes, 0, sizeof(ir_classes));
+    ir_timing_init(&ir_header, config.ir_header, error, IR_CLASS_HEADER);
+    ir_timing_init(&ir_mark_one, config.ir_mark_one, error, IR_CLASS_ONE);
+    ir_timing_init(&ir_mark_zero, config.ir_mark_zero, error, IR_CLASS_ZERO);
+    ir_timing_init(&ir_space, config.ir_space, error, IR_CLASS_SPACE);
+
+    for (uint8_t i = 0; i < sizeof(ir_classes); i++)
+    {
+      if (ir_classes[i] & IR_CLASS_ZERO)
+        ir_classes[i] &= ~IR_CLASS_ONE;
+      if (ir_classes[i] & (IR_CLASS_ZERO << 4))
+        ir_classes[i] &= ~(IR_CLASS_ONE << 4);
+    }
+
+    uint32_t timeout = (uint32_t) ir_header.max + error;
+    ir_timeout = timeout > UINT16_MAX ? UINT16_MAX : timeout;
+  }
 }
 
-void ir_tx(uint16_t packet)
+ir_tx_status_t ir_tx(uint16_t packet, ir_priority_t priority)
 {
+  ir_tx_status_t status = IR_TX_QUEUED;
+
   ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
   {
+    PROFILE_SCOPE(PROFILE_IR_TX);
+    ir_ringbuf_t *ring = &ir_tx_bufs[priority];
+
     if (ir_tx_state == IR_STATE_IDLE)
     {
       /*
        * If the transmitter is idle, we can bypass the buffer completely and
        * start transmitting the packet.
        */
-      ir_start_tx(packet);
+      ir_start_tx(packet, priority, 0);
+    }
+    else if (ir_ringbuf_contains(ring, packet))
+    {
+      ir_coalesced[priority]++;
+      status = IR_TX_COALESCED;
+    }
+    else if (ir_ringbuf_full(ring))
+    {
+      ir_full[priority]++;
+      status = IR_TX_FULL;
     }
     else
     {
-      /*
-       * Push the packet onto the transmit buffer. If the buffer is full, the
-       * packet is dropped.
-       */
-      if (!ir_ringbuf_full(&ir_tx_buf))
-        ir_ringbuf_push(&ir_tx_buf, packet);
+      /* Push the packet onto the transmit buffer. */
+      ir_tx_times[priority][ring->tail] = clock_ticks();
+      ir_ringbuf_push(ring, packet);
     }
   }
+
+  return status;
 }
 
 bool ir_rx(uint16_t *packet)
+{
+  uint16_t ticks;
+  return ir_rx_timed(packet, &ticks);
+}
+
+bool ir_rx_timed(uint16_t *packet, uint16_t *ticks)
 {
   bool success = false;
   ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
   {
+    PROFILE_SCOPE(PROFILE_IR_RX);
     if (!ir_ringbuf_empty(&ir_rx_buf))
     {
       /* Pop a packet from the receive buffer. */
+      *ticks = ir_rx_times[ir_rx_buf.head];
       *packet = ir_ringbuf_pop(&ir_rx_buf);
       success = true;
     }
@@ -460,3 +784,155 @@ bool ir_rx(uint16_t *packet)
   return success;
 }
 
+void ir_stats(ir_stats_t *stats)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    stats->received = ir_received;
+    for (uint8_t i = 0; i < TRACE_IR_FULL; i++)
+      stats->dropped[i] = ir_dropped[i];
+
+    for (uint8_t i = 0; i < IR_PRIORITIES; i++)
+    {
+      stats->sent[i] = ir_sent[i];
+      stats->coalesced[i] = ir_coalesced[i];
+      stats->full[i] = ir_full[i];
+      stats->wait_max[i] = ir_wait_max[i];
+    }
+  }
+}
+
+void ir_dump(void)
+{
+  ir_stats_t stats;
+  ir_stats(&stats);
+
+  uart_puts_p(PSTR("ir received "));
+  uart_putu(stats.received);
+  for (uint8_t i = 0; i < TRACE_IR_FULL; i++)
+  {
+    uart_puts_p(pgm_read_ptr(&ir_drop_names[i]));
+    uart_putu(stats.dropped[i]);
+  }
+  uart_puts_p(PSTR("\r\n"));
+
+  for (uint8_t i = 0; i < IR_PRIORITIES; i++)
+  {
+    uart_puts_p(PSTR("ir tx "));
+    uart_putu(i);
+    uart_puts_p(PSTR(" sent "));
+    uart_putu(stats.sent[i]);
+    uart_puts_p(PSTR(" coalesced "));
+    uart_putu(stats.coalesced[i]);
+    uart_puts_p(PSTR(" full "));
+    uart_putu(stats.full[i]);
+    uart_puts_p(PSTR(" wait "));
+    uart_putu((uint32_t) stats.wait_max[i] * CLOCK_USECS_PER_TICK);
+    uart_puts_p(PSTR("\r\n"));
+  }
+}
+
+void ir_reset(void)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    ir_received = 0;
+    for (uint8_t i = 0; i < TRACE_IR_FULL; i++)
+      ir_dropped[i] = 0;
+
+    for (uint8_t i = 0; i < IR_PRIORITIES; i++)
+      ir_sent[i] = ir_coalesced[i] = ir_full[i] = ir_wait_max[i] = 0;
+  }
+}
+
+void ir_capture(bool enable)
+{
+  if (!IR_CAPTURE)
+    return;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    ir_capture_head = ir_capture_tail = 0;
+    ir_capture_dropped = 0;
+    ir_capture_at = clock_ticks();
+    ir_capturing = enable;
+  }
+}
+
+/* Appends an edge to a chunk, returning the chunk's new length. */
+static uint8_t ir_capture_encode(uint8_t *chunk, uint8_t len, uint16_t edge)
+{
+  uint16_t delta = edge & IR_CAPTURE_MAX_DELTA;
+  uint8_t value = ((edge >> 8) & 0x80) | (delta & 0x3F);
+  delta >>= 6;
+  if (delta)
+    value |= 0x40;
+  chunk[len++] = value;
+
+  while (delta)
+  {
+    value = delta & 0x7F;
+    delta >>= 7;
+    if (delta)
+      value |= 0x80;
+    chunk[len++] = value;
+  }
+
+  return len;
+}
+
+static void ir_capture_put(uint8_t value, uint16_t *crc)
+{
+  uart_putc(value);
+  *crc = _crc16_update(*crc, value);
+}
+
+void ir_capture_cycle(void)
+{
+  if (!IR_CAPTURE || !ir_capturing)
+    return;
+
+  for (;;)
+  {
+    uint8_t chunk[IR_CAPTURE_CHUNK];
+    uint8_t len = 0, dropped;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      dropped = ir_capture_dropped;
+      ir_capture_dropped = 0;
+    }
+
+    /* Leave room for the longest encoding of an edge. */
+    bool empty = false;
+    while (!empty && len <= IR_CAPTURE_CHUNK - 3)
+    {
+      ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+      {
+        empty = ir_capture_head == ir_capture_tail;
+        if (!empty)
+        {
+          len = ir_capture_encode(chunk, len, ir_capture_buf[ir_capture_head]);
+          ir_capture_head = (ir_capture_head + 1) % IR_CAPTURE_SIZE;
+        }
+      }
+    }
+
+    if (len == 0 && dropped == 0)
+      return;
+
+    uint16_t crc = 0xFFFF;
+    uart_putc('L');
+    uart_putc('I');
+    ir_capture_put(CLOCK_USECS_PER_TICK, &crc);
+    ir_capture_put(dropped, &crc);
+    ir_capture_put(len, &crc);
+    for (uint8_t i = 0; i < len; i++)
+      ir_capture_put(chunk[i], &crc);
+    uart_putc(crc & 0xFF);
+    uart_putc(crc >> 8);
+
+    if (empty)
+      return;
+  }
+}
@@ -1,17 +1,110 @@
 #ifndef LASERTAG_IR_H
 #define LASERTAG_IR_H
 
+#include <lasertag/trace.h>
 #include <stdbool.h>
 #include <stdint.h>
 
+/*
+ * If true, ir_capture() can be used to stream the edges seen by the receiver
+ * to the UART, so that they can be replayed through the decoder on the host
+ * with tools/irreplay.
+ */
+#ifndef IR_CAPTURE
+#define IR_CAPTURE false
+#endif
+
+/*
+ * If true, the receiver is timed by Timer1's input capture unit instead of
+ * INT0, so each edge is latched by the hardware to the cycle however late its
+ * ISR runs. The TSOP is then wired to ADC6 (IR_RX_ADC), which the analog
+ * comparator compares against the 1.1V bandgap reference, rather than PD2.
+ *
+ * Between packets, Timer1 counts freely, so an edge is timed exactly as long
+ * as its ISR runs within 4 ms. While a packet is being transmitted, Timer1
+ * generates the carrier by toggling PB1 (which fixes its duty cycle at 50%)
+ * and wraps around every ~13 us, so edges are timed by their ISR, as by INT0.
+ * The decoder still works in clock ticks: each edge is converted to the tick
+ * it was latched in, which is finer than the decoder's 8 us classes. This
+ * build can't be profiled, as the profiler needs Timer1's period to be fixed.
+ */
+#ifndef IR_RX_CAPTURE
+#define IR_RX_CAPTURE false
+#endif
+
+/* The ADC multiplexer input the TSOP is wired to if IR_RX_CAPTURE is set. */
+#define IR_RX_ADC 6
+
+/*
+ * The longest mark or space, in microseconds, which the receiver can classify.
+ * Each configured timing plus the error must be within this.
+ */
+#define IR_MAX_USECS 2036
+
+/* The frequency of the infrared carrier. */
+#define IR_FREQ 38000
+
+/*
+ * The period of Timer1 in cycles while it generates the carrier, which is that
+ * of the carrier, or half of it if IR_RX_CAPTURE is set. The profiler builds
+ * its timebase from Timer1.
+ */
+#define IR_TIMER1_PERIOD (IR_RX_CAPTURE ? F_CPU / IR_FREQ / 2 : F_CPU / IR_FREQ)
+
+/*
+ * The priorities of transmitted packets, highest first. A pending packet is
+ * always sent before any of a lower priority, but a packet already being sent
+ * is never interrupted.
+ */
+typedef enum
+{
+  IR_PRIORITY_SHOT,
+  IR_PRIORITY_CONTROL,
+  IR_PRIORITIES
+} ir_priority_t;
+
+/* The results of ir_tx(). */
+typedef enum
+{
+  IR_TX_QUEUED    = 0x0,
+  IR_TX_COALESCED = 0x1,
+  IR_TX_FULL      = 0x2
+} ir_tx_status_t;
+
+/*
+ * The number of packets received, and dropped for each reason. For each
+ * priority, the number of packets sent, coalesced with an identical pending
+ * packet and rejected because the queue was full, and the longest time a
+ * packet waited to start being sent in clock ticks (saturating at 65535).
+ */
+typedef struct
+{
+  uint16_t received;
+  uint16_t dropped[TRACE_IR_FULL]; /* indexed by trace_ir_drop_t - 1 */
+  uint16_t sent[IR_PRIORITIES];
+  uint16_t coalesced[IR_PRIORITIES];
+  uint16_t full[IR_PRIORITIES];
+  uint16_t wait_max[IR_PRIORITIES];
+} ir_stats_t;
+
 /* Initializes the infrared transmitter and receiver. */
 void ir_init(void);
 
+/* Updates the timings of the packets after the configuration has changed. */
+void ir_configure(void);
+
 /*
- * Transmits a 16-bit infrared packet. No guarantees are made of the integrity
- * of the packet, or if it will even arrive.
+ * Queues a 16-bit infrared packet to be transmitted after those of the same or
+ * a higher priority, and returns IR_TX_QUEUED. If an identical packet of the
+ * same priority is already pending, the two are coalesced and IR_TX_COALESCED
+ * is returned. If the priority's queue is full, the packet is dropped and
+ * IR_TX_FULL is returned.
+ *
+ * As packets aren't interrupted, a packet waits for at most the one being sent,
+ * the gap after it and the packets ahead of it in the queues. No guarantees are
+ * made of the integrity of the packet, or if it will even arrive.
  */
-void ir_tx(uint16_t packet);
+ir_tx_status_t ir_tx(uint16_t packet, ir_priority_t priority);
 
 /*
  * Polls the infrared packet receive buffer. If the receive buffer is empty,
@@ -20,5 +113,57 @@ void ir_tx(uint16_t packet);
  */
 bool ir_rx(uint16_t *packet);
 
+/*
+ * As ir_rx(), but also writes the low 16 bits of the clock_ticks() at which
+ * the packet was received, for measuring how long it took to be handled.
+ */
+bool ir_rx_timed(uint16_t *packet, uint16_t *ticks);
+
+/*
+ * Called by the timer at the end of each mark and space being transmitted, and
+ * when a packet being received times out.
+ */
+void ir_tx_timer(void);
+void ir_rx_timeout(void);
+
+/* Copies the transmitter's and receiver's counters. */
+void ir_stats(ir_stats_t *stats);
+
+/* Writes the counters to the UART, with the waits in microseconds. */
+void ir_dump(void);
+
+/* Resets the counters. */
+void ir_reset(void);
+
+/*
+ * Starts or stops capturing the edges seen by the receiver, if IR_CAPTURE is
+ * enabled. While capturing, ir_capture_cycle() writes the edges to the UART in
+ * chunks, each laid out as follows:
+ *
+ *   'L', 'I', microseconds per tick, edges dropped, length, edges..., 16-bit
+ *   CRC
+ *
+ * The edges dropped is the number of edges (saturating at 255) which didn't
+ * fit in the capture buffer since the previous chunk, in which case the time
+ * of the first edge in the chunk is unreliable. The CRC is calculated as for
+ * the trace dump, over everything after the magic number.
+ *
+ * Each edge is the time in clock ticks since the previous edge, saturating at
+ * IR_CAPTURE_MAX_DELTA, encoded in one to three bytes. The first byte holds
+ * the level in bit 7 (1 for the start of a mark, 0 for the end of one) and the
+ * low 6 bits of the time in bits 0 to 5. Each further byte holds the next 7
+ * bits of the time in bits 0 to 6. Bit 6 of the first byte, and bit 7 of the
+ * others, is set if another byte follows.
+ *
+ * The edges take around 3.5KB/s during a fire fight, so the UART's baud rate
+ * needs to be raised for the capture to keep up.
+ */
+#define IR_CAPTURE_MAX_DELTA 0x7FFF
+
+void ir_capture(bool enable);
+
+/* Called regularly to write captured edges to the UART. */
+void ir_capture_cycle(void);
+
 #endif
 
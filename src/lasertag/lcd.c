@@ -2,12 +2,26 @@
 #include <avr/io.h>
 #include <avr/pgmspace.h>
 #include <lasertag/clock.h>
+#include <lasertag/pt.h>
 #include <lasertag/shift.h>
+#include <lasertag/trace.h>
 
 /* The number of rows and columns in the LCD. */
 #define LCD_COLS 8
 #define LCD_ROWS 2
 
+/*
+ * The number of writes which can be queued for the LCD. This must be a power
+ * of two.
+ */
+#define LCD_QUEUE_SIZE 32
+
+/*
+ * Writes which take longer than this number of microseconds to complete are
+ * waited for by yielding to the scheduler rather than spinning.
+ */
+#define LCD_SPIN_USECS 100
+
 /* RS pin values. */
 #define LCD_CMD  false
 #define LCD_DATA true
@@ -64,10 +78,27 @@ static shift_t lcd_shift =
   .latch = PC5
 };
 
+typedef struct
+{
+  bool rs;
+  uint8_t value;
+} lcd_write_t;
+
 /* Current cursor position and display flags. */
 static uint8_t lcd_row, lcd_col;
 static uint8_t lcd_flags;
 
+/*
+ * The queue of writes waiting to be sent to the controller by lcd_cycle(),
+ * which is only touched from the main loop.
+ */
+static lcd_write_t lcd_queue[LCD_QUEUE_SIZE];
+static uint8_t lcd_queue_head, lcd_queue_tail;
+
+/* The protothread which initializes the controller and drains the queue. */
+static pt_t lcd_pt;
+static bool lcd_initialized;
+
 static void lcd_write_nibble(bool rs, uint8_t value)
 {
   /* Write D4-D7 and RS pins, and raise the EN pin. */
@@ -87,7 +118,11 @@ static void lcd_write_nibble(bool rs, uint8_t value)
   clock_usdelay(1);
 }
 
-static void lcd_write(bool rs, uint8_t value)
+/*
+ * Sends an 8-bit command/data write to the controller, returning the number
+ * of microseconds it takes to complete.
+ */
+static unsigned int lcd_send(bool rs, uint8_t value)
 {
   /* Write the 8-bit command/data in two goes. */
   lcd_write_nibble(rs, (value >> 4) & 0xF);
@@ -97,19 +132,71 @@ static void lcd_write(bool rs, uint8_t value)
   shift_out(&lcd_shift, 0);
 
   /*
-   * Wait for the command to complete. Note that no maximum is listed for the
-   * clear display command, so this is guessed assuming it takes 1.52ms (as it
-   * does the same thing as 'return home') as well as 37us*2 for each of the
-   * maximum of 16*2 characters on the screen (as clearing the screen is the
-   * same as setting the DDRAM address and then writing to DDRAM for each of
-   * the characters.)
+   * Note that no maximum is listed for the clear display command, so this is
+   * guessed assuming it takes 1.52ms (as it does the same thing as 'return
+   * home') as well as 37us*2 for each of the maximum of 16*2 characters on the
+   * screen (as clearing the screen is the same as setting the DDRAM address
+   * and then writing to DDRAM for each of the characters.)
    */
-  if (value & LCD_CMD_CLEAR_DISPLAY)
-    clock_msdelay(4);
-  else if (value & LCD_CMD_RETURN_HOME)
-    clock_usdelay(1520);
+  if (rs == LCD_CMD && value == LCD_CMD_CLEAR_DISPLAY)
+    return 4000;
+  else if (rs == LCD_CMD && (value & ~1) == LCD_CMD_RETURN_HOME)
+    return 1520;
   else
-    clock_usdelay(37);
+    return 37;
+}
+
+static pt_state_t lcd_thread(void)
+{
+  PT_BEGIN(&lcd_pt);
+
+  /*
+   * Initialize the controller in 4-bit mode, the following sequence of
+   * commands and delays is from the HD44780 datasheet.
+   */
+  lcd_write_nibble(LCD_CMD, 0x03);
+  PT_DELAY(&lcd_pt, 4100);
+
+  lcd_write_nibble(LCD_CMD, 0x03);
+  PT_DELAY(&lcd_pt, 100);
+
+  lcd_write_nibble(LCD_CMD, 0x03);
+
+  lcd_write_nibble(LCD_CMD, 0x02);
+
+  for (;;)
+  {
+    /* The LCD is ready once the writes queued by lcd_init() have been sent. */
+    if (!lcd_initialized && lcd_queue_head == lcd_queue_tail)
+    {
+      lcd_initialized = true;
+      trace(TRACE_READY, TRACE_READY_LCD);
+    }
+
+    PT_WAIT_UNTIL(&lcd_pt, lcd_queue_head != lcd_queue_tail);
+
+    lcd_write_t write = lcd_queue[lcd_queue_tail % LCD_QUEUE_SIZE];
+    lcd_queue_tail++;
+
+    /* Wait for the write to complete. */
+    unsigned int usecs = lcd_send(write.rs, write.value);
+    if (usecs > LCD_SPIN_USECS)
+      PT_DELAY(&lcd_pt, usecs);
+    else
+      clock_usdelay(usecs);
+  }
+
+  PT_END(&lcd_pt);
+}
+
+static void lcd_write(bool rs, uint8_t value)
+{
+  /* If the queue is full, wait for the oldest write to be sent. */
+  while ((uint8_t) (lcd_queue_head - lcd_queue_tail) == LCD_QUEUE_SIZE)
+    lcd_thread();
+
+  lcd_queue[lcd_queue_head % LCD_QUEUE_SIZE] = (lcd_write_t) { rs, value };
+  lcd_queue_head++;
 }
 
 static void lcd_write_cursor(void)
@@ -129,19 +216,8 @@ void lcd_init(void)
   shift_init(&lcd_shift);
   shift_out(&lcd_shift, 0);
 
-  /*
-   * Initialize the controller in 4-bit mode, the following sequence of
-   * commands and delays is from the HD44780 datasheet.
-   */
-  lcd_write_nibble(LCD_CMD, 0x03);
-  clock_usdelay(4100);
-
-  lcd_write_nibble(LCD_CMD, 0x03);
-  clock_usdelay(100);
-
-  lcd_write_nibble(LCD_CMD, 0x03);
-
-  lcd_write_nibble(LCD_CMD, 0x02);
+  /* The controller is initialized by lcd_cycle(). */
+  PT_INIT(&lcd_pt);
 
   /* Set function flags. */
   uint8_t function = 0;
@@ -160,6 +236,16 @@ void lcd_init(void)
   lcd_clear();
 }
 
+void lcd_cycle(void)
+{
+  lcd_thread();
+}
+
+bool lcd_idle(void)
+{
+  return lcd_initialized && lcd_queue_head == lcd_queue_tail;
+}
+
 void lcd_enable(void)
 {
   lcd_flags |= LCD_DISPLAY_ON;
@@ -230,23 +316,24 @@ void lcd_puts_p(const char *str)
 
 void lcd_make_char(uint8_t id, const uint8_t bitmap[8])
 {
-  for (int off = 0; off < 8; off++)
-  {
-    lcd_write(LCD_CMD, LCD_CMD_CGRAM_ADDR | (id * 8 + off));
-    lcd_write(LCD_DATA, bitmap[off]);
-  }
-
-  lcd_write_cursor();
+  lcd_make_char_rows(id, 0, 8, bitmap);
 }
 
 void lcd_make_char_p(uint8_t id, const uint8_t bitmap[8])
 {
+  /* The address moves to the next row after each write. */
+  lcd_write(LCD_CMD, LCD_CMD_CGRAM_ADDR | (id * 8));
   for (int off = 0; off < 8; off++)
-  {
-    lcd_write(LCD_CMD, LCD_CMD_CGRAM_ADDR | (id * 8 + off));
     lcd_write(LCD_DATA, pgm_read_byte(&bitmap[off]));
-  }
 
   lcd_write_cursor();
 }
 
+void lcd_make_char_rows(uint8_t id, uint8_t first, uint8_t count, const uint8_t *rows)
+{
+  lcd_write(LCD_CMD, LCD_CMD_CGRAM_ADDR | (id * 8 + first));
+  for (uint8_t off = 0; off < count; off++)
+    lcd_write(LCD_DATA, rows[off]);
+
+  lcd_write_cursor();
+}
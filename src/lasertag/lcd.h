@@ -4,9 +4,24 @@
 #include <stdbool.h>
 #include <stdint.h>
 
-/* Initializes the LCD controller. */
+/*
+ * Starts initializing the LCD controller. The initialization is carried out
+ * by lcd_cycle(), so the other functions may be called straight away.
+ */
 void lcd_init(void);
 
+/*
+ * Called regularly to initialize the controller and send it the writes queued
+ * by the other functions, which return without waiting for the controller.
+ */
+void lcd_cycle(void);
+
+/*
+ * Returns true if the controller has been initialized and all of the queued
+ * writes have been sent.
+ */
+bool lcd_idle(void);
+
 /* Enable/disable the LCD display. */
 void lcd_enable(void);
 void lcd_disable(void);
@@ -32,5 +47,11 @@ void lcd_puts_p(const char *str);
 void lcd_make_char(uint8_t id, const uint8_t bitmap[8]);
 void lcd_make_char_p(uint8_t id, const uint8_t bitmap[8]);
 
+/*
+ * Rewrites count rows of a custom character, starting from the given row, and
+ * leaves the others alone.
+ */
+void lcd_make_char_rows(uint8_t id, uint8_t first, uint8_t count, const uint8_t *rows);
+
 #endif
 
@@ -1,15 +1,106 @@
 #include <lasertag/led.h>
 #include <avr/io.h>
+#include <avr/pgmspace.h>
 #include <lasertag/clock.h>
 #include <lasertag/shift.h>
+#include <lasertag/timer.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <util/atomic.h>
+
+/* The number of clock ticks between calls to led_tick() (4.096 ms). */
+#define LED_TICK_PERIOD (4096 / CLOCK_USECS_PER_TICK)
 
 /* The number of microseconds the muzzle flash LED is switched on for. */
 #define LED_MUZ_USECS 100000UL
 
-/* The number of microseconds between alternate team LED flashes. */
-#define LED_TEAM_USECS 500000UL
+/* The brightest level. Each output may be at a level from 0 (off) to this. */
+#define LED_LEVEL_MAX 3
+
+/*
+ * The LEDs are dimmed with binary code modulation: the outputs' level bits
+ * are split into one byte per bit (a bit plane), and each plane is shown for a
+ * time proportional to its bit's weight. With two planes, plane 0 is shown for
+ * one tick and plane 1 for two, so a frame lasts 3 ticks (~12 ms).
+ */
+#define LED_FRAME_TICKS 3
+
+/*
+ * Macros for building the pattern tables. Each step sets the level of the
+ * two sets of team LEDs which are lit alternately (see led_team_mask()) and
+ * lasts for up to ~1 second. A pattern either ends by (re)starting the
+ * background pattern, which makes the background patterns loop, or holds its
+ * last step.
+ */
+#define LED_STEP(level0, level1, ms) \
+  { (level0) | ((level1) << 2), (ms) * 1000UL / CLOCK_USECS_PER_TICK }
+#define LED_END  { LED_STEP_END, 0 }
+#define LED_HOLD { LED_STEP_HOLD, 0 }
+
+/* The flags marking the end of a pattern. */
+#define LED_STEP_END  0x10
+#define LED_STEP_HOLD 0x20
+
+typedef struct
+{
+  /* The levels of the two sets of LEDs, or one of the end flags. */
+  uint8_t levels;
+
+  /* The number of clock ticks the step lasts. */
+  uint32_t ticks;
+} led_step_t;
+
+static const led_step_t led_alternate[] PROGMEM = {
+  LED_STEP(3, 0, 500),
+  LED_STEP(0, 3, 500),
+  LED_END
+};
+
+static const led_step_t led_pulse[] PROGMEM = {
+  LED_STEP(1, 1, 150),
+  LED_STEP(2, 2, 150),
+  LED_STEP(3, 3, 300),
+  LED_STEP(2, 2, 150),
+  LED_STEP(1, 1, 150),
+  LED_STEP(0, 0, 300),
+  LED_END
+};
+
+static const led_step_t led_ammo_low[] PROGMEM = {
+  LED_STEP(3, 1, 100),
+  LED_STEP(0, 1, 100),
+  LED_STEP(3, 1, 100),
+  LED_STEP(0, 1, 700),
+  LED_END
+};
+
+static const led_step_t led_fade[] PROGMEM = {
+  LED_STEP(3, 3, 250),
+  LED_STEP(2, 2, 250),
+  LED_STEP(1, 1, 250),
+  LED_STEP(0, 0, 0),
+  LED_HOLD
+};
+
+static const led_step_t led_strobe[] PROGMEM = {
+  LED_STEP(3, 3, 40),
+  LED_STEP(0, 0, 40),
+  LED_STEP(3, 3, 40),
+  LED_STEP(0, 0, 40),
+  LED_STEP(3, 3, 40),
+  LED_STEP(0, 0, 40),
+  LED_STEP(3, 3, 40),
+  LED_STEP(0, 0, 40),
+  LED_END
+};
+
+static const led_step_t * const led_patterns[LED_PATTERNS] PROGMEM = {
+  led_alternate,
+  led_pulse,
+  led_ammo_low,
+  led_fade,
+  led_strobe
+};
 
 static shift_t led_shift =
 {
@@ -24,9 +115,67 @@ static shift_t led_shift =
 static uint32_t led_muz_start;
 
 /* Team LEDs state. */
-static uint32_t led_team_start;
 static led_color_t led_team_color, led_team_alt_color;
-static bool led_team_alt;
+static led_pattern_t led_background;
+static const led_step_t *led_step;
+static uint32_t led_step_start;
+
+/*
+ * The bit planes of the shift register outputs and the muzzle LED (bit 0 for
+ * plane 0 and bit 1 for plane 1), which are read by led_tick().
+ */
+static volatile uint8_t led_planes[2];
+static volatile uint8_t led_muz_level;
+
+/* The ISR's position in the frame and the byte last shifted out. */
+static uint8_t led_frame_tick;
+static uint8_t led_output;
+
+/*
+ * Returns the outputs in each of the two sets of team LEDs. The shift register
+ * drives two banks of four LEDs (one of each color), and the sets alternate
+ * the team colors between the banks.
+ */
+static uint8_t led_team_mask(uint8_t set)
+{
+  if (set == 0)
+    return (led_team_color << 4) | led_team_alt_color;
+  else
+    return led_team_color | (led_team_alt_color << 4);
+}
+
+/*
+ * Works out the bit planes for the current step. An output in both sets
+ * combines the bits of the two levels.
+ */
+static void led_update(void)
+{
+  uint8_t levels = pgm_read_byte(&led_step->levels);
+  uint8_t mask0 = led_team_mask(0), mask1 = led_team_mask(1);
+
+  uint8_t planes[2];
+  for (uint8_t plane = 0; plane < 2; plane++)
+  {
+    planes[plane] = 0;
+    if (levels & (1 << plane))
+      planes[plane] |= mask0;
+    if (levels & (4 << plane))
+      planes[plane] |= mask1;
+  }
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    led_planes[0] = planes[0];
+    led_planes[1] = planes[1];
+  }
+}
+
+static void led_start(led_pattern_t pattern, uint32_t now)
+{
+  led_step = pgm_read_ptr(&led_patterns[pattern]);
+  led_step_start = now;
+  led_update();
+}
 
 void led_init(void)
 {
@@ -36,57 +185,114 @@ void led_init(void)
 
   /* Set PB0 (muzzle LED) to be an output. */
   DDRB |= (1 << PB0);
+
+  led_start(LED_ALTERNATE, clock_ticks());
+  timer_after(TIMER_LED, LED_TICK_PERIOD);
 }
 
 void led_cycle(void)
 {
-  uint32_t now = clock_micros();
+  uint32_t now = clock_ticks();
 
-  /* Turn off the muzzle LED if it has been on for its duration. */
-  if (led_muz_start && (clock_delta(now, led_muz_start) >= LED_MUZ_USECS))
+  /* Fade the muzzle LED out over its duration. */
+  if (led_muz_start)
   {
-    led_muz_start = 0;
-    PORTB &= ~(1 << PB0);
+    uint32_t elapsed = (now - led_muz_start) * CLOCK_USECS_PER_TICK;
+    if (elapsed >= LED_MUZ_USECS)
+    {
+      led_muz_start = 0;
+      led_muz_level = 0;
+    }
+    else if (elapsed >= LED_MUZ_USECS * 3 / 4)
+    {
+      led_muz_level = 1;
+    }
+    else if (elapsed >= LED_MUZ_USECS / 2)
+    {
+      led_muz_level = 2;
+    }
   }
 
-  /* Flash alternate team LEDs. */
-  if (clock_delta(now, led_team_start) >= LED_TEAM_USECS)
+  /* Move on to the next step of the pattern once this one has finished. */
+  if (now - led_step_start < pgm_read_dword(&led_step->ticks))
+    return;
+
+  led_step_start = now;
+  switch (pgm_read_byte(&(++led_step)->levels))
   {
-    led_team_start = now;
-    if ((led_team_alt = !led_team_alt))
-      shift_out(&led_shift, (led_team_color << 4) | led_team_alt_color);
-    else
-      shift_out(&led_shift, led_team_color | (led_team_alt_color << 4));
+    case LED_STEP_END:
+      led_start(led_background, now);
+      break;
+
+    case LED_STEP_HOLD:
+      led_step--;
+      break;
+
+    default:
+      led_update();
+      break;
   }
 }
 
-void led_muz_flash(void)
+void led_tick(void)
 {
-  /* Record the time at which the muzzle flash pin was raised. */
-  led_muz_start = clock_micros();
+  /* Show plane 0 for the first tick of the frame and plane 1 for the rest. */
+  uint8_t plane = led_frame_tick ? 1 : 0;
+  if (++led_frame_tick == LED_FRAME_TICKS)
+    led_frame_tick = 0;
 
   /*
-   * As zero is used as a special value to indicate the muzzle flash LED is
-   * off, and as precise timing is not important (such precise timing cannot be
-   * achieved with the code anyway), if the time happens to be zero, set it to
-   * one instead.
+   * Shifting the byte out is the expensive part, so it is only done when the
+   * byte changes. This bounds the ISR's cost at one shift_out() per tick.
    */
+  uint8_t output = led_planes[plane];
+  if (output != led_output)
+  {
+    led_output = output;
+    shift_out(&led_shift, output);
+  }
+
+  if (led_muz_level & (1 << plane))
+    PORTB |= (1 << PB0);
+  else
+    PORTB &= ~(1 << PB0);
+
+  timer_again(TIMER_LED, LED_TICK_PERIOD);
+}
+
+void led_muz_flash(void)
+{
+  /*
+   * Record the time at which the muzzle flash was started. As zero is used as
+   * a special value to indicate the muzzle flash LED is off, and as precise
+   * timing is not important, if the time happens to be zero, set it to one
+   * instead.
+   */
+  led_muz_start = clock_ticks();
   if (led_muz_start == 0)
     led_muz_start = 1;
 
-  /* Raise the muzzle flash pin. */
-  PORTB |= (1 << PB0);
+  led_muz_level = LED_LEVEL_MAX;
 }
 
 void led_team_on(led_color_t color, led_color_t alt_color)
 {
   led_team_color = color;
   led_team_alt_color = alt_color;
+  led_update();
 }
 
 void led_team_off(void)
 {
   led_team_color = 0;
   led_team_alt_color = 0;
+  led_update();
 }
 
+void led_pattern(led_pattern_t pattern)
+{
+  if (pattern < LED_FADE)
+    led_background = pattern;
+
+  led_start(pattern, clock_ticks());
+}
@@ -9,18 +9,39 @@ typedef enum
   LED_BLUE = 0x8
 } led_color_t;
 
+/*
+ * The patterns played on the team LEDs. The first three loop in the
+ * background until another background pattern is chosen. The others are
+ * played once over the top: the fade holds its last step (i.e. the LEDs stay
+ * off), and the strobe returns to the background pattern when it finishes.
+ */
+typedef enum
+{
+  LED_ALTERNATE,
+  LED_PULSE,
+  LED_AMMO_LOW,
+  LED_FADE,
+  LED_STROBE,
+  LED_PATTERNS
+} led_pattern_t;
+
 /* Initialize the LEDs. */
 void led_init(void);
 
-/* Called regularly to turn LEDs on/off. */
+/* Called regularly to advance the patterns and the muzzle flash. */
 void led_cycle(void);
 
+/* Called by the timer every ~4 ms to refresh the LEDs. */
+void led_tick(void);
+
 /* Flashes the muzzle LED for a small amount of time. */
 void led_muz_flash(void);
 
-/* Turn the flashing team LEDs on and off respectively. */
+/* Turn the team LEDs on and off respectively. */
 void led_team_on(led_color_t color, led_color_t alt_color);
 void led_team_off(void);
 
-#endif
+/* Starts playing a pattern on the team LEDs. */
+void led_pattern(led_pattern_t pattern);
 
+#endif
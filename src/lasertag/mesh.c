@@ -0,0 +1,235 @@
+#include <lasertag/mesh.h>
+#include <string.h>
+
+/*
+ * A mesh frame is laid out as follows:
+ *
+ *   MESH_FRAME, origin node ID, destination node ID, sequence number, TTL,
+ *   sender's distance to the base station, payload...
+ *
+ * Frames are flooded: every node which hears a frame it has not seen before
+ * and which is not addressed to it relays it, decrementing the TTL, until the
+ * TTL reaches one. The origin and sequence number identify the frame for
+ * duplicate suppression.
+ *
+ * Each node learns its distance to the base station from the distances
+ * advertised by the frames it hears. Frames heading for the base station are
+ * only relayed by nodes closer to it than the sender, which forms a gradient
+ * towards the base station and stops the flood spreading across the whole
+ * arena. Nodes which don't know their distance fall back to plain flooding.
+ */
+#define MESH_OFF_TYPE   0
+#define MESH_OFF_ORIGIN 1
+#define MESH_OFF_DST    2
+#define MESH_OFF_SEQ    3
+#define MESH_OFF_TTL    4
+#define MESH_OFF_DIST   5
+
+static bool mesh_seen(mesh_t *mesh, uint16_t key)
+{
+  for (uint8_t i = 0; i < MESH_SEEN_SIZE; i++)
+  {
+    if (mesh->seen[i] == key)
+      return true;
+  }
+  return false;
+}
+
+static void mesh_remember(mesh_t *mesh, uint16_t key)
+{
+  mesh->seen[mesh->seen_pos] = key;
+  mesh->seen_pos = (mesh->seen_pos + 1) % MESH_SEEN_SIZE;
+}
+
+/* Tops up the relay budget with the tokens earned since the last refill. */
+static void mesh_refill(mesh_t *mesh, uint16_t now)
+{
+  uint16_t earned = (uint16_t) (now - mesh->refilled_at) / MESH_RELAY_INTERVAL;
+  if (earned == 0)
+    return;
+
+  if (mesh->tokens + earned >= MESH_RELAY_BURST)
+  {
+    mesh->tokens = MESH_RELAY_BURST;
+    mesh->refilled_at = now;
+  }
+  else
+  {
+    mesh->tokens += earned;
+    mesh->refilled_at += earned * MESH_RELAY_INTERVAL;
+  }
+}
+
+/* Steps the 8-bit Galois LFSR used to pick the relay delay. */
+static uint8_t mesh_rand(mesh_t *mesh)
+{
+  mesh->rand = (mesh->rand >> 1) ^ (-(mesh->rand & 1) & 0xB8);
+  return mesh->rand;
+}
+
+/*
+ * Called when a duplicate of a frame is heard. If it's the frame we're about
+ * to relay and the neighbour relaying it has already covered the ground we
+ * would, our relay is cancelled.
+ */
+static void mesh_overheard(mesh_t *mesh, uint16_t key, uint8_t dst, uint8_t dist)
+{
+  if (mesh->relay_len == 0)
+    return;
+
+  uint16_t relay_key = ((uint16_t) mesh->relay[MESH_OFF_ORIGIN] << 8) | mesh->relay[MESH_OFF_SEQ];
+  if (key != relay_key)
+    return;
+
+  bool covered;
+  if (dst == MESH_BASE)
+    covered = dist <= mesh->hops;
+  else
+    covered = ++mesh->relay_heard >= MESH_BROADCAST_HEARD;
+
+  if (covered)
+  {
+    mesh->relay_len = 0;
+    mesh->cancelled++;
+  }
+}
+
+/* Updates this node's distance to the base station after hearing a sender. */
+static void mesh_learn(mesh_t *mesh, uint8_t dist, uint16_t now)
+{
+  if (mesh->node == MESH_BASE || dist >= MESH_HOPS_UNKNOWN - 1)
+    return;
+
+  bool stale = (uint16_t) (now - mesh->hops_at) >= MESH_HOPS_TIMEOUT;
+  if (dist + 1 <= mesh->hops || stale)
+  {
+    mesh->hops = dist + 1;
+    mesh->hops_at = now;
+  }
+}
+
+void mesh_init(mesh_t *mesh, uint8_t node)
+{
+  memset(mesh, 0, sizeof(*mesh));
+  mesh->node = node;
+  mesh->tokens = MESH_RELAY_BURST;
+  mesh->hops = node == MESH_BASE ? 0 : MESH_HOPS_UNKNOWN;
+
+  /*
+   * Mark the seen table as empty. Frames are never originated by the
+   * broadcast ID, so this key can't collide with a real frame.
+   */
+  for (uint8_t i = 0; i < MESH_SEEN_SIZE; i++)
+    mesh->seen[i] = (uint16_t) MESH_BROADCAST << 8;
+
+  /* Seed the generator with the node ID, it must not be zero. */
+  mesh->rand = node ^ 0x5A;
+  if (mesh->rand == 0)
+    mesh->rand = 1;
+}
+
+uint8_t mesh_wrap(mesh_t *mesh, uint8_t *frame, uint8_t dst, const uint8_t *payload, uint8_t len)
+{
+  frame[MESH_OFF_TYPE] = MESH_FRAME;
+  frame[MESH_OFF_ORIGIN] = mesh->node;
+  frame[MESH_OFF_DST] = dst;
+  frame[MESH_OFF_SEQ] = mesh->seq;
+  frame[MESH_OFF_TTL] = MESH_TTL;
+  frame[MESH_OFF_DIST] = mesh->hops;
+  memcpy(&frame[MESH_HEADER], payload, len);
+
+  return MESH_HEADER + len;
+}
+
+void mesh_wrap_sent(mesh_t *mesh)
+{
+  uint8_t seq = mesh->seq++;
+
+  /* Ignore our own frame when neighbours relay it back to us. */
+  mesh_remember(mesh, ((uint16_t) mesh->node << 8) | seq);
+}
+
+mesh_action_t mesh_receive(mesh_t *mesh, const uint8_t *frame, uint8_t len, uint16_t now)
+{
+  if (len < MESH_HEADER || frame[MESH_OFF_TYPE] != MESH_FRAME)
+    return MESH_DROP;
+
+  /* Duplicates still tell us how far the sender is from the base station. */
+  uint8_t dist = frame[MESH_OFF_DIST];
+  mesh_learn(mesh, dist, now);
+
+  /* Drop frames which have already been seen. */
+  uint8_t dst = frame[MESH_OFF_DST];
+  uint16_t key = ((uint16_t) frame[MESH_OFF_ORIGIN] << 8) | frame[MESH_OFF_SEQ];
+  if (mesh_seen(mesh, key))
+  {
+    mesh->duplicates++;
+    mesh_overheard(mesh, key, dst, dist);
+    return MESH_DROP;
+  }
+  mesh_remember(mesh, key);
+
+  mesh_action_t action = MESH_DROP;
+
+  if (dst == mesh->node || dst == MESH_BROADCAST)
+  {
+    action |= MESH_DELIVER;
+    mesh->delivered++;
+  }
+
+  /* Frames addressed to this node go no further. */
+  if (dst == mesh->node)
+    return action;
+
+  if (frame[MESH_OFF_TTL] <= 1)
+  {
+    mesh->expired++;
+    return action;
+  }
+
+  /* Leave frames heading for the base station to nodes closer to it. */
+  if (dst == MESH_BASE && dist != MESH_HOPS_UNKNOWN && mesh->hops >= dist)
+  {
+    mesh->pruned++;
+    return action;
+  }
+
+  /* Cap the relay load so a busy arena can't swamp this node. */
+  mesh_refill(mesh, now);
+  if (mesh->tokens == 0)
+  {
+    mesh->throttled++;
+    return action;
+  }
+
+  /* Only one frame can wait to be relayed at once. */
+  if (mesh->relay_len)
+  {
+    mesh->overflowed++;
+    return action;
+  }
+
+  mesh->tokens--;
+  memcpy(mesh->relay, frame, len);
+  mesh->relay_len = len;
+  mesh->relay[MESH_OFF_TTL]--;
+  mesh->relay_at = now + mesh_rand(mesh) % (MESH_BACKOFF_MAX + 1);
+  mesh->relay_heard = 0;
+  return action | MESH_RELAY;
+}
+
+uint8_t mesh_relay_due(mesh_t *mesh, uint16_t now)
+{
+  if (mesh->relay_len == 0 || (int16_t) (now - mesh->relay_at) < 0)
+    return 0;
+
+  /* Advertise our distance as it is when the frame is actually sent. */
+  mesh->relay[MESH_OFF_DIST] = mesh->hops;
+  return mesh->relay_len;
+}
+
+void mesh_relay_sent(mesh_t *mesh)
+{
+  mesh->relay_len = 0;
+  mesh->relayed++;
+}
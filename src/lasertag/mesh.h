@@ -0,0 +1,136 @@
+#ifndef LASERTAG_MESH_H
+#define LASERTAG_MESH_H
+
+#include <lasertag/radio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* The value of the first byte of a frame which is being flooded. */
+#define MESH_FRAME 0x80
+
+/* The node ID of the base station, and the ID which addresses every node. */
+#define MESH_BASE      0x00
+#define MESH_BROADCAST 0xFF
+
+/* The number of bytes the mesh header adds to the start of each frame. */
+#define MESH_HEADER 6
+
+/* The maximum payload of a frame sent through the mesh. */
+#define MESH_MAX_PAYLOAD (RADIO_MAX_PAYLOAD - MESH_HEADER)
+
+/* The initial TTL of a frame, i.e. the maximum number of hops it can take. */
+#define MESH_TTL 6
+
+/* The distance to the base station of a node which doesn't know it yet. */
+#define MESH_HOPS_UNKNOWN 0xFF
+
+/*
+ * The number of time units after which a node forgets its distance to the
+ * base station if it hasn't been confirmed, as players move around.
+ */
+#define MESH_HOPS_TIMEOUT 5000
+
+/* The number of recently seen frames remembered for duplicate suppression. */
+#define MESH_SEEN_SIZE 16
+
+/*
+ * The relay budget: each node can relay a burst of MESH_RELAY_BURST frames,
+ * after which it can relay one frame every MESH_RELAY_INTERVAL time units.
+ */
+#define MESH_RELAY_BURST    4
+#define MESH_RELAY_INTERVAL 20
+
+/* The maximum random delay, in time units, before a frame is relayed. */
+#define MESH_BACKOFF_MAX 31
+
+/*
+ * A pending broadcast relay is cancelled once this many neighbours have been
+ * heard relaying the same frame, as they will have covered the area.
+ */
+#define MESH_BROADCAST_HEARD 2
+
+/* The actions which should be taken after receiving a frame. */
+typedef enum
+{
+  MESH_DROP    = 0x0,
+  MESH_DELIVER = 0x1,
+  MESH_RELAY   = 0x2
+} mesh_action_t;
+
+typedef struct
+{
+  /* The ID of this node. */
+  uint8_t node;
+
+  /* The sequence number of the next frame originated by this node. */
+  uint8_t seq;
+
+  /*
+   * The number of hops between this node and the base station, and the time
+   * at which it was last confirmed.
+   */
+  uint8_t hops;
+  uint16_t hops_at;
+
+  /*
+   * The origin and sequence number (packed as origin << 8 | seq) of recently
+   * seen frames. This is a circular buffer, so the oldest entries are
+   * overwritten first.
+   */
+  uint16_t seen[MESH_SEEN_SIZE];
+  uint8_t seen_pos;
+
+  /* The relay budget and the time at which it was last topped up. */
+  uint8_t tokens;
+  uint16_t refilled_at;
+
+  /*
+   * A frame waiting to be relayed, the time at which it should be sent and
+   * the number of neighbours which have been heard relaying it in the
+   * meantime.
+   */
+  uint8_t relay[RADIO_MAX_PAYLOAD];
+  uint8_t relay_len;
+  uint16_t relay_at;
+  uint8_t relay_heard;
+
+  /* The state of the pseudo-random number generator used for backoff. */
+  uint8_t rand;
+
+  /* Counters for the frames which were delivered, relayed and dropped. */
+  uint16_t delivered, relayed, duplicates, expired, pruned, throttled;
+  uint16_t cancelled, overflowed;
+} mesh_t;
+
+/* Initializes the mesh state for the node with the given ID. */
+void mesh_init(mesh_t *mesh, uint8_t node);
+
+/*
+ * Wraps a payload of up to MESH_MAX_PAYLOAD bytes in a mesh header addressed
+ * to the given node, writing the frame into the buffer and returning its
+ * length. The frame's sequence number is only used up by mesh_wrap_sent(), so
+ * wrapping a frame the radio then refuses costs nothing.
+ */
+uint8_t mesh_wrap(mesh_t *mesh, uint8_t *frame, uint8_t dst, const uint8_t *payload, uint8_t len);
+
+/* Called once the frame returned by mesh_wrap() has been sent. */
+void mesh_wrap_sent(mesh_t *mesh);
+
+/*
+ * Processes a received mesh frame. If MESH_DELIVER is set in the result, the
+ * payload (which starts MESH_HEADER bytes into the frame) is addressed to this
+ * node. If MESH_RELAY is set, the frame has been queued to be relayed after a
+ * random delay.
+ */
+mesh_action_t mesh_receive(mesh_t *mesh, const uint8_t *frame, uint8_t len, uint16_t now);
+
+/*
+ * Returns the length of the frame waiting to be relayed (which is held in the
+ * relay buffer) if it is due to be sent, or zero otherwise.
+ */
+uint8_t mesh_relay_due(mesh_t *mesh, uint16_t now);
+
+/* Called once the frame returned by mesh_relay_due() has been sent. */
+void mesh_relay_sent(mesh_t *mesh);
+
+#endif
@@ -0,0 +1,88 @@
+#include <lasertag/nvm.h>
+#include <avr/eeprom.h>
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <lasertag/profile.h>
+#include <util/atomic.h>
+
+/* The rest of the block being written by the ISR. */
+static const uint8_t *nvm_src;
+static uint16_t nvm_addr;
+static uint8_t nvm_left;
+
+ISR(EE_READY_vect)
+{
+  PROFILE_SCOPE(PROFILE_EE_READY);
+
+  /*
+   * The EEPROM is ready, so eeprom_write_byte() starts the write and returns
+   * straight away. Unchanged bytes are skipped, to save time and wear.
+   */
+  while (nvm_left)
+  {
+    nvm_left--;
+    uint8_t *addr = (uint8_t *) (uintptr_t) nvm_addr++;
+    uint8_t value = *nvm_src++;
+
+    if (eeprom_read_byte(addr) != value)
+    {
+      eeprom_write_byte(addr, value);
+      return;
+    }
+  }
+
+  /* The last byte has been written, mask the interrupt until the next block. */
+  EECR &= ~(1 << EERIE);
+}
+
+void nvm_read(uint16_t addr, void *dst, uint8_t len)
+{
+  uint8_t *bytes = dst;
+  while (len)
+  {
+    /*
+     * The ISR may start a write at any time, so the EEPROM must be checked
+     * with interrupts disabled. Otherwise eeprom_read_byte() could wait for
+     * the write to finish with them disabled.
+     */
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      if (eeprom_is_ready())
+      {
+        *bytes++ = eeprom_read_byte((const uint8_t *) (uintptr_t) addr++);
+        len--;
+      }
+    }
+  }
+}
+
+bool nvm_update_byte(uint16_t addr, uint8_t value)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    if (!eeprom_is_ready())
+      return false;
+
+    eeprom_update_byte((uint8_t *) (uintptr_t) addr, value);
+  }
+  return true;
+}
+
+bool nvm_write(uint16_t addr, const void *src, uint8_t len)
+{
+  if (nvm_busy())
+    return false;
+
+  nvm_src = src;
+  nvm_addr = addr;
+  nvm_left = len;
+
+  /* The interrupt fires as soon as the EEPROM is ready. */
+  EECR |= (1 << EERIE);
+  return true;
+}
+
+bool nvm_busy(void)
+{
+  return EECR & (1 << EERIE);
+}
@@ -0,0 +1,46 @@
+#ifndef LASERTAG_NVM_H
+#define LASERTAG_NVM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Access to the EEPROM which is shared by the modules which store data in it.
+ *
+ * Each byte takes ~3.4 ms to write, so blocks are written in the background by
+ * the EE_READY ISR, one byte per interrupt. Single bytes may also be written
+ * from the main loop, between the ISR's writes. As the ISR uses the EEPROM's
+ * registers, everything else must access the EEPROM through these functions
+ * rather than <avr/eeprom.h>.
+ *
+ * The EEPROM is laid out as follows:
+ *
+ *      0 -   63: configuration
+ *     64 -  255: trace events (see trace.c)
+ *    256 - 1023: game statistics (see stats.c)
+ */
+
+/*
+ * Reads a block from the EEPROM. If a byte is being written, this waits for
+ * it to finish (with interrupts enabled).
+ */
+void nvm_read(uint16_t addr, void *dst, uint8_t len);
+
+/*
+ * Writes a byte to the EEPROM if it differs from the existing value. If the
+ * EEPROM is busy, nothing is written and false is returned.
+ */
+bool nvm_update_byte(uint16_t addr, uint8_t value);
+
+/*
+ * Starts writing a block to the EEPROM in the background, skipping any bytes
+ * which are unchanged. The source must not be modified until nvm_busy()
+ * returns false. If a block is already being written, nothing is written and
+ * false is returned.
+ */
+bool nvm_write(uint16_t addr, const void *src, uint8_t len);
+
+/* Returns true if a block is being written. */
+bool nvm_busy(void);
+
+#endif
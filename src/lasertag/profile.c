@@ -0,0 +1,291 @@
+#include <lasertag/profile.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <lasertag/clock.h>
+#include <lasertag/ir.h>
+#include <lasertag/uart.h>
+#include <util/atomic.h>
+
+#if PROFILE && IR_RX_CAPTURE
+#error "The profiler's timebase needs Timer1 to wrap around with the carrier"
+#endif
+
+/*
+ * The period of Timer1 in cycles, which ir_init() sets from that of the 38 kHz
+ * IR carrier.
+ */
+#define PROFILE_PERIOD ((int16_t) IR_TIMER1_PERIOD)
+
+/* The number of cycles between Timer2 overflows. */
+#define PROFILE_OVERFLOW_CYCLES (256UL * CLOCK_PRESCALER)
+
+/* How far the phase of Timer1 moves each time Timer2 overflows. */
+#define PROFILE_WRAP (PROFILE_OVERFLOW_CYCLES % PROFILE_PERIOD)
+
+/*
+ * The tolerance, in cycles, for the difference between the time taken to read
+ * the timers in profile_now() and in profile_init().
+ */
+#define PROFILE_SLACK 32
+
+/*
+ * The number of histogram buckets. The first bucket counts durations of under
+ * 64 cycles, and each subsequent bucket doubles the limit, with the last
+ * counting everything else.
+ */
+#define PROFILE_BUCKETS     8
+#define PROFILE_BUCKET_SHIFT 6
+
+typedef struct
+{
+  uint16_t min, max;
+  uint16_t hist[PROFILE_BUCKETS];
+} profile_stats_t;
+
+/*
+ * The timebase combines Timer2, which ticks every CLOCK_PRESCALER (64) cycles,
+ * and Timer1, which counts every cycle but wraps around every PROFILE_PERIOD
+ * cycles. As the period is longer than a tick, the Timer1 count identifies how
+ * far into the current tick we are.
+ *
+ * If TCNT2 was zero at cycle 0, then at cycle c:
+ *
+ *   c = TCNT2 * 64 + n, where n < 64
+ *   TCNT1 = (c + offset) % PROFILE_PERIOD
+ *
+ * and so n = (TCNT1 - TCNT2 * 64 - offset) % PROFILE_PERIOD. This table holds
+ * TCNT2 * 64 % PROFILE_PERIOD for each value of TCNT2. The offset, which
+ * depends on the phase of the timers, is measured in profile_init() and
+ * advanced by PROFILE_WRAP each time Timer2 overflows.
+ *
+ * As Timer2 overflows every 16384 cycles, the low two bits of the number of
+ * overflows (the epoch) make up the top two bits of the 16-bit time.
+ */
+#define PROFILE_PHASE(n)  ((uint16_t) (((uint32_t) CLOCK_PRESCALER * (n)) % PROFILE_PERIOD))
+#define PROFILE_PHASE4(n) PROFILE_PHASE(n), PROFILE_PHASE((n) + 1), \
+                          PROFILE_PHASE((n) + 2), PROFILE_PHASE((n) + 3)
+#define PROFILE_PHASE16(n) PROFILE_PHASE4(n), PROFILE_PHASE4((n) + 4), \
+                           PROFILE_PHASE4((n) + 8), PROFILE_PHASE4((n) + 12)
+#define PROFILE_PHASE64(n) PROFILE_PHASE16(n), PROFILE_PHASE16((n) + 16), \
+                           PROFILE_PHASE16((n) + 32), PROFILE_PHASE16((n) + 48)
+
+static const uint16_t profile_phase[256] PROGMEM = {
+  PROFILE_PHASE64(0), PROFILE_PHASE64(64),
+  PROFILE_PHASE64(128), PROFILE_PHASE64(192)
+};
+
+static volatile uint16_t profile_offset;
+static volatile uint8_t profile_epoch;
+
+static profile_stats_t profile_durations[PROFILE_SITES];
+static profile_stats_t profile_latencies[PROFILE_EVENT_SITES];
+
+static const char profile_name_timer2_compa[] PROGMEM = "TIMER2_COMPA";
+static const char profile_name_timer2_ovf[] PROGMEM = "TIMER2_OVF";
+static const char profile_name_int0[] PROGMEM = "INT0";
+static const char profile_name_int1[] PROGMEM = "INT1";
+static const char profile_name_timer1_capt[] PROGMEM = "TIMER1_CAPT";
+static const char profile_name_usart_rx[] PROGMEM = "USART_RX";
+static const char profile_name_usart_udre[] PROGMEM = "USART_UDRE";
+static const char profile_name_timer0_ovf[] PROGMEM = "TIMER0_OVF";
+static const char profile_name_ee_ready[] PROGMEM = "EE_READY";
+static const char profile_name_ir_tx[] PROGMEM = "ir_tx";
+static const char profile_name_ir_rx[] PROGMEM = "ir_rx";
+static const char profile_name_uart_getc[] PROGMEM = "uart_getc";
+static const char profile_name_uart_putc[] PROGMEM = "uart_putc";
+static const char profile_name_radio_tx[] PROGMEM = "radio_tx";
+static const char profile_name_shift_out[] PROGMEM = "shift_out";
+
+static const char * const profile_names[PROFILE_SITES] PROGMEM = {
+  profile_name_timer2_compa,
+  profile_name_timer2_ovf,
+  profile_name_int0,
+  profile_name_int1,
+  profile_name_timer1_capt,
+  profile_name_usart_rx,
+  profile_name_usart_udre,
+  profile_name_timer0_ovf,
+  profile_name_ee_ready,
+  profile_name_ir_tx,
+  profile_name_ir_rx,
+  profile_name_uart_getc,
+  profile_name_uart_putc,
+  profile_name_radio_tx,
+  profile_name_shift_out
+};
+
+/* Converts a reading of the timers to a time. */
+static profile_time_t profile_time(uint8_t epoch, uint8_t coarse, uint16_t fine, uint16_t offset)
+{
+  int16_t cycles = (int16_t) fine - (int16_t) pgm_read_word(&profile_phase[coarse]) - (int16_t) offset;
+
+  /*
+   * Reduce the result into the range [-PROFILE_SLACK, PROFILE_PERIOD -
+   * PROFILE_SLACK), so that readings taken just before the calibrated start of
+   * a tick are negative rather than wrapping around to the end of it.
+   */
+  while (cycles < -PROFILE_SLACK)
+    cycles += PROFILE_PERIOD;
+  if (cycles >= PROFILE_PERIOD - PROFILE_SLACK)
+    cycles -= PROFILE_PERIOD;
+
+  return (profile_time_t) (epoch * PROFILE_OVERFLOW_CYCLES) + coarse * CLOCK_PRESCALER + cycles;
+}
+
+static void profile_clear(profile_stats_t *stats)
+{
+  stats->min = UINT16_MAX;
+  stats->max = 0;
+  for (uint8_t i = 0; i < PROFILE_BUCKETS; i++)
+    stats->hist[i] = 0;
+}
+
+static void profile_add(profile_stats_t *stats, uint16_t cycles)
+{
+  if (cycles < stats->min)
+    stats->min = cycles;
+  if (cycles > stats->max)
+    stats->max = cycles;
+
+  uint8_t bucket = 0;
+  for (uint16_t n = cycles >> PROFILE_BUCKET_SHIFT; n && bucket < PROFILE_BUCKETS - 1; n >>= 1)
+    bucket++;
+
+  if (stats->hist[bucket] != UINT16_MAX)
+    stats->hist[bucket]++;
+}
+
+static void profile_put_stats(const profile_stats_t *stats)
+{
+  /* Take a copy, as the stats may be updated while they're being written. */
+  profile_stats_t copy;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    copy = *stats;
+  }
+
+  uart_putc(' ');
+  uart_putu(copy.max < copy.min ? 0 : copy.min);
+  uart_putc(' ');
+  uart_putu(copy.max);
+  for (uint8_t i = 0; i < PROFILE_BUCKETS; i++)
+  {
+    uart_putc(' ');
+    uart_putu(copy.hist[i]);
+  }
+  uart_puts_p(PSTR("\r\n"));
+}
+
+void profile_init(void)
+{
+  if (!PROFILE)
+    return;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    /*
+     * Wait for the start of a tick, which is defined to be zero cycles into it.
+     * Tick 0 is avoided so that a pending overflow can't be counted twice.
+     */
+    uint8_t tick = TCNT2, coarse;
+    while ((coarse = TCNT2) == tick || coarse == 0);
+    uint16_t fine = TCNT1;
+
+    int16_t offset = (int16_t) fine - (int16_t) pgm_read_word(&profile_phase[coarse]);
+    if (offset < 0)
+      offset += PROFILE_PERIOD;
+    profile_offset = offset;
+  }
+
+  profile_reset();
+}
+
+profile_time_t profile_now(void)
+{
+  uint8_t epoch, coarse;
+  uint16_t fine, offset;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    coarse = TCNT2;
+    fine = TCNT1;
+    offset = profile_offset;
+    epoch = profile_epoch;
+
+    /* Account for an overflow the ISR hasn't run for yet, as clock_micros(). */
+    if ((TIFR2 & (1 << TOV2)) && coarse != UINT8_MAX)
+    {
+      offset += PROFILE_WRAP;
+      epoch++;
+    }
+  }
+
+  return profile_time(epoch, coarse, fine, offset);
+}
+
+profile_time_t profile_tick_time(uint8_t tick)
+{
+  uint8_t epoch = profile_epoch, now = TCNT2;
+  if ((TIFR2 & (1 << TOV2)) && now != UINT8_MAX)
+    epoch++;
+
+  /* A tick after the current one must have been before the last overflow. */
+  if (tick > now)
+    epoch--;
+
+  return (profile_time_t) (epoch * PROFILE_OVERFLOW_CYCLES) + tick * CLOCK_PRESCALER;
+}
+
+void profile_end(profile_scope_t *scope)
+{
+  profile_time_t now = profile_now();
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    profile_add(&profile_durations[scope->site], now - scope->start);
+    if (scope->has_event && scope->site < PROFILE_EVENT_SITES)
+      profile_add(&profile_latencies[scope->site], scope->start - scope->event);
+  }
+}
+
+void profile_overflow(void)
+{
+  uint16_t offset = profile_offset + PROFILE_WRAP;
+  if (offset >= PROFILE_PERIOD)
+    offset -= PROFILE_PERIOD;
+  profile_offset = offset;
+  profile_epoch++;
+}
+
+void profile_dump(void)
+{
+  uart_puts_p(PSTR("# site kind min max <64 <128 <256 <512 <1k <2k <4k >=4k\r\n"));
+
+  for (uint8_t site = 0; site < PROFILE_SITES; site++)
+  {
+    const char *name = pgm_read_ptr(&profile_names[site]);
+
+    uart_puts_p(name);
+    uart_puts_p(PSTR(" duration"));
+    profile_put_stats(&profile_durations[site]);
+
+    if (site < PROFILE_EVENT_SITES)
+    {
+      uart_puts_p(name);
+      uart_puts_p(PSTR(" latency"));
+      profile_put_stats(&profile_latencies[site]);
+    }
+  }
+}
+
+void profile_reset(void)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    for (uint8_t site = 0; site < PROFILE_SITES; site++)
+      profile_clear(&profile_durations[site]);
+
+    for (uint8_t site = 0; site < PROFILE_EVENT_SITES; site++)
+      profile_clear(&profile_latencies[site]);
+  }
+}
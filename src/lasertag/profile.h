@@ -0,0 +1,103 @@
+#ifndef LASERTAG_PROFILE_H
+#define LASERTAG_PROFILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * If true, the duration of each ISR and ATOMIC_BLOCK site (i.e. the time for
+ * which it holds off other interrupts) is measured, along with the entry
+ * latency of the ISRs triggered by a Timer2 event. Build with -DPROFILE=1 to
+ * enable it. Otherwise the macros below compile to nothing.
+ */
+#ifndef PROFILE
+#define PROFILE 0
+#endif
+
+/*
+ * The sites which are profiled. The ISRs triggered by a Timer2 event, whose
+ * entry latency is measured, come first.
+ */
+typedef enum
+{
+  PROFILE_TIMER2_COMPA,
+  PROFILE_TIMER2_OVF,
+  PROFILE_INT0,
+  PROFILE_INT1,
+  PROFILE_TIMER1_CAPT,
+  PROFILE_USART_RX,
+  PROFILE_USART_UDRE,
+  PROFILE_TIMER0_OVF,
+  PROFILE_EE_READY,
+  PROFILE_IR_TX,
+  PROFILE_IR_RX,
+  PROFILE_UART_GETC,
+  PROFILE_UART_PUTC,
+  PROFILE_RADIO_TX,
+  PROFILE_SHIFT_OUT,
+  PROFILE_SITES
+} profile_site_t;
+
+#define PROFILE_EVENT_SITES (PROFILE_TIMER2_OVF + 1)
+
+/*
+ * A timestamp in CPU cycles, which wraps around every 65536 cycles (4.096
+ * milliseconds).
+ */
+typedef uint16_t profile_time_t;
+
+typedef struct
+{
+  profile_site_t site;
+  bool has_event;
+  profile_time_t start, event;
+} profile_scope_t;
+
+#if PROFILE
+/*
+ * Records the duration of the enclosing scope (which ends however it is left)
+ * against the site. The EVENT variant also records the latency between the
+ * given time, at which the event that triggered an ISR occurred, and the
+ * start of the scope.
+ */
+#define PROFILE_SCOPE(site) \
+  profile_scope_t profile_scope __attribute__((cleanup(profile_end))) = \
+    { (site), false, profile_now(), 0 }
+#define PROFILE_SCOPE_EVENT(site, event_time) \
+  profile_scope_t profile_scope __attribute__((cleanup(profile_end))) = \
+    { (site), true, profile_now(), (event_time) }
+
+/* Called by the Timer2 overflow ISR to keep the timebase in step. */
+#define PROFILE_OVERFLOW() profile_overflow()
+#else
+#define PROFILE_SCOPE(site)
+#define PROFILE_SCOPE_EVENT(site, event_time)
+#define PROFILE_OVERFLOW()
+#endif
+
+/*
+ * Initializes the profiler. This must be called after clock_init() and
+ * ir_init(), as the timebase is built from Timer1 and Timer2.
+ */
+void profile_init(void);
+
+/* Returns the current time. */
+profile_time_t profile_now(void);
+
+/*
+ * Returns the time at which Timer2 ticked over to the given value, within the
+ * last 65536 cycles.
+ */
+profile_time_t profile_tick_time(uint8_t tick);
+
+/* Used by the macros above. */
+void profile_end(profile_scope_t *scope);
+void profile_overflow(void);
+
+/* Writes the results to the UART. */
+void profile_dump(void);
+
+/* Clears the results. */
+void profile_reset(void);
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef LASERTAG_PT_H
+#define LASERTAG_PT_H
+
+#include <lasertag/clock.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Protothreads: stackless coroutines which let a driver wait for a condition
+ * or a delay without spinning, by returning to the scheduler and resuming
+ * where it left off the next time it is run.
+ *
+ * A protothread is a function which returns a pt_state_t, with its body
+ * between PT_BEGIN() and PT_END(). The position at which it is waiting is kept
+ * in a pt_t, and is implemented with a switch statement whose case labels are
+ * the line numbers of the PT_WAIT_UNTIL() statements (as in Adam Dunkels'
+ * original). This means that:
+ *
+ *   - local variables are not preserved across a wait, so any state which is
+ *     needed afterwards must be static.
+ *   - a protothread can't contain a switch statement which spans a wait.
+ *   - only one wait may be on each line.
+ */
+/* Marks the deliberate fall through into each case label. */
+#if __GNUC__ >= 7
+#define PT_FALLTHROUGH __attribute__((fallthrough))
+#else
+#define PT_FALLTHROUGH
+#endif
+
+typedef enum
+{
+  PT_WAITING,
+  PT_ENDED
+} pt_state_t;
+
+typedef struct
+{
+  uint16_t line;
+
+  /* The clock tick at which the current delay started, and its length. */
+  uint32_t start;
+  uint16_t ticks;
+} pt_t;
+
+/* Makes the protothread start from the beginning the next time it is run. */
+#define PT_INIT(pt) ((pt)->line = 0)
+
+#define PT_BEGIN(pt) switch ((pt)->line) { case 0:
+
+/* Ends the protothread. Running it again has no effect until PT_INIT(). */
+#define PT_END(pt) \
+  PT_FALLTHROUGH; \
+  default: \
+    (pt)->line = UINT16_MAX; \
+  } \
+  return PT_ENDED
+
+/* Returns until the condition is true. */
+#define PT_WAIT_UNTIL(pt, cond) \
+  do \
+  { \
+    (pt)->line = __LINE__; \
+    PT_FALLTHROUGH; \
+    case __LINE__: \
+    if (!(cond)) \
+      return PT_WAITING; \
+  } while (0)
+
+#define PT_WAIT_WHILE(pt, cond) PT_WAIT_UNTIL((pt), !(cond))
+
+/* Runs another protothread until it ends. */
+#define PT_WAIT_THREAD(pt, thread) PT_WAIT_UNTIL((pt), (thread) == PT_ENDED)
+
+/*
+ * Waits for at least the given number of microseconds (up to ~250 ms). As
+ * the clock only ticks every CLOCK_USECS_PER_TICK microseconds, the delay may
+ * be up to two ticks longer than requested, plus however long the scheduler
+ * takes to run the protothread again. Short delays, which aren't worth
+ * returning to the scheduler for, should use clock_usdelay() instead.
+ */
+#define PT_DELAY(pt, usecs) \
+  do \
+  { \
+    (pt)->start = clock_ticks(); \
+    (pt)->ticks = ((usecs) + CLOCK_USECS_PER_TICK - 1) / CLOCK_USECS_PER_TICK; \
+    PT_WAIT_UNTIL((pt), pt_elapsed(pt)); \
+  } while (0)
+
+/* Returns true if the delay started by PT_DELAY() has elapsed. */
+static inline bool pt_elapsed(const pt_t *pt)
+{
+  /*
+   * The delay started somewhere within the tick at which it was recorded, so
+   * an extra tick is waited for to make sure none of it is cut short.
+   */
+  return clock_ticks() - pt->start > pt->ticks;
+}
+
+#endif
@@ -1,8 +1,105 @@
 #include <lasertag/radio.h>
 #include <avr/interrupt.h>
 #include <avr/io.h>
+#include <lasertag/clock.h>
+#include <lasertag/profile.h>
+#include <lasertag/pt.h>
+#include <lasertag/sched.h>
 #include <lasertag/spi.h>
-#include <stdint.h>
+#include <lasertag/trace.h>
+#include <string.h>
+#include <util/atomic.h>
+#include <util/crc16.h>
+
+/* Commands used to configure the RFM12B, see the datasheet for details. */
+#define RADIO_CMD_STATUS       0x0000
+#define RADIO_CMD_CONFIG       0x80E7 /* TX register, FIFO, 868 MHz, 12 pF */
+#define RADIO_CMD_FREQ         0xA640 /* 868.0 MHz */
+#define RADIO_CMD_DATA_RATE    0xC606 /* ~49.2 kbps */
+#define RADIO_CMD_RX_CONTROL   0x94A2 /* VDI, 134 kHz, max LNA, -91 dBm */
+#define RADIO_CMD_DATA_FILTER  0xC2AC /* auto lock, digital filter, DQD 4 */
+#define RADIO_CMD_FIFO_RESET   0xCA81 /* 8-bit FIFO interrupt, sync disabled */
+#define RADIO_CMD_FIFO_SYNC    0xCA83 /* 8-bit FIFO interrupt, fill on sync */
+#define RADIO_CMD_SYNC_PATTERN 0xCED4 /* sync word 0x2DD4 */
+#define RADIO_CMD_AFC          0xC483 /* AFC on power-up, no restriction */
+#define RADIO_CMD_TX_CONFIG    0x9850 /* 90 kHz deviation, max power */
+#define RADIO_CMD_PLL          0xCC77
+#define RADIO_CMD_WAKEUP       0xE000
+#define RADIO_CMD_LOW_DUTY     0xC800
+#define RADIO_CMD_LOW_BATTERY  0xC049
+
+/* Power management commands which select the operating mode. */
+#define RADIO_CMD_SLEEP        0x8205
+#define RADIO_CMD_IDLE         0x820D
+#define RADIO_CMD_RX_ON        0x82DD
+#define RADIO_CMD_TX_ON        0x823D
+
+/* Commands which read from the RX FIFO and write to the TX register. */
+#define RADIO_CMD_FIFO_READ    0xB000
+#define RADIO_CMD_TX_WRITE     0xB800
+
+/* The interrupt flag (RGIT/FFIT) in the status word. */
+#define RADIO_STATUS_IT 0x8000
+
+/*
+ * The number of microseconds after power-on before the radio is configured,
+ * allowing for its power-on reset to complete.
+ */
+#define RADIO_POR_USECS 100000UL
+
+/* The preamble and sync bytes sent before the length byte of each frame. */
+#define RADIO_PREAMBLE 0xAA
+#define RADIO_SYNC_HI  0x2D
+#define RADIO_SYNC_LO  0xD4
+
+/*
+ * The on-air frame is laid out as follows:
+ *
+ *   3 preamble bytes, 2 sync bytes, length byte, payload, 16-bit CRC,
+ *   1 dummy byte
+ *
+ * The CRC covers the length byte and the payload. The dummy byte ensures the
+ * last CRC byte has been shifted out completely before the transmitter is
+ * switched off.
+ */
+#define RADIO_TX_HEADER 6
+#define RADIO_TX_TRAILER 3
+
+/*
+ * The possible states for the radio state machine.
+ *
+ * INIT: waiting for radio_cycle() to configure the radio
+ * RX: listening for or receiving a frame
+ * TX: transmitting a frame
+ */
+typedef enum
+{
+  RADIO_STATE_INIT,
+  RADIO_STATE_RX,
+  RADIO_STATE_TX
+} radio_state_t;
+
+static volatile radio_state_t radio_state;
+
+/* The protothread which configures the radio. */
+static pt_t radio_pt;
+
+/* The TX state. */
+static uint8_t radio_tx_buf[RADIO_MAX_PAYLOAD];
+static uint8_t radio_tx_len, radio_tx_pos;
+static uint16_t radio_tx_crc;
+
+/* The RX state. */
+static uint8_t radio_rx_buf[RADIO_MAX_PAYLOAD];
+static uint8_t radio_rx_frame_len, radio_rx_len, radio_rx_pos;
+static uint16_t radio_rx_crc;
+static volatile bool radio_rx_ready;
+
+/*
+ * Set if the previous frame hadn't been collected when the current frame
+ * started, in which case the current frame is thrown away as a whole.
+ */
+static bool radio_rx_discard;
 
 static uint16_t radio_spi_transfer(uint16_t value)
 {
@@ -22,9 +119,183 @@ static uint16_t radio_spi_transfer(uint16_t value)
   return ret_value;
 }
 
+/*
+ * Switches the radio back to receive mode and re-arms the sync pattern
+ * detector, so the FIFO only starts filling when the next frame begins.
+ *
+ * NB: interrupts must be disabled by the caller.
+ */
+static void radio_start_rx(void)
+{
+  radio_state = RADIO_STATE_RX;
+  radio_rx_pos = 0;
+
+  radio_spi_transfer(RADIO_CMD_FIFO_RESET);
+  radio_spi_transfer(RADIO_CMD_FIFO_SYNC);
+  radio_spi_transfer(RADIO_CMD_RX_ON);
+}
+
+/* Returns the byte at the given position in the on-air TX frame. */
+static uint8_t radio_tx_byte(uint8_t pos)
+{
+  if (pos < 3)
+    return RADIO_PREAMBLE;
+  else if (pos == 3)
+    return RADIO_SYNC_HI;
+  else if (pos == 4)
+    return RADIO_SYNC_LO;
+  else if (pos == 5)
+    return radio_tx_len;
+
+  pos -= RADIO_TX_HEADER;
+  if (pos < radio_tx_len)
+    return radio_tx_buf[pos];
+
+  pos -= radio_tx_len;
+  if (pos == 0)
+    return radio_tx_crc & 0xFF;
+  else if (pos == 1)
+    return (radio_tx_crc >> 8) & 0xFF;
+  else
+    return RADIO_PREAMBLE;
+}
+
+static void radio_rx_byte(uint8_t value)
+{
+  if (radio_rx_pos == 0)
+  {
+    /* The first byte after the sync word is the length of the payload. */
+    if (value > RADIO_MAX_PAYLOAD)
+    {
+      /* Corrupted frame - drop it and wait for the next sync word. */
+      trace(TRACE_RADIO_DROP, (TRACE_RADIO_TOO_LONG << 8) | value);
+      radio_start_rx();
+      return;
+    }
+
+    radio_rx_frame_len = value;
+    radio_rx_discard = radio_rx_ready;
+    radio_rx_crc = _crc16_update(~0, value);
+  }
+  else if (radio_rx_pos <= radio_rx_frame_len)
+  {
+    /*
+     * If the previous frame hadn't been collected when this one started we
+     * still need to clock the bytes out of the FIFO, but they are thrown away.
+     * Otherwise, any bytes written before the previous frame was collected
+     * would be missing from this one.
+     */
+    if (!radio_rx_discard)
+      radio_rx_buf[radio_rx_pos - 1] = value;
+    radio_rx_crc = _crc16_update(radio_rx_crc, value);
+  }
+  else
+  {
+    /*
+     * The CRC bytes. When the CRC is included in the calculation, the result
+     * is zero if the frame arrived intact.
+     */
+    radio_rx_crc = _crc16_update(radio_rx_crc, value);
+    if (radio_rx_pos == radio_rx_frame_len + 2)
+    {
+      if (radio_rx_crc != 0)
+      {
+        trace(TRACE_RADIO_DROP, (TRACE_RADIO_BAD_CRC << 8) | radio_rx_frame_len);
+      }
+      else if (radio_rx_discard)
+      {
+        trace(TRACE_RADIO_DROP, (TRACE_RADIO_FULL << 8) | radio_rx_frame_len);
+      }
+      else
+      {
+        radio_rx_len = radio_rx_frame_len;
+        radio_rx_ready = true;
+        trace(TRACE_RADIO_RX, (radio_rx_len ? radio_rx_buf[0] << 8 : 0) | radio_rx_len);
+
+        /* Let the uplink handle the frame (e.g. an ACK) straight away. */
+        sched_wake(SCHED_UPLINK);
+      }
+
+      radio_start_rx();
+      return;
+    }
+  }
+
+  radio_rx_pos++;
+}
+
 ISR(INT1_vect)
 {
+  PROFILE_SCOPE(PROFILE_INT1);
 
+  /* Reading the status word also clears the interrupt. */
+  uint16_t status = radio_spi_transfer(RADIO_CMD_STATUS);
+  if (!(status & RADIO_STATUS_IT))
+    return;
+
+  if (radio_state == RADIO_STATE_RX)
+  {
+    /* The FIFO contains the next received byte. */
+    radio_rx_byte(radio_spi_transfer(RADIO_CMD_FIFO_READ) & 0xFF);
+  }
+  else
+  {
+    if (radio_tx_pos == RADIO_TX_HEADER + radio_tx_len + RADIO_TX_TRAILER)
+    {
+      /* The whole frame has been sent, switch back to listening. */
+      radio_spi_transfer(RADIO_CMD_IDLE);
+      radio_start_rx();
+
+      /* The uplink may have another frame waiting to be sent. */
+      sched_wake(SCHED_UPLINK);
+    }
+    else
+    {
+      /* The TX register is empty, write the next byte of the frame. */
+      radio_spi_transfer(RADIO_CMD_TX_WRITE | radio_tx_byte(radio_tx_pos++));
+    }
+  }
+}
+
+static pt_state_t radio_init_thread(void)
+{
+  PT_BEGIN(&radio_pt);
+
+  /* Give the radio time to finish its power-on reset. */
+  PT_WAIT_UNTIL(&radio_pt, clock_ticks() >= RADIO_POR_USECS / CLOCK_USECS_PER_TICK);
+
+  /* Clear the power-on reset interrupt and put the radio to sleep. */
+  radio_spi_transfer(RADIO_CMD_STATUS);
+  radio_spi_transfer(RADIO_CMD_SLEEP);
+
+  /* Configure the radio. */
+  radio_spi_transfer(RADIO_CMD_CONFIG);
+  radio_spi_transfer(RADIO_CMD_FREQ);
+  radio_spi_transfer(RADIO_CMD_DATA_RATE);
+  radio_spi_transfer(RADIO_CMD_RX_CONTROL);
+  radio_spi_transfer(RADIO_CMD_DATA_FILTER);
+  radio_spi_transfer(RADIO_CMD_FIFO_SYNC);
+  radio_spi_transfer(RADIO_CMD_SYNC_PATTERN);
+  radio_spi_transfer(RADIO_CMD_AFC);
+  radio_spi_transfer(RADIO_CMD_TX_CONFIG);
+  radio_spi_transfer(RADIO_CMD_PLL);
+  radio_spi_transfer(RADIO_CMD_WAKEUP);
+  radio_spi_transfer(RADIO_CMD_LOW_DUTY);
+  radio_spi_transfer(RADIO_CMD_LOW_BATTERY);
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    /* Start listening for frames. */
+    radio_start_rx();
+
+    /* Enable INT1 on a falling edge of PD3. */
+    EICRA |= (1 << ISC11);
+    EIMSK |= (1 << INT1);
+  }
+
+  trace(TRACE_READY, TRACE_READY_RADIO);
+
+  PT_END(&radio_pt);
 }
 
 void radio_init(void)
@@ -36,8 +307,72 @@ void radio_init(void)
   /* Set nIRQ (PD3) to be an input. */
   DDRD &= ~(1 << PD3);
 
-  /* Enable INT1 on a falling edge of PD3. */
-  EICRA |= (1 << ISC11);
-  EIMSK |= (1 << INT1);
+  /* The radio is configured by radio_cycle(). */
+  radio_state = RADIO_STATE_INIT;
+  PT_INIT(&radio_pt);
+}
+
+void radio_cycle(void)
+{
+  radio_init_thread();
 }
 
+bool radio_busy(void)
+{
+  return radio_state != RADIO_STATE_RX;
+}
+
+bool radio_tx(const uint8_t *buf, uint8_t len)
+{
+  if (len > RADIO_MAX_PAYLOAD)
+    return false;
+
+  bool success = false;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    PROFILE_SCOPE(PROFILE_RADIO_TX);
+
+    /*
+     * Frames can only be sent if the transmitter is idle and we're not half
+     * way through receiving a frame.
+     */
+    if (radio_state == RADIO_STATE_RX && radio_rx_pos == 0)
+    {
+      memcpy(radio_tx_buf, buf, len);
+      radio_tx_len = len;
+      radio_tx_pos = 0;
+
+      /* Calculate the CRC of the length byte and payload up front. */
+      radio_tx_crc = _crc16_update(~0, len);
+      for (uint8_t i = 0; i < len; i++)
+        radio_tx_crc = _crc16_update(radio_tx_crc, buf[i]);
+
+      /*
+       * Switch the transmitter on, the RGIT interrupt is fired as soon as the
+       * TX register is ready for the first byte.
+       */
+      radio_state = RADIO_STATE_TX;
+      radio_spi_transfer(RADIO_CMD_IDLE);
+      radio_spi_transfer(RADIO_CMD_TX_ON);
+
+      trace(TRACE_RADIO_TX, (len ? buf[0] << 8 : 0) | len);
+      success = true;
+    }
+  }
+  return success;
+}
+
+bool radio_rx(uint8_t *buf, uint8_t *len)
+{
+  if (!radio_rx_ready)
+    return false;
+
+  /*
+   * The ISR doesn't touch the buffer while the ready flag is set, so it can be
+   * copied without disabling interrupts.
+   */
+  memcpy(buf, radio_rx_buf, radio_rx_len);
+  *len = radio_rx_len;
+  radio_rx_ready = false;
+  return true;
+}
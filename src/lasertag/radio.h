@@ -1,8 +1,40 @@
 #ifndef LASERTAG_RADIO_H
 #define LASERTAG_RADIO_H
 
-/* Initializes the RFM12B radio chip. */
+#include <stdbool.h>
+#include <stdint.h>
+
+/* The maximum number of payload bytes in a single radio frame. */
+#define RADIO_MAX_PAYLOAD 24
+
+/*
+ * Starts initializing the RFM12B radio chip. The radio is configured by
+ * radio_cycle() once it has come out of its power-on reset.
+ */
 void radio_init(void);
 
-#endif
+/* Called regularly to configure the radio. */
+void radio_cycle(void);
+
+/*
+ * Returns true if a frame is currently being transmitted, or the radio hasn't
+ * been configured yet.
+ */
+bool radio_busy(void);
 
+/*
+ * Starts transmitting a frame of up to RADIO_MAX_PAYLOAD bytes. If the radio
+ * is busy, false is returned and the frame is not sent. As with IR packets, no
+ * guarantees are made that the frame will arrive.
+ */
+bool radio_tx(const uint8_t *buf, uint8_t len);
+
+/*
+ * Polls the radio receive buffer. If no frame has been received, false is
+ * returned. Otherwise, the frame's payload is copied into the buffer (which
+ * must be at least RADIO_MAX_PAYLOAD bytes long), its length is written into
+ * the destination specified by the len argument and true is returned.
+ */
+bool radio_rx(uint8_t *buf, uint8_t *len);
+
+#endif
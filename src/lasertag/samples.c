@@ -0,0 +1,136 @@
+/* Generated by tools/pcmenc, do not edit. */
+#include <lasertag/samples.h>
+#include <avr/pgmspace.h>
+
+/* sounds/shot.wav: 1249 samples, 0.160 seconds */
+const uint8_t samples_shot[] PROGMEM = {
+  0xe1, 0x04, 0xf7, 0x7f, 0xf7, 0x7f, 0xf7, 0x69, 0xd0, 0x30, 0xa8, 0x20,
+  0xc9, 0x41, 0x09, 0x8d, 0x04, 0x8b, 0x03, 0x8c, 0x05, 0x8b, 0x05, 0x8c,
+  0x03, 0xd1, 0x20, 0xb8, 0x41, 0xc8, 0x39, 0x81, 0x0d, 0x84, 0x0b, 0x03,
+  0xc8, 0x28, 0xa8, 0x52, 0x89, 0x1c, 0x84, 0x9b, 0x60, 0xb8, 0x48, 0x90,
+  0x0a, 0x85, 0x9a, 0x48, 0xa9, 0x90, 0x86, 0x8b, 0x05, 0xb8, 0x49, 0x18,
+  0x1b, 0x04, 0xba, 0x30, 0x8a, 0x8c, 0x15, 0xe8, 0x48, 0x08, 0x8a, 0x58,
+  0xa9, 0x80, 0x23, 0x8d, 0x50, 0x89, 0x1c, 0x12, 0xc0, 0x29, 0x84, 0x0d,
+  0x38, 0x08, 0x0d, 0x31, 0xb8, 0x19, 0x85, 0xd9, 0x91, 0x05, 0xb8, 0x40,
+  0x90, 0x8b, 0x69, 0x88, 0x1b, 0x48, 0x18, 0xab, 0x58, 0x82, 0x8d, 0x40,
+  0x80, 0x0b, 0x69, 0x19, 0x8d, 0x21, 0x80, 0x8a, 0x49, 0x01, 0x0c, 0x5a,
+  0x89, 0x2b, 0x00, 0x84, 0xf1, 0x80, 0x01, 0xb1, 0x91, 0x23, 0xb0, 0x9e,
+  0x78, 0x88, 0x89, 0x88, 0x04, 0xa8, 0x18, 0x96, 0x08, 0x0d, 0x28, 0x82,
+  0xd0, 0x88, 0x15, 0xc8, 0x08, 0x21, 0x80, 0x0e, 0x88, 0x83, 0x82, 0x0c,
+  0x30, 0x88, 0xc8, 0x90, 0x05, 0x00, 0x9f, 0x80, 0x85, 0x18, 0x1c, 0x48,
+  0x09, 0xd0, 0x91, 0x41, 0x88, 0xb9, 0x81, 0x21, 0xb2, 0x1e, 0x00, 0x05,
+  0xa8, 0x8c, 0x10, 0x93, 0x03, 0x8f, 0x80, 0x83, 0x98, 0x0c, 0xa0, 0x87,
+  0x80, 0xd2, 0x08, 0x38, 0x01, 0xe0, 0x00, 0x49, 0x90, 0xc0, 0x01, 0x09,
+  0x93, 0x31, 0x8f, 0x90, 0x06, 0x88, 0xc0, 0x00, 0x30, 0x99, 0xd8, 0xa1,
+  0x11, 0x85, 0x18, 0x0f, 0x00, 0x59, 0x90, 0x00, 0x8b, 0x18, 0x96, 0x80,
+  0xc9, 0x29, 0xa1, 0x86, 0x88, 0x1c, 0x89, 0x31, 0x02, 0xa1, 0x8f, 0x18,
+  0x79, 0x00, 0x90, 0x0b, 0x90, 0x48, 0x29, 0x29, 0x1f, 0x08, 0x5a, 0x88,
+  0x80, 0x9c, 0x01, 0x58, 0x01, 0x09, 0x8e, 0x88, 0x61, 0x80, 0x80, 0x9b,
+  0x01, 0xa9, 0x07, 0x98, 0xb0, 0x10, 0x08, 0x71, 0x08, 0x88, 0x9c, 0x00,
+  0x61, 0x08, 0x88, 0xd9, 0x10, 0x99, 0x42, 0x98, 0x11, 0x8f, 0x90, 0x20,
+  0x95, 0x00, 0x89, 0x9b, 0x29, 0x90, 0x27, 0x09, 0xd0, 0x09, 0x19, 0x79,
+  0x81, 0x29, 0xc8, 0x2a, 0x98, 0x78, 0x91, 0x90, 0xe2, 0x00, 0x98, 0x90,
+  0x14, 0x18, 0x19, 0x9d, 0x09, 0x91, 0x86, 0x11, 0x99, 0x1c, 0x81, 0x2a,
+  0x7b, 0x08, 0x00, 0xe9, 0x81, 0x90, 0x81, 0x16, 0xa0, 0x01, 0x8f, 0x00,
+  0x18, 0x28, 0xb2, 0x28, 0x0a, 0x8f, 0x11, 0x9b, 0x43, 0x90, 0x88, 0xe3,
+  0x10, 0xa8, 0x30, 0x97, 0x29, 0x90, 0xf0, 0x90, 0x08, 0x28, 0x05, 0x00,
+  0x08, 0x2a, 0x8f, 0x00, 0x9a, 0x52, 0x28, 0x0a, 0x98, 0x1f, 0xa0, 0x91,
+  0x91, 0x05, 0x81, 0x39, 0xf1, 0x89, 0x08, 0x08, 0x71, 0x90, 0x80, 0x82,
+  0x0d, 0x19, 0xa0, 0x0a, 0x87, 0x00, 0x29, 0x90, 0x0f, 0x18, 0x88, 0x29,
+  0x85, 0x29, 0x28, 0xe0, 0x08, 0x80, 0x0b, 0x20, 0x07, 0x98, 0x81, 0x89,
+  0x8c, 0x9a, 0x02, 0xc2, 0x17, 0x99, 0x81, 0x08, 0x0d, 0x8a, 0x03, 0x3a,
+  0x7c, 0x82, 0x18, 0x08, 0xf1, 0x09, 0x00, 0x08, 0xa0, 0x14, 0x81, 0x89,
+  0x03, 0xdf, 0x81, 0x88, 0xa1, 0x78, 0x01, 0x91, 0x88, 0x80, 0x1d, 0x89,
+  0x89, 0x00, 0x70, 0x00, 0x82, 0x99, 0x38, 0x8f, 0x00, 0xa8, 0x18, 0x79,
+  0x80, 0x90, 0x08, 0x89, 0xc0, 0xa0, 0xa4, 0x10, 0xa0, 0x27, 0x91, 0x82,
+  0x9c, 0xa4, 0x8f, 0x10, 0x08, 0xa0, 0x71, 0x80, 0x18, 0xb1, 0x80, 0xf0,
+  0x89, 0x11, 0x00, 0xb8, 0x70, 0x00, 0xa1, 0xa1, 0x30, 0xfb, 0x18, 0xa1,
+  0x28, 0xa9, 0x72, 0x90, 0x02, 0x01, 0x8b, 0xf8, 0xa0, 0x18, 0xa8, 0x28,
+  0x71, 0x02, 0x8a, 0x28, 0x99, 0x10, 0xaf, 0x39, 0x80, 0x0c, 0x02, 0x37,
+  0x8a, 0x98, 0x88, 0x28, 0xf3, 0x99, 0x19, 0x92, 0x9c, 0x21, 0x07, 0x21,
+  0x09, 0xb8, 0x90, 0x0f, 0xa0, 0x39, 0x0a, 0xa8, 0x79, 0x24, 0x90, 0xa1,
+  0x91, 0xa4, 0xf2, 0x88, 0x90, 0x80, 0x08, 0x98, 0x37, 0xa8, 0x90, 0x18,
+  0x91, 0xf8, 0x89, 0x09, 0x02, 0x38, 0x80, 0x6f, 0x91, 0xa2, 0xa2, 0x12,
+  0x2a, 0x9f, 0x89, 0x19, 0x29, 0x82, 0x3d, 0x07, 0x88, 0x81, 0x80, 0x29,
+  0x89, 0xaf, 0x2a, 0x8a, 0x08, 0x02, 0x68, 0x07, 0x80, 0x09, 0x09, 0x98,
+  0x22, 0x8f, 0x09, 0x01, 0x0c, 0x88, 0x82, 0x17, 0xa8, 0x21, 0x0a, 0x88,
+  0x31, 0xbe, 0x19, 0x2b, 0x0c, 0x04, 0xa0, 0x78, 0x02, 0x0a, 0x00, 0x02,
+  0x8d, 0x99, 0x9f, 0x12, 0x90, 0x4a, 0x10, 0x8c, 0x71, 0x81, 0x99, 0x21,
+  0x80, 0xaa, 0x03,
+};
+
+/* sounds/hit.wav: 1718 samples, 0.220 seconds */
+const uint8_t samples_hit[] PROGMEM = {
+  0xb6, 0x06, 0x70, 0x77, 0x77, 0x77, 0x57, 0x00, 0x50, 0x98, 0xa9, 0xfb,
+  0x8d, 0xa9, 0x98, 0x84, 0x18, 0x00, 0x0e, 0x11, 0x20, 0x72, 0x12, 0x11,
+  0xb1, 0x01, 0x98, 0xa8, 0x87, 0xaa, 0xaa, 0xf9, 0x9b, 0x89, 0x49, 0x09,
+  0x19, 0x18, 0x1f, 0x01, 0x12, 0x72, 0x22, 0x02, 0xd2, 0x00, 0x90, 0x90,
+  0x96, 0x98, 0x99, 0xfa, 0x9a, 0x88, 0x99, 0x85, 0x88, 0x08, 0x1c, 0x12,
+  0x12, 0x73, 0x12, 0x30, 0x11, 0x0e, 0x00, 0x91, 0x60, 0x98, 0xba, 0xb8,
+  0xaf, 0x9a, 0x88, 0x85, 0x88, 0x88, 0xc1, 0x01, 0x21, 0x31, 0x57, 0x01,
+  0x01, 0xc1, 0x18, 0x98, 0x00, 0x96, 0x88, 0x99, 0xfb, 0x99, 0x89, 0x99,
+  0x94, 0x88, 0x81, 0xd1, 0x11, 0x32, 0x02, 0x37, 0x12, 0x11, 0xe1, 0x00,
+  0x80, 0x88, 0xa5, 0xa9, 0xb9, 0xfc, 0x8a, 0x90, 0xa8, 0x83, 0x80, 0x11,
+  0xf1, 0x08, 0x12, 0x21, 0x47, 0x10, 0x11, 0xc1, 0x11, 0x89, 0x81, 0x95,
+  0x99, 0xbb, 0xf9, 0x9c, 0x98, 0x89, 0x49, 0x89, 0x88, 0x00, 0x1d, 0x23,
+  0x42, 0x71, 0x03, 0x02, 0x02, 0x0d, 0x80, 0x08, 0x79, 0x98, 0x89, 0x8a,
+  0xfa, 0x9b, 0x8a, 0x08, 0x04, 0x89, 0x18, 0xe2, 0x11, 0x11, 0x32, 0x47,
+  0x10, 0x11, 0x10, 0x0d, 0x88, 0x90, 0x79, 0x98, 0x88, 0xa9, 0x9f, 0x98,
+  0x99, 0x88, 0x93, 0x88, 0x21, 0xf8, 0x29, 0x02, 0x33, 0x73, 0x14, 0x10,
+  0x10, 0x8d, 0x00, 0x08, 0x99, 0x87, 0x98, 0x9a, 0xfa, 0x89, 0x98, 0x99,
+  0x04, 0x89, 0x18, 0x00, 0x1e, 0x10, 0x01, 0x72, 0x12, 0x22, 0x21, 0xe0,
+  0x08, 0x08, 0x08, 0x40, 0xaa, 0x99, 0xbc, 0xbf, 0xa9, 0x99, 0x89, 0x86,
+  0x18, 0x08, 0xf1, 0x00, 0x11, 0x12, 0x71, 0x12, 0x01, 0x02, 0xd8, 0x00,
+  0x00, 0xa0, 0x86, 0x89, 0xa8, 0xba, 0xbf, 0x99, 0x99, 0x09, 0x87, 0x80,
+  0x80, 0xc1, 0x11, 0x08, 0x33, 0x72, 0x15, 0x00, 0x00, 0xd0, 0x08, 0x00,
+  0x90, 0x68, 0x99, 0xa8, 0xb8, 0xf8, 0x9a, 0x88, 0x88, 0x93, 0x08, 0x80,
+  0x38, 0x8f, 0x22, 0x22, 0x11, 0x57, 0x10, 0x02, 0x20, 0x0e, 0x88, 0x81,
+  0x99, 0x95, 0xa0, 0x9a, 0x8a, 0xbf, 0x99, 0x98, 0xa9, 0x87, 0x89, 0x80,
+  0x00, 0x0e, 0x20, 0x22, 0x31, 0x27, 0x21, 0x21, 0x08, 0x8e, 0x80, 0x80,
+  0x99, 0x07, 0x88, 0x98, 0xaa, 0xbf, 0x88, 0x9a, 0x99, 0x87, 0x88, 0x81,
+  0x80, 0x1c, 0x10, 0x22, 0x32, 0x37, 0x11, 0x11, 0x12, 0x0f, 0x81, 0x80,
+  0xa8, 0x78, 0x88, 0x98, 0xba, 0xf9, 0x9a, 0xa8, 0x88, 0x69, 0x88, 0x19,
+  0x88, 0xd1, 0x11, 0x02, 0x01, 0x72, 0x14, 0x20, 0x02, 0x20, 0x8f, 0x81,
+  0x08, 0x89, 0x96, 0x88, 0x89, 0xba, 0x9f, 0x99, 0x89, 0x98, 0x68, 0x88,
+  0x90, 0x00, 0xe8, 0x01, 0x20, 0x12, 0x73, 0x12, 0x11, 0x21, 0x38, 0x0f,
+  0x18, 0x99, 0x08, 0x86, 0x99, 0x89, 0xa9, 0xfb, 0x8b, 0x8a, 0x99, 0x58,
+  0x99, 0x88, 0x00, 0x28, 0x1f, 0x20, 0x31, 0x21, 0x47, 0x11, 0x11, 0x12,
+  0xe1, 0x08, 0x80, 0x88, 0x7a, 0x89, 0x89, 0x88, 0x8b, 0xbf, 0x89, 0x99,
+  0x98, 0x95, 0x80, 0x88, 0x21, 0xf1, 0x00, 0x28, 0x31, 0x21, 0x47, 0x10,
+  0x11, 0x12, 0x0f, 0x00, 0x18, 0xa0, 0x79, 0x09, 0x99, 0x9a, 0x8a, 0x9f,
+  0x99, 0x99, 0x89, 0x87, 0x88, 0x08, 0x18, 0xe0, 0x10, 0x11, 0x20, 0x30,
+  0x17, 0x11, 0x11, 0x00, 0xd0, 0x01, 0x80, 0x89, 0x89, 0x87, 0xa8, 0xaa,
+  0x9b, 0xbf, 0xa8, 0x88, 0x9b, 0x78, 0x00, 0x08, 0x00, 0x09, 0x0f, 0x01,
+  0x11, 0x21, 0x70, 0x12, 0x01, 0x30, 0x13, 0x0f, 0x08, 0x10, 0x88, 0x79,
+  0x90, 0x98, 0x9b, 0xb8, 0xcf, 0x98, 0x98, 0x09, 0x6a, 0x08, 0x88, 0x08,
+  0x18, 0x0f, 0x11, 0x11, 0x11, 0x70, 0x12, 0x10, 0x21, 0x11, 0x0f, 0x00,
+  0x98, 0x18, 0x80, 0x86, 0x98, 0xaa, 0x98, 0xf9, 0x8c, 0xa9, 0x90, 0x89,
+  0x84, 0x8a, 0x01, 0x80, 0xf2, 0x18, 0x12, 0x22, 0x32, 0x47, 0x00, 0x11,
+  0x03, 0x30, 0x9f, 0x01, 0x98, 0x90, 0x70, 0x90, 0x99, 0xa9, 0xc8, 0xaf,
+  0x88, 0x89, 0x99, 0x78, 0x90, 0x80, 0x80, 0x88, 0xd1, 0x80, 0x22, 0x83,
+  0x41, 0x47, 0x11, 0x00, 0x28, 0x10, 0x0f, 0x00, 0x90, 0x98, 0x79, 0x89,
+  0x88, 0x98, 0xa9, 0x9f, 0x98, 0x9a, 0x88, 0x9a, 0x87, 0x90, 0x80, 0x11,
+  0xe1, 0x18, 0x11, 0x11, 0x21, 0x72, 0x13, 0x20, 0x12, 0x82, 0xf8, 0x88,
+  0x10, 0x09, 0xb9, 0x87, 0x99, 0x88, 0x98, 0xab, 0xdf, 0x88, 0x98, 0x89,
+  0x68, 0x99, 0x00, 0x90, 0x08, 0xf8, 0x18, 0x12, 0x02, 0x13, 0x70, 0x14,
+  0x00, 0x02, 0x12, 0x8f, 0x08, 0x81, 0x08, 0x88, 0x97, 0x88, 0x98, 0xa9,
+  0xbb, 0x9f, 0xa9, 0x98, 0x0a, 0x9a, 0x17, 0x00, 0x19, 0x89, 0x21, 0x8f,
+  0x80, 0x31, 0x30, 0x71, 0x13, 0x31, 0x12, 0x01, 0xf2, 0x80, 0x98, 0x80,
+  0x18, 0x70, 0x82, 0x9a, 0x9b, 0xbb, 0xfd, 0x0a, 0xa8, 0x99, 0x99, 0x69,
+  0x88, 0x10, 0x19, 0x81, 0xf1, 0x19, 0x31, 0x32, 0x42, 0x78, 0x03, 0x11,
+  0x12, 0x21, 0xf0, 0x80, 0x90, 0x00, 0xb0, 0x79, 0x08, 0x98, 0x88, 0xbb,
+  0xf9, 0x8e, 0x89, 0x99, 0x98, 0x68, 0x08, 0x89, 0x89, 0x10, 0x28, 0x8f,
+  0x11, 0x21, 0x21, 0x13, 0x57, 0x08, 0x00, 0x11, 0x81, 0x0d, 0x81, 0x01,
+  0x0a, 0x19, 0x87, 0xa9, 0x89, 0x0b, 0x8c, 0xf9, 0x8b, 0x99, 0x9a, 0xaa,
+  0x70, 0x00, 0x89, 0x81, 0x00, 0xf8, 0x00, 0x20, 0x22, 0x20, 0x53, 0x27,
+  0x10, 0x20, 0x30, 0x01, 0x8f, 0x88, 0x88, 0x09, 0x10, 0x97, 0x08, 0x8a,
+  0x0b, 0x89, 0xfb, 0x8e, 0x99, 0x88, 0xa8, 0x59, 0x10, 0x0a, 0x01, 0x91,
+  0x21, 0xbf, 0x02, 0x32, 0x22, 0x41, 0x27, 0x11, 0x00, 0x01, 0x13, 0xf2,
+  0x18, 0x91, 0x08, 0x91, 0x79, 0x99, 0x8a, 0x99, 0x0b, 0xd9, 0xcf, 0x89,
+  0x98, 0xa8, 0x88, 0x79, 0x01, 0x88, 0x18, 0x18, 0xf1, 0x88, 0x02, 0x11,
+  0x21, 0x42, 0x27, 0x10, 0x01, 0x80, 0x13, 0xf1, 0x88, 0x00, 0x18, 0x89,
+  0xa8, 0x17, 0xaa, 0x09, 0x89, 0xba, 0xef, 0x98, 0x98, 0x88, 0x9a, 0x69,
+  0x98, 0x09, 0x91, 0x02, 0x92, 0x8f, 0x08, 0x82, 0x42, 0x30, 0x74, 0x03,
+  0x10, 0x11, 0x10, 0x10, 0x8f, 0x00, 0x01, 0xaa, 0x98, 0x7b, 0x80, 0x09,
+  0x88, 0xca, 0xb8, 0xaf, 0x89, 0xa8, 0xb9, 0x89, 0x7b,
+};
@@ -0,0 +1,14 @@
+#ifndef LASERTAG_SAMPLES_H
+#define LASERTAG_SAMPLES_H
+
+#include <stdint.h>
+
+/*
+ * The ADPCM samples played by the speaker, which are generated from the WAV
+ * files in sounds/ by tools/pcmenc (run make samples after changing them).
+ * See tools/pcmenc/pcmenc.c for the format.
+ */
+extern const uint8_t samples_shot[];
+extern const uint8_t samples_hit[];
+
+#endif
@@ -0,0 +1,188 @@
+#include <lasertag/sched.h>
+#include <avr/pgmspace.h>
+#include <lasertag/clock.h>
+#include <lasertag/console.h>
+#include <lasertag/game.h>
+#include <lasertag/lcd.h>
+#include <lasertag/led.h>
+#include <lasertag/radio.h>
+#include <lasertag/trace.h>
+#include <lasertag/uart.h>
+#include <lasertag/uplink.h>
+#include <stdbool.h>
+#include <util/atomic.h>
+
+/* Converts a time in microseconds to clock ticks. */
+#define SCHED_TICKS(usecs) ((uint16_t) ((usecs) / CLOCK_USECS_PER_TICK))
+
+typedef struct
+{
+  void (*run)(void);
+
+  /* The time between runs, in clock ticks. */
+  uint16_t period;
+
+  /* The time a run is expected to take at most, in clock ticks. */
+  uint16_t budget;
+} sched_info_t;
+
+typedef struct
+{
+  uint16_t runs, overruns;
+  uint16_t max, late;
+  uint32_t total;
+} sched_stats_t;
+
+/*
+ * The buttons are sampled every 10 ms, so the game task runs twice as often to
+ * keep the sampling regular. The LCD task sends every queued write which
+ * completes quickly in one run, so its budget allows for a full queue. The
+ * trace task starts at most one EEPROM write per run, which finishes in the
+ * background, so its period is just longer than a write (~3.4 ms) takes. The
+ * console's budget allows for a dump, as the UART blocks once its buffer is
+ * full.
+ */
+static const sched_info_t sched_info[SCHED_TASKS] PROGMEM = {
+  [SCHED_GAME]    = { game_cycle,    SCHED_TICKS(5000),  SCHED_TICKS(1000) },
+  [SCHED_UPLINK]  = { uplink_cycle,  SCHED_TICKS(2000),  SCHED_TICKS(2000) },
+  [SCHED_RADIO]   = { radio_cycle,   SCHED_TICKS(1000),  SCHED_TICKS(500) },
+  [SCHED_LCD]     = { lcd_cycle,     SCHED_TICKS(1000),  SCHED_TICKS(2000) },
+  [SCHED_LED]     = { led_cycle,     SCHED_TICKS(10000), SCHED_TICKS(500) },
+  [SCHED_TRACE]   = { trace_cycle,   SCHED_TICKS(4000),  SCHED_TICKS(500) },
+  [SCHED_CONSOLE] = { console_cycle, SCHED_TICKS(20000), SCHED_TICKS(50000) }
+};
+
+static const char sched_name_game[] PROGMEM = "game";
+static const char sched_name_uplink[] PROGMEM = "uplink";
+static const char sched_name_radio[] PROGMEM = "radio";
+static const char sched_name_lcd[] PROGMEM = "lcd";
+static const char sched_name_led[] PROGMEM = "led";
+static const char sched_name_trace[] PROGMEM = "trace";
+static const char sched_name_console[] PROGMEM = "console";
+
+static const char * const sched_names[SCHED_TASKS] PROGMEM = {
+  sched_name_game,
+  sched_name_uplink,
+  sched_name_radio,
+  sched_name_lcd,
+  sched_name_led,
+  sched_name_trace,
+  sched_name_console
+};
+
+/* A bitmask of the tasks which have been woken. */
+static volatile uint8_t sched_woken;
+
+/* The time at which each task is next due. */
+static uint32_t sched_due[SCHED_TASKS];
+
+static sched_stats_t sched_stats[SCHED_TASKS];
+
+static void sched_put_ticks(uint32_t ticks)
+{
+  uart_putc(' ');
+  uart_putu(ticks * CLOCK_USECS_PER_TICK);
+}
+
+void sched_init(void)
+{
+  /* Stagger the first runs, so the tasks don't all fall due together. */
+  uint32_t now = clock_ticks();
+  for (uint8_t task = 0; task < SCHED_TASKS; task++)
+    sched_due[task] = now + task;
+
+  sched_reset();
+}
+
+void sched_cycle(void)
+{
+  uint32_t now = clock_ticks();
+
+  for (uint8_t task = 0; task < SCHED_TASKS; task++)
+  {
+    uint8_t mask = 1 << task;
+    int32_t late = now - sched_due[task];
+    if (!(sched_woken & mask) && late < 0)
+      continue;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      sched_woken &= ~mask;
+    }
+
+    sched_info_t info;
+    memcpy_P(&info, &sched_info[task], sizeof(info));
+
+    sched_stats_t *stats = &sched_stats[task];
+    if (late >= 0)
+    {
+      if (late > stats->late)
+        stats->late = late > UINT16_MAX ? UINT16_MAX : late;
+
+      /*
+       * The next run is due a period after this one was due, rather than a
+       * period from now, so the period doesn't drift. If the task has fallen a
+       * whole period behind, the missed runs are skipped.
+       */
+      sched_due[task] += info.period;
+      if ((int32_t) (now - sched_due[task]) >= 0)
+        sched_due[task] = now + info.period;
+    }
+
+    info.run();
+
+    uint32_t ticks = clock_ticks() - now;
+    if (ticks > UINT16_MAX)
+      ticks = UINT16_MAX;
+
+    if (stats->runs != UINT16_MAX)
+      stats->runs++;
+    stats->total += ticks;
+    if (ticks > stats->max)
+      stats->max = ticks;
+    if (ticks > info.budget && stats->overruns != UINT16_MAX)
+      stats->overruns++;
+
+    return;
+  }
+}
+
+void sched_wake(sched_task_t task)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    sched_woken |= 1 << task;
+  }
+}
+
+void sched_dump(void)
+{
+  uart_puts_p(PSTR("# task runs avg max budget overruns late\r\n"));
+
+  for (uint8_t task = 0; task < SCHED_TASKS; task++)
+  {
+    const sched_stats_t *stats = &sched_stats[task];
+
+    uart_puts_p(pgm_read_ptr(&sched_names[task]));
+    uart_putc(' ');
+    uart_putu(stats->runs);
+    sched_put_ticks(stats->runs ? stats->total / stats->runs : 0);
+    sched_put_ticks(stats->max);
+    sched_put_ticks(pgm_read_word(&sched_info[task].budget));
+    uart_putc(' ');
+    uart_putu(stats->overruns);
+    sched_put_ticks(stats->late);
+    uart_puts_p(PSTR("\r\n"));
+  }
+}
+
+void sched_reset(void)
+{
+  for (uint8_t task = 0; task < SCHED_TASKS; task++)
+  {
+    sched_stats_t *stats = &sched_stats[task];
+    stats->runs = stats->overruns = 0;
+    stats->max = stats->late = 0;
+    stats->total = 0;
+  }
+}
@@ -0,0 +1,47 @@
+#ifndef LASERTAG_SCHED_H
+#define LASERTAG_SCHED_H
+
+#include <stdint.h>
+
+/*
+ * The tasks run by the main loop, in priority order. Each task is one of the
+ * modules' *_cycle() functions, and is run when its period has elapsed or when
+ * it has been woken by an event (e.g. a frame arriving), whichever is first.
+ * There may be at most 8 tasks.
+ */
+typedef enum
+{
+  SCHED_GAME,
+  SCHED_UPLINK,
+  SCHED_RADIO,
+  SCHED_LCD,
+  SCHED_LED,
+  SCHED_TRACE,
+  SCHED_CONSOLE,
+  SCHED_TASKS
+} sched_task_t;
+
+/* Initializes the scheduler. This must be called after clock_init(). */
+void sched_init(void);
+
+/*
+ * Called repeatedly by the main loop to run the highest priority task which is
+ * due or has been woken, if any. Only one task is run per call, so a woken
+ * task waits for at most one lower priority task to finish.
+ */
+void sched_cycle(void);
+
+/* Makes a task due immediately. This may be called from an ISR. */
+void sched_wake(sched_task_t task);
+
+/*
+ * Writes the number of runs, average and maximum run times, budget, the
+ * number of runs which exceeded the budget and the maximum lateness of each
+ * task to the UART. Times are in microseconds.
+ */
+void sched_dump(void);
+
+/* Clears the statistics. */
+void sched_reset(void);
+
+#endif
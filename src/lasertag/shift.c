@@ -1,4 +1,6 @@
 #include <lasertag/shift.h>
+#include <lasertag/profile.h>
+#include <util/atomic.h>
 
 void shift_init(shift_t *shift)
 {
@@ -12,29 +14,37 @@ void shift_out(shift_t *shift, uint8_t data)
    * No delays are required in this function. As F_CPU is 16 MHz, the length of
    * a single AVR clock cycle is 62.5 nanoseconds. This is longer than the
    * minimum time required for the 74HC595 chip to detect a clock edge.
+   *
+   * The LED and LCD shift registers share a port, and the LEDs are driven from
+   * an ISR, so interrupts are disabled to stop the read-modify-write of the
+   * port here from undoing the ISR's changes.
    */
-
-  for (uint8_t mask = 0x80; mask != 0; mask >>= 1)
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
   {
-    /*
-     * Raise or lower the data pin depending on the value of the current
-     * bit.
-     */
-    if (data & mask)
-      *shift->port |= (1 << shift->data);
-    else
-      *shift->port &= ~(1 << shift->data);
+    PROFILE_SCOPE(PROFILE_SHIFT_OUT);
 
-    /* Pulse the clock pin. */
-    *shift->port |= (1 << shift->clock);
-    *shift->port &= ~(1 << shift->clock);
-  }
+    for (uint8_t mask = 0x80; mask != 0; mask >>= 1)
+    {
+      /*
+       * Raise or lower the data pin depending on the value of the current
+       * bit.
+       */
+      if (data & mask)
+        *shift->port |= (1 << shift->data);
+      else
+        *shift->port &= ~(1 << shift->data);
 
-  /* Lower the data pin. */
-  *shift->port &= ~(1 << shift->data);
+      /* Pulse the clock pin. */
+      *shift->port |= (1 << shift->clock);
+      *shift->port &= ~(1 << shift->clock);
+    }
 
-  /* Pulse the latch pin. */
-  *shift->port |= (1 << shift->latch);
-  *shift->port &= ~(1 << shift->latch);
+    /* Lower the data pin. */
+    *shift->port &= ~(1 << shift->data);
+
+    /* Pulse the latch pin. */
+    *shift->port |= (1 << shift->latch);
+    *shift->port &= ~(1 << shift->latch);
+  }
 }
 
@@ -1,8 +1,18 @@
 #include <lasertag/speaker.h>
+#include <avr/interrupt.h>
 #include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <lasertag/adpcm.h>
+#include <lasertag/clock.h>
+#include <lasertag/profile.h>
+#include <lasertag/samples.h>
+#include <lasertag/timer.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <util/atomic.h>
 
 /* The Timer0 prescaler. */
-#define SPEAKER_PRESCALER 1024
+#define SPEAKER_PRESCALER 256
 
 /*
  * The frequency at which the speaker pin is toggled. The actual frequency of
@@ -10,6 +20,265 @@
  */
 #define SPEAKER_TOGGLE_FREQ (F_CPU / SPEAKER_PRESCALER)
 
+/*
+ * The Timer0 prescaler while a sample is playing. The timer runs in 8-bit fast
+ * PWM mode, so the PWM frequency and the sample rate are F_CPU / 8 / 256, or
+ * 7812.5 Hz. This leaves 2048 cycles between samples, of which decoding a
+ * sample takes under 200.
+ *
+ * The overflow ISR may therefore hold off INT0 for up to 12.5 us, or just over
+ * three 4 us clock ticks, so the receiver may time a mark or space up to four
+ * ticks long or short. This is well within the default IR error of 200 us (50
+ * ticks). With IR_RX_CAPTURE, Timer1 latches the time of each edge itself, so
+ * holding off TIMER1_CAPT doesn't affect the timing at all. The 200 cycles are
+ * worked out rather than measured: to measure them, build with PROFILE=1 and
+ * play an effect, and the console's 'p' command reports the longest run of
+ * TIMER0_OVF.
+ */
+#define SPEAKER_PCM_PRESCALER 8
+
+/* The number of microseconds between calls to speaker_tick(). */
+#define SPEAKER_TICK_USECS 4096UL
+
+/* The same in clock ticks. */
+#define SPEAKER_TICK_PERIOD (SPEAKER_TICK_USECS / CLOCK_USECS_PER_TICK)
+
+/*
+ * The terminal count value for a tone of the given frequency (at least 123 Hz),
+ * rounded.
+ */
+#define SPEAKER_OCR(hz) ((uint8_t) ((SPEAKER_TOGGLE_FREQ + (hz)) / (2 * (hz)) - 1))
+
+/* The number of ticks in the given number of milliseconds, rounded. */
+#define SPEAKER_TICKS(ms) ((uint8_t) (((ms) * 1000UL + SPEAKER_TICK_USECS / 2) / SPEAKER_TICK_USECS))
+
+/*
+ * Macros for building the effect tables. A sweep slides linearly from one
+ * frequency to another by adjusting the terminal count on every tick. Each
+ * step may last up to ~1 second.
+ */
+#define SPEAKER_TONE(hz, ms) { SPEAKER_OCR(hz), 0, SPEAKER_TICKS(ms) }
+#define SPEAKER_SWEEP(from_hz, to_hz, ms) \
+  { SPEAKER_OCR(from_hz), \
+    (int8_t) (((int16_t) SPEAKER_OCR(to_hz) - SPEAKER_OCR(from_hz)) / SPEAKER_TICKS(ms)), \
+    SPEAKER_TICKS(ms) }
+#define SPEAKER_REST(ms) { 0, 0, SPEAKER_TICKS(ms) }
+#define SPEAKER_END { 0, 0, 0 }
+
+typedef struct
+{
+  /* The terminal count value, or 0 if the speaker is silent. */
+  uint8_t ocr;
+
+  /* The amount added to the terminal count value on each tick. */
+  int8_t sweep;
+
+  /* The number of ticks the step lasts, or 0 at the end of an effect. */
+  uint8_t ticks;
+} speaker_step_t;
+
+static const speaker_step_t speaker_reload[] PROGMEM = {
+  SPEAKER_TONE(800, 20),
+  SPEAKER_REST(60),
+  SPEAKER_TONE(1200, 20),
+  SPEAKER_END
+};
+
+static const speaker_step_t speaker_respawn[] PROGMEM = {
+  SPEAKER_TONE(523, 80),
+  SPEAKER_TONE(659, 80),
+  SPEAKER_TONE(784, 80),
+  SPEAKER_TONE(1047, 160),
+  SPEAKER_END
+};
+
+/* The effects played as tones, or NULL for those played as samples. */
+static const speaker_step_t * const speaker_effects[SPEAKER_EFFECTS] PROGMEM = {
+  [SPEAKER_RELOAD]  = speaker_reload,
+  [SPEAKER_RESPAWN] = speaker_respawn
+};
+
+/* The effects played as samples, or NULL for those played as tones. */
+static const uint8_t * const speaker_samples[SPEAKER_EFFECTS] PROGMEM = {
+  [SPEAKER_SHOT] = samples_shot,
+  [SPEAKER_HIT]  = samples_hit
+};
+
+/*
+ * The difference encoded by each magnitude at each step index, worked out in
+ * advance so the decoder needs a single table lookup rather than a series of
+ * shifts and additions.
+ */
+#define SPEAKER_PCM_DIFFS(step) \
+  { ADPCM_DIFF(step, 0), ADPCM_DIFF(step, 1), ADPCM_DIFF(step, 2), ADPCM_DIFF(step, 3), \
+    ADPCM_DIFF(step, 4), ADPCM_DIFF(step, 5), ADPCM_DIFF(step, 6), ADPCM_DIFF(step, 7) },
+
+static const uint16_t speaker_pcm_diffs[ADPCM_STEPS][8] PROGMEM = {
+  ADPCM_STEP_TABLE(SPEAKER_PCM_DIFFS)
+};
+
+static const int8_t speaker_pcm_index_adjust[8] PROGMEM = ADPCM_INDEX_TABLE;
+
+/* The current step and effect, or NULL if nothing is playing. */
+static const speaker_step_t * volatile speaker_step;
+static speaker_effect_t speaker_effect;
+
+/* The ticks left in the current step and the sweep applied on each tick. */
+static uint8_t speaker_ticks;
+static int8_t speaker_sweep;
+
+/*
+ * The decoder state of the current sample: the next byte of codes, the number
+ * of samples left, the predicted sample and step index, and the byte whose
+ * high nibble holds the next code (if speaker_pcm_high is set).
+ */
+static const uint8_t *speaker_pcm_data;
+static uint16_t speaker_pcm_left;
+static int16_t speaker_pcm_pred;
+static uint8_t speaker_pcm_index;
+static uint8_t speaker_pcm_byte;
+static bool speaker_pcm_high;
+
+static void speaker_set_ocr(uint8_t ocr)
+{
+  OCR0A = ocr;
+
+  /*
+   * If the count is already past the new terminal count, it would run on to
+   * 255 before the next toggle - restart the period instead.
+   */
+  if (TCNT0 > ocr)
+    TCNT0 = 0;
+}
+
+/*
+ * Stops any effect, and puts Timer0 back into its tone generating mode with
+ * the speaker disconnected.
+ *
+ * NB: interrupts must be disabled by the caller.
+ */
+static void speaker_stop(void)
+{
+  speaker_step = NULL;
+  timer_cancel(TIMER_SPEAKER);
+
+  TIMSK0 &= ~(1 << TOIE0);
+  TCCR0A = (1 << WGM01);
+  TCCR0B = (1 << CS02);
+}
+
+/*
+ * Loads the step at speaker_step, stopping if it is the end of the effect.
+ *
+ * NB: interrupts must be disabled by the caller.
+ */
+static void speaker_load(void)
+{
+  speaker_ticks = pgm_read_byte(&speaker_step->ticks);
+  if (!speaker_ticks)
+  {
+    speaker_stop();
+    return;
+  }
+
+  speaker_sweep = pgm_read_byte(&speaker_step->sweep);
+
+  uint8_t ocr = pgm_read_byte(&speaker_step->ocr);
+  if (ocr)
+  {
+    /* Connect output compare unit A to PD6. */
+    speaker_set_ocr(ocr);
+    TCCR0A |= (1 << COM0A0);
+  }
+  else
+  {
+    /* Disconnect output compare unit A from PD6. */
+    TCCR0A &= ~(1 << COM0A0);
+  }
+}
+
+/*
+ * Starts playing a sample.
+ *
+ * NB: interrupts must be disabled by the caller.
+ */
+static void speaker_start_pcm(const uint8_t *sample)
+{
+  speaker_pcm_left = pgm_read_word(sample);
+  speaker_pcm_data = sample + 2;
+  speaker_pcm_pred = 0;
+  speaker_pcm_index = 0;
+  speaker_pcm_high = false;
+
+  /*
+   * Switch Timer0 to fast PWM mode, with the duty cycle of PD6 set by OCR0A,
+   * starting from silence. The overflow interrupt loads each sample.
+   */
+  OCR0A = 0x80;
+  TCNT0 = 0;
+  TCCR0A = (1 << COM0A1) | (1 << WGM01) | (1 << WGM00);
+  TCCR0B = (1 << CS01);
+  TIFR0 = (1 << TOV0);
+  TIMSK0 |= (1 << TOIE0);
+}
+
+ISR(TIMER0_OVF_vect)
+{
+  PROFILE_SCOPE(PROFILE_TIMER0_OVF);
+
+  if (speaker_pcm_left == 0)
+  {
+    speaker_stop();
+    return;
+  }
+  speaker_pcm_left--;
+
+  /* Each byte holds two codes, the first in the low nibble. */
+  uint8_t code;
+  if (speaker_pcm_high)
+  {
+    code = speaker_pcm_byte >> 4;
+  }
+  else
+  {
+    speaker_pcm_byte = pgm_read_byte(speaker_pcm_data++);
+    code = speaker_pcm_byte & 0xF;
+  }
+  speaker_pcm_high = !speaker_pcm_high;
+
+  /* Apply the difference to the prediction, saturating at the limits. */
+  uint8_t magnitude = code & 7;
+  int32_t pred = speaker_pcm_pred;
+  uint16_t diff = pgm_read_word(&speaker_pcm_diffs[speaker_pcm_index][magnitude]);
+  if (code & ADPCM_SIGN)
+  {
+    pred -= diff;
+    if (pred < INT16_MIN)
+      pred = INT16_MIN;
+  }
+  else
+  {
+    pred += diff;
+    if (pred > INT16_MAX)
+      pred = INT16_MAX;
+  }
+  speaker_pcm_pred = pred;
+
+  /* Move the step index, keeping it within the table. */
+  int8_t index = speaker_pcm_index + (int8_t) pgm_read_byte(&speaker_pcm_index_adjust[magnitude]);
+  if (index < 0)
+    index = 0;
+  else if (index >= ADPCM_STEPS)
+    index = ADPCM_STEPS - 1;
+  speaker_pcm_index = index;
+
+  /*
+   * Output the top 8 bits as an unsigned value. OCR0A is double-buffered in
+   * fast PWM mode, so the new duty cycle starts with the next period.
+   */
+  OCR0A = ((uint16_t) speaker_pcm_pred + 0x8000) >> 8;
+}
+
 void speaker_init(void)
 {
   /* Set PD6 (speaker) to be an output. */
@@ -17,25 +286,69 @@ void speaker_init(void)
 
   /*
    * Configure Timer0 to use the clear on terminal count waveform generator,
-   * such that the frequency can be varied. A prescaler of 1024 is used which
-   * allows a range of 256 frequencies in the range ~30 Hz to ~7.8 kHz.
+   * such that the frequency can be varied. A prescaler of 256 is used which
+   * allows a range of 256 frequencies in the range ~122 Hz to ~31 kHz, and is
+   * fine enough to keep tones up to ~2 kHz within a few percent of their
+   * frequency.
    */
   TCCR0A = (1 << WGM01);
-  TCCR0B = (1 << CS02) | (1 << CS00);
+  TCCR0B = (1 << CS02);
 }
 
-void speaker_tone(int hz)
+void speaker_play(speaker_effect_t effect)
 {
-  /* Calculate and set the terminal count value for the specified frequency. */
-  OCR0A = SPEAKER_TOGGLE_FREQ / (2 * hz) - 1;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    if (!speaker_playing() || effect >= speaker_effect)
+    {
+      speaker_stop();
+      speaker_effect = effect;
 
-  /* Connect output compare unit A to PD6. */
-  TCCR0A |= (1 << COM0A0);
+      const uint8_t *sample = pgm_read_ptr(&speaker_samples[effect]);
+      if (sample)
+      {
+        speaker_start_pcm(sample);
+      }
+      else
+      {
+        speaker_step = pgm_read_ptr(&speaker_effects[effect]);
+        speaker_load();
+        if (speaker_step)
+          timer_after(TIMER_SPEAKER, SPEAKER_TICK_PERIOD);
+      }
+    }
+  }
+}
+
+bool speaker_playing(void)
+{
+  /* The overflow interrupt is only enabled while a sample is playing. */
+  return speaker_step != NULL || (TIMSK0 & (1 << TOIE0));
 }
 
 void speaker_off(void)
 {
-  /* Disconnect output compare unit A from PD6. */
-  TCCR0A &= ~(1 << COM0A0);
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    speaker_stop();
+  }
 }
 
+void speaker_tick(void)
+{
+  if (!speaker_step)
+    return;
+
+  if (--speaker_ticks == 0)
+  {
+    speaker_step++;
+    speaker_load();
+  }
+  else if (speaker_sweep)
+  {
+    speaker_set_ocr(OCR0A + speaker_sweep);
+  }
+
+  if (speaker_step)
+    timer_again(TIMER_SPEAKER, SPEAKER_TICK_PERIOD);
+}
@@ -1,14 +1,38 @@
 #ifndef LASERTAG_SPEAKER_H
 #define LASERTAG_SPEAKER_H
 
+#include <stdbool.h>
+
+/*
+ * The sound effects, in increasing order of priority. An effect interrupts
+ * any effect of the same or lower priority which is already playing, and is
+ * ignored if one of a higher priority is playing.
+ */
+typedef enum
+{
+  SPEAKER_SHOT,
+  SPEAKER_RELOAD,
+  SPEAKER_RESPAWN,
+  SPEAKER_HIT,
+  SPEAKER_EFFECTS
+} speaker_effect_t;
+
 /* Initializes the speaker. */
 void speaker_init(void);
 
-/* Turns on the speaker and makes it play a tone of the given frequency. */
-void speaker_tone(int hz);
+/*
+ * Starts playing a sound effect. The effect plays in the background, its steps
+ * advanced by speaker_tick().
+ */
+void speaker_play(speaker_effect_t effect);
+
+/* Returns true if a sound effect is playing. */
+bool speaker_playing(void);
 
-/* Turns off the speaker. */
+/* Stops any sound effect and turns off the speaker. */
 void speaker_off(void);
 
-#endif
+/* Called by the timer every ~4 ms while an effect plays to advance it. */
+void speaker_tick(void);
 
+#endif
@@ -0,0 +1,56 @@
+#include <lasertag/stack.h>
+#include <avr/io.h>
+
+/* The pattern painted over the unused RAM. */
+#define STACK_CANARY 0xC5
+
+#ifdef __AVR__
+/*
+ * The end of the static data (.data, .bss and .noinit) and the initial stack
+ * pointer, both defined by the linker script.
+ */
+extern uint8_t _end;
+extern uint8_t __stack;
+
+#define STACK_BOTTOM (&_end)
+#define STACK_TOP    (&__stack)
+
+/*
+ * Paints the unused RAM. This is placed in the .init3 section so that it runs
+ * after the stack pointer and zero register are set up, but before .data and
+ * .bss are initialized, when nothing has been pushed onto the stack yet. As
+ * the .init sections are executed inline by the startup code, it must be
+ * naked.
+ */
+__attribute__((naked, used, section(".init3")))
+static void stack_paint(void)
+{
+  for (uint8_t *p = STACK_BOTTOM; p <= STACK_TOP; p++)
+    *p = STACK_CANARY;
+}
+#else
+/* The host build has no AVR stack, so an untouched region is measured. */
+static uint8_t stack_region[] = { STACK_CANARY };
+
+#define STACK_BOTTOM (&stack_region[0])
+#define STACK_TOP    (&stack_region[0])
+#endif
+
+/* Returns the lowest address the stack has reached. */
+static uint8_t *stack_low_water(void)
+{
+  uint8_t *p = STACK_BOTTOM;
+  while (p <= STACK_TOP && *p == STACK_CANARY)
+    p++;
+  return p;
+}
+
+uint16_t stack_high_water(void)
+{
+  return STACK_TOP + 1 - stack_low_water();
+}
+
+uint16_t stack_free(void)
+{
+  return stack_low_water() - STACK_BOTTOM;
+}
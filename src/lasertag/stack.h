@@ -0,0 +1,22 @@
+#ifndef LASERTAG_STACK_H
+#define LASERTAG_STACK_H
+
+#include <stdint.h>
+
+/*
+ * The RAM between the end of the static data and the stack is painted with a
+ * known pattern at startup, before main() runs. As the stack grows into it,
+ * the pattern is overwritten, so the lowest address where it is intact marks
+ * the deepest the stack has ever been.
+ */
+
+/* Returns the maximum number of bytes the stack has used since startup. */
+uint16_t stack_high_water(void);
+
+/*
+ * Returns the number of bytes between the end of the static data and the
+ * deepest point of the stack, i.e. the RAM which has never been used.
+ */
+uint16_t stack_free(void);
+
+#endif
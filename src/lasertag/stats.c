@@ -0,0 +1,219 @@
+#include <lasertag/stats.h>
+#include <avr/pgmspace.h>
+#include <lasertag/clock.h>
+#include <lasertag/nvm.h>
+#include <lasertag/uart.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <util/crc16.h>
+
+/*
+ * The number of shooters whose hits are counted individually. Hits from any
+ * others are counted together.
+ */
+#define STATS_SHOOTERS 6
+
+/*
+ * The location of the log in the EEPROM, and the number of records it holds.
+ * See nvm.h for the layout of the EEPROM.
+ */
+#define STATS_EEPROM_START 256
+#define STATS_EEPROM_END   1024
+#define STATS_EEPROM_SIZE  ((STATS_EEPROM_END - STATS_EEPROM_START) / sizeof(stats_record_t))
+
+/*
+ * How long the counters must be left unchanged before they are written, in
+ * clock ticks, so the log isn't written in the middle of a fight.
+ */
+#define STATS_IDLE_TICKS ((uint32_t) 2000000 / CLOCK_USECS_PER_TICK)
+
+typedef struct
+{
+  /*
+   * The sequence number is incremented with each record, so the newest is
+   * the only one not followed by its successor.
+   */
+  uint16_t seq;
+
+  uint16_t shots, hits, deaths, reloads;
+
+  /* The hits from the shooters not in the table. */
+  uint16_t other_hits;
+
+  /* The shooters with their own hit counters, a slot is free if it's zero. */
+  uint8_t shooters[STATS_SHOOTERS];
+  uint16_t shooter_hits[STATS_SHOOTERS];
+
+  /* The CRC of the rest of the record, calculated with _crc16_update(). */
+  uint16_t crc;
+} stats_record_t;
+
+/* The counters, and the copy being written to the EEPROM. */
+static stats_record_t stats_record, stats_flush_record;
+
+/* The slot to which the next record is written. */
+static uint8_t stats_pos;
+
+static bool stats_dirty;
+static uint32_t stats_changed_at;
+
+static uint16_t stats_eeprom_addr(uint8_t pos)
+{
+  return STATS_EEPROM_START + pos * sizeof(stats_record_t);
+}
+
+static uint16_t stats_crc(const stats_record_t *record)
+{
+  const uint8_t *bytes = (const uint8_t *) record;
+  uint16_t crc = ~0;
+  for (uint8_t i = 0; i < offsetof(stats_record_t, crc); i++)
+    crc = _crc16_update(crc, bytes[i]);
+  return crc;
+}
+
+static void stats_changed(void)
+{
+  stats_dirty = true;
+  stats_changed_at = clock_ticks();
+}
+
+static void stats_increment(uint16_t *counter)
+{
+  if (*counter != UINT16_MAX)
+    (*counter)++;
+  stats_changed();
+}
+
+void stats_init(void)
+{
+  /*
+   * Find the newest record by following the sequence numbers, which only
+   * reads two bytes of each. If the log hasn't wrapped around yet, it's the
+   * last slot.
+   */
+  uint8_t newest = STATS_EEPROM_SIZE - 1;
+  uint16_t seq, next;
+  nvm_read(stats_eeprom_addr(0), &seq, sizeof(seq));
+  for (uint8_t pos = 1; pos < STATS_EEPROM_SIZE; pos++)
+  {
+    nvm_read(stats_eeprom_addr(pos), &next, sizeof(next));
+    if (next != (uint16_t) (seq + 1))
+    {
+      newest = pos - 1;
+      break;
+    }
+    seq = next;
+  }
+
+  /*
+   * If the newest record was only partly written, fall back to the ones
+   * before it. The next record overwrites the broken one, so the sequence
+   * numbers still follow on from each other.
+   */
+  for (uint8_t i = 0; i < STATS_EEPROM_SIZE; i++)
+  {
+    uint8_t pos = (newest + STATS_EEPROM_SIZE - i) % STATS_EEPROM_SIZE;
+    nvm_read(stats_eeprom_addr(pos), &stats_record, sizeof(stats_record));
+    if (stats_crc(&stats_record) == stats_record.crc)
+    {
+      stats_pos = (pos + 1) % STATS_EEPROM_SIZE;
+      return;
+    }
+  }
+
+  /* The log is empty, so the first record has sequence number zero. */
+  memset(&stats_record, 0, sizeof(stats_record));
+  stats_record.seq = UINT16_MAX;
+  stats_pos = 0;
+}
+
+void stats_cycle(void)
+{
+  if (!stats_dirty || nvm_busy())
+    return;
+
+  if (clock_ticks() - stats_changed_at < STATS_IDLE_TICKS)
+    return;
+
+  stats_record.seq++;
+  stats_record.crc = stats_crc(&stats_record);
+
+  stats_flush_record = stats_record;
+  nvm_write(stats_eeprom_addr(stats_pos), &stats_flush_record, sizeof(stats_flush_record));
+
+  stats_pos = (stats_pos + 1) % STATS_EEPROM_SIZE;
+  stats_dirty = false;
+}
+
+void stats_shot(void)
+{
+  stats_increment(&stats_record.shots);
+}
+
+void stats_reload(void)
+{
+  stats_increment(&stats_record.reloads);
+}
+
+void stats_death(void)
+{
+  stats_increment(&stats_record.deaths);
+}
+
+void stats_hit(uint8_t shooter)
+{
+  stats_increment(&stats_record.hits);
+
+  /* Shooter zero is counted with the others, as it marks a free slot. */
+  uint16_t *counter = &stats_record.other_hits;
+  for (uint8_t i = 0; i < STATS_SHOOTERS && shooter; i++)
+  {
+    if (stats_record.shooters[i] == shooter || stats_record.shooters[i] == 0)
+    {
+      stats_record.shooters[i] = shooter;
+      counter = &stats_record.shooter_hits[i];
+      break;
+    }
+  }
+
+  if (*counter != UINT16_MAX)
+    (*counter)++;
+}
+
+void stats_dump(void)
+{
+  uart_puts_p(PSTR("shots "));
+  uart_putu(stats_record.shots);
+  uart_puts_p(PSTR(" hits "));
+  uart_putu(stats_record.hits);
+  uart_puts_p(PSTR(" deaths "));
+  uart_putu(stats_record.deaths);
+  uart_puts_p(PSTR(" reloads "));
+  uart_putu(stats_record.reloads);
+  uart_puts_p(PSTR("\r\nhits by"));
+
+  for (uint8_t i = 0; i < STATS_SHOOTERS && stats_record.shooters[i]; i++)
+  {
+    uint8_t shooter = stats_record.shooters[i];
+    uart_putc(' ');
+    uart_putu(shooter >> 6);
+    uart_putc('/');
+    uart_putu(shooter & 0x3F);
+    uart_putc(':');
+    uart_putu(stats_record.shooter_hits[i]);
+  }
+
+  uart_puts_p(PSTR(" other:"));
+  uart_putu(stats_record.other_hits);
+  uart_puts_p(PSTR("\r\n"));
+}
+
+void stats_clear(void)
+{
+  uint16_t seq = stats_record.seq;
+  memset(&stats_record, 0, sizeof(stats_record));
+  stats_record.seq = seq;
+
+  stats_changed();
+}
@@ -0,0 +1,40 @@
+#ifndef LASERTAG_STATS_H
+#define LASERTAG_STATS_H
+
+#include <stdint.h>
+
+/*
+ * The game statistics, which are kept across power cycles until they are
+ * cleared at the start of the next match.
+ *
+ * The counters are kept in SRAM, and written to a log of records in the
+ * EEPROM in the background once the game has been quiet for a while. Each
+ * record is written to the slot after the previous one, spreading the wear
+ * over the whole log, and is protected by a CRC so a record which was only
+ * partly written when the power was cut is ignored.
+ */
+
+/* Restores the counters from the newest valid record in the EEPROM. */
+void stats_init(void);
+
+/* Called regularly to write the counters to the EEPROM when they've changed. */
+void stats_cycle(void);
+
+/* Count a shot fired, a reload, or a death respectively. */
+void stats_shot(void);
+void stats_reload(void);
+void stats_death(void);
+
+/* Counts a hit taken from the given shooter (see GAME_PACKET_SHOOTER()). */
+void stats_hit(uint8_t shooter);
+
+/*
+ * Writes the counters to the UART, including the hits taken from each
+ * shooter as team/player:hits.
+ */
+void stats_dump(void);
+
+/* Clears the counters, e.g. at the start of a match. */
+void stats_clear(void);
+
+#endif
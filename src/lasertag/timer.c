@@ -0,0 +1,150 @@
+#include <lasertag/timer.h>
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <lasertag/clock.h>
+#include <lasertag/ir.h>
+#include <lasertag/led.h>
+#include <lasertag/profile.h>
+#include <lasertag/speaker.h>
+#include <stdbool.h>
+#include <util/atomic.h>
+
+/*
+ * The fewest ticks between reading the counter and the compare match. A match
+ * one tick away could be missed if the counter ticks over while it is being
+ * set.
+ */
+#define TIMER_MIN_TICKS 2
+
+static void (* const timer_handlers[TIMER_CHANNELS])(void) PROGMEM = {
+  [TIMER_IR_TX]   = ir_tx_timer,
+  [TIMER_IR_RX]   = ir_rx_timeout,
+  [TIMER_SPEAKER] = speaker_tick,
+  [TIMER_LED]     = led_tick
+};
+
+/* A bitmask of the channels which have a deadline. */
+static volatile uint8_t timer_pending;
+
+/* Each channel's deadline, or last deadline if it no longer has one. */
+static volatile uint32_t timer_deadlines[TIMER_CHANNELS];
+
+/*
+ * Set while the compare ISR calls the handlers, as it sets the compare unit
+ * once they have all returned.
+ */
+static bool timer_dispatching;
+
+/*
+ * Sets the compare unit for the earliest deadline, or disables it if there are
+ * none before the next overflow.
+ *
+ * NB: interrupts must be disabled by the caller.
+ */
+static void timer_arm(void)
+{
+  uint32_t now = clock_ticks();
+
+  uint8_t next = TIMER_CHANNELS;
+  int32_t soonest = INT32_MAX;
+  for (uint8_t channel = 0; channel < TIMER_CHANNELS; channel++)
+  {
+    if (!(timer_pending & (1 << channel)))
+      continue;
+
+    int32_t ticks = timer_deadlines[channel] - now;
+    if (ticks < soonest)
+    {
+      next = channel;
+      soonest = ticks;
+    }
+  }
+
+  if (next == TIMER_CHANNELS || soonest > UINT8_MAX)
+  {
+    TIMSK2 &= ~(1 << OCIE2A);
+    return;
+  }
+
+  /*
+   * The counter may have moved on while the deadlines were compared, so the
+   * ticks left are worked out again from its current value. A deadline may be
+   * long overdue, so this can't be narrowed.
+   */
+  uint8_t tick = TCNT2;
+  int32_t left = soonest - (uint8_t) (tick - (uint8_t) now);
+  if (left < TIMER_MIN_TICKS)
+    OCR2A = tick + TIMER_MIN_TICKS;
+  else
+    OCR2A = timer_deadlines[next];
+
+  /*
+   * Reset the output compare flag to mask an immediate interrupt. The flags
+   * are cleared by writing a one, so the overflow flag is written as zero.
+   */
+  TIFR2 = (1 << OCF2A);
+  TIMSK2 |= (1 << OCIE2A);
+}
+
+ISR(TIMER2_COMPA_vect)
+{
+  PROFILE_SCOPE_EVENT(PROFILE_TIMER2_COMPA, profile_tick_time(OCR2A));
+
+  uint32_t now = clock_ticks();
+
+  timer_dispatching = true;
+  for (uint8_t channel = 0; channel < TIMER_CHANNELS; channel++)
+  {
+    uint8_t mask = 1 << channel;
+    if (!(timer_pending & mask) || (int32_t) (now - timer_deadlines[channel]) < 0)
+      continue;
+
+    timer_pending &= ~mask;
+
+    void (*handler)(void);
+    memcpy_P(&handler, &timer_handlers[channel], sizeof(handler));
+    handler();
+  }
+  timer_dispatching = false;
+
+  timer_arm();
+}
+
+void timer_at(timer_channel_t channel, uint32_t deadline)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    timer_deadlines[channel] = deadline;
+    timer_pending |= 1 << channel;
+
+    if (!timer_dispatching)
+      timer_arm();
+  }
+}
+
+void timer_after(timer_channel_t channel, uint32_t ticks)
+{
+  timer_at(channel, clock_ticks() + ticks);
+}
+
+void timer_again(timer_channel_t channel, uint32_t ticks)
+{
+  timer_at(channel, timer_deadlines[channel] + ticks);
+}
+
+void timer_cancel(timer_channel_t channel)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    timer_pending &= ~(1 << channel);
+
+    /* The compare unit is left set, as a spurious interrupt does no harm. */
+  }
+}
+
+void timer_overflow(void)
+{
+  if (timer_pending && !(TIMSK2 & (1 << OCIE2A)))
+    timer_arm();
+}
@@ -0,0 +1,52 @@
+#ifndef LASERTAG_TIMER_H
+#define LASERTAG_TIMER_H
+
+#include <stdint.h>
+
+/*
+ * The virtual compare channels, in priority order. The channels share Timer2's
+ * channel A compare unit, which is set for whichever deadline is next. Each
+ * deadline is a clock_ticks() value, so unlike the 8-bit compare unit, it may
+ * be any time up to 2^31 ticks in the future: deadlines which are further
+ * away than the next overflow are picked up by the overflow ISR.
+ *
+ * When a channel's deadline passes, its handler (listed in timer.c) is called
+ * from the compare ISR. Handlers may schedule their own channel, or any other.
+ * There may be at most 8 channels.
+ */
+typedef enum
+{
+  TIMER_IR_TX,
+  TIMER_IR_RX,
+  TIMER_SPEAKER,
+  TIMER_LED,
+  TIMER_CHANNELS
+} timer_channel_t;
+
+/*
+ * Schedules the channel's handler to be called at the given clock tick,
+ * replacing any deadline the channel already has. A deadline which has already
+ * passed, or is less than two ticks away, is moved to two ticks from now.
+ */
+void timer_at(timer_channel_t channel, uint32_t deadline);
+
+/* Calls the channel's handler once the given number of ticks have elapsed. */
+void timer_after(timer_channel_t channel, uint32_t ticks);
+
+/*
+ * Schedules the channel's handler to be called the given number of ticks
+ * after its last deadline. This is used by handlers which run periodically, or
+ * which time a series of edges, so that the latency of the ISR doesn't add up.
+ */
+void timer_again(timer_channel_t channel, uint32_t ticks);
+
+/* Cancels the channel's deadline, if it has one. */
+void timer_cancel(timer_channel_t channel);
+
+/*
+ * Called by the clock's overflow ISR to set the compare unit for a deadline
+ * which has come into range.
+ */
+void timer_overflow(void);
+
+#endif
@@ -0,0 +1,255 @@
+#include <lasertag/trace.h>
+#include <avr/io.h>
+#include <lasertag/clock.h>
+#include <lasertag/nvm.h>
+#include <lasertag/uart.h>
+#include <util/atomic.h>
+#include <util/crc16.h>
+
+/* The number of events in the SRAM buffer. This must be a power of two. */
+#ifndef TRACE_SIZE
+#define TRACE_SIZE 32
+#endif
+
+/*
+ * The location of the EEPROM ring buffer, and the number of events it holds.
+ * See nvm.h for the layout of the EEPROM.
+ */
+#define TRACE_EEPROM_START 64
+#define TRACE_EEPROM_SIZE  32
+
+/*
+ * The top bit of the type byte of each event in the EEPROM is flipped on each
+ * pass around the ring buffer, so that the position of the newest event can
+ * be found after a reset.
+ */
+#define TRACE_EEPROM_LAP 0x80
+
+/* The type byte of an erased event in the EEPROM, with the lap bit masked. */
+#define TRACE_EEPROM_ERASED 0x7F
+
+/* The magic number at the start of a dump. */
+#define TRACE_MAGIC_0 'L'
+#define TRACE_MAGIC_1 'T'
+
+typedef struct
+{
+  uint8_t time[3];
+  uint8_t type;
+  uint16_t arg;
+} trace_entry_t;
+
+/*
+ * The order in which the bytes of an event are written to the EEPROM. The type
+ * byte (and its lap bit) is written last, so an event which is half written
+ * when the power is cut still looks like the old one.
+ */
+static const uint8_t trace_eeprom_order[] = {
+  0, 1, 2, 4, 5, 3
+};
+
+#define TRACE_ENTRY_SIZE sizeof(trace_eeprom_order)
+
+static trace_entry_t trace_buf[TRACE_SIZE];
+
+/* The total number of events recorded, which wraps around. */
+static volatile uint8_t trace_head;
+
+/* The number of events in the buffer. */
+static volatile uint8_t trace_count;
+
+/* The EEPROM mirror state. */
+static uint8_t trace_mirrored;
+static trace_entry_t trace_mirror_entry;
+static uint8_t trace_mirror_byte = TRACE_ENTRY_SIZE;
+static uint8_t trace_eeprom_pos, trace_eeprom_lap;
+
+static uint16_t trace_eeprom_addr(uint8_t pos, uint8_t byte)
+{
+  return TRACE_EEPROM_START + pos * TRACE_ENTRY_SIZE + byte;
+}
+
+static uint8_t trace_eeprom_read_byte(uint8_t pos, uint8_t byte)
+{
+  uint8_t value;
+  nvm_read(trace_eeprom_addr(pos, byte), &value, sizeof(value));
+  return value;
+}
+
+/* Reads an event from the EEPROM, returning false if it has been erased. */
+static bool trace_eeprom_read(uint8_t pos, trace_entry_t *entry)
+{
+  nvm_read(trace_eeprom_addr(pos, 0), entry, TRACE_ENTRY_SIZE);
+
+  entry->type &= ~TRACE_EEPROM_LAP;
+  return entry->type != TRACE_EEPROM_ERASED;
+}
+
+/* Finds where the next event should be written to the EEPROM. */
+static void trace_eeprom_init(void)
+{
+  uint8_t lap = trace_eeprom_read_byte(0, 3) & TRACE_EEPROM_LAP;
+
+  /*
+   * The events before the newest were written on the current pass, and the
+   * events after it on the previous pass, so it's followed by a change in the
+   * lap bit. If there is no change, the pass was completed.
+   */
+  trace_eeprom_pos = 0;
+  for (uint8_t pos = 1; pos < TRACE_EEPROM_SIZE; pos++)
+  {
+    if ((trace_eeprom_read_byte(pos, 3) & TRACE_EEPROM_LAP) != lap)
+    {
+      trace_eeprom_pos = pos;
+      break;
+    }
+  }
+
+  trace_eeprom_lap = trace_eeprom_pos ? lap : lap ^ TRACE_EEPROM_LAP;
+}
+
+static void trace_put(uint8_t value, uint16_t *crc)
+{
+  uart_putc(value);
+  *crc = _crc16_update(*crc, value);
+}
+
+static void trace_put_entry(const trace_entry_t *entry, uint16_t *crc)
+{
+  trace_put(entry->time[0], crc);
+  trace_put(entry->time[1], crc);
+  trace_put(entry->time[2], crc);
+  trace_put(entry->type, crc);
+  trace_put(entry->arg & 0xFF, crc);
+  trace_put(entry->arg >> 8, crc);
+}
+
+void trace_init(void)
+{
+  /* Record and clear the reset flags, so the next reset's are distinct. */
+  uint8_t flags = MCUSR;
+  MCUSR = 0;
+
+  if (TRACE_EEPROM)
+    trace_eeprom_init();
+
+  trace(TRACE_RESET, flags);
+}
+
+void trace(trace_event_t type, uint16_t arg)
+{
+  uint32_t ticks = clock_ticks();
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    trace_entry_t *entry = &trace_buf[trace_head % TRACE_SIZE];
+    entry->time[0] = ticks & 0xFF;
+    entry->time[1] = (ticks >> 8) & 0xFF;
+    entry->time[2] = (ticks >> 16) & 0xFF;
+    entry->type = type;
+    entry->arg = arg;
+
+    trace_head++;
+    if (trace_count < TRACE_SIZE)
+      trace_count++;
+  }
+}
+
+void trace_cycle(void)
+{
+  if (!TRACE_EEPROM)
+    return;
+
+  if (trace_mirror_byte == TRACE_ENTRY_SIZE)
+  {
+    /* Start copying the next event, if there is one. */
+    bool pending = false;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      /* Skip any events which have been overwritten before being copied. */
+      if ((uint8_t) (trace_head - trace_mirrored) > trace_count)
+        trace_mirrored = trace_head - trace_count;
+
+      if (trace_mirrored != trace_head)
+      {
+        trace_mirror_entry = trace_buf[trace_mirrored % TRACE_SIZE];
+        trace_mirrored++;
+        pending = true;
+      }
+    }
+
+    if (!pending)
+      return;
+
+    trace_mirror_entry.type |= trace_eeprom_lap;
+    trace_mirror_byte = 0;
+  }
+
+  /*
+   * Write one byte at a time, as each write takes ~3.4 ms and the EEPROM can't
+   * be written again until it has finished.
+   */
+  uint8_t byte = trace_eeprom_order[trace_mirror_byte];
+  if (!nvm_update_byte(trace_eeprom_addr(trace_eeprom_pos, byte), ((uint8_t *) &trace_mirror_entry)[byte]))
+    return;
+  trace_mirror_byte++;
+
+  if (trace_mirror_byte == TRACE_ENTRY_SIZE && ++trace_eeprom_pos == TRACE_EEPROM_SIZE)
+  {
+    trace_eeprom_pos = 0;
+    trace_eeprom_lap ^= TRACE_EEPROM_LAP;
+  }
+}
+
+void trace_dump(bool eeprom)
+{
+  uint16_t crc = ~0;
+  trace_put(TRACE_MAGIC_0, &crc);
+  trace_put(TRACE_MAGIC_1, &crc);
+  trace_put(eeprom, &crc);
+
+  trace_entry_t entry;
+  if (eeprom)
+  {
+    /*
+     * The oldest event is the one at the write position, unless it hasn't
+     * been written yet.
+     */
+    uint8_t count = 0;
+    for (uint8_t pos = 0; pos < TRACE_EEPROM_SIZE; pos++)
+    {
+      if (trace_eeprom_read(pos, &entry))
+        count++;
+    }
+    trace_put(count, &crc);
+
+    for (uint8_t i = 0; i < TRACE_EEPROM_SIZE; i++)
+    {
+      if (trace_eeprom_read((trace_eeprom_pos + i) % TRACE_EEPROM_SIZE, &entry))
+        trace_put_entry(&entry, &crc);
+    }
+  }
+  else
+  {
+    uint8_t head, count;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      head = trace_head;
+      count = trace_count;
+    }
+    trace_put(count, &crc);
+
+    for (uint8_t i = count; i > 0; i--)
+    {
+      ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+      {
+        entry = trace_buf[(uint8_t) (head - i) % TRACE_SIZE];
+      }
+      trace_put_entry(&entry, &crc);
+    }
+  }
+
+  uint16_t value = crc;
+  trace_put(value & 0xFF, &crc);
+  trace_put(value >> 8, &crc);
+}
@@ -0,0 +1,123 @@
+#ifndef LASERTAG_TRACE_H
+#define LASERTAG_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * If true, trace events are also copied to a ring buffer in the EEPROM, so
+ * that they survive a reset or power cycle.
+ */
+#ifndef TRACE_EEPROM
+#define TRACE_EEPROM false
+#endif
+
+/* The types of event recorded in the trace. */
+typedef enum
+{
+  /* The firmware started, the argument is the MCUSR reset flags. */
+  TRACE_RESET = 0x01,
+
+  /* An IR packet was received, the argument is the packet. */
+  TRACE_IR_RX = 0x02,
+
+  /*
+   * An IR packet was dropped, the argument is the reason in the high byte and
+   * the number of bits still to be received in the low byte.
+   */
+  TRACE_IR_DROP = 0x03,
+
+  /*
+   * An IR packet started being transmitted (e.g. a shot was fired), the
+   * argument is the packet.
+   */
+  TRACE_IR_TX = 0x04,
+
+  /*
+   * A button changed state, the argument is the pin in the high byte and 1 if
+   * it was pressed or 0 if it was released in the low byte.
+   */
+  TRACE_BUTTON = 0x05,
+
+  /*
+   * A radio frame was received or sent, the argument is the frame type (its
+   * first byte) in the high byte and its length in the low byte.
+   */
+  TRACE_RADIO_RX = 0x06,
+  TRACE_RADIO_TX = 0x07,
+
+  /*
+   * A radio frame was dropped, or an uplink frame was given up on as it was
+   * never acknowledged. The argument is the reason in the high byte and the
+   * frame's length in the low byte.
+   */
+  TRACE_RADIO_DROP = 0x08,
+
+  /*
+   * A driver finished initializing, or the game was ready to take its first
+   * shot. The argument is one of the values below.
+   */
+  TRACE_READY = 0x09
+} trace_event_t;
+
+/* The things which become ready, recorded by TRACE_READY events. */
+typedef enum
+{
+  TRACE_READY_GAME  = 0x00,
+  TRACE_READY_LCD   = 0x01,
+  TRACE_READY_RADIO = 0x02
+} trace_ready_t;
+
+/* The reasons an IR packet is dropped. */
+typedef enum
+{
+  TRACE_IR_BAD_HEADER = 0x01,
+  TRACE_IR_BAD_SPACE  = 0x02,
+  TRACE_IR_BAD_MARK   = 0x03,
+  TRACE_IR_BAD_EDGE   = 0x04,
+  TRACE_IR_TIMEOUT    = 0x05,
+  TRACE_IR_FULL       = 0x06
+} trace_ir_drop_t;
+
+/* The reasons a radio frame is dropped. */
+typedef enum
+{
+  TRACE_RADIO_TOO_LONG = 0x01,
+  TRACE_RADIO_BAD_CRC  = 0x02,
+  TRACE_RADIO_FULL     = 0x03,
+  TRACE_RADIO_NO_ACK   = 0x04
+} trace_radio_drop_t;
+
+/*
+ * Initializes the trace and records a TRACE_RESET event with the reset flags.
+ * This must be called before anything else is recorded.
+ */
+void trace_init(void);
+
+/*
+ * Records an event, timestamped with the low 24 bits of clock_ticks(). If the
+ * buffer is full, the oldest event is overwritten. This may be called from an
+ * ISR.
+ */
+void trace(trace_event_t type, uint16_t arg);
+
+/* Called regularly to copy new events to the EEPROM, if enabled. */
+void trace_cycle(void);
+
+/*
+ * Writes the events in the SRAM buffer, or the EEPROM if eeprom is true, to
+ * the UART. The dump is binary, and is laid out as follows:
+ *
+ *   'L', 'T', source (0 for SRAM or 1 for EEPROM), event count, events...,
+ *   16-bit CRC
+ *
+ * The events are written oldest first, and each is laid out as follows:
+ *
+ *   24-bit time in clock ticks, type, 16-bit argument
+ *
+ * Multi-byte values are little-endian. The CRC is calculated over everything
+ * before it with _crc16_update(), starting from 0xFFFF.
+ */
+void trace_dump(bool eeprom);
+
+#endif
@@ -2,13 +2,13 @@
 #include <avr/interrupt.h>
 #include <avr/io.h>
 #include <avr/pgmspace.h>
+#include <lasertag/config.h>
+#include <lasertag/profile.h>
+#include <lasertag/sched.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <util/atomic.h>
 
-/* The baud rate. */
-#define UART_BAUD 9600
-
 /* The number of bytes in the RX and TX buffers. */
 #define UART_BUF_SIZE 16
 
@@ -27,7 +27,7 @@ static bool uart_ringbuf_empty(uart_ringbuf_t *ring)
 
 static bool uart_ringbuf_full(uart_ringbuf_t *ring)
 {
-  return ((ring->head + 1) % UART_BUF_SIZE) == ring->tail;
+  return ((ring->tail + 1) % UART_BUF_SIZE) == ring->head;
 }
 
 static char uart_ringbuf_pop(uart_ringbuf_t *ring)
@@ -51,10 +51,7 @@ void uart_init(void)
   /* Set PD1 (UART TX) to be an output. */
   DDRD |= (1 << PD1);
 
-  /* Set the baud rate register. */
-  uint16_t ubrr = F_CPU / (16UL * UART_BAUD) - 1;
-  UBRR0H = (uint8_t) (ubrr >> 8);
-  UBRR0L = (uint8_t) ubrr;
+  uart_configure();
 
   /*
    * Reset UCSR0A - even though we don't set any flags, and the datasheet
@@ -78,8 +75,18 @@ void uart_init(void)
   UCSR0C = (1 << UCSZ00) | (1 << UCSZ01);
 }
 
+void uart_configure(void)
+{
+  /* Set the baud rate register. */
+  uint16_t ubrr = F_CPU / (16UL * config.uart_baud) - 1;
+  UBRR0H = (uint8_t) (ubrr >> 8);
+  UBRR0L = (uint8_t) ubrr;
+}
+
 ISR(USART_RX_vect)
 {
+  PROFILE_SCOPE(PROFILE_USART_RX);
+
   /*
    * Read the next character and push it onto the RX buffer if it is not full.
    * If the RX buffer is full, we're going too slowly to receive any more data
@@ -88,10 +95,15 @@ ISR(USART_RX_vect)
   char c = UDR0;
   if (!uart_ringbuf_full(&uart_rx_buf))
     uart_ringbuf_push(&uart_rx_buf, c);
+
+  /* Run the console promptly to handle the command. */
+  sched_wake(SCHED_CONSOLE);
 }
 
 ISR(USART_UDRE_vect)
 {
+  PROFILE_SCOPE(PROFILE_USART_UDRE);
+
   /*
    * If the TX buffer has been emptied, the UDRE interrupt is masked so this
    * code will not be called again.
@@ -112,6 +124,7 @@ int uart_getc(void)
   int c = -1;
   ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
   {
+    PROFILE_SCOPE(PROFILE_UART_GETC);
     if (!uart_ringbuf_empty(&uart_rx_buf))
       c = uart_ringbuf_pop(&uart_rx_buf);
   }
@@ -125,6 +138,7 @@ void uart_putc(int c)
   {
     ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
     {
+      PROFILE_SCOPE(PROFILE_UART_PUTC);
       if (!uart_ringbuf_full(&uart_tx_buf))
       {
         /* Push the character into the buffer. */
@@ -157,3 +171,19 @@ void uart_puts_p(const char *str)
     uart_putc(c);
 }
 
+void uart_putu(uint32_t value)
+{
+  char buf[11];
+  uint8_t i = sizeof(buf);
+
+  /* Write the digits backwards, starting with the least significant. */
+  buf[--i] = '\0';
+  do
+  {
+    buf[--i] = '0' + value % 10;
+    value /= 10;
+  } while (value);
+
+  uart_puts(&buf[i]);
+}
+
@@ -1,9 +1,21 @@
 #ifndef LASERTAG_UART_H
 #define LASERTAG_UART_H
 
+#include <stdint.h>
+
+/*
+ * The range of baud rates which the 12-bit baud rate register can divide the
+ * clock down to.
+ */
+#define UART_MIN_BAUD (F_CPU / (16UL * 4096) + 1)
+#define UART_MAX_BAUD (F_CPU / 16UL)
+
 /* Initializes the UART. */
 void uart_init(void);
 
+/* Updates the baud rate after the configuration has changed. */
+void uart_configure(void);
+
 /*
  * Reads a single character from the UART, or returns -1 if no character is
  * available.
@@ -17,5 +29,8 @@ void uart_putc(int c);
 void uart_puts(const char *str);
 void uart_puts_p(const char *str);
 
+/* Writes an unsigned integer to the UART in decimal. */
+void uart_putu(uint32_t value);
+
 #endif
 
@@ -0,0 +1,351 @@
+#include <lasertag/uplink.h>
+#include <lasertag/clock.h>
+#include <lasertag/config.h>
+#include <lasertag/mesh.h>
+#include <lasertag/radio.h>
+#include <lasertag/trace.h>
+
+/*
+ * If true, frames are flooded through the mesh of other guns to reach the
+ * base station, and this gun relays frames on behalf of the others.
+ */
+#ifndef UPLINK_MESH
+#define UPLINK_MESH false
+#endif
+
+/*
+ * Event times are recorded in units of 1024 microseconds, so that they can be
+ * calculated with a shift rather than a division.
+ */
+#define UPLINK_TIME_SHIFT 10
+
+/* The number of events in the queue. */
+#define UPLINK_QUEUE_SIZE 8
+
+/*
+ * Events are held back until this many are queued or the oldest has waited
+ * for UPLINK_BATCH_DELAY time units, so that several can share a frame.
+ */
+#define UPLINK_BATCH_EVENTS 4
+#define UPLINK_BATCH_DELAY  50
+
+/*
+ * The maximum number of unacknowledged frames in flight. This must be a power
+ * of two no greater than 8, as the acknowledged frames are tracked in a byte.
+ */
+#define UPLINK_WINDOW 4
+
+/*
+ * The number of time units to wait for an ACK before retransmitting, which
+ * doubles each time the same frame is retransmitted.
+ */
+#define UPLINK_RTO 100
+
+/*
+ * The number of times a frame is sent before it is given up on, so that the
+ * window isn't stalled forever if the base station is out of range.
+ */
+#define UPLINK_TRIES 6
+
+/* The number of header bytes at the start of a data frame. */
+#define UPLINK_HEADER 5
+
+/* The maximum number of bytes a single encoded event can occupy. */
+#define UPLINK_EVENT_MAX 6
+
+/*
+ * A data frame is laid out as follows:
+ *
+ *   type, node ID, sequence number, 16-bit base time, events...
+ *
+ * Each event is encoded as:
+ *
+ *   type | (argument length << 6), 0-2 argument bytes, time delta
+ *
+ * The time delta is relative to the previous event in the frame (or the base
+ * time for the first event) and is encoded 7 bits at a time, least significant
+ * bits first, with the top bit of each byte set if another byte follows.
+ *
+ * An ACK frame is laid out as follows:
+ *
+ *   type, node ID, next expected sequence number, selective ACK bitmap
+ *
+ * Bit n of the bitmap is set if the frame with the sequence number n + 1
+ * after the next expected sequence number has also been received.
+ *
+ * A configuration frame, sent by the base station, is laid out as follows:
+ *
+ *   type, node ID, offset, part of a config_t...
+ *
+ * The parts are passed to config_stage(), so they must be sent in order.
+ */
+
+typedef struct
+{
+  uint8_t type;
+  uint16_t arg;
+  uint16_t time;
+} uplink_entry_t;
+
+typedef struct
+{
+  uint8_t len;
+  uint8_t buf[RADIO_MAX_PAYLOAD];
+  uint16_t sent_at;
+  uint8_t tries;
+} uplink_slot_t;
+
+/*
+ * The event queue. The head and tail indices are free-running, so that a full
+ * queue can be told apart from an empty one.
+ */
+static uplink_entry_t uplink_queue[UPLINK_QUEUE_SIZE];
+static uint8_t uplink_queue_head, uplink_queue_tail;
+
+/*
+ * The window of frames in flight. Frame n is stored in slot n % UPLINK_WINDOW
+ * and bit n % UPLINK_WINDOW of uplink_acked is set once it has been
+ * acknowledged.
+ */
+static uplink_slot_t uplink_slots[UPLINK_WINDOW];
+static uint8_t uplink_base, uplink_next;
+static uint8_t uplink_acked;
+
+/* The mesh state, including any frame waiting to be relayed for another gun. */
+static mesh_t uplink_mesh;
+
+static uint16_t uplink_now(void)
+{
+  return clock_micros() >> UPLINK_TIME_SHIFT;
+}
+
+static uint8_t uplink_queue_count(void)
+{
+  return uplink_queue_tail - uplink_queue_head;
+}
+
+static uplink_entry_t *uplink_queue_peek(void)
+{
+  return &uplink_queue[uplink_queue_head % UPLINK_QUEUE_SIZE];
+}
+
+static uint8_t uplink_encode(uint8_t *buf, const uplink_entry_t *entry, uint16_t delta)
+{
+  uint8_t len = 1;
+
+  /* Only the argument bytes which are non-zero are sent. */
+  uint8_t arg_len = entry->arg > 0xFF ? 2 : entry->arg ? 1 : 0;
+  buf[0] = entry->type | (arg_len << 6);
+  if (arg_len >= 1)
+    buf[len++] = entry->arg & 0xFF;
+  if (arg_len == 2)
+    buf[len++] = (entry->arg >> 8) & 0xFF;
+
+  /* Write the time delta, 7 bits at a time. */
+  while (delta >= 0x80)
+  {
+    buf[len++] = (delta & 0x7F) | 0x80;
+    delta >>= 7;
+  }
+  buf[len++] = delta;
+
+  return len;
+}
+
+/* Packs as many queued events as will fit into the next frame in the window. */
+static uplink_slot_t *uplink_pack(void)
+{
+  uint8_t seq = uplink_next++;
+  uplink_slot_t *slot = &uplink_slots[seq % UPLINK_WINDOW];
+  uplink_acked &= ~(1 << (seq % UPLINK_WINDOW));
+
+  uint16_t time = uplink_queue_peek()->time;
+  slot->buf[0] = UPLINK_FRAME_DATA;
+  slot->buf[1] = config.node;
+  slot->buf[2] = seq;
+  slot->buf[3] = time & 0xFF;
+  slot->buf[4] = (time >> 8) & 0xFF;
+  slot->len = UPLINK_HEADER;
+  slot->tries = 0;
+
+  /* The mesh header eats into the space available for events. */
+  uint8_t max_len = UPLINK_MESH ? MESH_MAX_PAYLOAD : RADIO_MAX_PAYLOAD;
+
+  while (uplink_queue_count() && slot->len + UPLINK_EVENT_MAX <= max_len)
+  {
+    uplink_entry_t *entry = uplink_queue_peek();
+    slot->len += uplink_encode(&slot->buf[slot->len], entry, entry->time - time);
+    time = entry->time;
+    uplink_queue_head++;
+  }
+
+  return slot;
+}
+
+/* Returns true if the frame in the slot is due to be sent (again). */
+static bool uplink_due(const uplink_slot_t *slot, uint16_t now)
+{
+  if (slot->tries == 0)
+    return true;
+
+  return (uint16_t) (now - slot->sent_at) >= (UPLINK_RTO << (slot->tries - 1));
+}
+
+static void uplink_send(uplink_slot_t *slot, uint16_t now)
+{
+  /*
+   * If the radio refused the frame (e.g. because it was receiving at the
+   * time), it is still due, so it is retried on the next cycle.
+   */
+  bool sent;
+  if (UPLINK_MESH)
+  {
+    uint8_t frame[RADIO_MAX_PAYLOAD];
+    uint8_t len = mesh_wrap(&uplink_mesh, frame, MESH_BASE, slot->buf, slot->len);
+    sent = radio_tx(frame, len);
+    if (sent)
+      mesh_wrap_sent(&uplink_mesh);
+  }
+  else
+  {
+    sent = radio_tx(slot->buf, slot->len);
+  }
+
+  if (sent)
+  {
+    slot->sent_at = now;
+    slot->tries++;
+  }
+}
+
+/* Slides the window past the frames which have been acknowledged. */
+static void uplink_slide(void)
+{
+  while (uplink_base != uplink_next && (uplink_acked & (1 << (uplink_base % UPLINK_WINDOW))))
+    uplink_base++;
+}
+
+static void uplink_ack(const uint8_t *buf, uint8_t len)
+{
+  if (len < 4 || buf[1] != config.node)
+    return;
+
+  uint8_t ack_next = buf[2];
+  uint8_t bitmap = buf[3];
+
+  for (uint8_t seq = uplink_base; seq != uplink_next; seq++)
+  {
+    /*
+     * Frames before the next expected sequence number have been received,
+     * as have those after it with their bit set in the bitmap.
+     */
+    uint8_t ahead = seq - ack_next;
+    if (ahead >= 0x80 || (ahead > 0 && ahead <= 8 && (bitmap & (1 << (ahead - 1)))))
+      uplink_acked |= (1 << (seq % UPLINK_WINDOW));
+  }
+
+  uplink_slide();
+}
+
+static void uplink_receive(uint16_t now)
+{
+  uint8_t buf[RADIO_MAX_PAYLOAD], len;
+  if (!radio_rx(buf, &len) || len == 0)
+    return;
+
+  uint8_t *payload = buf;
+  if (UPLINK_MESH && buf[0] == MESH_FRAME)
+  {
+    if (!(mesh_receive(&uplink_mesh, buf, len, now) & MESH_DELIVER))
+      return;
+
+    payload += MESH_HEADER;
+    len -= MESH_HEADER;
+  }
+
+  if (len > 0 && payload[0] == UPLINK_FRAME_ACK)
+    uplink_ack(payload, len);
+  else if (len > 3 && payload[0] == UPLINK_FRAME_CONFIG && payload[1] == config.node)
+    config_stage(payload[2], &payload[3], len - 3);
+}
+
+void uplink_init(void)
+{
+  uplink_queue_head = uplink_queue_tail = 0;
+  uplink_base = uplink_next = 0;
+  uplink_acked = 0;
+
+  uplink_configure();
+}
+
+void uplink_configure(void)
+{
+  if (UPLINK_MESH)
+    mesh_init(&uplink_mesh, config.node);
+}
+
+void uplink_cycle(void)
+{
+  uint16_t now = uplink_now();
+
+  uplink_receive(now);
+
+  /* Only one frame can be on the air at once. */
+  if (radio_busy())
+    return;
+
+  /* Relaying frames for other guns takes priority over our own frames. */
+  uint8_t relay_len = UPLINK_MESH ? mesh_relay_due(&uplink_mesh, now) : 0;
+  if (relay_len)
+  {
+    if (radio_tx(uplink_mesh.relay, relay_len))
+      mesh_relay_sent(&uplink_mesh);
+    return;
+  }
+
+  /*
+   * Selectively retransmit the oldest frame whose ACK is overdue, giving up on
+   * any which have already been sent UPLINK_TRIES times. The base station
+   * restarts its receive window once frames after one which was given up on
+   * are too far ahead of it.
+   */
+  for (uint8_t seq = uplink_base; seq != uplink_next; seq++)
+  {
+    uint8_t mask = 1 << (seq % UPLINK_WINDOW);
+    uplink_slot_t *slot = &uplink_slots[seq % UPLINK_WINDOW];
+    if ((uplink_acked & mask) || !uplink_due(slot, now))
+      continue;
+
+    if (slot->tries == UPLINK_TRIES)
+    {
+      trace(TRACE_RADIO_DROP, (TRACE_RADIO_NO_ACK << 8) | slot->len);
+      uplink_acked |= mask;
+      uplink_slide();
+      continue;
+    }
+
+    uplink_send(slot, now);
+    return;
+  }
+
+  /* Send a new frame if the window has room and enough events are waiting. */
+  uint8_t count = uplink_queue_count();
+  if (count == 0 || (uint8_t) (uplink_next - uplink_base) == UPLINK_WINDOW)
+    return;
+
+  if (count >= UPLINK_BATCH_EVENTS || (uint16_t) (now - uplink_queue_peek()->time) >= UPLINK_BATCH_DELAY)
+    uplink_send(uplink_pack(), now);
+}
+
+bool uplink_event(uplink_event_t type, uint16_t arg)
+{
+  if (uplink_queue_count() == UPLINK_QUEUE_SIZE)
+    return false;
+
+  uplink_entry_t *entry = &uplink_queue[uplink_queue_tail % UPLINK_QUEUE_SIZE];
+  entry->type = type;
+  entry->arg = arg;
+  entry->time = uplink_now();
+  uplink_queue_tail++;
+  return true;
+}
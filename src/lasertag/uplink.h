@@ -0,0 +1,42 @@
+#ifndef LASERTAG_UPLINK_H
+#define LASERTAG_UPLINK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* The types of frame exchanged with the base station. */
+typedef enum
+{
+  UPLINK_FRAME_DATA   = 0x01,
+  UPLINK_FRAME_ACK    = 0x02,
+  UPLINK_FRAME_CONFIG = 0x03
+} uplink_frame_t;
+
+/* The types of game event reported to the base station. */
+typedef enum
+{
+  UPLINK_EVENT_SHOT,
+  UPLINK_EVENT_HIT,
+  UPLINK_EVENT_DEATH,
+  UPLINK_EVENT_RESPAWN,
+  UPLINK_EVENT_RELOAD,
+  UPLINK_EVENT_CONFIG
+} uplink_event_t;
+
+/* Initializes the event uplink. */
+void uplink_init(void);
+
+/* Updates the node ID after the configuration has changed. */
+void uplink_configure(void);
+
+/* Called regularly to send, retransmit and acknowledge event frames. */
+void uplink_cycle(void);
+
+/*
+ * Queues a game event for delivery to the base station, timestamped with the
+ * current time. If the queue is full, the event is dropped and false is
+ * returned.
+ */
+bool uplink_event(uplink_event_t type, uint16_t arg);
+
+#endif
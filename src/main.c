@@ -1,37 +1,53 @@
 #include <avr/interrupt.h>
 #include <avr/io.h>
 #include <lasertag/clock.h>
+#include <lasertag/config.h>
+#include <lasertag/console.h>
 #include <lasertag/game.h>
 #include <lasertag/ir.h>
 #include <lasertag/lcd.h>
 #include <lasertag/led.h>
+#include <lasertag/profile.h>
 #include <lasertag/radio.h>
+#include <lasertag/sched.h>
 #include <lasertag/speaker.h>
 #include <lasertag/spi.h>
+#include <lasertag/trace.h>
 #include <lasertag/uart.h>
+#include <lasertag/uplink.h>
 
 int main(void)
 {
   /* Power down TWI and ADC. */
   PRR = (1 << PRTWI) | (1 << PRADC);
 
+  /* This is first, so the reset flags are recorded before anything else. */
+  trace_init();
+
+  /* The configuration is needed by the drivers, so it's loaded before them. */
+  config_init();
+
   uart_init();
   clock_init();
   ir_init();
+  profile_init();
   led_init();
   speaker_init();
   lcd_init();
   spi_init();
   radio_init();
+  uplink_init();
   game_init();
+  sched_init();
 
-  /* Enable interrupts. */
+  /*
+   * Enable interrupts. The LCD and radio finish initializing in the
+   * background, so the game is ready as soon as the main loop starts.
+   */
   sei();
+  trace(TRACE_READY, TRACE_READY_GAME);
 
   for (;;)
-  {
-    led_cycle();
-    game_cycle();
-  }
+    sched_cycle();
 }
 
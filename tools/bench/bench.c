@@ -0,0 +1,501 @@
+/*
+ * A cycle-accurate benchmark of the firmware, which runs the lasertag ELF
+ * under simavr while replaying a script of stimuli (IR packets on PD2, button
+ * presses and UART input).
+ *
+ * The cycles spent in each interrupt handler, each call to the scheduler and
+ * each run of its tasks' cycle functions are measured by watching the program
+ * counter: a handler or function is entered when the PC reaches its first
+ * instruction, and left when the stack pointer rises above its value on entry
+ * (i.e. the return address has been popped by RET or RETI). The counts are
+ * inclusive of any interrupts taken during a call. A main loop iteration is
+ * measured from one entry of sched_cycle() to the next.
+ *
+ * The addresses of the symbols are read with nm, as simavr doesn't expose the
+ * ELF symbol table. The results are written to stdout as JSON.
+ *
+ * The script is a text file with one stimulus per line, in the form
+ * "<time in ms> <command> <arguments>". Blank lines and lines beginning with
+ * '#' are ignored. The commands are:
+ *
+ *   pin <port><bit> <0|1>  drive an input pin, e.g. "pin D4 1"
+ *   ir <packet>            send a 16-bit IR packet (in hex) to the receiver
+ *   uart <text>            send the rest of the line to the UART
+ *   end                    stop the simulation
+ */
+#include <avr_ioport.h>
+#include <avr_uart.h>
+#include <ctype.h>
+#include <sim_avr.h>
+#include <sim_elf.h>
+#include <sim_time.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* The CPU frequency, which must match FREQ in the Makefile. */
+#define BENCH_FREQ 16000000
+
+/* The length of the IR header, one/zero marks and spaces, see ir.c. */
+#define BENCH_IR_HEADER    1200
+#define BENCH_IR_MARK_ONE  800
+#define BENCH_IR_MARK_ZERO 400
+#define BENCH_IR_SPACE     400
+
+/* The maximum depth of nested calls that are tracked. */
+#define BENCH_MAX_DEPTH 16
+
+/* The maximum length of a script line. */
+#define BENCH_MAX_LINE 256
+
+typedef enum
+{
+  BENCH_EVENT_PIN,
+  BENCH_EVENT_UART,
+  BENCH_EVENT_END
+} bench_event_type_t;
+
+typedef struct
+{
+  avr_cycle_count_t cycle;
+  size_t seq;
+  bench_event_type_t type;
+  char port;
+  uint8_t bit, value;
+} bench_event_t;
+
+typedef struct
+{
+  const char *name;
+  const char *symbol;
+  bool isr;
+  bool found;
+  avr_flashaddr_t addr;
+  unsigned long count;
+  uint64_t min, max, total;
+} bench_target_t;
+
+typedef struct
+{
+  bench_target_t *target;
+  avr_cycle_count_t start;
+  uint16_t sp;
+} bench_frame_t;
+
+/*
+ * The interrupt handlers and functions to measure. The ATmega328P's vector
+ * numbers are used as avr-gcc names the handlers __vector_N.
+ */
+static bench_target_t targets[] = {
+  { "INT0_vect",         "__vector_1",  true,  false, 0, 0, 0, 0, 0 },
+  { "INT1_vect",         "__vector_2",  true,  false, 0, 0, 0, 0, 0 },
+  { "TIMER2_COMPA_vect", "__vector_7",  true,  false, 0, 0, 0, 0, 0 },
+  { "TIMER2_COMPB_vect", "__vector_8",  true,  false, 0, 0, 0, 0, 0 },
+  { "TIMER2_OVF_vect",   "__vector_9",  true,  false, 0, 0, 0, 0, 0 },
+  { "TIMER1_CAPT_vect",  "__vector_10", true,  false, 0, 0, 0, 0, 0 },
+  { "TIMER1_COMPA_vect", "__vector_11", true,  false, 0, 0, 0, 0, 0 },
+  { "TIMER1_COMPB_vect", "__vector_12", true,  false, 0, 0, 0, 0, 0 },
+  { "TIMER1_OVF_vect",   "__vector_13", true,  false, 0, 0, 0, 0, 0 },
+  { "TIMER0_COMPA_vect", "__vector_14", true,  false, 0, 0, 0, 0, 0 },
+  { "TIMER0_COMPB_vect", "__vector_15", true,  false, 0, 0, 0, 0, 0 },
+  { "TIMER0_OVF_vect",   "__vector_16", true,  false, 0, 0, 0, 0, 0 },
+  { "USART_RX_vect",     "__vector_18", true,  false, 0, 0, 0, 0, 0 },
+  { "USART_UDRE_vect",   "__vector_19", true,  false, 0, 0, 0, 0, 0 },
+  { "EE_READY_vect",     "__vector_22", true,  false, 0, 0, 0, 0, 0 },
+  { "ANALOG_COMP_vect",  "__vector_23", true,  false, 0, 0, 0, 0, 0 },
+  { "sched_cycle",       "sched_cycle", false, false, 0, 0, 0, 0, 0 },
+  { "game_cycle",        "game_cycle",  false, false, 0, 0, 0, 0, 0 },
+  { "uplink_cycle",      "uplink_cycle", false, false, 0, 0, 0, 0, 0 },
+  { "radio_cycle",       "radio_cycle", false, false, 0, 0, 0, 0, 0 },
+  { "lcd_cycle",         "lcd_cycle",   false, false, 0, 0, 0, 0, 0 },
+  { "led_cycle",         "led_cycle",   false, false, 0, 0, 0, 0, 0 },
+  { "trace_cycle",       "trace_cycle", false, false, 0, 0, 0, 0, 0 },
+  { "console_cycle",     "console_cycle", false, false, 0, 0, 0, 0, 0 }
+};
+
+#define BENCH_TARGETS (sizeof(targets) / sizeof(targets[0]))
+
+/* The function whose entry marks the start of a main loop iteration. */
+#define BENCH_LOOP_TARGET "sched_cycle"
+
+static bench_target_t loop = { "loop", NULL, false, false, 0, 0, 0, 0, 0 };
+
+/* A map from flash word address to target, or NULL. */
+static bench_target_t **target_map;
+static size_t target_map_size;
+
+static bench_event_t *events;
+static size_t event_count, event_capacity;
+
+static const char *nm = "avr-nm";
+static unsigned long duration_ms = 5000;
+
+static void bench_record(bench_target_t *target, uint64_t cycles)
+{
+  if (target->count == 0 || cycles < target->min)
+    target->min = cycles;
+  if (cycles > target->max)
+    target->max = cycles;
+  target->total += cycles;
+  target->count++;
+}
+
+static void bench_add_event(avr_t *avr, double ms, bench_event_type_t type, char port, uint8_t bit, uint8_t value)
+{
+  if (event_count == event_capacity)
+  {
+    event_capacity = event_capacity ? event_capacity * 2 : 64;
+    events = realloc(events, event_capacity * sizeof(*events));
+    if (!events)
+    {
+      perror("bench");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  bench_event_t *event = &events[event_count++];
+  event->cycle = avr_usec_to_cycles(avr, (uint32_t) (ms * 1000));
+  event->seq = event_count;
+  event->type = type;
+  event->port = port;
+  event->bit = bit;
+  event->value = value;
+}
+
+/*
+ * Adds the edges of an IR packet, as seen by the TSOP (which is active low),
+ * to the event list.
+ */
+static void bench_add_ir(avr_t *avr, double ms, uint16_t packet)
+{
+  bench_add_event(avr, ms, BENCH_EVENT_PIN, 'D', 2, 0);
+  ms += BENCH_IR_HEADER / 1000.0;
+
+  for (int bit = 15; bit >= 0; bit--)
+  {
+    bench_add_event(avr, ms, BENCH_EVENT_PIN, 'D', 2, 1);
+    ms += BENCH_IR_SPACE / 1000.0;
+
+    bench_add_event(avr, ms, BENCH_EVENT_PIN, 'D', 2, 0);
+    ms += (packet & (1 << bit) ? BENCH_IR_MARK_ONE : BENCH_IR_MARK_ZERO) / 1000.0;
+  }
+
+  bench_add_event(avr, ms, BENCH_EVENT_PIN, 'D', 2, 1);
+}
+
+static int bench_compare_events(const void *a, const void *b)
+{
+  const bench_event_t *x = a, *y = b;
+  if (x->cycle != y->cycle)
+    return x->cycle < y->cycle ? -1 : 1;
+
+  /* Keep events at the same time in script order. */
+  return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+static void bench_load_script(avr_t *avr, const char *path)
+{
+  FILE *file = fopen(path, "r");
+  if (!file)
+  {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+
+  char line[BENCH_MAX_LINE];
+  unsigned int line_no = 0;
+  bool ended = false;
+
+  while (fgets(line, sizeof(line), file))
+  {
+    line_no++;
+    line[strcspn(line, "\r\n")] = '\0';
+
+    char *p = line;
+    while (isspace((unsigned char) *p))
+      p++;
+    if (*p == '\0' || *p == '#')
+      continue;
+
+    char command[16];
+    double ms;
+    int n;
+    if (sscanf(p, "%lf %15s %n", &ms, command, &n) != 2)
+      goto invalid;
+    char *args = p + n;
+
+    if (strcmp(command, "pin") == 0)
+    {
+      char port;
+      unsigned int bit, value;
+      if (sscanf(args, "%c%u %u", &port, &bit, &value) != 3 || bit > 7 || value > 1)
+        goto invalid;
+      bench_add_event(avr, ms, BENCH_EVENT_PIN, toupper((unsigned char) port), bit, value);
+    }
+    else if (strcmp(command, "ir") == 0)
+    {
+      unsigned int packet;
+      if (sscanf(args, "%x", &packet) != 1 || packet > UINT16_MAX)
+        goto invalid;
+      bench_add_ir(avr, ms, packet);
+    }
+    else if (strcmp(command, "uart") == 0)
+    {
+      for (char *c = args; *c; c++)
+        bench_add_event(avr, ms, BENCH_EVENT_UART, 0, 0, *c);
+      bench_add_event(avr, ms, BENCH_EVENT_UART, 0, 0, '\n');
+    }
+    else if (strcmp(command, "end") == 0)
+    {
+      bench_add_event(avr, ms, BENCH_EVENT_END, 0, 0, 0);
+      ended = true;
+    }
+    else
+    {
+      goto invalid;
+    }
+  }
+
+  fclose(file);
+
+  if (!ended)
+    bench_add_event(avr, duration_ms, BENCH_EVENT_END, 0, 0, 0);
+
+  qsort(events, event_count, sizeof(*events), bench_compare_events);
+  return;
+
+invalid:
+  fprintf(stderr, "%s:%u: invalid stimulus\n", path, line_no);
+  exit(EXIT_FAILURE);
+}
+
+/* Looks up the addresses of the targets in the ELF file's symbol table. */
+static void bench_load_symbols(const char *elf)
+{
+  char cmd[BENCH_MAX_LINE];
+  snprintf(cmd, sizeof(cmd), "%s '%s'", nm, elf);
+
+  FILE *pipe = popen(cmd, "r");
+  if (!pipe)
+  {
+    perror(nm);
+    exit(EXIT_FAILURE);
+  }
+
+  char line[BENCH_MAX_LINE];
+  while (fgets(line, sizeof(line), pipe))
+  {
+    unsigned long addr;
+    char type, symbol[BENCH_MAX_LINE];
+    if (sscanf(line, "%lx %c %255s", &addr, &type, symbol) != 3 || tolower((unsigned char) type) != 't')
+      continue;
+
+    for (size_t i = 0; i < BENCH_TARGETS; i++)
+    {
+      if (strcmp(targets[i].symbol, symbol) == 0)
+      {
+        targets[i].found = true;
+        targets[i].addr = addr;
+      }
+    }
+  }
+
+  if (pclose(pipe) != 0)
+  {
+    fprintf(stderr, "bench: %s failed\n", cmd);
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void bench_apply_event(avr_t *avr, const bench_event_t *event)
+{
+  if (event->type == BENCH_EVENT_PIN)
+    avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(event->port), event->bit), event->value);
+  else if (event->type == BENCH_EVENT_UART)
+    avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_INPUT), event->value);
+}
+
+static uint16_t bench_sp(avr_t *avr)
+{
+  return avr->data[R_SPL] | (avr->data[R_SPH] << 8);
+}
+
+static void bench_print_target(const bench_target_t *target, bool last)
+{
+  printf("    \"%s\": { \"count\": %lu, \"min\": %llu, \"max\": %llu, \"mean\": %.1f }%s\n",
+    target->name, target->count, (unsigned long long) target->min,
+    (unsigned long long) target->max,
+    target->count ? (double) target->total / target->count : 0.0, last ? "" : ",");
+}
+
+static void bench_print_group(const char *name, bool isr)
+{
+  size_t found = 0, printed = 0;
+  for (size_t i = 0; i < BENCH_TARGETS; i++)
+  {
+    if (targets[i].isr == isr && targets[i].found)
+      found++;
+  }
+
+  printf("  \"%s\": {\n", name);
+  for (size_t i = 0; i < BENCH_TARGETS; i++)
+  {
+    if (targets[i].isr == isr && targets[i].found)
+      bench_print_target(&targets[i], ++printed == found);
+  }
+  printf("  },\n");
+}
+
+static void usage(const char *prog)
+{
+  fprintf(stderr, "Usage: %s [-n nm] [-t duration] [-s script] elf\n", prog);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+  const char *script = NULL;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:t:s:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'n': nm = optarg; break;
+      case 't': duration_ms = strtoul(optarg, NULL, 10); break;
+      case 's': script = optarg; break;
+      default: usage(argv[0]);
+    }
+  }
+
+  if (optind != argc - 1)
+    usage(argv[0]);
+
+  const char *elf = argv[optind];
+
+  elf_firmware_t firmware;
+  memset(&firmware, 0, sizeof(firmware));
+  if (elf_read_firmware(elf, &firmware) != 0)
+  {
+    fprintf(stderr, "bench: failed to load %s\n", elf);
+    return EXIT_FAILURE;
+  }
+
+  avr_t *avr = avr_make_mcu_by_name("atmega328p");
+  if (!avr)
+  {
+    fprintf(stderr, "bench: simavr doesn't support the atmega328p\n");
+    return EXIT_FAILURE;
+  }
+
+  avr_init(avr);
+  avr_load_firmware(avr, &firmware);
+  avr->frequency = BENCH_FREQ;
+
+  /* Don't echo the UART output to stdout, which is reserved for the results. */
+  uint32_t flags = 0;
+  avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS('0'), &flags);
+  flags &= ~AVR_UART_FLAG_STDIO;
+  avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+
+  /* The TSOP idles high, and the buttons (which are active high) are open. */
+  bench_add_event(avr, 0, BENCH_EVENT_PIN, 'D', 2, 1);
+  bench_add_event(avr, 0, BENCH_EVENT_PIN, 'D', 4, 0);
+  bench_add_event(avr, 0, BENCH_EVENT_PIN, 'D', 5, 0);
+  bench_add_event(avr, 0, BENCH_EVENT_PIN, 'D', 7, 0);
+
+  if (script)
+    bench_load_script(avr, script);
+  else
+    bench_add_event(avr, duration_ms, BENCH_EVENT_END, 0, 0, 0);
+
+  bench_load_symbols(elf);
+
+  target_map_size = (avr->flashend + 1) / 2;
+  target_map = calloc(target_map_size, sizeof(*target_map));
+  if (!target_map)
+  {
+    perror("bench");
+    return EXIT_FAILURE;
+  }
+
+  bench_target_t *loop_target = NULL;
+  for (size_t i = 0; i < BENCH_TARGETS; i++)
+  {
+    if (targets[i].found && targets[i].addr / 2 < target_map_size)
+      target_map[targets[i].addr / 2] = &targets[i];
+    if (strcmp(targets[i].name, BENCH_LOOP_TARGET) == 0 && targets[i].found)
+      loop_target = &targets[i];
+  }
+
+  bench_frame_t frames[BENCH_MAX_DEPTH];
+  int depth = 0;
+  avr_cycle_count_t loop_start = 0;
+  size_t next_event = 0;
+
+  for (;;)
+  {
+    while (next_event < event_count && events[next_event].cycle <= avr->cycle)
+    {
+      if (events[next_event].type == BENCH_EVENT_END)
+        goto done;
+      bench_apply_event(avr, &events[next_event++]);
+    }
+
+    int state = avr_run(avr);
+    if (state == cpu_Done || state == cpu_Crashed)
+    {
+      fprintf(stderr, "bench: the firmware stopped at pc 0x%04x\n", avr->pc);
+      return EXIT_FAILURE;
+    }
+
+    uint16_t sp = bench_sp(avr);
+
+    /* Check if any calls have returned. */
+    while (depth > 0 && sp > frames[depth - 1].sp)
+    {
+      depth--;
+      bench_record(frames[depth].target, avr->cycle - frames[depth].start);
+    }
+
+    /* Check if a handler or function has been entered. */
+    bench_target_t *target = avr->pc / 2 < target_map_size ? target_map[avr->pc / 2] : NULL;
+    if (!target)
+      continue;
+
+    if (depth == BENCH_MAX_DEPTH)
+    {
+      fprintf(stderr, "bench: calls nested too deeply\n");
+      return EXIT_FAILURE;
+    }
+
+    frames[depth].target = target;
+    frames[depth].start = avr->cycle;
+    frames[depth].sp = sp;
+    depth++;
+
+    if (target == loop_target)
+    {
+      if (loop_start)
+        bench_record(&loop, avr->cycle - loop_start);
+      loop_start = avr->cycle;
+    }
+  }
+
+done:
+  printf("{\n");
+  printf("  \"elf\": \"%s\",\n", elf);
+  printf("  \"frequency\": %d,\n", BENCH_FREQ);
+  printf("  \"cycles\": %llu,\n", (unsigned long long) avr->cycle);
+  bench_print_group("isrs", true);
+  bench_print_group("functions", false);
+  printf("  \"loop\": { \"count\": %lu, \"min\": %llu, \"max\": %llu, \"mean\": %.1f }\n",
+    loop.count, (unsigned long long) loop.min, (unsigned long long) loop.max,
+    loop.count ? (double) loop.total / loop.count : 0.0);
+  printf("}\n");
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,656 @@
+/*
+ * The base station bridge. It reads the uplink frames passed on by the base
+ * station (see link.h) from a serial port or pseudo-terminal, acknowledges
+ * them, drops duplicates, merges the events from every gun into one timeline
+ * and keeps a scoreboard.
+ *
+ * Each gun timestamps its events in units of 1024 microseconds from its own
+ * clock, in 16 bits. The timestamps are unwrapped separately for each gun, and
+ * mapped onto the bridge's clock with an offset: the smallest difference seen
+ * between the time a frame arrived and the time of its newest event, which is
+ * the one with the least delay in it. Events are then held in a heap for
+ * BRIDGE_HOLD time units, so that those in frames which were delayed by
+ * retransmission can be put in order, before they are applied.
+ *
+ * The scoreboard has each gun's shots, the hits and kills it scored, and the
+ * hits it took and its deaths. A victim reports a hit or death with the team
+ * and player ID of the shooter, which is matched to a gun by the IDs in the
+ * packets of the gun's shots.
+ *
+ * A snapshot of the scoreboard, written with -s, is laid out as follows:
+ *
+ *   'L', 'S', version, gun count, 32-bit event count, guns..., 16-bit CRC
+ *
+ * Each gun is laid out as follows:
+ *
+ *   node ID, flags (bit 0 is set if the team and player ID is known), team
+ *   and player ID, 16-bit shots, hits, hits taken, kills and deaths
+ *
+ * Multi-byte values are little-endian, and the CRC is calculated over
+ * everything before it as in the link's framing. The snapshot is written to a
+ * temporary file which is renamed over the old one, so that a reader never sees
+ * half of it.
+ *
+ * The bridge can be tested end to end against guns simulated by gunsim:
+ *
+ *   gunsim -o expected.txt -- bridge -p > actual.txt
+ *   diff expected.txt actual.txt
+ */
+#include <lasertag/game.h>
+#include <lasertag/uplink.h>
+#include "link.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+/* The length of a time unit is 1 << BRIDGE_TIME_SHIFT us, as in uplink.c. */
+#define BRIDGE_TIME_SHIFT 10
+
+/* The number of time units events are held for to put them in order. */
+#define BRIDGE_HOLD 1000
+
+/* The number of node IDs, and of team and player IDs. */
+#define BRIDGE_NODES    256
+#define BRIDGE_SHOOTERS 256
+
+/* The number of header bytes at the start of a data frame, as in uplink.c. */
+#define BRIDGE_HEADER 5
+
+/* The most events a frame can hold, at two bytes each. */
+#define BRIDGE_FRAME_EVENTS ((RADIO_MAX_PAYLOAD - BRIDGE_HEADER) / 2)
+
+/*
+ * A frame this far behind the receive window can't be a retransmission, so
+ * the gun is taken to have been reset and its window restarts from the frame.
+ */
+#define BRIDGE_STALE 16
+
+#define BRIDGE_SNAPSHOT_VERSION 1
+#define BRIDGE_SNAPSHOT_GUN 13
+
+typedef struct
+{
+  /* The time the event happened on the bridge's clock, in time units. */
+  int64_t time;
+
+  /* The order the event arrived in, which breaks ties. */
+  uint32_t order;
+
+  uint8_t node, type;
+  uint16_t arg;
+} bridge_event_t;
+
+typedef struct
+{
+  /*
+   * The receive window: the next expected sequence number and a bitmap of
+   * the frames after it which have been received, as in an ACK frame. seen is
+   * set once a frame has been received.
+   */
+  bool seen;
+  uint8_t next, received;
+
+  /* The last timestamp and its unwrapped value, and the clock offset. */
+  bool timed;
+  uint16_t last_time;
+  int64_t unwrapped;
+  int64_t offset;
+
+  /* The scoreboard. */
+  bool active, shooter_known;
+  uint8_t shooter;
+  uint32_t shots, taken, deaths;
+} bridge_node_t;
+
+static bridge_node_t nodes[BRIDGE_NODES];
+static uint32_t landed[BRIDGE_SHOOTERS], kills[BRIDGE_SHOOTERS];
+
+/* The events waiting to be applied, as a binary min-heap. */
+static bridge_event_t *heap;
+static size_t heap_len, heap_cap;
+static uint32_t heap_order;
+
+static int64_t start;
+static bool print_events;
+
+/* Statistics. */
+static unsigned long frames, duplicates, restarts, malformed, skipped;
+static unsigned long events, acks;
+
+static int64_t bridge_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  int64_t usecs = (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+  return usecs >> BRIDGE_TIME_SHIFT;
+}
+
+static bool bridge_before(const bridge_event_t *a, const bridge_event_t *b)
+{
+  return a->time < b->time || (a->time == b->time && a->order < b->order);
+}
+
+static void bridge_heap_push(const bridge_event_t *event)
+{
+  if (heap_len == heap_cap)
+  {
+    heap_cap = heap_cap ? heap_cap * 2 : 1024;
+    heap = realloc(heap, heap_cap * sizeof(*heap));
+    if (!heap)
+    {
+      perror("realloc");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  size_t i = heap_len++;
+  while (i > 0 && bridge_before(event, &heap[(i - 1) / 2]))
+  {
+    heap[i] = heap[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  heap[i] = *event;
+}
+
+static bridge_event_t bridge_heap_pop(void)
+{
+  bridge_event_t top = heap[0];
+  bridge_event_t last = heap[--heap_len];
+
+  size_t i = 0;
+  for (;;)
+  {
+    size_t child = i * 2 + 1;
+    if (child >= heap_len)
+      break;
+    if (child + 1 < heap_len && bridge_before(&heap[child + 1], &heap[child]))
+      child++;
+    if (!bridge_before(&heap[child], &last))
+      break;
+
+    heap[i] = heap[child];
+    i = child;
+  }
+  heap[i] = last;
+
+  return top;
+}
+
+static const char *bridge_event_name(uint8_t type)
+{
+  switch (type)
+  {
+    case UPLINK_EVENT_SHOT:    return "shot";
+    case UPLINK_EVENT_HIT:     return "hit";
+    case UPLINK_EVENT_DEATH:   return "death";
+    case UPLINK_EVENT_RESPAWN: return "respawn";
+    case UPLINK_EVENT_RELOAD:  return "reload";
+    case UPLINK_EVENT_CONFIG:  return "config";
+    default:                   return "unknown";
+  }
+}
+
+static void bridge_apply(const bridge_event_t *event)
+{
+  bridge_node_t *n = &nodes[event->node];
+  n->active = true;
+  events++;
+
+  switch (event->type)
+  {
+    case UPLINK_EVENT_SHOT:
+      n->shots++;
+      n->shooter = GAME_PACKET_SHOOTER(event->arg);
+      n->shooter_known = true;
+      break;
+
+    case UPLINK_EVENT_HIT:
+      n->taken++;
+      landed[event->arg & 0xFF]++;
+      break;
+
+    case UPLINK_EVENT_DEATH:
+      n->deaths++;
+      kills[event->arg & 0xFF]++;
+      break;
+  }
+
+  if (print_events)
+  {
+    double secs = (event->time - start) * (1 << BRIDGE_TIME_SHIFT) / 1e6;
+    printf("%12.3f  node=%-3u %-7s arg=0x%04x\n", secs, event->node,
+      bridge_event_name(event->type), event->arg);
+  }
+}
+
+/* Applies the events which have been held for long enough, or all of them. */
+static void bridge_release(int64_t now, bool all)
+{
+  while (heap_len && (all || heap[0].time <= now - BRIDGE_HOLD))
+  {
+    bridge_event_t event = bridge_heap_pop();
+    bridge_apply(&event);
+  }
+}
+
+/*
+ * Adds a frame to the node's receive window, returning false if it has been
+ * received before.
+ */
+static bool bridge_window(bridge_node_t *n, uint8_t seq)
+{
+  uint8_t ahead = seq - n->next;
+  uint8_t behind = n->next - seq;
+
+  /*
+   * A gun numbers its frames from zero, so the window starts there. A bridge
+   * started after the guns finds them far ahead of it, and restarts the
+   * window as though they had been reset.
+   */
+  if (ahead > 8 && behind > BRIDGE_STALE)
+  {
+    if (n->seen)
+      restarts++;
+
+    n->timed = false;
+    n->next = seq;
+    n->received = 0;
+    ahead = 0;
+  }
+  else if (ahead > 8)
+  {
+    return false;
+  }
+  else if (ahead > 0)
+  {
+    uint8_t mask = 1 << (ahead - 1);
+    if (n->received & mask)
+      return false;
+
+    n->received |= mask;
+    return true;
+  }
+
+  /* Slide the window past this frame and any received after it. */
+  bool more;
+  do
+  {
+    n->next++;
+    more = n->received & 1;
+    n->received >>= 1;
+  } while (more);
+
+  return true;
+}
+
+static void bridge_write(int fd, const uint8_t *buf, size_t len)
+{
+  while (len)
+  {
+    ssize_t n = write(fd, buf, len);
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      /* The link has been closed, which the next read will find. */
+      if (errno == EIO)
+        return;
+
+      perror("write");
+      exit(EXIT_FAILURE);
+    }
+    buf += n;
+    len -= n;
+  }
+}
+
+static void bridge_ack(int fd, uint8_t node)
+{
+  if (fd < 0)
+    return;
+
+  uint8_t frame[4] = { UPLINK_FRAME_ACK, node, nodes[node].next, nodes[node].received };
+  uint8_t buf[LINK_MAX_FRAME];
+  bridge_write(fd, buf, link_encode(buf, frame, sizeof(frame)));
+  acks++;
+}
+
+/* Decodes a data frame's events, returning their count or -1 if malformed. */
+static int bridge_decode(const uint8_t *frame, uint8_t len, bridge_event_t *decoded)
+{
+  uint16_t time = frame[3] | (frame[4] << 8);
+  uint8_t pos = BRIDGE_HEADER;
+  int count = 0;
+
+  while (pos < len)
+  {
+    uint8_t type = frame[pos] & 0x3F;
+    uint8_t arg_len = frame[pos++] >> 6;
+    if (arg_len > 2 || pos + arg_len >= len)
+      return -1;
+
+    uint16_t arg = 0;
+    if (arg_len >= 1)
+      arg = frame[pos++];
+    if (arg_len == 2)
+      arg |= frame[pos++] << 8;
+
+    /* The time delta, 7 bits at a time. */
+    uint16_t delta = 0;
+    for (uint8_t shift = 0;; shift += 7)
+    {
+      if (pos == len || shift > 14)
+        return -1;
+
+      uint8_t c = frame[pos++];
+      delta |= (uint16_t) (c & 0x7F) << shift;
+      if (!(c & 0x80))
+        break;
+    }
+
+    time += delta;
+    decoded[count].type = type;
+    decoded[count].arg = arg;
+    decoded[count].time = time;
+    count++;
+  }
+
+  return count;
+}
+
+static void bridge_data(int fd, const uint8_t *frame, uint8_t len, int64_t now)
+{
+  bridge_event_t decoded[BRIDGE_FRAME_EVENTS];
+  int count;
+  if (len < BRIDGE_HEADER || (count = bridge_decode(frame, len, decoded)) <= 0)
+  {
+    malformed++;
+    return;
+  }
+
+  uint8_t node = frame[1];
+  bridge_node_t *n = &nodes[node];
+  frames++;
+
+  /* Duplicates are acknowledged again, as the first ACK may have been lost. */
+  bool fresh = bridge_window(n, frame[2]);
+  n->seen = true;
+  bridge_ack(fd, node);
+  if (!fresh)
+  {
+    duplicates++;
+    return;
+  }
+
+  /* Unwrap the timestamps, relative to the last frame from the gun. */
+  if (!n->timed)
+  {
+    n->timed = true;
+    n->last_time = decoded[0].time;
+    n->unwrapped = decoded[0].time;
+    n->offset = now - n->unwrapped;
+  }
+
+  for (int i = 0; i < count; i++)
+  {
+    uint16_t time = decoded[i].time;
+    n->unwrapped += (int16_t) (time - n->last_time);
+    n->last_time = time;
+    decoded[i].time = n->unwrapped;
+  }
+
+  if (now - n->unwrapped < n->offset)
+    n->offset = now - n->unwrapped;
+
+  for (int i = 0; i < count; i++)
+  {
+    decoded[i].time += n->offset;
+    decoded[i].order = heap_order++;
+    decoded[i].node = node;
+    bridge_heap_push(&decoded[i]);
+  }
+}
+
+static void bridge_put16(uint8_t *buf, uint32_t value)
+{
+  if (value > UINT16_MAX)
+    value = UINT16_MAX;
+  buf[0] = value & 0xFF;
+  buf[1] = value >> 8;
+}
+
+static void bridge_snapshot(const char *path)
+{
+  static uint8_t buf[8 + BRIDGE_NODES * BRIDGE_SNAPSHOT_GUN + 2];
+  size_t len = 8;
+  uint8_t guns = 0;
+
+  for (int node = 0; node < BRIDGE_NODES && guns < UINT8_MAX; node++)
+  {
+    bridge_node_t *n = &nodes[node];
+    if (!n->active)
+      continue;
+
+    uint8_t *gun = &buf[len];
+    gun[0] = node;
+    gun[1] = n->shooter_known ? 1 : 0;
+    gun[2] = n->shooter;
+    bridge_put16(&gun[3], n->shots);
+    bridge_put16(&gun[5], n->shooter_known ? landed[n->shooter] : 0);
+    bridge_put16(&gun[7], n->taken);
+    bridge_put16(&gun[9], n->shooter_known ? kills[n->shooter] : 0);
+    bridge_put16(&gun[11], n->deaths);
+    len += BRIDGE_SNAPSHOT_GUN;
+    guns++;
+  }
+
+  buf[0] = 'L';
+  buf[1] = 'S';
+  buf[2] = BRIDGE_SNAPSHOT_VERSION;
+  buf[3] = guns;
+  buf[4] = events & 0xFF;
+  buf[5] = (events >> 8) & 0xFF;
+  buf[6] = (events >> 16) & 0xFF;
+  buf[7] = (events >> 24) & 0xFF;
+
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < len; i++)
+    crc = link_crc16_update(crc, buf[i]);
+  buf[len++] = crc & 0xFF;
+  buf[len++] = crc >> 8;
+
+  char tmp[4096];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+  FILE *file = fopen(tmp, "wb");
+  if (!file || fwrite(buf, 1, len, file) != len || fclose(file) != 0 || rename(tmp, path) != 0)
+  {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void bridge_print(void)
+{
+  printf("node team player  shots   hits  taken  kills deaths\n");
+  for (int node = 0; node < BRIDGE_NODES; node++)
+  {
+    bridge_node_t *n = &nodes[node];
+    if (!n->active)
+      continue;
+
+    if (n->shooter_known)
+    {
+      printf("%4d %4u %6u %6u %6u %6u %6u %6u\n", node,
+        (unsigned) GAME_PACKET_TEAM(n->shooter << 8),
+        (unsigned) GAME_PACKET_PLAYER(n->shooter << 8),
+        n->shots, landed[n->shooter], n->taken, kills[n->shooter], n->deaths);
+    }
+    else
+    {
+      printf("%4d %4s %6s %6u %6u %6u %6u %6u\n", node, "-", "-", n->shots, 0u,
+        n->taken, 0u, n->deaths);
+    }
+  }
+}
+
+static speed_t bridge_speed(long baud)
+{
+  switch (baud)
+  {
+    case 1200:   return B1200;
+    case 2400:   return B2400;
+    case 4800:   return B4800;
+    case 9600:   return B9600;
+    case 19200:  return B19200;
+    case 38400:  return B38400;
+    case 57600:  return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    default:
+      fprintf(stderr, "bridge: unsupported baud rate %ld\n", baud);
+      exit(EXIT_FAILURE);
+  }
+}
+
+static void usage(const char *prog)
+{
+  fprintf(stderr, "Usage: %s [-b baud] [-s snapshot] [-i interval] [-e] [-p] device\n", prog);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+  long baud = 9600, interval = 1000;
+  const char *snapshot = NULL;
+  bool print_scoreboard = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "b:s:i:ep")) != -1)
+  {
+    switch (opt)
+    {
+      case 'b': baud = strtol(optarg, NULL, 0); break;
+      case 's': snapshot = optarg; break;
+      case 'i': interval = strtol(optarg, NULL, 0); break;
+      case 'e': print_events = true; break;
+      case 'p': print_scoreboard = true; break;
+      default: usage(argv[0]);
+    }
+  }
+
+  if (argc - optind != 1 || interval <= 0)
+    usage(argv[0]);
+
+  int fd = open(argv[optind], O_RDWR | O_NOCTTY);
+  if (fd < 0)
+  {
+    perror(argv[optind]);
+    return EXIT_FAILURE;
+  }
+
+  /*
+   * ACKs are only written back to a terminal, so that a capture of the link
+   * in a file can be replayed without writing to it.
+   */
+  bool tty = isatty(fd);
+  if (tty)
+  {
+    struct termios tio;
+    if (tcgetattr(fd, &tio) != 0)
+    {
+      perror("tcgetattr");
+      return EXIT_FAILURE;
+    }
+
+    cfmakeraw(&tio);
+    cfsetspeed(&tio, bridge_speed(baud));
+    if (tcsetattr(fd, TCSANOW, &tio) != 0)
+    {
+      perror("tcsetattr");
+      return EXIT_FAILURE;
+    }
+  }
+
+  start = bridge_now();
+  int64_t snapshot_at = start;
+  int64_t snapshot_units = (interval * 1000) >> BRIDGE_TIME_SHIFT;
+
+  static uint8_t buf[65536];
+  size_t len = 0;
+
+  for (;;)
+  {
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    int ready = poll(&pfd, 1, 10);
+    if (ready < 0 && errno != EINTR)
+    {
+      perror("poll");
+      return EXIT_FAILURE;
+    }
+
+    if (ready > 0)
+    {
+      ssize_t n = read(fd, &buf[len], sizeof(buf) - len);
+      if (n < 0 && errno == EINTR)
+        continue;
+
+      /* A pseudo-terminal returns EIO once the other end has been closed. */
+      if (n == 0 || (n < 0 && errno == EIO))
+        break;
+
+      if (n < 0)
+      {
+        perror("read");
+        return EXIT_FAILURE;
+      }
+      len += n;
+    }
+
+    int64_t now = bridge_now();
+
+    size_t pos = 0;
+    for (;;)
+    {
+      const uint8_t *frame;
+      uint8_t frame_len;
+      size_t used = link_decode(&buf[pos], len - pos, &frame, &frame_len);
+      if (used == 0)
+        break;
+
+      pos += used;
+      if (!frame)
+        skipped++;
+      else if (frame[0] == UPLINK_FRAME_DATA)
+        bridge_data(tty ? fd : -1, frame, frame_len, now);
+    }
+    memmove(buf, &buf[pos], len - pos);
+    len -= pos;
+
+    bridge_release(now, false);
+
+    if (snapshot && now - snapshot_at >= snapshot_units)
+    {
+      bridge_snapshot(snapshot);
+      snapshot_at = now;
+    }
+  }
+
+  bridge_release(0, true);
+  if (snapshot)
+    bridge_snapshot(snapshot);
+  if (print_scoreboard)
+    bridge_print();
+
+  fprintf(stderr, "bridge: %lu frames, %lu duplicates, %lu restarts, %lu malformed, "
+    "%lu bytes skipped, %lu events, %lu ACKs\n", frames, duplicates, restarts,
+    malformed, skipped, events, acks);
+  return EXIT_SUCCESS;
+}
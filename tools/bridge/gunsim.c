@@ -0,0 +1,565 @@
+/*
+ * Simulates guns sending their events to the base station, to test the bridge
+ * end to end. The guns' end of the link is the master side of a
+ * pseudo-terminal, and the command given after the options (normally the
+ * bridge) is run with the path of the slave side appended to its arguments.
+ *
+ * Each gun queues its events and sends them in frames with the same encoding,
+ * batching, window and retransmission backoff as src/lasertag/uplink.c, using
+ * a clock with a random offset. Unlike a real gun, a simulated gun never gives
+ * up on a frame, so that the bridge's scoreboard can be checked.
+ *
+ * The guns shoot each other at random: each event is a shot or a reload, a
+ * shot hits another gun with probability SIM_HIT_PERCENT, and a gun dies after
+ * SIM_LIVES hits and respawns SIM_RESPAWN time units later. Frames and ACKs
+ * are lost, and frames sent twice, at random with the given percentages.
+ *
+ * Once the duration is over and every event has been acknowledged, the link is
+ * closed, which the bridge sees as the end of its input, and the scoreboard
+ * which the bridge should print with -p is written to the output file.
+ *
+ * Radio airtime and collisions aren't modelled, see meshsim for those.
+ */
+#define _XOPEN_SOURCE 700
+#include <lasertag/game.h>
+#include <lasertag/uplink.h>
+#include "link.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+/* The link parameters, as in uplink.c. */
+#define SIM_TIME_SHIFT    10
+#define SIM_HEADER        5
+#define SIM_EVENT_MAX     6
+#define SIM_BATCH_EVENTS  4
+#define SIM_BATCH_DELAY   50
+#define SIM_WINDOW        4
+#define SIM_RTO           100
+#define SIM_TRIES         6
+
+/*
+ * The number of events each gun can queue. This is more than a real gun can,
+ * so that events are only dropped if the link can't keep up at all.
+ */
+#define SIM_QUEUE_SIZE 256
+
+/* The game rules. */
+#define SIM_HIT_PERCENT    30
+#define SIM_RELOAD_PERCENT 10
+#define SIM_LIVES          5
+#define SIM_RESPAWN        200
+#define SIM_DAMAGE         4
+
+/* How long to wait for the last events to be acknowledged, in time units. */
+#define SIM_DRAIN_TIMEOUT 30000
+
+#define SIM_MAX_GUNS 254
+
+typedef struct
+{
+  uint8_t type;
+  uint16_t arg;
+  uint16_t time;
+} sim_entry_t;
+
+typedef struct
+{
+  uint8_t len;
+  uint8_t buf[RADIO_MAX_PAYLOAD];
+  uint16_t sent_at;
+  uint8_t tries;
+} sim_slot_t;
+
+typedef struct
+{
+  uint8_t node, team, player;
+  uint16_t offset;
+
+  uint8_t health, seq;
+  bool alive;
+  uint64_t respawn_at;
+
+  sim_entry_t queue[SIM_QUEUE_SIZE];
+  unsigned queue_head, queue_tail;
+
+  sim_slot_t slots[SIM_WINDOW];
+  uint8_t base, next, acked;
+
+  /* The scoreboard which the bridge should end up with. */
+  bool active, shot;
+  unsigned shots, landed, taken, kills, deaths;
+} sim_gun_t;
+
+static sim_gun_t guns[SIM_MAX_GUNS];
+static int gun_count = 16;
+static int master = -1;
+static unsigned loss_percent, dup_percent;
+static uint32_t rng_state = 1;
+
+/* Statistics. */
+static unsigned long queued, dropped, sent, lost, duplicated, acks;
+
+static uint32_t sim_rand(void)
+{
+  /* xorshift32. */
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return rng_state;
+}
+
+static bool sim_chance(unsigned percent)
+{
+  return sim_rand() % 100 < percent;
+}
+
+static uint64_t sim_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  uint64_t usecs = (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+  return usecs >> SIM_TIME_SHIFT;
+}
+
+static uint16_t sim_gun_time(const sim_gun_t *gun, uint64_t now)
+{
+  return (uint16_t) (now + gun->offset);
+}
+
+static unsigned sim_queue_count(const sim_gun_t *gun)
+{
+  return gun->queue_tail - gun->queue_head;
+}
+
+static sim_entry_t *sim_queue_peek(sim_gun_t *gun)
+{
+  return &gun->queue[gun->queue_head % SIM_QUEUE_SIZE];
+}
+
+static bool sim_event(sim_gun_t *gun, uplink_event_t type, uint16_t arg, uint64_t now)
+{
+  if (sim_queue_count(gun) == SIM_QUEUE_SIZE)
+  {
+    dropped++;
+    return false;
+  }
+
+  sim_entry_t *entry = &gun->queue[gun->queue_tail++ % SIM_QUEUE_SIZE];
+  entry->type = type;
+  entry->arg = arg;
+  entry->time = sim_gun_time(gun, now);
+  gun->active = true;
+  queued++;
+  return true;
+}
+
+static void sim_read_acks(void);
+
+static void sim_write(const uint8_t *buf, size_t len)
+{
+  while (len)
+  {
+    ssize_t n = write(master, buf, len);
+    if (n < 0 && errno == EAGAIN)
+    {
+      /* Read the ACKs while waiting, so the bridge can't block on them. */
+      struct pollfd pfd = { .fd = master, .events = POLLIN | POLLOUT };
+      poll(&pfd, 1, 10);
+      if (pfd.revents & POLLIN)
+        sim_read_acks();
+      continue;
+    }
+
+    if (n < 0 && errno != EINTR)
+    {
+      perror("write");
+      exit(EXIT_FAILURE);
+    }
+
+    if (n > 0)
+    {
+      buf += n;
+      len -= n;
+    }
+  }
+}
+
+static void sim_send(sim_slot_t *slot, uint16_t now)
+{
+  slot->sent_at = now;
+  if (slot->tries < SIM_TRIES)
+    slot->tries++;
+  sent++;
+
+  if (sim_chance(loss_percent))
+  {
+    lost++;
+    return;
+  }
+
+  uint8_t buf[LINK_MAX_FRAME];
+  size_t len = link_encode(buf, slot->buf, slot->len);
+  sim_write(buf, len);
+  if (sim_chance(dup_percent))
+  {
+    sim_write(buf, len);
+    duplicated++;
+  }
+}
+
+static uint8_t sim_encode(uint8_t *buf, const sim_entry_t *entry, uint16_t delta)
+{
+  uint8_t len = 1;
+
+  uint8_t arg_len = entry->arg > 0xFF ? 2 : entry->arg ? 1 : 0;
+  buf[0] = entry->type | (arg_len << 6);
+  if (arg_len >= 1)
+    buf[len++] = entry->arg & 0xFF;
+  if (arg_len == 2)
+    buf[len++] = (entry->arg >> 8) & 0xFF;
+
+  while (delta >= 0x80)
+  {
+    buf[len++] = (delta & 0x7F) | 0x80;
+    delta >>= 7;
+  }
+  buf[len++] = delta;
+
+  return len;
+}
+
+static sim_slot_t *sim_pack(sim_gun_t *gun)
+{
+  uint8_t seq = gun->next++;
+  sim_slot_t *slot = &gun->slots[seq % SIM_WINDOW];
+  gun->acked &= ~(1 << (seq % SIM_WINDOW));
+
+  uint16_t time = sim_queue_peek(gun)->time;
+  slot->buf[0] = UPLINK_FRAME_DATA;
+  slot->buf[1] = gun->node;
+  slot->buf[2] = seq;
+  slot->buf[3] = time & 0xFF;
+  slot->buf[4] = (time >> 8) & 0xFF;
+  slot->len = SIM_HEADER;
+  slot->tries = 0;
+
+  while (sim_queue_count(gun) && slot->len + SIM_EVENT_MAX <= RADIO_MAX_PAYLOAD)
+  {
+    sim_entry_t *entry = sim_queue_peek(gun);
+    slot->len += sim_encode(&slot->buf[slot->len], entry, entry->time - time);
+    time = entry->time;
+    gun->queue_head++;
+  }
+
+  return slot;
+}
+
+static void sim_ack(const uint8_t *buf, uint8_t len)
+{
+  if (len < 4 || buf[1] == 0 || buf[1] > gun_count || sim_chance(loss_percent))
+    return;
+
+  sim_gun_t *gun = &guns[buf[1] - 1];
+  uint8_t ack_next = buf[2];
+  uint8_t bitmap = buf[3];
+  acks++;
+
+  for (uint8_t seq = gun->base; seq != gun->next; seq++)
+  {
+    uint8_t ahead = seq - ack_next;
+    if (ahead >= 0x80 || (ahead > 0 && ahead <= 8 && (bitmap & (1 << (ahead - 1)))))
+      gun->acked |= (1 << (seq % SIM_WINDOW));
+  }
+
+  while (gun->base != gun->next && (gun->acked & (1 << (gun->base % SIM_WINDOW))))
+    gun->base++;
+}
+
+static void sim_read_acks(void)
+{
+  static uint8_t buf[4096];
+  static size_t len;
+
+  ssize_t n = read(master, &buf[len], sizeof(buf) - len);
+  if (n <= 0)
+    return;
+  len += n;
+
+  size_t pos = 0;
+  for (;;)
+  {
+    const uint8_t *frame;
+    uint8_t frame_len;
+    size_t used = link_decode(&buf[pos], len - pos, &frame, &frame_len);
+    if (used == 0)
+      break;
+
+    pos += used;
+    if (frame && frame[0] == UPLINK_FRAME_ACK)
+      sim_ack(frame, frame_len);
+  }
+  memmove(buf, &buf[pos], len - pos);
+  len -= pos;
+}
+
+/* Sends a frame for the gun if one is due, as uplink_cycle() does. */
+static void sim_uplink(sim_gun_t *gun, uint64_t now)
+{
+  uint16_t time = sim_gun_time(gun, now);
+
+  for (uint8_t seq = gun->base; seq != gun->next; seq++)
+  {
+    sim_slot_t *slot = &gun->slots[seq % SIM_WINDOW];
+    uint16_t rto = SIM_RTO << (slot->tries - 1);
+    if (!(gun->acked & (1 << (seq % SIM_WINDOW))) && (uint16_t) (time - slot->sent_at) >= rto)
+    {
+      sim_send(slot, time);
+      return;
+    }
+  }
+
+  unsigned count = sim_queue_count(gun);
+  if (count == 0 || (uint8_t) (gun->next - gun->base) == SIM_WINDOW)
+    return;
+
+  if (count >= SIM_BATCH_EVENTS || (uint16_t) (time - sim_queue_peek(gun)->time) >= SIM_BATCH_DELAY)
+    sim_send(sim_pack(gun), time);
+}
+
+/* Plays one random event: a shot, which may hit another gun, or a reload. */
+static void sim_play(uint64_t now)
+{
+  sim_gun_t *gun = &guns[sim_rand() % gun_count];
+  if (!gun->alive)
+    return;
+
+  if (sim_chance(SIM_RELOAD_PERCENT))
+  {
+    sim_event(gun, UPLINK_EVENT_RELOAD, sim_rand() % 10, now);
+    return;
+  }
+
+  uint16_t packet = GAME_PACKET(gun->team, gun->player, SIM_DAMAGE, gun->seq);
+  gun->seq = (gun->seq + 1) & 0xF;
+  if (!sim_event(gun, UPLINK_EVENT_SHOT, packet, now))
+    return;
+  gun->shots++;
+  gun->shot = true;
+
+  sim_gun_t *victim = &guns[sim_rand() % gun_count];
+  if (victim == gun || !victim->alive || !sim_chance(SIM_HIT_PERCENT))
+    return;
+
+  uint16_t shooter = GAME_PACKET_SHOOTER(packet);
+  victim->health--;
+  if (sim_event(victim, UPLINK_EVENT_HIT, shooter, now))
+  {
+    victim->taken++;
+    gun->landed++;
+  }
+
+  if (victim->health == 0)
+  {
+    victim->alive = false;
+    victim->respawn_at = now + SIM_RESPAWN;
+    if (sim_event(victim, UPLINK_EVENT_DEATH, shooter, now))
+    {
+      victim->deaths++;
+      gun->kills++;
+    }
+  }
+}
+
+static void sim_print(FILE *file)
+{
+  fprintf(file, "node team player  shots   hits  taken  kills deaths\n");
+  for (int i = 0; i < gun_count; i++)
+  {
+    sim_gun_t *gun = &guns[i];
+    if (!gun->active)
+      continue;
+
+    /* The bridge only learns a gun's team and player from its shots. */
+    if (gun->shot)
+    {
+      fprintf(file, "%4u %4u %6u %6u %6u %6u %6u %6u\n", gun->node, gun->team,
+        gun->player, gun->shots, gun->landed, gun->taken, gun->kills, gun->deaths);
+    }
+    else
+    {
+      fprintf(file, "%4u %4s %6s %6u %6u %6u %6u %6u\n", gun->node, "-", "-",
+        gun->shots, 0u, gun->taken, 0u, gun->deaths);
+    }
+  }
+}
+
+static void usage(const char *prog)
+{
+  fprintf(stderr, "Usage: %s [-n guns] [-r events/s] [-t duration] [-l loss%%] "
+    "[-d duplicate%%] [-s seed] [-o output] [-- command...]\n", prog);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+  unsigned rate = 2000, duration = 5;
+  const char *output = NULL;
+
+  loss_percent = 10;
+  dup_percent = 5;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:r:t:l:d:s:o:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'n': gun_count = atoi(optarg); break;
+      case 'r': rate = strtoul(optarg, NULL, 0); break;
+      case 't': duration = strtoul(optarg, NULL, 0); break;
+      case 'l': loss_percent = strtoul(optarg, NULL, 0); break;
+      case 'd': dup_percent = strtoul(optarg, NULL, 0); break;
+      case 's': rng_state = strtoul(optarg, NULL, 0); break;
+      case 'o': output = optarg; break;
+      default: usage(argv[0]);
+    }
+  }
+
+  if (gun_count < 2 || gun_count > SIM_MAX_GUNS || loss_percent >= 100 || rng_state == 0)
+    usage(argv[0]);
+
+  master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+  {
+    perror("posix_openpt");
+    return EXIT_FAILURE;
+  }
+
+  /*
+   * The slave is held open (but never read) so that the link doesn't hang up
+   * before the command has opened it, and is made raw so that the frames
+   * aren't echoed or translated.
+   */
+  const char *path = ptsname(master);
+  int slave = open(path, O_RDWR | O_NOCTTY);
+  struct termios tio;
+  if (slave < 0 || tcgetattr(slave, &tio) != 0)
+  {
+    perror(path);
+    return EXIT_FAILURE;
+  }
+  cfmakeraw(&tio);
+  tcsetattr(slave, TCSANOW, &tio);
+  fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+  pid_t child = -1;
+  if (optind < argc)
+  {
+    child = fork();
+    if (child == 0)
+    {
+      char **args = calloc(argc - optind + 2, sizeof(*args));
+      for (int i = optind; i < argc; i++)
+        args[i - optind] = argv[i];
+      args[argc - optind] = (char *) path;
+
+      close(master);
+      close(slave);
+      execvp(args[0], args);
+      perror(args[0]);
+      _exit(EXIT_FAILURE);
+    }
+  }
+  else
+  {
+    printf("%s\n", path);
+    fflush(stdout);
+  }
+
+  uint64_t start = sim_now();
+  for (int i = 0; i < gun_count; i++)
+  {
+    sim_gun_t *gun = &guns[i];
+    gun->node = i + 1;
+    gun->team = gun->node & 3;
+    gun->player = gun->node >> 2;
+    gun->offset = sim_rand();
+    gun->health = SIM_LIVES;
+    gun->alive = true;
+    sim_event(gun, UPLINK_EVENT_RESPAWN, 0, start);
+  }
+
+  /* Play the events at the given rate, and then wait for them to be sent. */
+  uint64_t end = start + ((uint64_t) duration * 1000000 >> SIM_TIME_SHIFT);
+  uint64_t played = 0;
+  for (;;)
+  {
+    uint64_t now = sim_now();
+    if (now < end)
+    {
+      uint64_t due = (now - start) * rate * (1 << SIM_TIME_SHIFT) / 1000000;
+      for (; played < due; played++)
+        sim_play(now);
+    }
+
+    bool idle = true;
+    for (int i = 0; i < gun_count; i++)
+    {
+      sim_gun_t *gun = &guns[i];
+      if (!gun->alive && now >= gun->respawn_at && now < end)
+      {
+        gun->alive = true;
+        gun->health = SIM_LIVES;
+        sim_event(gun, UPLINK_EVENT_RESPAWN, 0, now);
+      }
+
+      sim_uplink(gun, now);
+      if (sim_queue_count(gun) || gun->base != gun->next)
+        idle = false;
+    }
+
+    if (now >= end && idle)
+      break;
+
+    if (now >= end + SIM_DRAIN_TIMEOUT)
+    {
+      fprintf(stderr, "gunsim: timed out waiting for ACKs\n");
+      return EXIT_FAILURE;
+    }
+
+    struct pollfd pfd = { .fd = master, .events = POLLIN };
+    if (poll(&pfd, 1, 1) > 0 && (pfd.revents & POLLIN))
+      sim_read_acks();
+  }
+
+  close(slave);
+  close(master);
+
+  int status = 0;
+  if (child > 0)
+    waitpid(child, &status, 0);
+
+  FILE *file = output ? fopen(output, "w") : stderr;
+  if (!file)
+  {
+    perror(output);
+    return EXIT_FAILURE;
+  }
+  sim_print(file);
+  if (output)
+    fclose(file);
+
+  fprintf(stderr, "gunsim: %lu events queued, %lu dropped, %lu frames sent, "
+    "%lu lost, %lu duplicated, %lu ACKs\n", queued, dropped, sent, lost,
+    duplicated, acks);
+
+  return WIFEXITED(status) ? WEXITSTATUS(status) : EXIT_FAILURE;
+}
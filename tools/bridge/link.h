@@ -0,0 +1,91 @@
+/*
+ * The serial link between the base station and the bridge.
+ *
+ * The base station passes each uplink frame it receives from a gun (see
+ * src/lasertag/uplink.c), with any mesh header removed, to the serial port,
+ * and transmits each frame it reads from the serial port to the guns. On the
+ * serial port, each frame is laid out as follows:
+ *
+ *   'L', 'B', length, frame..., 16-bit CRC
+ *
+ * The CRC is little-endian, and is calculated over the length and the frame
+ * with _crc16_update(), starting from 0xFFFF (as for the trace dump). A reader
+ * which finds a bad length or CRC skips a byte and looks for the next 'L', 'B'.
+ */
+#ifndef LINK_H
+#define LINK_H
+
+#include <lasertag/radio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LINK_MAGIC0 'L'
+#define LINK_MAGIC1 'B'
+
+/* The number of bytes the framing adds around a frame. */
+#define LINK_OVERHEAD 5
+
+/* The longest frame on the serial port, including the framing. */
+#define LINK_MAX_FRAME (RADIO_MAX_PAYLOAD + LINK_OVERHEAD)
+
+static inline uint16_t link_crc16_update(uint16_t crc, uint8_t a)
+{
+  crc ^= a;
+  for (int i = 0; i < 8; i++)
+  {
+    if (crc & 1)
+      crc = (crc >> 1) ^ 0xA001;
+    else
+      crc = (crc >> 1);
+  }
+  return crc;
+}
+
+/* Writes a frame to the buffer with its framing, returning the total length. */
+static inline size_t link_encode(uint8_t *buf, const uint8_t *frame, uint8_t len)
+{
+  uint16_t crc = link_crc16_update(0xFFFF, len);
+  buf[0] = LINK_MAGIC0;
+  buf[1] = LINK_MAGIC1;
+  buf[2] = len;
+  for (uint8_t i = 0; i < len; i++)
+  {
+    buf[3 + i] = frame[i];
+    crc = link_crc16_update(crc, frame[i]);
+  }
+  buf[3 + len] = crc & 0xFF;
+  buf[4 + len] = crc >> 8;
+  return len + LINK_OVERHEAD;
+}
+
+/*
+ * Looks for a frame at the start of the buffer. Returns the number of bytes to
+ * consume: zero if more bytes are needed, one if the first byte doesn't start
+ * a valid frame (in which case *frame is set to NULL) or the length of the
+ * frame with its framing otherwise.
+ */
+static inline size_t link_decode(const uint8_t *buf, size_t avail, const uint8_t **frame, uint8_t *len)
+{
+  *frame = NULL;
+  if (avail < 3)
+    return (avail >= 1 && buf[0] != LINK_MAGIC0) || (avail >= 2 && buf[1] != LINK_MAGIC1) ? 1 : 0;
+
+  if (buf[0] != LINK_MAGIC0 || buf[1] != LINK_MAGIC1 || buf[2] == 0 || buf[2] > RADIO_MAX_PAYLOAD)
+    return 1;
+
+  size_t total = buf[2] + LINK_OVERHEAD;
+  if (avail < total)
+    return 0;
+
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 2; i < total - 2; i++)
+    crc = link_crc16_update(crc, buf[i]);
+  if ((buf[total - 2] | (buf[total - 1] << 8)) != crc)
+    return 1;
+
+  *frame = &buf[3];
+  *len = buf[2];
+  return total;
+}
+
+#endif
@@ -0,0 +1,354 @@
+/*
+ * Replays IR edge captures, written to the UART by ir_capture_cycle(), through
+ * the firmware's IR decoder, which is linked unchanged from the host build.
+ *
+ * The edges are fed to the decoder by driving the receiver's pin with the mock
+ * HAL and advancing Timer2 between them, so the decoder sees the same timings
+ * (to the nearest clock tick) as it did on the gun. The packets it decodes,
+ * and the reasons it dropped any others, are then reported along with
+ * histograms of the lengths of the marks and spaces in the capture.
+ *
+ * Each file (or stdin if none are given) is replayed in turn, and any bytes
+ * which aren't part of a chunk, such as the console's other output, are
+ * skipped. The timings of the decoder can be overridden to try out a change
+ * against the same captures.
+ *
+ * The receiver's interrupt can also be held off for a random time after each
+ * edge, as it would be by another ISR, to compare the INT0 receiver with the
+ * input capture one (irreplay-capture, which links the decoder built with
+ * IR_RX_CAPTURE). INT0 times an edge when its ISR runs, but Timer1 latches it
+ * when it happens.
+ */
+#include <hal.h>
+#include <avr/interrupt.h>
+#include <lasertag/clock.h>
+#include <lasertag/config.h>
+#include <lasertag/ir.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* The longest mark or space in the histograms, in microseconds. */
+#define REPLAY_HIST_MAX 4000
+
+/* The number of clock ticks of silence used to separate captures. */
+#define REPLAY_GAP 1024
+
+typedef struct
+{
+  unsigned int width;
+  unsigned long counts[REPLAY_HIST_MAX + 1];
+  unsigned long longer;
+} replay_hist_t;
+
+static bool replay_verbose;
+
+/*
+ * The longest time the receiver's interrupt is held off after an edge, and
+ * the time it was held off after the previous one, in microseconds.
+ */
+static unsigned int replay_latency;
+static uint32_t replay_late;
+static replay_hist_t replay_marks, replay_spaces;
+
+/* The time replayed so far, in microseconds and in clock ticks. */
+static uint64_t replay_usecs, replay_ticks;
+
+static unsigned long replay_edges, replay_packets, replay_chunks, replay_bad_chunks, replay_dropped;
+
+/* The level of the previous edge, or -1 if it isn't known. */
+static int replay_level = -1;
+
+static uint16_t replay_crc16_update(uint16_t crc, uint8_t a)
+{
+  crc ^= a;
+  for (int i = 0; i < 8; i++)
+  {
+    if (crc & 1)
+      crc = (crc >> 1) ^ 0xA001;
+    else
+      crc = (crc >> 1);
+  }
+  return crc;
+}
+
+static void replay_hist_add(replay_hist_t *hist, uint32_t usecs)
+{
+  if (usecs > REPLAY_HIST_MAX)
+    hist->longer++;
+  else
+    hist->counts[usecs / hist->width * hist->width]++;
+}
+
+static void replay_hist_print(const char *name, const replay_hist_t *hist)
+{
+  unsigned long max = 0;
+  for (unsigned int usecs = 0; usecs <= REPLAY_HIST_MAX; usecs++)
+  {
+    if (hist->counts[usecs] > max)
+      max = hist->counts[usecs];
+  }
+
+  printf("\n%s lengths (us)\n", name);
+  for (unsigned int usecs = 0; usecs <= REPLAY_HIST_MAX; usecs++)
+  {
+    unsigned long count = hist->counts[usecs];
+    if (count == 0)
+      continue;
+
+    printf("%6u %8lu ", usecs, count);
+    for (unsigned long i = 0; i < (count * 50 + max - 1) / max; i++)
+      putchar('#');
+    putchar('\n');
+  }
+  printf("%6s %8lu\n", "longer", hist->longer);
+}
+
+/* Advances the clock, servicing the decoder's timeout interrupt. */
+static void replay_advance(uint64_t usecs)
+{
+  replay_usecs += usecs;
+  uint64_t ticks = replay_usecs / CLOCK_USECS_PER_TICK;
+  hal_timer2_step(ticks - replay_ticks);
+  replay_ticks = ticks;
+}
+
+static void replay_poll(void)
+{
+  uint16_t packet;
+  while (ir_rx(&packet))
+  {
+    replay_packets++;
+    if (replay_verbose)
+      printf("%12.6f  0x%04x\n", replay_usecs / 1e6, packet);
+  }
+}
+
+static void replay_edge(bool rising, uint32_t usecs, bool saturated)
+{
+  /* The time the previous edge's interrupt was held off has already passed. */
+  replay_advance(usecs > replay_late ? usecs - replay_late : 0);
+
+  if (!saturated && replay_level == !rising)
+    replay_hist_add(rising ? &replay_spaces : &replay_marks, usecs);
+  replay_level = rising;
+
+  /*
+   * The TSOP is active low. Its output is wired to PD2, or to ADC6 if the
+   * firmware was built with IR_RX_CAPTURE, so both are driven.
+   */
+  replay_late = replay_latency ? (uint32_t) rand() % (replay_latency + 1) : 0;
+  cli();
+  hal_pin_write(&PIND, PD2, !rising);
+  hal_adc_write(IR_RX_ADC, !rising);
+  replay_advance(replay_late);
+  sei();
+  replay_edges++;
+  replay_poll();
+}
+
+/* Separates captures, or the edges either side of a gap in one. */
+static void replay_gap(void)
+{
+  replay_advance(REPLAY_GAP * CLOCK_USECS_PER_TICK);
+  replay_level = -1;
+  replay_late = 0;
+  replay_poll();
+}
+
+static void replay_chunk(const uint8_t *chunk)
+{
+  uint8_t usecs_per_tick = chunk[0];
+  uint8_t dropped = chunk[1];
+  uint8_t len = chunk[2];
+  const uint8_t *edges = &chunk[3];
+
+  replay_chunks++;
+  if (dropped)
+  {
+    replay_dropped += dropped;
+    replay_gap();
+  }
+
+  for (uint8_t i = 0; i < len;)
+  {
+    uint8_t value = edges[i++];
+    bool rising = value & 0x80;
+    uint32_t delta = value & 0x3F;
+    unsigned int shift = 6;
+    bool more = value & 0x40;
+
+    while (more && i < len)
+    {
+      value = edges[i++];
+      delta |= (uint32_t) (value & 0x7F) << shift;
+      shift += 7;
+      more = value & 0x80;
+    }
+
+    replay_edge(rising, delta * usecs_per_tick, delta >= IR_CAPTURE_MAX_DELTA);
+  }
+}
+
+static void replay_file(FILE *file)
+{
+  /* The magic number, the chunk header, the longest chunk and the CRC. */
+  uint8_t buf[2 + 3 + UINT8_MAX + 2];
+  size_t avail = 0;
+  bool eof = false;
+
+  while (!eof || avail > 0)
+  {
+    if (!eof)
+    {
+      avail += fread(&buf[avail], 1, sizeof(buf) - avail, file);
+      eof = avail < sizeof(buf);
+    }
+
+    size_t consume = 1;
+    if (avail >= 5 && buf[0] == 'L' && buf[1] == 'I' && avail >= (size_t) buf[4] + 7)
+    {
+      size_t total = buf[4] + 7;
+      uint16_t crc = 0xFFFF;
+      for (size_t i = 2; i < total - 2; i++)
+        crc = replay_crc16_update(crc, buf[i]);
+
+      if ((buf[total - 2] | (buf[total - 1] << 8)) == crc)
+      {
+        replay_chunk(&buf[2]);
+        consume = total;
+      }
+      else
+      {
+        replay_bad_chunks++;
+      }
+    }
+    else if (avail >= 2 && buf[0] == 'L' && buf[1] == 'I' && !eof)
+    {
+      /* The rest of the chunk hasn't been read yet. */
+      continue;
+    }
+
+    memmove(buf, &buf[consume], avail - consume);
+    avail -= consume;
+  }
+}
+
+static void usage(const char *prog)
+{
+  fprintf(stderr, "Usage: %s [-v] [-H header] [-1 one] [-0 zero] [-S space] [-E error] [-l latency] [-w width] [file...]\n", prog);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+  hal_reset();
+  config_init();
+
+  replay_marks.width = CLOCK_USECS_PER_TICK;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "vH:1:0:S:E:l:w:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'v':
+        replay_verbose = true;
+        break;
+
+      case 'H':
+        config.ir_header = atoi(optarg);
+        break;
+
+      case '1':
+        config.ir_mark_one = atoi(optarg);
+        break;
+
+      case '0':
+        config.ir_mark_zero = atoi(optarg);
+        break;
+
+      case 'S':
+        config.ir_space = atoi(optarg);
+        break;
+
+      case 'E':
+        config.ir_error = atoi(optarg);
+        break;
+
+      case 'l':
+        replay_latency = atoi(optarg);
+        break;
+
+      case 'w':
+        replay_marks.width = atoi(optarg);
+        break;
+
+      default:
+        usage(argv[0]);
+    }
+  }
+
+  if (replay_marks.width == 0)
+    usage(argv[0]);
+  replay_spaces.width = replay_marks.width;
+
+  /* The receiver's output idles high. */
+  hal_pin_write(&PIND, PD2, true);
+  hal_adc_write(IR_RX_ADC, true);
+  clock_init();
+  ir_init();
+  sei();
+
+  if (optind == argc)
+  {
+    replay_file(stdin);
+  }
+  else
+  {
+    for (int i = optind; i < argc; i++)
+    {
+      FILE *file = fopen(argv[i], "rb");
+      if (!file)
+      {
+        perror(argv[i]);
+        return EXIT_FAILURE;
+      }
+
+      replay_file(file);
+      fclose(file);
+      replay_gap();
+    }
+  }
+  replay_gap();
+
+  ir_stats_t stats;
+  ir_stats(&stats);
+
+  unsigned long dropped = 0;
+  for (int i = 0; i < TRACE_IR_FULL; i++)
+    dropped += stats.dropped[i];
+
+  printf("# %lu chunks (%lu bad), %lu edges (%lu lost), %.3f s\n", replay_chunks,
+    replay_bad_chunks, replay_edges, replay_dropped, replay_usecs / 1e6);
+  printf("# timings (us): header %u one %u zero %u space %u error %u\n", config.ir_header,
+    config.ir_mark_one, config.ir_mark_zero, config.ir_space, config.ir_error);
+  printf("# receiver: %s, held off for up to %u us\n", IR_RX_CAPTURE ? "input capture" : "INT0",
+    replay_latency);
+
+  unsigned long attempts = replay_packets + dropped;
+  printf("\ndecoded %8lu (%.1f%%)\n", replay_packets, attempts ? replay_packets * 100.0 / attempts : 0.0);
+  printf("dropped %8lu\n", dropped);
+
+  static const char * const reasons[TRACE_IR_FULL] = {
+    "bad header", "bad space", "bad mark", "unexpected edge", "timeout", "buffer full"
+  };
+  for (int i = 0; i < TRACE_IR_FULL; i++)
+    printf("  %-16s %8u\n", reasons[i], stats.dropped[i]);
+
+  replay_hist_print("mark", &replay_marks);
+  replay_hist_print("space", &replay_spaces);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,271 @@
+/*
+ * Reports the static RAM and flash used by each module of the firmware, read
+ * from the map file written by the linker.
+ *
+ * Every input section in the .text, .data, .bss and .noinit output sections
+ * is attributed to a module. The firmware is built with -ffunction-sections
+ * and -fdata-sections, so each section holds a single function or variable.
+ * Sections from an object file in the tree are attributed to the module the
+ * file was compiled from, and sections from an archive to the archive (e.g.
+ * libc or libgcc). With LTO, the firmware is linked from temporary ltrans
+ * objects, so instead the module is taken from the prefix of the symbol in
+ * the section name, as each module prefixes its symbols with its name (e.g.
+ * ir_rx_buf belongs to ir).
+ *
+ * Flash usage is the size of the .text and .data sections (as the initial
+ * values of .data are stored in flash), and RAM usage is the size of the
+ * .data, .bss and .noinit sections. The RAM which isn't used by static data
+ * is left for the stack.
+ */
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* The ATmega328P's memory sizes. */
+#define MEM_FLASH 32768
+#define MEM_RAM   2048
+
+/* The maximum number of modules and the maximum length of their names. */
+#define MEM_MAX_MODULES 64
+#define MEM_MAX_NAME    32
+
+/* The maximum length of a line in the map file. */
+#define MEM_MAX_LINE 1024
+
+typedef enum
+{
+  MEM_SECTION_NONE,
+  MEM_SECTION_TEXT,
+  MEM_SECTION_DATA,
+  MEM_SECTION_BSS
+} mem_section_t;
+
+typedef struct
+{
+  char name[MEM_MAX_NAME];
+  unsigned long text, data, bss;
+} mem_module_t;
+
+static mem_module_t modules[MEM_MAX_MODULES];
+static int module_count;
+
+static mem_module_t *mem_module(const char *name)
+{
+  for (int i = 0; i < module_count; i++)
+  {
+    if (strcmp(modules[i].name, name) == 0)
+      return &modules[i];
+  }
+
+  if (module_count == MEM_MAX_MODULES)
+  {
+    fprintf(stderr, "memreport: too many modules\n");
+    exit(EXIT_FAILURE);
+  }
+
+  mem_module_t *module = &modules[module_count++];
+  snprintf(module->name, sizeof(module->name), "%s", name);
+  return module;
+}
+
+/* Works out which module an input section belongs to. */
+static void mem_module_name(const char *section, const char *file, char *name, size_t len)
+{
+  /* An object in an archive, e.g. /usr/lib/avr/lib/libc.a(strlen.o). */
+  const char *paren = strchr(file, '(');
+  if (paren)
+  {
+    const char *start = file;
+    for (const char *p = file; p < paren; p++)
+    {
+      if (*p == '/')
+        start = p + 1;
+    }
+
+    const char *end = paren;
+    if (end - start > 2 && strncmp(end - 2, ".a", 2) == 0)
+      end -= 2;
+    snprintf(name, len, "%.*s", (int) (end - start), start);
+    return;
+  }
+
+  /* A temporary object from an LTO link - use the symbol's prefix. */
+  if (strstr(file, "ltrans") || strstr(file, "/tmp/"))
+  {
+    /* Skip the section type, e.g. the ".text." of ".text.ir_init". */
+    const char *symbol = strchr(section + 1, '.');
+    if (symbol && symbol[1])
+    {
+      symbol++;
+      if (strncmp(symbol, "__vector_", 9) == 0)
+      {
+        snprintf(name, len, "vectors");
+        return;
+      }
+
+      size_t n = strcspn(symbol, "_.");
+      if (n > 0)
+      {
+        snprintf(name, len, "%.*s", (int) n, symbol);
+        return;
+      }
+    }
+
+    snprintf(name, len, "lto");
+    return;
+  }
+
+  /* An object in the tree, e.g. src/lasertag/ir.o. */
+  const char *start = strrchr(file, '/');
+  start = start ? start + 1 : file;
+  size_t n = strcspn(start, ".");
+  snprintf(name, len, "%.*s", (int) n, start);
+}
+
+static void mem_add(mem_section_t type, const char *section, unsigned long size, const char *file)
+{
+  if (size == 0)
+    return;
+
+  char name[MEM_MAX_NAME];
+  mem_module_name(section, file, name, sizeof(name));
+
+  mem_module_t *module = mem_module(name);
+  switch (type)
+  {
+    case MEM_SECTION_TEXT: module->text += size; break;
+    case MEM_SECTION_DATA: module->data += size; break;
+    case MEM_SECTION_BSS:  module->bss += size; break;
+    default: break;
+  }
+}
+
+static mem_section_t mem_output_section(const char *line)
+{
+  size_t n = strcspn(line, " \t\n");
+  if (n == 5 && strncmp(line, ".text", n) == 0)
+    return MEM_SECTION_TEXT;
+  else if (n == 5 && strncmp(line, ".data", n) == 0)
+    return MEM_SECTION_DATA;
+  else if ((n == 4 && strncmp(line, ".bss", n) == 0) || (n == 7 && strncmp(line, ".noinit", n) == 0))
+    return MEM_SECTION_BSS;
+  else
+    return MEM_SECTION_NONE;
+}
+
+static int mem_compare(const void *a, const void *b)
+{
+  const mem_module_t *x = a, *y = b;
+  unsigned long x_total = x->text + x->data * 2 + x->bss;
+  unsigned long y_total = y->text + y->data * 2 + y->bss;
+  if (x_total != y_total)
+    return x_total > y_total ? -1 : 1;
+  return strcmp(x->name, y->name);
+}
+
+static void usage(const char *prog)
+{
+  fprintf(stderr, "Usage: %s map\n", prog);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+  if (getopt(argc, argv, "") != -1 || optind != argc - 1)
+    usage(argv[0]);
+
+  FILE *file = fopen(argv[optind], "r");
+  if (!file)
+  {
+    perror(argv[optind]);
+    return EXIT_FAILURE;
+  }
+
+  char line[MEM_MAX_LINE];
+  bool memory_map = false;
+  mem_section_t type = MEM_SECTION_NONE;
+
+  /* An input section name which was too long to share a line with its size. */
+  char pending[MEM_MAX_LINE] = "";
+
+  while (fgets(line, sizeof(line), file))
+  {
+    /* The input sections listed before the memory map were discarded. */
+    if (!memory_map)
+    {
+      memory_map = strncmp(line, "Linker script and memory map", 28) == 0;
+      continue;
+    }
+
+    /* Output sections start at the beginning of the line. */
+    if (line[0] != ' ')
+    {
+      if (line[0] != '\n')
+        type = mem_output_section(line);
+      pending[0] = '\0';
+      continue;
+    }
+
+    if (type == MEM_SECTION_NONE)
+      continue;
+
+    char section[MEM_MAX_LINE], obj[MEM_MAX_LINE];
+    unsigned long addr, size;
+
+    if (sscanf(line, " %s 0x%lx 0x%lx %s", section, &addr, &size, obj) == 4)
+    {
+      /* An input section on a single line. */
+      if (section[0] == '.' || strcmp(section, "COMMON") == 0)
+        mem_add(type, section, size, obj);
+      pending[0] = '\0';
+    }
+    else if (pending[0] && sscanf(line, " 0x%lx 0x%lx %s", &addr, &size, obj) == 3)
+    {
+      /* The second line of a long input section. */
+      mem_add(type, pending, size, obj);
+      pending[0] = '\0';
+    }
+    else if (sscanf(line, " %s", section) == 1 && section[0] == '.' && !isspace((unsigned char) line[1]))
+    {
+      /* The first line of a long input section. */
+      snprintf(pending, sizeof(pending), "%s", section);
+    }
+    else
+    {
+      /* A symbol, fill or something else which doesn't take up any space. */
+      pending[0] = '\0';
+    }
+  }
+
+  fclose(file);
+
+  if (!memory_map)
+  {
+    fprintf(stderr, "memreport: %s isn't a linker map\n", argv[optind]);
+    return EXIT_FAILURE;
+  }
+
+  qsort(modules, module_count, sizeof(*modules), mem_compare);
+
+  unsigned long flash = 0, ram = 0;
+  printf("%-16s %8s %8s %8s %8s\n", "module", "flash", "data", "bss", "ram");
+  for (int i = 0; i < module_count; i++)
+  {
+    mem_module_t *module = &modules[i];
+    printf("%-16s %8lu %8lu %8lu %8lu\n", module->name, module->text + module->data,
+      module->data, module->bss, module->data + module->bss);
+    flash += module->text + module->data;
+    ram += module->data + module->bss;
+  }
+
+  printf("%-16s %8lu %8s %8s %8lu\n", "total", flash, "", "", ram);
+  printf("\n");
+  printf("flash: %lu of %d bytes (%.1f%%)\n", flash, MEM_FLASH, flash * 100.0 / MEM_FLASH);
+  printf("ram: %lu of %d bytes (%.1f%%), leaving %lu for the stack\n", ram, MEM_RAM,
+    ram * 100.0 / MEM_RAM, ram < MEM_RAM ? MEM_RAM - ram : 0);
+
+  return EXIT_SUCCESS;
+}
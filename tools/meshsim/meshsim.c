@@ -0,0 +1,360 @@
+/*
+ * A host simulation of the mesh relaying in src/lasertag/mesh.c.
+ *
+ * Guns are scattered at random over a rectangular arena with the base station
+ * on the middle of its left edge. Every gun periodically originates a frame
+ * addressed to the base station, which is relayed through the mesh using the
+ * same code as the firmware. The base station periodically broadcasts a frame
+ * (standing in for its ACKs), from which the guns learn their distance to it.
+ * The radio channel is modelled with a fixed range, airtime proportional to
+ * the frame length, carrier sense (a gun won't start transmitting while it can
+ * hear another transmission) and collisions (a frame is lost if the receiver
+ * hears another transmission which overlaps it).
+ *
+ * Time is simulated in steps of one mesh time unit (1024 microseconds).
+ */
+#include <lasertag/mesh.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* The size of the payload each gun originates, in bytes. */
+#define SIM_PAYLOAD 16
+
+/* The number of microseconds it takes to send one byte at ~49.2 kbps. */
+#define SIM_USECS_PER_BYTE 163
+
+/* The number of preamble, sync, length, CRC and dummy bytes around a frame. */
+#define SIM_FRAME_OVERHEAD 9
+
+/* The length of a mesh time unit in microseconds. */
+#define SIM_USECS_PER_UNIT 1024
+
+/* The maximum number of transmissions which can be on the air at once. */
+#define SIM_MAX_TX 256
+
+typedef struct
+{
+  double x, y;
+  mesh_t mesh;
+
+  /* The frame being transmitted, if any. */
+  int tx;
+
+  /* A frame originated by this node waiting to be sent. */
+  uint8_t own[RADIO_MAX_PAYLOAD];
+  uint8_t own_len;
+  uint32_t next_origin;
+  uint16_t app_seq;
+} sim_node_t;
+
+typedef struct
+{
+  bool active;
+  int node;
+  uint32_t start, end;
+  uint8_t frame[RADIO_MAX_PAYLOAD];
+  uint8_t len;
+} sim_tx_t;
+
+static sim_node_t *nodes;
+static int node_count = 60;
+static sim_tx_t txs[SIM_MAX_TX];
+
+static double arena_w = 400, arena_h = 400, range = 120;
+static uint32_t duration = 60000, period = 2000, beacon = 1000;
+static uint32_t rng_state = 1;
+
+/* Statistics. */
+static unsigned long originated, delivered, base_duplicates, collisions;
+static unsigned long hop_hist[MESH_TTL + 1];
+static double latency_sum;
+static uint32_t latency_max;
+static uint32_t *latencies;
+static uint8_t *delivered_map;
+
+static uint32_t sim_rand(void)
+{
+  /* xorshift32. */
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return rng_state;
+}
+
+static double sim_uniform(void)
+{
+  return (sim_rand() & 0xFFFFFF) / (double) 0x1000000;
+}
+
+static bool sim_in_range(int a, int b)
+{
+  double dx = nodes[a].x - nodes[b].x, dy = nodes[a].y - nodes[b].y;
+  return a != b && dx * dx + dy * dy <= range * range;
+}
+
+/* Returns true if the node can hear another transmission at the given time. */
+static bool sim_carrier(int node, uint32_t now)
+{
+  for (int i = 0; i < SIM_MAX_TX; i++)
+  {
+    if (txs[i].active && txs[i].start <= now && sim_in_range(txs[i].node, node))
+      return true;
+  }
+  return false;
+}
+
+static bool sim_transmit(int node, const uint8_t *frame, uint8_t len, uint32_t now)
+{
+  if (nodes[node].tx >= 0 || sim_carrier(node, now))
+    return false;
+
+  for (int i = 0; i < SIM_MAX_TX; i++)
+  {
+    if (!txs[i].active)
+    {
+      uint32_t usecs = (SIM_FRAME_OVERHEAD + len) * SIM_USECS_PER_BYTE;
+      txs[i].active = true;
+      txs[i].node = node;
+      txs[i].start = now;
+      txs[i].end = now + (usecs + SIM_USECS_PER_UNIT - 1) / SIM_USECS_PER_UNIT;
+      memcpy(txs[i].frame, frame, len);
+      txs[i].len = len;
+      nodes[node].tx = i;
+      return true;
+    }
+  }
+
+  fprintf(stderr, "meshsim: too many simultaneous transmissions\n");
+  exit(EXIT_FAILURE);
+}
+
+/* Returns true if the receiver heard anything else while the frame was sent. */
+static bool sim_collided(int tx, int node)
+{
+  for (int i = 0; i < SIM_MAX_TX; i++)
+  {
+    if (i == tx || !txs[i].active)
+      continue;
+
+    bool overlaps = txs[i].start < txs[tx].end && txs[tx].start < txs[i].end;
+    if (overlaps && (txs[i].node == node || sim_in_range(txs[i].node, node)))
+      return true;
+  }
+  return false;
+}
+
+static void sim_deliver_base(const uint8_t *frame, uint32_t now)
+{
+  const uint8_t *payload = frame + MESH_HEADER;
+  uint8_t origin = frame[1];
+  uint16_t app_seq = payload[0] | (payload[1] << 8);
+  uint32_t sent = payload[2] | (payload[3] << 8) | ((uint32_t) payload[4] << 16);
+
+  size_t index = (size_t) origin * 65536 + app_seq;
+  if (delivered_map[index])
+  {
+    base_duplicates++;
+    return;
+  }
+  delivered_map[index] = 1;
+
+  uint32_t latency = now - sent;
+  latencies[delivered++] = latency;
+  latency_sum += latency;
+  if (latency > latency_max)
+    latency_max = latency;
+
+  /* The TTL is decremented once per relay, so the first hop leaves it alone. */
+  hop_hist[MESH_TTL - frame[4] + 1]++;
+}
+
+static void sim_receive(int node, sim_tx_t *tx, uint32_t now)
+{
+  sim_node_t *n = &nodes[node];
+  uint8_t frame[RADIO_MAX_PAYLOAD];
+  memcpy(frame, tx->frame, tx->len);
+
+  mesh_action_t action = mesh_receive(&n->mesh, frame, tx->len, (uint16_t) now);
+  if ((action & MESH_DELIVER) && node == 0)
+    sim_deliver_base(frame, now);
+}
+
+static void sim_step(uint32_t now)
+{
+  /* Finish transmissions which have ended, delivering them to neighbours. */
+  for (int i = 0; i < SIM_MAX_TX; i++)
+  {
+    if (!txs[i].active || txs[i].end != now)
+      continue;
+
+    for (int node = 0; node < node_count; node++)
+    {
+      if (!sim_in_range(txs[i].node, node))
+        continue;
+
+      if (sim_collided(i, node))
+        collisions++;
+      else
+        sim_receive(node, &txs[i], now);
+    }
+  }
+
+  for (int i = 0; i < SIM_MAX_TX; i++)
+  {
+    if (txs[i].active && txs[i].end == now)
+    {
+      txs[i].active = false;
+      nodes[txs[i].node].tx = -1;
+    }
+  }
+
+  /* Originate new frames and start transmissions, relays first. */
+  for (int node = 0; node < node_count; node++)
+  {
+    sim_node_t *n = &nodes[node];
+
+    if (node == 0 && now >= n->next_origin && n->own_len == 0)
+    {
+      uint8_t payload[SIM_PAYLOAD] = { 0 };
+      n->own_len = mesh_wrap(&n->mesh, n->own, MESH_BROADCAST, payload, sizeof(payload));
+      n->next_origin = now + beacon;
+    }
+    else if (node != 0 && now >= n->next_origin && n->own_len == 0 && now + period <= duration)
+    {
+      uint8_t payload[SIM_PAYLOAD] = { 0 };
+      payload[0] = n->app_seq & 0xFF;
+      payload[1] = (n->app_seq >> 8) & 0xFF;
+      payload[2] = now & 0xFF;
+      payload[3] = (now >> 8) & 0xFF;
+      payload[4] = (now >> 16) & 0xFF;
+      n->app_seq++;
+      n->own_len = mesh_wrap(&n->mesh, n->own, MESH_BASE, payload, sizeof(payload));
+      n->next_origin = now + period / 2 + sim_rand() % period;
+      originated++;
+    }
+
+    uint8_t relay_len = mesh_relay_due(&n->mesh, (uint16_t) now);
+    if (relay_len)
+    {
+      if (sim_transmit(node, n->mesh.relay, relay_len, now))
+        mesh_relay_sent(&n->mesh);
+    }
+    else if (n->own_len)
+    {
+      if (sim_transmit(node, n->own, n->own_len, now))
+      {
+        mesh_wrap_sent(&n->mesh);
+        n->own_len = 0;
+      }
+    }
+  }
+}
+
+static int sim_compare(const void *a, const void *b)
+{
+  uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+  return (x > y) - (x < y);
+}
+
+static void usage(const char *prog)
+{
+  fprintf(stderr, "Usage: %s [-n nodes] [-w width] [-h height] [-r range] "
+    "[-p period] [-b beacon] [-t duration] [-s seed]\n", prog);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+  int opt;
+  while ((opt = getopt(argc, argv, "n:w:h:r:p:b:t:s:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'n': node_count = atoi(optarg); break;
+      case 'w': arena_w = atof(optarg); break;
+      case 'h': arena_h = atof(optarg); break;
+      case 'r': range = atof(optarg); break;
+      case 'p': period = strtoul(optarg, NULL, 10); break;
+      case 'b': beacon = strtoul(optarg, NULL, 10); break;
+      case 't': duration = strtoul(optarg, NULL, 10); break;
+      case 's': rng_state = strtoul(optarg, NULL, 10) | 1; break;
+      default: usage(argv[0]);
+    }
+  }
+
+  /* Node IDs are 8-bit and the broadcast ID is reserved. */
+  if (node_count < 2 || node_count >= MESH_BROADCAST || period == 0 || beacon == 0)
+    usage(argv[0]);
+
+  nodes = calloc(node_count, sizeof(*nodes));
+  latencies = calloc((size_t) node_count * (duration / (period / 2) + 1), sizeof(*latencies));
+  delivered_map = calloc((size_t) node_count * 65536, 1);
+  if (!nodes || !latencies || !delivered_map)
+  {
+    perror("meshsim");
+    return EXIT_FAILURE;
+  }
+
+  for (int node = 0; node < node_count; node++)
+  {
+    sim_node_t *n = &nodes[node];
+    if (node == 0)
+    {
+      n->x = 0;
+      n->y = arena_h / 2;
+    }
+    else
+    {
+      n->x = sim_uniform() * arena_w;
+      n->y = sim_uniform() * arena_h;
+    }
+    n->tx = -1;
+    n->next_origin = sim_rand() % period;
+    mesh_init(&n->mesh, node);
+  }
+
+  /* Run until every frame has had a chance to drain out of the mesh. */
+  for (uint32_t now = 0; now < duration + 1000; now++)
+    sim_step(now);
+
+  unsigned long duplicates = 0, relayed = 0, pruned = 0, throttled = 0, expired = 0;
+  unsigned long cancelled = 0, overflowed = 0;
+  for (int node = 0; node < node_count; node++)
+  {
+    duplicates += nodes[node].mesh.duplicates;
+    relayed += nodes[node].mesh.relayed;
+    pruned += nodes[node].mesh.pruned;
+    cancelled += nodes[node].mesh.cancelled;
+    overflowed += nodes[node].mesh.overflowed;
+    throttled += nodes[node].mesh.throttled;
+    expired += nodes[node].mesh.expired;
+  }
+
+  qsort(latencies, delivered, sizeof(*latencies), sim_compare);
+
+  printf("nodes: %d\n", node_count);
+  printf("originated: %lu\n", originated);
+  printf("delivered: %lu\n", delivered);
+  printf("delivery_ratio: %.4f\n", originated ? (double) delivered / originated : 0.0);
+  printf("latency_mean_ms: %.2f\n", delivered ? latency_sum * SIM_USECS_PER_UNIT / 1000 / delivered : 0.0);
+  printf("latency_p95_ms: %.2f\n", delivered ? latencies[delivered * 95 / 100] * SIM_USECS_PER_UNIT / 1000.0 : 0.0);
+  printf("latency_max_ms: %.2f\n", latency_max * SIM_USECS_PER_UNIT / 1000.0);
+  for (int hops = 1; hops <= MESH_TTL; hops++)
+    printf("hops_%d: %lu\n", hops, hop_hist[hops]);
+  printf("relayed: %lu\n", relayed);
+  printf("duplicates: %lu\n", duplicates);
+  printf("base_duplicates: %lu\n", base_duplicates);
+  printf("pruned: %lu\n", pruned);
+  printf("cancelled: %lu\n", cancelled);
+  printf("throttled: %lu\n", throttled);
+  printf("overflowed: %lu\n", overflowed);
+  printf("expired: %lu\n", expired);
+  printf("collisions: %lu\n", collisions);
+
+  free(delivered_map);
+  free(latencies);
+  free(nodes);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,236 @@
+/*
+ * Encodes WAV files into the 4-bit IMA ADPCM samples played by the speaker,
+ * and writes them to stdout as a C source file (src/lasertag/samples.c).
+ *
+ * Each WAV file must be mono, 8 or 16-bit PCM, recorded at the speaker's
+ * sample rate of 7812.5 Hz (7812 or 7813 Hz in the header). Each sample is
+ * named after its file, e.g. sounds/shot.wav becomes samples_shot[].
+ *
+ * A sample starts with its length in samples (a 16-bit little-endian value),
+ * followed by the codes, two to a byte with the first in the low nibble.
+ */
+#include <lasertag/adpcm.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* The sample rate of the speaker, rounded down and up. */
+#define PCM_RATE_MIN 7812
+#define PCM_RATE_MAX 7813
+
+/* The maximum length of a sample, as its length is stored in 16 bits. */
+#define PCM_MAX_SAMPLES 65535
+
+/* The maximum length of a sample's name. */
+#define PCM_MAX_NAME 32
+
+#define PCM_STEP(step) step,
+
+static const int32_t pcm_steps[ADPCM_STEPS] = {
+  ADPCM_STEP_TABLE(PCM_STEP)
+};
+
+static const int8_t pcm_index_adjust[8] = ADPCM_INDEX_TABLE;
+
+static void pcm_fail(const char *file, const char *msg)
+{
+  fprintf(stderr, "pcmenc: %s: %s\n", file, msg);
+  exit(EXIT_FAILURE);
+}
+
+static uint32_t pcm_le(const uint8_t *buf, int len)
+{
+  uint32_t value = 0;
+  for (int i = len - 1; i >= 0; i--)
+    value = (value << 8) | buf[i];
+  return value;
+}
+
+/* Reads a WAV file, returning its samples as 16-bit values. */
+static int16_t *pcm_read(const char *path, size_t *count)
+{
+  FILE *file = fopen(path, "rb");
+  if (!file)
+  {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+
+  uint8_t header[12];
+  if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+      memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0)
+    pcm_fail(path, "not a WAV file");
+
+  int bits = 0;
+  int16_t *samples = NULL;
+
+  /* Walk the chunks until the data chunk is found. */
+  uint8_t chunk[8];
+  while (!samples && fread(chunk, 1, sizeof(chunk), file) == sizeof(chunk))
+  {
+    uint32_t len = pcm_le(chunk + 4, 4);
+    uint8_t *body = malloc(len + 1);
+    if (!body)
+      pcm_fail(path, "out of memory");
+    if (fread(body, 1, len + (len & 1), file) < len)
+      pcm_fail(path, "truncated chunk");
+
+    if (memcmp(chunk, "fmt ", 4) == 0)
+    {
+      if (len < 16 || pcm_le(body, 2) != 1)
+        pcm_fail(path, "not PCM");
+      if (pcm_le(body + 2, 2) != 1)
+        pcm_fail(path, "not mono");
+
+      uint32_t rate = pcm_le(body + 4, 4);
+      if (rate < PCM_RATE_MIN || rate > PCM_RATE_MAX)
+        pcm_fail(path, "not recorded at 7812.5 Hz");
+
+      bits = pcm_le(body + 14, 2);
+      if (bits != 8 && bits != 16)
+        pcm_fail(path, "not 8 or 16-bit");
+    }
+    else if (memcmp(chunk, "data", 4) == 0)
+    {
+      if (!bits)
+        pcm_fail(path, "data before format");
+
+      *count = len / (bits / 8);
+      if (*count > PCM_MAX_SAMPLES)
+        pcm_fail(path, "too long");
+
+      samples = malloc(*count * sizeof(*samples) + 1);
+      if (!samples)
+        pcm_fail(path, "out of memory");
+
+      for (size_t i = 0; i < *count; i++)
+      {
+        if (bits == 8)
+          samples[i] = (body[i] - 128) << 8;
+        else
+          samples[i] = (int16_t) pcm_le(body + i * 2, 2);
+      }
+    }
+
+    free(body);
+  }
+
+  fclose(file);
+
+  if (!samples)
+    pcm_fail(path, "no data");
+  return samples;
+}
+
+/* Encodes one sample, updating the predictor exactly as the decoder does. */
+static uint8_t pcm_encode(int16_t sample, int32_t *pred, int *index)
+{
+  int32_t step = pcm_steps[*index];
+  int32_t diff = sample - *pred;
+
+  uint8_t code = 0;
+  if (diff < 0)
+  {
+    code = ADPCM_SIGN;
+    diff = -diff;
+  }
+
+  if (diff >= step)
+  {
+    code |= 4;
+    diff -= step;
+  }
+  if (diff >= step >> 1)
+  {
+    code |= 2;
+    diff -= step >> 1;
+  }
+  if (diff >= step >> 2)
+    code |= 1;
+
+  int32_t delta = ADPCM_DIFF(step, code & 7);
+  *pred += (code & ADPCM_SIGN) ? -delta : delta;
+  if (*pred > INT16_MAX)
+    *pred = INT16_MAX;
+  else if (*pred < INT16_MIN)
+    *pred = INT16_MIN;
+
+  *index += pcm_index_adjust[code & 7];
+  if (*index < 0)
+    *index = 0;
+  else if (*index >= ADPCM_STEPS)
+    *index = ADPCM_STEPS - 1;
+
+  return code;
+}
+
+/* Works out a sample's name from its path, e.g. sounds/shot.wav is shot. */
+static void pcm_name(const char *path, char *name, size_t len)
+{
+  const char *start = strrchr(path, '/');
+  start = start ? start + 1 : path;
+
+  size_t n = strcspn(start, ".");
+  if (n >= len)
+    n = len - 1;
+
+  for (size_t i = 0; i < n; i++)
+  {
+    char c = start[i];
+    name[i] = (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') ? c : '_';
+  }
+  name[n] = '\0';
+}
+
+static void pcm_write(const char *path)
+{
+  size_t count;
+  int16_t *samples = pcm_read(path, &count);
+
+  char name[PCM_MAX_NAME];
+  pcm_name(path, name, sizeof(name));
+
+  printf("\n/* %s: %zu samples, %.3f seconds */\n", path, count, count / 7812.5);
+  printf("const uint8_t samples_%s[] PROGMEM = {\n", name);
+  printf("  0x%02x, 0x%02x,", (unsigned int) (count & 0xFF), (unsigned int) (count >> 8));
+
+  int32_t pred = 0;
+  int index = 0;
+  int col = 2;
+  for (size_t i = 0; i < count; i += 2)
+  {
+    uint8_t byte = pcm_encode(samples[i], &pred, &index);
+    if (i + 1 < count)
+      byte |= pcm_encode(samples[i + 1], &pred, &index) << 4;
+
+    if (col++ % 12 == 0)
+      printf("\n ");
+    printf(" 0x%02x,", byte);
+  }
+  printf("\n};\n");
+
+  free(samples);
+}
+
+static void usage(const char *prog)
+{
+  fprintf(stderr, "Usage: %s file.wav...\n", prog);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+  if (getopt(argc, argv, "") != -1 || optind == argc)
+    usage(argv[0]);
+
+  printf("/* Generated by tools/pcmenc, do not edit. */\n");
+  printf("#include <lasertag/samples.h>\n");
+  printf("#include <avr/pgmspace.h>\n");
+
+  for (int i = optind; i < argc; i++)
+    pcm_write(argv[i]);
+
+  return EXIT_SUCCESS;
+}
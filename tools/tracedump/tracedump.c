@@ -0,0 +1,218 @@
+/*
+ * Decodes a binary trace dump, written to the UART by trace_dump(), into a
+ * human-readable timeline.
+ *
+ * The dump is read from the given file (e.g. a capture of the serial port),
+ * or stdin if no file is given. Any bytes before the start of the dump, such
+ * as the console's echo, are skipped.
+ *
+ * The timestamps in the dump are the low 24 bits of the clock's tick count,
+ * which wrap around every ~67 seconds. They are unwrapped on the assumption
+ * that consecutive events are less than one wrap apart, and restart from zero
+ * at each reset.
+ */
+#include <lasertag/trace.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* The length of a clock tick in microseconds, see clock.h. */
+#define DUMP_USECS_PER_TICK 4
+
+/* The length of an event in the dump. */
+#define DUMP_ENTRY_SIZE 6
+
+/* The maximum number of events in a dump. */
+#define DUMP_MAX_EVENTS 255
+
+static uint16_t dump_crc16_update(uint16_t crc, uint8_t a)
+{
+  crc ^= a;
+  for (int i = 0; i < 8; i++)
+  {
+    if (crc & 1)
+      crc = (crc >> 1) ^ 0xA001;
+    else
+      crc = (crc >> 1);
+  }
+  return crc;
+}
+
+static const char *dump_ir_drop_reason(uint8_t reason)
+{
+  switch (reason)
+  {
+    case TRACE_IR_BAD_HEADER: return "bad header";
+    case TRACE_IR_BAD_SPACE:  return "bad space";
+    case TRACE_IR_BAD_MARK:   return "bad mark";
+    case TRACE_IR_BAD_EDGE:   return "unexpected edge";
+    case TRACE_IR_TIMEOUT:    return "timeout";
+    case TRACE_IR_FULL:       return "buffer full";
+    default:                  return "unknown";
+  }
+}
+
+static const char *dump_radio_drop_reason(uint8_t reason)
+{
+  switch (reason)
+  {
+    case TRACE_RADIO_TOO_LONG: return "too long";
+    case TRACE_RADIO_BAD_CRC:  return "bad CRC";
+    case TRACE_RADIO_FULL:     return "buffer full";
+    case TRACE_RADIO_NO_ACK:   return "no ACK";
+    default:                   return "unknown";
+  }
+}
+
+static const char *dump_ready_name(uint16_t arg)
+{
+  switch (arg)
+  {
+    case TRACE_READY_GAME:  return "game";
+    case TRACE_READY_LCD:   return "lcd";
+    case TRACE_READY_RADIO: return "radio";
+    default:                return "unknown";
+  }
+}
+
+static void dump_event(uint8_t type, uint16_t arg)
+{
+  uint8_t hi = arg >> 8, lo = arg & 0xFF;
+
+  switch (type)
+  {
+    case TRACE_RESET:
+      printf("reset       flags=0x%02x%s%s%s%s\n", lo,
+        lo & 0x01 ? " power-on" : "", lo & 0x02 ? " external" : "",
+        lo & 0x04 ? " brown-out" : "", lo & 0x08 ? " watchdog" : "");
+      break;
+
+    case TRACE_IR_RX:
+      printf("ir_rx       packet=0x%04x\n", arg);
+      break;
+
+    case TRACE_IR_DROP:
+      printf("ir_drop     %s, %u bits left\n", dump_ir_drop_reason(hi), lo);
+      break;
+
+    case TRACE_IR_TX:
+      printf("ir_tx       packet=0x%04x\n", arg);
+      break;
+
+    case TRACE_BUTTON:
+      printf("button      pin=%u %s\n", hi, lo ? "pressed" : "released");
+      break;
+
+    case TRACE_RADIO_RX:
+      printf("radio_rx    type=0x%02x len=%u\n", hi, lo);
+      break;
+
+    case TRACE_RADIO_TX:
+      printf("radio_tx    type=0x%02x len=%u\n", hi, lo);
+      break;
+
+    case TRACE_RADIO_DROP:
+      printf("radio_drop  %s, len=%u\n", dump_radio_drop_reason(hi), lo);
+      break;
+
+    case TRACE_READY:
+      printf("ready       %s\n", dump_ready_name(arg));
+      break;
+
+    default:
+      printf("unknown     type=0x%02x arg=0x%04x\n", type, arg);
+      break;
+  }
+}
+
+static int dump_getc(FILE *file, uint16_t *crc)
+{
+  int c = fgetc(file);
+  if (c == EOF)
+  {
+    fprintf(stderr, "tracedump: truncated dump\n");
+    exit(EXIT_FAILURE);
+  }
+
+  *crc = dump_crc16_update(*crc, c);
+  return c;
+}
+
+static void usage(const char *prog)
+{
+  fprintf(stderr, "Usage: %s [file]\n", prog);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+  if (getopt(argc, argv, "") != -1 || argc - optind > 1)
+    usage(argv[0]);
+
+  FILE *file = stdin;
+  if (optind < argc)
+  {
+    file = fopen(argv[optind], "rb");
+    if (!file)
+    {
+      perror(argv[optind]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  /* Find the magic number. */
+  int prev = EOF, c;
+  while ((c = fgetc(file)) != EOF && !(prev == 'L' && c == 'T'))
+    prev = c;
+
+  if (c == EOF)
+  {
+    fprintf(stderr, "tracedump: no dump found\n");
+    return EXIT_FAILURE;
+  }
+
+  uint16_t crc = dump_crc16_update(dump_crc16_update(0xFFFF, 'L'), 'T');
+  int source = dump_getc(file, &crc);
+  int count = dump_getc(file, &crc);
+
+  uint8_t events[DUMP_MAX_EVENTS][DUMP_ENTRY_SIZE];
+  for (int i = 0; i < count; i++)
+  {
+    for (int j = 0; j < DUMP_ENTRY_SIZE; j++)
+      events[i][j] = dump_getc(file, &crc);
+  }
+
+  uint16_t expected = crc;
+  uint16_t actual = dump_getc(file, &crc);
+  actual |= dump_getc(file, &crc) << 8;
+  if (actual != expected)
+  {
+    fprintf(stderr, "tracedump: CRC mismatch (expected 0x%04x, got 0x%04x)\n", expected, actual);
+    return EXIT_FAILURE;
+  }
+
+  printf("# %d events from %s\n", count, source ? "EEPROM" : "SRAM");
+
+  uint64_t base = 0;
+  uint32_t prev_time = 0;
+  for (int i = 0; i < count; i++)
+  {
+    uint8_t *event = events[i];
+    uint32_t time = event[0] | (event[1] << 8) | ((uint32_t) event[2] << 16);
+    uint8_t type = event[3];
+    uint16_t arg = event[4] | (event[5] << 8);
+
+    if (type == TRACE_RESET)
+      base = 0;
+    else if (time < prev_time)
+      base += 1 << 24;
+    prev_time = time;
+
+    double secs = (base + time) * DUMP_USECS_PER_TICK / 1e6;
+    printf("%12.6f  ", secs);
+    dump_event(type, arg);
+  }
+
+  return EXIT_SUCCESS;
+}